@@ -6,21 +6,37 @@ HEADERS += \
     $$PWD/qtssh/sshsftpcommandget.h \
     $$PWD/qtssh/sshsftpcommandmkdir.h \
     $$PWD/qtssh/sshsftpcommandreaddir.h \
+    $$PWD/qtssh/sshsftpcommandrename.h \
     $$PWD/qtssh/sshsftpcommandsend.h \
+    $$PWD/qtssh/sshsftpcommandsetstat.h \
     $$PWD/qtssh/sshsftpcommandunlink.h \
     $$PWD/qtssh/sshtunnelout.h \
+    $$PWD/qtssh/sshtunneloutbalancer.h \
     $$PWD/qtssh/sshtunnelin.h \
     $$PWD/qtssh/sshprocess.h \
     $$PWD/qtssh/sshchannel.h \
     $$PWD/qtssh/sshclient.h \
     $$PWD/qtssh/sshscpsend.h \
     $$PWD/qtssh/sshscpget.h \
+    $$PWD/qtssh/sshscpdefaults.h \
+    $$PWD/qtssh/sshfileutils.h \
+    $$PWD/qtssh/sshscpbatchsend.h \
+    $$PWD/qtssh/sshscpbatchget.h \
+    $$PWD/qtssh/sshtarsend.h \
+    $$PWD/qtssh/sshtarget.h \
     $$PWD/qtssh/sshsftp.h \
     $$PWD/qtssh/sshsftpcommand.h \
     $$PWD/qtssh/sshkey.h \
+    $$PWD/qtssh/sshknownhosts.h \
+    $$PWD/qtssh/sshkeystore.h \
+    $$PWD/qtssh/sshagent.h \
     $$PWD/qtssh/sshtunnelinconnection.h \
     $$PWD/qtssh/sshtunneloutconnection.h \
-    $$PWD/qtssh/sshtunneldataconnector.h
+    $$PWD/qtssh/sshtunneldataconnector.h \
+    $$PWD/qtssh/sshtunnelscheduler.h \
+    $$PWD/qtssh/sshratelimiter.h \
+    $$PWD/qtssh/sshmappedfile.h \
+    $$PWD/qtssh/sshtransport.h
 
 
 SOURCES += \
@@ -28,20 +44,35 @@ SOURCES += \
     $$PWD/qtssh/sshsftpcommandget.cpp \
     $$PWD/qtssh/sshsftpcommandmkdir.cpp \
     $$PWD/qtssh/sshsftpcommandreaddir.cpp \
+    $$PWD/qtssh/sshsftpcommandrename.cpp \
     $$PWD/qtssh/sshsftpcommandsend.cpp \
+    $$PWD/qtssh/sshsftpcommandsetstat.cpp \
     $$PWD/qtssh/sshsftpcommandunlink.cpp \
     $$PWD/qtssh/sshtunnelout.cpp \
+    $$PWD/qtssh/sshtunneloutbalancer.cpp \
     $$PWD/qtssh/sshtunnelin.cpp \
     $$PWD/qtssh/sshprocess.cpp \
     $$PWD/qtssh/sshchannel.cpp \
     $$PWD/qtssh/sshclient.cpp \
     $$PWD/qtssh/sshscpsend.cpp \
     $$PWD/qtssh/sshscpget.cpp \
+    $$PWD/qtssh/sshfileutils.cpp \
+    $$PWD/qtssh/sshscpbatchsend.cpp \
+    $$PWD/qtssh/sshscpbatchget.cpp \
+    $$PWD/qtssh/sshtarsend.cpp \
+    $$PWD/qtssh/sshtarget.cpp \
     $$PWD/qtssh/sshsftp.cpp \
     $$PWD/qtssh/sshsftpcommand.cpp \
     $$PWD/qtssh/sshkey.cpp \
+    $$PWD/qtssh/sshknownhosts.cpp \
+    $$PWD/qtssh/sshkeystore.cpp \
+    $$PWD/qtssh/sshagent.cpp \
     $$PWD/qtssh/sshtunnelinconnection.cpp \
     $$PWD/qtssh/sshtunneloutconnection.cpp \
-    $$PWD/qtssh/sshtunneldataconnector.cpp
+    $$PWD/qtssh/sshtunneldataconnector.cpp \
+    $$PWD/qtssh/sshtunnelscheduler.cpp \
+    $$PWD/qtssh/sshratelimiter.cpp \
+    $$PWD/qtssh/sshmappedfile.cpp \
+    $$PWD/qtssh/sshtransport.cpp
 
 INCLUDEPATH += $$PWD/qtssh
@@ -0,0 +1,430 @@
+#include "sshagent.h"
+#include "sshknownhosts.h"
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(logsshagent, "ssh.agent", QtWarningMsg)
+
+/* draft-miller-ssh-agent */
+#define SSH2_AGENTC_REQUEST_IDENTITIES  11
+#define SSH2_AGENT_IDENTITIES_ANSWER    12
+#define SSH2_AGENTC_SIGN_REQUEST        13
+#define SSH2_AGENT_SIGN_RESPONSE        14
+#define SSH_AGENT_RSA_SHA2_256          0x02
+#define SSH_AGENT_RSA_SHA2_512          0x04
+
+#define AGENT_MAX_REPLY (256 * 1024)
+#define AGENT_TIMEOUT   (10 * 1000)
+
+static void putUint32(QByteArray &out, quint32 value)
+{
+    char buf[4];
+    qToBigEndian<quint32>(value, buf);
+    out.append(buf, 4);
+}
+
+static void putString(QByteArray &out, const QByteArray &value)
+{
+    putUint32(out, static_cast<quint32>(value.size()));
+    out.append(value);
+}
+
+static bool getUint32(const QByteArray &in, int &pos, quint32 &value)
+{
+    if(pos < 0 || in.size() - pos < 4)
+    {
+        return false;
+    }
+    value = qFromBigEndian<quint32>(in.constData() + pos);
+    pos += 4;
+    return true;
+}
+
+static bool getString(const QByteArray &in, int &pos, QByteArray &value)
+{
+    quint32 len = 0;
+    if(!getUint32(in, pos, len) || len > static_cast<quint32>(in.size() - pos))
+    {
+        return false;
+    }
+    value = in.mid(pos, static_cast<int>(len));
+    pos += static_cast<int>(len);
+    return true;
+}
+
+/* Until fd is ready or the request deadline passes (errno ETIMEDOUT) */
+static bool waitFd(int fd, short events, const QElapsedTimer &timer, int timeout)
+{
+    for(;;)
+    {
+        qint64 left = timeout - timer.elapsed();
+        if(left <= 0)
+        {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        int ret = ::poll(&pfd, 1, static_cast<int>(left));
+        if(ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(ret == 0)
+        {
+            errno = ETIMEDOUT;
+        }
+        return (ret > 0);
+    }
+}
+
+static bool sendAll(int fd, const char *data, size_t len, const QElapsedTimer &timer, int timeout)
+{
+    while(len > 0)
+    {
+        if(!waitFd(fd, POLLOUT, timer, timeout))
+        {
+            return false;
+        }
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool recvAll(int fd, char *data, size_t len, const QElapsedTimer &timer, int timeout)
+{
+    while(len > 0)
+    {
+        if(!waitFd(fd, POLLIN, timer, timeout))
+        {
+            return false;
+        }
+        ssize_t n = ::recv(fd, data, len, MSG_DONTWAIT);
+        if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            continue;
+        }
+        if(n == 0)
+        {
+            errno = ECONNRESET;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/*
+ * The signed data is the session id followed by the userauth request, which
+ * names the signature algorithm chosen by libssh2.
+ */
+static QByteArray signatureAlgorithm(const QByteArray &data)
+{
+    int pos = 0;
+    QByteArray field;
+    if(!getString(data, pos, field))   /* session id */
+    {
+        return QByteArray();
+    }
+    pos += 1;                           /* SSH_MSG_USERAUTH_REQUEST */
+    if(!getString(data, pos, field) || !getString(data, pos, field) || !getString(data, pos, field))
+    {
+        return QByteArray();            /* user, service, "publickey" */
+    }
+    pos += 1;                           /* TRUE */
+    return (getString(data, pos, field))?(field):(QByteArray());
+}
+
+SshAgent *SshAgent::instance()
+{
+    static SshAgent s_agent;
+    return &s_agent;
+}
+
+SshAgent::SshAgent()
+    : m_socketPath(QString::fromLocal8Bit(qgetenv("SSH_AUTH_SOCK")))
+    , m_timeout(AGENT_TIMEOUT)
+{
+}
+
+SshAgent::~SshAgent()
+{
+    _disconnect();
+}
+
+void SshAgent::setSocketPath(const QString &path)
+{
+    QMutexLocker lock(&m_mutex);
+    if(path != m_socketPath)
+    {
+        _disconnect();
+        m_socketPath = path;
+        m_loaded = false;
+        m_identities.clear();
+        m_working.clear();
+    }
+}
+
+QString SshAgent::socketPath()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_socketPath;
+}
+
+void SshAgent::setTimeout(int msec)
+{
+    QMutexLocker lock(&m_mutex);
+    m_timeout = (msec > 0)?(msec):(AGENT_TIMEOUT);
+}
+
+QByteArray SshAgent::hostName(const QString &username, const QString &hostname, quint16 port)
+{
+    return username.toUtf8() + "@" + SshKnownHosts::hostName(hostname, port);
+}
+
+QList<SshKeyStore::IdentityPtr> SshAgent::identities(const QByteArray &host)
+{
+    QMutexLocker lock(&m_mutex);
+    if(!m_loaded)
+    {
+        _load();
+    }
+
+    QList<SshKeyStore::IdentityPtr> res = m_identities;
+    const QByteArray working = m_working.value(host);
+    if(!working.isEmpty())
+    {
+        for(int i = 0; i < res.size(); i++)
+        {
+            if(res.at(i)->publicKeyBlob == working)
+            {
+                res.move(i, 0);
+                break;
+            }
+        }
+    }
+    return res;
+}
+
+void SshAgent::setWorkingIdentity(const QByteArray &host, const SshKeyStore::IdentityPtr &identity)
+{
+    if(identity.isNull())
+    {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    m_working.insert(host, identity->publicKeyBlob);
+}
+
+void SshAgent::reload()
+{
+    QMutexLocker lock(&m_mutex);
+    m_loaded = false;
+}
+
+void SshAgent::_load()
+{
+    m_identities.clear();
+    QByteArray reply;
+    if(!_request(QByteArray(1, SSH2_AGENTC_REQUEST_IDENTITIES), reply))
+    {
+        /* Nothing is retained: asked again on next use */
+        return;
+    }
+    m_loaded = true;
+
+    int pos = 1;
+    quint32 count = 0;
+    if(reply.at(0) != SSH2_AGENT_IDENTITIES_ANSWER || !getUint32(reply, pos, count))
+    {
+        qCWarning(logsshagent) << "Unexpected answer to the identities request";
+        return;
+    }
+    for(quint32 i = 0; i < count; i++)
+    {
+        QByteArray blob;
+        QByteArray comment;
+        QByteArray type;
+        int typePos = 0;
+        if(!getString(reply, pos, blob) || !getString(reply, pos, comment) || !getString(blob, typePos, type))
+        {
+            qCWarning(logsshagent) << "Truncated identities answer";
+            break;
+        }
+        SshKeyStore::IdentityPtr identity = SshKeyStore::instance()->identityWithSigner(
+                    type + " " + blob.toBase64() + " " + comment,
+                    [this, blob](const QByteArray &data) { return _sign(blob, data); });
+        if(!identity.isNull())
+        {
+            m_identities.append(identity);
+        }
+    }
+    qCDebug(logsshagent) << "Agent has" << m_identities.size() << "identities";
+}
+
+/* RSA keys are signed with the hash of the algorithm libssh2 chose */
+QByteArray SshAgent::_sign(const QByteArray &blob, const QByteArray &data)
+{
+    quint32 flags = 0;
+    QByteArray algorithm = signatureAlgorithm(data);
+    if(algorithm == "rsa-sha2-256")
+    {
+        flags = SSH_AGENT_RSA_SHA2_256;
+    }
+    else if(algorithm == "rsa-sha2-512")
+    {
+        flags = SSH_AGENT_RSA_SHA2_512;
+    }
+
+    QByteArray request(1, SSH2_AGENTC_SIGN_REQUEST);
+    putString(request, blob);
+    putString(request, data);
+    putUint32(request, flags);
+
+    QByteArray reply;
+    {
+        QMutexLocker lock(&m_mutex);
+        if(!_request(request, reply))
+        {
+            return QByteArray();
+        }
+    }
+    if(reply.at(0) != SSH2_AGENT_SIGN_RESPONSE)
+    {
+        qCWarning(logsshagent) << "Agent refused to sign, answer" << static_cast<int>(reply.at(0));
+        return QByteArray();
+    }
+
+    /* string signature { string format, string blob }, libssh2 wants the blob */
+    QByteArray signature;
+    QByteArray format;
+    QByteArray raw;
+    int pos = 1;
+    int sigPos = 0;
+    if(!getString(reply, pos, signature) || !getString(signature, sigPos, format) || !getString(signature, sigPos, raw))
+    {
+        qCWarning(logsshagent) << "Truncated signature";
+        return QByteArray();
+    }
+    return raw;
+}
+
+/*
+ * One retry on a fresh connection: the agent may have closed an idle one.
+ * An agent that does not answer in time is dropped, not retried: clients
+ * wait for the mutex meanwhile.
+ */
+bool SshAgent::_request(const QByteArray &request, QByteArray &reply)
+{
+    for(int attempt = 0; attempt < 2; attempt++)
+    {
+        if(m_fd < 0 && !_connect())
+        {
+            return false;
+        }
+        if(_transfer(request, reply))
+        {
+            return true;
+        }
+        bool timedOut = (errno == ETIMEDOUT);
+        _disconnect();
+        if(timedOut)
+        {
+            qCWarning(logsshagent) << "No answer from the agent in" << m_timeout << "ms";
+            return false;
+        }
+    }
+    return false;
+}
+
+bool SshAgent::_transfer(const QByteArray &request, QByteArray &reply)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray message;
+    putString(message, request);
+    if(!sendAll(m_fd, message.constData(), static_cast<size_t>(message.size()), timer, m_timeout))
+    {
+        return false;
+    }
+
+    char header[4];
+    if(!recvAll(m_fd, header, 4, timer, m_timeout))
+    {
+        return false;
+    }
+    quint32 len = qFromBigEndian<quint32>(header);
+    if(len == 0 || len > AGENT_MAX_REPLY)
+    {
+        qCWarning(logsshagent) << "Invalid reply length" << len;
+        errno = EPROTO;
+        return false;
+    }
+    reply.resize(static_cast<int>(len));
+    return recvAll(m_fd, reply.data(), len, timer, m_timeout);
+}
+
+bool SshAgent::_connect()
+{
+    if(m_socketPath.isEmpty())
+    {
+        qCDebug(logsshagent) << "No agent socket";
+        return false;
+    }
+    QByteArray path = m_socketPath.toLocal8Bit();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if(static_cast<size_t>(path.size()) >= sizeof(addr.sun_path))
+    {
+        qCWarning(logsshagent) << "Agent socket path too long" << m_socketPath;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.constData(), static_cast<size_t>(path.size()));
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_fd < 0)
+    {
+        return false;
+    }
+    if(::connect(m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        qCWarning(logsshagent) << "Can't connect to the agent" << m_socketPath << ":" << strerror(errno);
+        _disconnect();
+        return false;
+    }
+    return true;
+}
+
+void SshAgent::_disconnect()
+{
+    if(m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
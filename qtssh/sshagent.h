@@ -0,0 +1,63 @@
+#ifndef SSHAGENT_H
+#define SSHAGENT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include "sshkeystore.h"
+
+/*
+ * Process-wide ssh-agent client. One connection to the agent and one list of
+ * identities, shared by every SshClient: the agent is asked for its keys once,
+ * not for each connection. Identities are SshKeyStore identities whose signer
+ * forwards the signature request to the agent.
+ *
+ * The identity accepted by a host is remembered and tried first on the next
+ * connection to that host.
+ *
+ * Speaks the agent protocol on the SSH_AUTH_SOCK unix socket. Requests are
+ * blocking and serialized; a lost connection is opened again once, an agent
+ * not answering within the timeout is dropped and the attempt fails.
+ */
+class SshAgent
+{
+public:
+    static SshAgent *instance();
+
+    /* Defaults to $SSH_AUTH_SOCK */
+    void setSocketPath(const QString &path);
+    QString socketPath();
+    /* Longest wait for one agent answer, in ms; 10s by default */
+    void setTimeout(int msec);
+
+    /* Agent identities, the one known to work for host first */
+    QList<SshKeyStore::IdentityPtr> identities(const QByteArray &host = QByteArray());
+    void setWorkingIdentity(const QByteArray &host, const SshKeyStore::IdentityPtr &identity);
+    /* Ask the agent for its identities again on next use (keys added or removed) */
+    void reload();
+
+    static QByteArray hostName(const QString &username, const QString &hostname, quint16 port);
+
+private:
+    SshAgent();
+    ~SshAgent();
+
+    QMutex m_mutex;
+    QString m_socketPath;
+    int m_fd {-1};
+    int m_timeout;
+    bool m_loaded {false};
+    QList<SshKeyStore::IdentityPtr> m_identities;
+    QHash<QByteArray, QByteArray> m_working;
+
+    bool _connect();
+    void _disconnect();
+    bool _request(const QByteArray &request, QByteArray &reply);
+    bool _transfer(const QByteArray &request, QByteArray &reply);
+    void _load();
+    QByteArray _sign(const QByteArray &blob, const QByteArray &data);
+};
+
+#endif // SSHAGENT_H
@@ -13,6 +13,7 @@
 #include <QLoggingCategory>
 #include <QMutex>
 #include <libssh2.h>
+#include "sshtransport.h"
 
 class SshClient;
 
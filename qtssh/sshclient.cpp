@@ -5,12 +5,16 @@
 #include <QDateTime>
 #include <QCoreApplication>
 #include <QNetworkProxy>
+#include <QCryptographicHash>
 #include "sshtunnelin.h"
 #include "sshtunnelout.h"
+#include "sshtunnelscheduler.h"
+#include "sshratelimiter.h"
 #include "sshprocess.h"
 #include "sshscpsend.h"
 #include "sshscpget.h"
 #include "sshsftp.h"
+#include "sshagent.h"
 #include "cerrno"
 
 Q_LOGGING_CATEGORY(sshclient, "ssh.client", QtWarningMsg)
@@ -100,6 +104,11 @@ SshClient::~SshClient()
     qCDebug(sshclient) << m_name << ": SshClient::~SshClient() " << this;
     disconnectFromHost();
     waitForState(SshClient::SshState::Unconnected);
+    if(m_session)
+    {
+        /* Left behind by an error, must not call us back */
+        sshTransport()->setWakeup(m_session, nullptr);
+    }
     --s_nbInstance;
     if(s_nbInstance == 0)
     {
@@ -114,6 +123,32 @@ QString SshClient::getName() const
     return m_name;
 }
 
+/* Shares the session between the tunnel connections, see SshTunnelScheduler */
+SshTunnelScheduler *SshClient::tunnelScheduler()
+{
+    if(!m_tunnelScheduler)
+    {
+        m_tunnelScheduler = new SshTunnelScheduler(this);
+    }
+    return m_tunnelScheduler;
+}
+
+/* Limit shared by all tunnel connections of the session */
+QSharedPointer<SshRateLimiter> SshClient::rateLimiter()
+{
+    if(!m_rateLimiter)
+    {
+        m_rateLimiter.reset(new SshRateLimiter());
+    }
+    return m_rateLimiter;
+}
+
+/* Bytes per second for all tunnels of the session (both directions), 0 for no limit */
+void SshClient::setRateLimit(qint64 bytesPerSecond)
+{
+    rateLimiter()->setRate(bytesPerSecond);
+}
+
 bool SshClient::takeChannelCreationMutex(void *identifier)
 {
     if ( ! channelCreationInProgress.tryLock() && currentLockerForChannelCreation != identifier )
@@ -154,6 +189,7 @@ int SshClient::connectToHost(const QString &user, const QString &host, quint16 p
 
     m_connTimeoutCnt = connTimeoutMsec;
     m_authenticationMethodes = methodes;
+    m_identitiesListed = false;
     m_hostname = host;
     m_port = port;
     m_username = user;
@@ -214,43 +250,139 @@ void SshClient::setPassphrase(const QString & pass)
 
 void SshClient::setKeys(const QString &publicKey, const QString &privateKey)
 {
-    m_publicKey  = publicKey;
-    m_privateKey = privateKey;
+    m_identity = (publicKey.isEmpty() && privateKey.isEmpty())?(SshKeyStore::IdentityPtr()):(SshKeyStore::instance()->identity(publicKey.toUtf8(), privateKey.toUtf8()));
+}
+
+void SshClient::setIdentity(const SshKeyStore::IdentityPtr &identity)
+{
+    m_identity = identity;
+}
+
+void SshClient::setUseAgent(bool use)
+{
+    m_useAgent = use;
 }
 
 bool SshClient::saveKnownHosts(const QString & file)
 {
-    bool res = (libssh2_knownhost_writefile(m_knownHosts, qPrintable(file), LIBSSH2_KNOWNHOST_FILE_OPENSSH) == 0);
-    return res;
+    if(m_knownHosts.isNull())
+    {
+        return false;
+    }
+    return m_knownHosts->save(file);
 }
 
 void SshClient::setKownHostFile(const QString &file)
 {
     m_knowhostFiles = file;
+    m_knownHosts = (file.isEmpty())?(QSharedPointer<SshKnownHosts>()):(SshKnownHosts::shared(file));
+    m_verifiedHost.clear();
 }
 
-bool SshClient::addKnownHost(const QString & hostname,const SshKey & key)
+void SshClient::setHostKeyPolicy(HostKeyPolicy policy, const HostKeyCallback &callback)
 {
-    bool ret;
-    int typemask = LIBSSH2_KNOWNHOST_TYPE_PLAIN | LIBSSH2_KNOWNHOST_KEYENC_RAW;
-    switch (key.type)
+    m_hostKeyPolicy = policy;
+    m_hostKeyCallback = callback;
+    m_verifiedHost.clear();
+}
+
+SshClient::HostKeyPolicy SshClient::hostKeyPolicy() const
+{
+    return m_hostKeyPolicy;
+}
+
+const SshKey &SshClient::hostKey() const
+{
+    return m_hostKey;
+}
+
+bool SshClient::addKnownHost(const QString & hostname,const SshKey & key, quint16 port)
+{
+    if(key.type == SshKey::UnknownType)
+    {
+        return false;
+    }
+    if(m_knownHosts.isNull())
     {
-        case SshKey::Dss:
-            typemask |= LIBSSH2_KNOWNHOST_KEY_SSHDSS;
+        /* No file: kept for this client only, until saveKnownHosts() */
+        m_knownHosts = QSharedPointer<SshKnownHosts>::create();
+    }
+    /* Named "[host]:port" off port 22, as check() looks it up */
+    return m_knownHosts->add(hostname, (port != 0)?(port):(m_port), key.key);
+}
+
+/*
+ * Checks the server key against the known hosts, following the policy.
+ * The key accepted last time is not looked up again on reconnection, as
+ * long as the known hosts file was not read again since (a key may have
+ * been revoked or removed).
+ */
+bool SshClient::_verifyHostKey()
+{
+    QByteArray host = SshKnownHosts::hostName(m_hostname, m_port);
+    if(m_knownHosts.isNull())
+    {
+        m_knownHosts = QSharedPointer<SshKnownHosts>::create();
+    }
+    quint64 generation = m_knownHosts->generation();
+    if(!m_verifiedHost.isEmpty() && host == m_verifiedHost && m_hostKey.key == m_verifiedKey
+       && generation == m_verifiedGeneration)
+    {
+        return true;
+    }
+
+    bool accept = false;
+    SshKnownHosts::Result known = m_knownHosts->check(m_hostname, m_port, m_hostKey.key);
+    switch(known)
+    {
+        case SshKnownHosts::Match:
+            accept = true;
             break;
-        case SshKey::Rsa:
-            typemask |= LIBSSH2_KNOWNHOST_KEY_SSHRSA;
+
+        case SshKnownHosts::NotFound:
+            if(m_hostKeyPolicy == AcceptNew)
+            {
+                accept = true;
+            }
+            else if(m_hostKeyPolicy == Callback && m_hostKeyCallback)
+            {
+                accept = m_hostKeyCallback(m_hostKey, known);
+            }
+            if(accept)
+            {
+                qCInfo(sshclient) << m_name << ": Adding" << host << m_hostKey.fingerprint() << "to the known hosts";
+                m_knownHosts->append(m_hostname, m_port, m_hostKey.key);
+            }
+            else
+            {
+                qCCritical(sshclient) << m_name << ": Unknown host" << host << m_hostKey.fingerprint();
+            }
             break;
-        case SshKey::UnknownType:
-            return false;
+
+        case SshKnownHosts::Mismatch:
+            if(m_hostKeyPolicy == Callback && m_hostKeyCallback)
+            {
+                accept = m_hostKeyCallback(m_hostKey, known);
+            }
+            if(!accept)
+            {
+                qCCritical(sshclient) << m_name << ": Host key of" << host << "has changed:" << m_hostKey.fingerprint();
+            }
+            break;
+    }
+
+    if(accept)
+    {
+        m_verifiedHost = host;
+        m_verifiedKey = m_hostKey.key;
+        m_verifiedGeneration = m_knownHosts->generation();
     }
-    ret = (libssh2_knownhost_add(m_knownHosts, qPrintable(hostname), nullptr, key.key.data(), static_cast<size_t>(key.key.size()), typemask, nullptr));
-    return ret;
+    return accept;
 }
 
 QString SshClient::banner()
 {
-    return QString(libssh2_session_banner_get(m_session));
+    return QString(sshTransport()->session_banner_get(m_session));
 }
 
 void SshClient::_sendKeepAlive()
@@ -258,7 +390,7 @@ void SshClient::_sendKeepAlive()
     int keepalive = 0;
     if(m_session)
     {
-        int ret = libssh2_keepalive_send(m_session, &keepalive);
+        int ret = sshTransport()->keepalive_send(m_session, &keepalive);
         if(ret == LIBSSH2_ERROR_SOCKET_SEND)
         {
             qCWarning(sshclient) << m_name << ": Connection I/O error !!!";
@@ -377,7 +509,7 @@ void SshClient::_ssh_processEvent()
 
         case SshState::Initialize:
         {
-            m_session = libssh2_session_init_ex(nullptr, nullptr, nullptr, reinterpret_cast<void *>(&m_socket));
+            m_session = sshTransport()->session_init_ex(nullptr, nullptr, nullptr, reinterpret_cast<void *>(&m_socket));
             if(m_session == nullptr)
             {
                 qCCritical(sshclient) << m_name << ": libssh error during session init";
@@ -386,24 +518,17 @@ void SshClient::_ssh_processEvent()
                 return;
             }
 
-            libssh2_session_callback_set(m_session, LIBSSH2_CALLBACK_RECV,reinterpret_cast<void*>(& qt_callback_libssh_recv));
-            libssh2_session_callback_set(m_session, LIBSSH2_CALLBACK_SEND,reinterpret_cast<void*>(& qt_callback_libssh_send));
-            libssh2_session_set_blocking(m_session, 0);
-
-            m_knownHosts = libssh2_knownhost_init(m_session);
-            Q_ASSERT(m_knownHosts);
-
-            if(m_knowhostFiles.size())
-            {
-                libssh2_knownhost_readfile(m_knownHosts, qPrintable(m_knowhostFiles), LIBSSH2_KNOWNHOST_FILE_OPENSSH);
-            }
+            sshTransport()->session_callback_set(m_session, LIBSSH2_CALLBACK_RECV,reinterpret_cast<void*>(& qt_callback_libssh_recv));
+            sshTransport()->session_callback_set(m_session, LIBSSH2_CALLBACK_SEND,reinterpret_cast<void*>(& qt_callback_libssh_send));
+            sshTransport()->session_set_blocking(m_session, 0);
+            sshTransport()->setWakeup(m_session, [this]() { emit sshEvent(); });
 
             setSshState(SshState::HandShake);
         }
 
         FALLTHROUGH; case SshState::HandShake:
         {
-            int ret = libssh2_session_handshake(m_session, static_cast<int>(m_socket.socketDescriptor()));
+            int ret = sshTransport()->session_handshake(m_session, static_cast<int>(m_socket.socketDescriptor()));
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -419,7 +544,7 @@ void SshClient::_ssh_processEvent()
             /* HandShake success, continue autentication */
             size_t len;
             int type;
-            const char * fingerprint = libssh2_session_hostkey(m_session, &len, &type);
+            const char * fingerprint = sshTransport()->session_hostkey(m_session, &len, &type);
             if(fingerprint == nullptr)
             {
                 qCCritical(sshclient) << m_name << "Fingerprint error";
@@ -428,7 +553,7 @@ void SshClient::_ssh_processEvent()
                 return;
             }
 
-            m_hostKey.hash = QByteArray(libssh2_hostkey_hash(m_session,LIBSSH2_HOSTKEY_HASH_MD5), 16);
+            m_hostKey.hash = QByteArray(sshTransport()->hostkey_hash(m_session,LIBSSH2_HOSTKEY_HASH_MD5), 16);
             switch (type)
             {
                 case LIBSSH2_HOSTKEY_TYPE_RSA:
@@ -437,13 +562,34 @@ void SshClient::_ssh_processEvent()
                 case LIBSSH2_HOSTKEY_TYPE_DSS:
                     m_hostKey.type=SshKey::Dss;
                     break;
+#ifdef LIBSSH2_HOSTKEY_TYPE_ECDSA_256
+                case LIBSSH2_HOSTKEY_TYPE_ECDSA_256:
+                    m_hostKey.type=SshKey::EcdsaP256;
+                    break;
+                case LIBSSH2_HOSTKEY_TYPE_ECDSA_384:
+                    m_hostKey.type=SshKey::EcdsaP384;
+                    break;
+                case LIBSSH2_HOSTKEY_TYPE_ECDSA_521:
+                    m_hostKey.type=SshKey::EcdsaP521;
+                    break;
+#endif
+#ifdef LIBSSH2_HOSTKEY_TYPE_ED25519
+                case LIBSSH2_HOSTKEY_TYPE_ED25519:
+                    m_hostKey.type=SshKey::Ed25519;
+                    break;
+#endif
                 default:
                     m_hostKey.type=SshKey::UnknownType;
             }
 
             m_hostKey.key = QByteArray(fingerprint, static_cast<int>(len));
-            struct libssh2_knownhost *khost;
-            libssh2_knownhost_check(m_knownHosts, m_hostname.toStdString().c_str(), fingerprint, len, LIBSSH2_KNOWNHOST_TYPE_PLAIN | LIBSSH2_KNOWNHOST_KEYENC_RAW, &khost);
+            m_hostKey.sha256 = QCryptographicHash::hash(m_hostKey.key, QCryptographicHash::Sha256);
+            if(!_verifyHostKey())
+            {
+                setSshState(SshState::Error);
+                m_socket.disconnectFromHost();
+                return;
+            }
             setSshState(SshState::GetAuthenticationMethodes);
         }
 
@@ -454,10 +600,10 @@ void SshClient::_ssh_processEvent()
                 QByteArray username = m_username.toLocal8Bit();
                 char * alist = nullptr;
 
-                alist = libssh2_userauth_list(m_session, username.data(), static_cast<unsigned int>(username.length()));
+                alist = sshTransport()->userauth_list(m_session, username.data(), static_cast<unsigned int>(username.length()));
                 if(alist == nullptr)
                 {
-                    int ret = libssh2_session_last_error(m_session, nullptr, nullptr, 0);
+                    int ret = sshTransport()->session_last_error(m_session, nullptr, nullptr, 0);
                     if(ret == LIBSSH2_ERROR_EAGAIN)
                     {
                         return;
@@ -480,28 +626,72 @@ void SshClient::_ssh_processEvent()
             {
                 if(m_authenticationMethodes.first() == "publickey")
                 {
-                    int ret = libssh2_userauth_publickey_frommemory(
+                    if(!m_identitiesListed)
+                    {
+                        m_identities.clear();
+                        if(m_useAgent)
+                        {
+                            m_identities = SshAgent::instance()->identities(SshAgent::hostName(m_username, m_hostname, m_port));
+                        }
+                        if(!m_identity.isNull())
+                        {
+                            m_identities.append(m_identity);
+                        }
+                        m_identitiesListed = true;
+                    }
+                    if(m_identities.isEmpty())
+                    {
+                        m_authenticationMethodes.removeFirst();
+                        continue;
+                    }
+
+                    const SshKeyStore::IdentityPtr identity = m_identities.first();
+                    QByteArray username = m_username.toUtf8();
+                    int ret;
+                    if(identity->signer)
+                    {
+                        m_signAbstract = const_cast<SshKeyStore::Identity *>(identity.data());
+                        ret = sshTransport()->userauth_publickey(
+                                    m_session,
+                                    username.constData(),
+                                    reinterpret_cast<const unsigned char *>(identity->publicKeyBlob.constData()),
+                                    static_cast<size_t>(identity->publicKeyBlob.size()),
+                                    &SshKeyStore::signCallback,
+                                    &m_signAbstract
+                            );
+                    }
+                    else
+                    {
+                        QByteArray passphrase = m_passphrase.toUtf8();
+                        ret = sshTransport()->userauth_publickey_frommemory(
                                     m_session,
-                                    m_username.toStdString().c_str(),
-                                    static_cast<size_t>(m_username.length()),
-                                    m_publicKey.toStdString().c_str(),
-                                    static_cast<size_t>(m_publicKey.length()),
-                                    m_privateKey.toStdString().c_str(),
-                                    static_cast<size_t>(m_privateKey.length()),
-                                    m_passphrase.toStdString().c_str()
+                                    username.constData(),
+                                    static_cast<size_t>(username.size()),
+                                    identity->publicKey.constData(),
+                                    static_cast<size_t>(identity->publicKey.size()),
+                                    identity->privateKey.constData(),
+                                    static_cast<size_t>(identity->privateKey.size()),
+                                    passphrase.constData()
                             );
+                    }
                     if(ret == LIBSSH2_ERROR_EAGAIN)
                     {
                         return;
                     }
+                    m_identities.removeFirst();
                     if(ret < 0)
                     {
                         qCWarning(sshclient) << m_name << ": Authentication with publickey failed:" << sshErrorToString(ret);
-                        m_authenticationMethodes.removeFirst();
+                        continue;
                     }
                     if(ret == 0)
                     {
                         qCDebug(sshclient) << m_name << ": Authenticated with publickey";
+                        if(m_useAgent)
+                        {
+                            SshAgent::instance()->setWorkingIdentity(SshAgent::hostName(m_username, m_hostname, m_port), identity);
+                        }
+                        m_identities.clear();
                         setSshState(SshState::Ready);
                         break;
                     }
@@ -512,11 +702,11 @@ void SshClient::_ssh_processEvent()
                     QByteArray username = m_username.toLatin1();
                     QByteArray passphrase = m_passphrase.toLatin1();
 
-                    int ret = libssh2_userauth_password_ex(m_session,
-                                                             username.data(),
-                                                             static_cast<unsigned int>(username.length()),
-                                                             passphrase.data(),
-                                                             static_cast<unsigned int>(passphrase.length()), nullptr);
+                    int ret = sshTransport()->userauth_password_ex(m_session,
+                                                                     username.data(),
+                                                                     static_cast<unsigned int>(username.length()),
+                                                                     passphrase.data(),
+                                                                     static_cast<unsigned int>(passphrase.length()), nullptr);
                     if(ret == LIBSSH2_ERROR_EAGAIN)
                     {
                         return;
@@ -538,13 +728,13 @@ void SshClient::_ssh_processEvent()
 
                 m_authenticationMethodes.pop_front();
             }
-            if(libssh2_userauth_authenticated(m_session))
+            if(sshTransport()->userauth_authenticated(m_session))
             {
                 qCDebug(sshclient) << m_name << ": Connected and authenticated";
                 m_connectionTimeout.stop();
                 m_keepalive.setSingleShot(true);
                 m_keepalive.start(1000);
-                libssh2_keepalive_config(m_session, 1, 5);
+                sshTransport()->keepalive_config(m_session, 1, 5);
                 setSshState(SshState::Ready);
                 emit sshReady();
             }
@@ -586,7 +776,7 @@ void SshClient::_ssh_processEvent()
 
         case SshState::DisconnectingSession:
         {
-            int ret = libssh2_session_disconnect_ex(m_session, SSH_DISCONNECT_BY_APPLICATION, "good bye!", "");
+            int ret = sshTransport()->session_disconnect_ex(m_session, SSH_DISCONNECT_BY_APPLICATION, "good bye!", "");
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -615,15 +805,9 @@ void SshClient::_ssh_processEvent()
         FALLTHROUGH; case SshState::FreeSession:
         {
             m_keepalive.stop();
-            if (m_knownHosts)
-            {
-                libssh2_knownhost_free(m_knownHosts);
-                m_knownHosts = nullptr;
-            }
-
             if(m_session)
             {
-                int ret = libssh2_session_free(m_session);
+                int ret = sshTransport()->session_free(m_session);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     emit sshEvent();
@@ -7,7 +7,10 @@
 #include <QMutex>
 #include "sshchannel.h"
 #include "sshkey.h"
+#include "sshknownhosts.h"
+#include "sshkeystore.h"
 #include <QSharedPointer>
+#include <functional>
 
 #ifndef FALLTHROUGH
 #if __has_cpp_attribute(fallthrough)
@@ -22,9 +25,13 @@
 Q_DECLARE_LOGGING_CATEGORY(sshclient)
 class SshScpGet;
 class SshScpSend;
+class SshScpBatchGet;
+class SshScpBatchSend;
 class SshSFtp;
 class SshTunnelIn;
 class SshTunnelOut;
+class SshTunnelScheduler;
+class SshRateLimiter;
 class QNetworkProxy;
 
 class  SshClient : public QObject {
@@ -47,10 +54,25 @@ public:
     };
     Q_ENUM(SshState)
 
+    enum HostKeyPolicy {
+        AcceptNew,  /* Unknown hosts are added to the known hosts, changed keys refused */
+        Strict,     /* Known hosts only */
+        Callback    /* The callback decides for unknown hosts and changed keys */
+    };
+    Q_ENUM(HostKeyPolicy)
+
+    /* Returns true to accept the key; an accepted unknown host is added */
+    typedef std::function<bool(const SshKey &key, SshKnownHosts::Result known)> HostKeyCallback;
+
 private:
     static int s_nbInstance;
     LIBSSH2_SESSION    * m_session {nullptr};
-    LIBSSH2_KNOWNHOSTS * m_knownHosts {nullptr};
+    QSharedPointer<SshKnownHosts> m_knownHosts;
+    HostKeyPolicy m_hostKeyPolicy {AcceptNew};
+    HostKeyCallback m_hostKeyCallback;
+    QByteArray m_verifiedHost;
+    QByteArray m_verifiedKey;
+    quint64 m_verifiedGeneration {0};
     QList<SshChannel*> m_channels;
 
     QString m_name;
@@ -66,8 +88,11 @@ private:
     QString m_hostname;
     QString m_username;
     QString m_passphrase;
-    QString m_privateKey;
-    QString m_publicKey;
+    SshKeyStore::IdentityPtr m_identity;
+    void *m_signAbstract {nullptr};
+    bool m_useAgent {false};
+    bool m_identitiesListed {false};
+    QList<SshKeyStore::IdentityPtr> m_identities;
     QString m_errorMessage;
     QString m_knowhostFiles;
     SshKey  m_hostKey;
@@ -75,12 +100,17 @@ private:
     QTimer m_connectionTimeout;
     QMutex channelCreationInProgress;
     void *currentLockerForChannelCreation {nullptr};
+    SshTunnelScheduler *m_tunnelScheduler {nullptr};
+    QSharedPointer<SshRateLimiter> m_rateLimiter;
 
 public:
     SshClient(const QString &name = "noname", QObject * parent = nullptr);
     virtual ~SshClient();
 
     QString getName() const;
+    SshTunnelScheduler *tunnelScheduler();
+    QSharedPointer<SshRateLimiter> rateLimiter();
+    void setRateLimit(qint64 bytesPerSecond);
     bool takeChannelCreationMutex(void *identifier);
     void releaseChannelCreationMutex(void *identifier);
 
@@ -116,10 +146,18 @@ public:
     }
 
     void setKeys(const QString &publicKey, const QString &privateKey);
+    /* Identity from SshKeyStore, shared with the other clients using it */
+    void setIdentity(const SshKeyStore::IdentityPtr &identity);
+    /* Try the ssh-agent identities (see SshAgent) before the keys */
+    void setUseAgent(bool use);
     void setPassphrase(const QString & pass);
     bool saveKnownHosts(const QString &file);
     void setKownHostFile(const QString &file);
-    bool addKnownHost  (const QString &hostname, const SshKey &key);
+    /* Port 0 is the port of this client, 22 until connectToHost() */
+    bool addKnownHost  (const QString &hostname, const SshKey &key, quint16 port = 0);
+    void setHostKeyPolicy(HostKeyPolicy policy, const HostKeyCallback &callback = nullptr);
+    HostKeyPolicy hostKeyPolicy() const;
+    const SshKey &hostKey() const;
     QString banner();
 
 
@@ -144,6 +182,7 @@ private: /* New function implementation with state machine */
     SshState m_sshState {SshState::Unconnected};
     QByteArrayList m_authenticationMethodes;
     void setSshState(const SshState &sshState);
+    bool _verifyHostKey();
 
 
 private slots: /* New function implementation with state machine */
@@ -0,0 +1,20 @@
+#include "sshfileutils.h"
+
+QString SshFileUtils::shellQuote(const QString &arg)
+{
+    QString res = arg;
+    res.replace("'", "'\\''");
+    return "'" + res + "'";
+}
+
+int SshFileUtils::fileMode(const QFileInfo &info)
+{
+    QFile::Permissions p = info.permissions();
+    return static_cast<int>(((p >> 12) & 07) << 6 | ((p >> 4) & 07) << 3 | (p & 07));
+}
+
+QFile::Permissions SshFileUtils::filePermissions(qint64 mode)
+{
+    int owner = static_cast<int>((mode >> 6) & 07);
+    return QFile::Permissions((owner << 12) | (owner << 8) | (((mode >> 3) & 07) << 4) | (mode & 07));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+
+/* Helpers shared by the scp and tar channels (internal) */
+namespace SshFileUtils
+{
+    /* Single-quoted for the remote shell */
+    QString shellQuote(const QString &arg);
+
+    /* Unix mode bits (0777) of a local file */
+    int fileMode(const QFileInfo &info);
+
+    /* Unix mode bits to Qt permissions, the owner also gets the user bits */
+    QFile::Permissions filePermissions(qint64 mode);
+}
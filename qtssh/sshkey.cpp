@@ -5,3 +5,8 @@ SshKey::SshKey(QObject *parent)
 {
 
 }
+
+QString SshKey::fingerprint() const
+{
+    return "SHA256:" + QString::fromLatin1(sha256.toBase64(QByteArray::OmitTrailingEquals));
+}
@@ -14,12 +14,20 @@ public:
     enum Type {
         UnknownType,
         Rsa,
-        Dss
+        Dss,
+        EcdsaP256,
+        EcdsaP384,
+        EcdsaP521,
+        Ed25519
     };
     Q_ENUM(Type)
-    QByteArray hash;
+    QByteArray hash;    /* MD5 */
+    QByteArray sha256;
     QByteArray key;
     Type       type {UnknownType};
+
+    /* "SHA256:<base64>", as printed by OpenSSH */
+    QString fingerprint() const;
 };
 
 #endif // SSHKEY_H
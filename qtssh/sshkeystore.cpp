@@ -0,0 +1,145 @@
+#include "sshkeystore.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QMutexLocker>
+#include <cstdlib>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(logkeystore, "ssh.keystore", QtWarningMsg)
+
+SshKeyStore *SshKeyStore::instance()
+{
+    static SshKeyStore s_store;
+    return &s_store;
+}
+
+/* Same content, same identity, as long as one client holds it */
+SshKeyStore::IdentityPtr SshKeyStore::identity(const QByteArray &publicKey, const QByteArray &privateKey)
+{
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    digest.addData(publicKey);
+    digest.addData("\0", 1);
+    digest.addData(privateKey);
+    QByteArray id = digest.result();
+
+    QMutexLocker lock(&m_mutex);
+    IdentityPtr identity = m_identities.value(id).toStrongRef();
+    if(identity.isNull())
+    {
+        QSharedPointer<Identity> created(new Identity());
+        created->publicKey = publicKey;
+        created->publicKeyBlob = publicKeyBlob(publicKey);
+        created->privateKey = privateKey;
+        identity = created;
+        for(auto it = m_identities.begin(); it != m_identities.end();)
+        {
+            if(it.value().isNull())
+                it = m_identities.erase(it);
+            else
+                ++it;
+        }
+        m_identities.insert(id, identity);
+    }
+    return identity;
+}
+
+SshKeyStore::IdentityPtr SshKeyStore::identityFromFile(const QString &privateKeyFile, const QString &publicKeyFile)
+{
+    QString pubFile = publicKeyFile;
+    if(pubFile.isEmpty() && QFileInfo::exists(privateKeyFile + ".pub"))
+    {
+        pubFile = privateKeyFile + ".pub";
+    }
+    QFileInfo info(privateKeyFile);
+    if(!info.exists())
+    {
+        qCWarning(logkeystore) << "No private key" << privateKeyFile;
+        return IdentityPtr();
+    }
+    QString key = info.absoluteFilePath() + "\n" + pubFile;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        const FileEntry entry = m_files.value(key);
+        if(!entry.identity.isNull() && entry.size == info.size() && entry.mtime == info.lastModified())
+        {
+            return entry.identity;
+        }
+    }
+
+    QFile priv(privateKeyFile);
+    if(!priv.open(QIODevice::ReadOnly))
+    {
+        qCWarning(logkeystore) << "Can't read" << privateKeyFile;
+        return IdentityPtr();
+    }
+    QByteArray pub;
+    if(!pubFile.isEmpty())
+    {
+        QFile file(pubFile);
+        if(file.open(QIODevice::ReadOnly))
+        {
+            pub = file.readAll().trimmed();
+        }
+    }
+
+    FileEntry entry;
+    entry.size = info.size();
+    entry.mtime = info.lastModified();
+    entry.identity = identity(pub, priv.readAll());
+    QMutexLocker lock(&m_mutex);
+    m_files.insert(key, entry);
+    return entry.identity;
+}
+
+SshKeyStore::IdentityPtr SshKeyStore::identityWithSigner(const QByteArray &publicKey, const Signer &signer)
+{
+    QSharedPointer<Identity> identity(new Identity());
+    identity->publicKey = publicKey.trimmed();
+    identity->publicKeyBlob = publicKeyBlob(identity->publicKey);
+    identity->signer = signer;
+    if(identity->publicKeyBlob.isEmpty() || !signer)
+    {
+        qCWarning(logkeystore) << "A signer needs an OpenSSH public key";
+        return IdentityPtr();
+    }
+    return identity;
+}
+
+/* "type base64 [comment]" */
+QByteArray SshKeyStore::publicKeyBlob(const QByteArray &publicKey)
+{
+    QList<QByteArray> fields = publicKey.simplified().split(' ');
+    if(fields.size() < 2)
+    {
+        return QByteArray();
+    }
+    return QByteArray::fromBase64(fields.at(1));
+}
+
+int SshKeyStore::signCallback(LIBSSH2_SESSION *session, unsigned char **sig, size_t *sig_len, const unsigned char *data, size_t data_len, void **abstract)
+{
+    Q_UNUSED(session)
+    const Identity *identity = static_cast<const Identity *>(*abstract);
+    if(identity == nullptr || !identity->signer)
+    {
+        return -1;
+    }
+    QByteArray signature = identity->signer(QByteArray::fromRawData(reinterpret_cast<const char *>(data), static_cast<int>(data_len)));
+    if(signature.isEmpty())
+    {
+        return -1;
+    }
+
+    /* Released by libssh2 with the session allocator, malloc by default */
+    *sig = static_cast<unsigned char *>(malloc(static_cast<size_t>(signature.size())));
+    if(*sig == nullptr)
+    {
+        return -1;
+    }
+    memcpy(*sig, signature.constData(), static_cast<size_t>(signature.size()));
+    *sig_len = static_cast<size_t>(signature.size());
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef SSHKEYSTORE_H
+#define SSHKEYSTORE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <functional>
+#include <libssh2.h>
+
+/*
+ * Process-wide store of the keys used for publickey authentication. Each
+ * key is read and decoded once, then shared by every SshClient using it:
+ * the same content gives the same identity, files are read again only when
+ * they change.
+ *
+ * An identity with a signer authenticates without private key material:
+ * the signer gets the data to sign and returns the raw signature (without
+ * the algorithm name), from a token, an HSM or a key it keeps unlocked.
+ */
+class SshKeyStore
+{
+public:
+    typedef std::function<QByteArray(const QByteArray &data)> Signer;
+
+    struct Identity {
+        QByteArray publicKey;       /* As given, OpenSSH one-line format or empty */
+        QByteArray publicKeyBlob;   /* Decoded OpenSSH public key */
+        QByteArray privateKey;
+        Signer signer;
+    };
+    typedef QSharedPointer<const Identity> IdentityPtr;
+
+    static SshKeyStore *instance();
+
+    IdentityPtr identity(const QByteArray &publicKey, const QByteArray &privateKey);
+    /* publicKeyFile defaults to privateKeyFile.pub, when it exists */
+    IdentityPtr identityFromFile(const QString &privateKeyFile, const QString &publicKeyFile = QString());
+    /* publicKey in the OpenSSH one-line format ("ssh-ed25519 AAAA... comment") */
+    IdentityPtr identityWithSigner(const QByteArray &publicKey, const Signer &signer);
+
+    /* For libssh2_userauth_publickey(), abstract points to the Identity */
+    static int signCallback(LIBSSH2_SESSION *session, unsigned char **sig, size_t *sig_len, const unsigned char *data, size_t data_len, void **abstract);
+
+    static QByteArray publicKeyBlob(const QByteArray &publicKey);
+
+private:
+    struct FileEntry {
+        qint64 size {-1};
+        QDateTime mtime;
+        IdentityPtr identity;
+    };
+
+    QMutex m_mutex;
+    QHash<QByteArray, QWeakPointer<const Identity>> m_identities;
+    QHash<QString, FileEntry> m_files;
+};
+
+#endif // SSHKEYSTORE_H
@@ -0,0 +1,340 @@
+#include "sshknownhosts.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QMessageAuthenticationCode>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QWeakPointer>
+#include <QtEndian>
+
+Q_LOGGING_CATEGORY(logknownhosts, "ssh.knownhosts", QtWarningMsg)
+
+static QMutex s_sharedMutex;
+static QHash<QString, QWeakPointer<SshKnownHosts>> s_shared;
+
+SshKnownHosts::SshKnownHosts(const QString &file)
+    : m_file(file)
+{
+}
+
+QSharedPointer<SshKnownHosts> SshKnownHosts::shared(const QString &file)
+{
+    QString path = QFileInfo(file).absoluteFilePath();
+    QMutexLocker lock(&s_sharedMutex);
+    QSharedPointer<SshKnownHosts> hosts = s_shared.value(path).toStrongRef();
+    if(hosts.isNull())
+    {
+        hosts = QSharedPointer<SshKnownHosts>::create(path);
+        s_shared.insert(path, hosts);
+    }
+    return hosts;
+}
+
+QString SshKnownHosts::file() const
+{
+    return m_file;
+}
+
+QByteArray SshKnownHosts::hostName(const QString &hostname, quint16 port)
+{
+    QByteArray name = hostname.toLower().toUtf8();
+    if(port != 0 && port != 22)
+    {
+        name = "[" + name + "]:" + QByteArray::number(port);
+    }
+    return name;
+}
+
+SshKnownHosts::Result SshKnownHosts::check(const QString &hostname, quint16 port, const QByteArray &key)
+{
+    QMutexLocker lock(&m_mutex);
+    _refresh();
+    const QList<Entry> entries = _lookup(hostName(hostname, port));
+    const QByteArray type = _keyType(key);
+    Result res = NotFound;
+    for(const Entry &entry: entries)
+    {
+        if(entry.key == key)
+        {
+            if(entry.revoked)
+            {
+                return Mismatch;
+            }
+            res = Match;
+        }
+        else if(res == NotFound && !entry.revoked && entry.type == type)
+        {
+            res = Mismatch;
+        }
+    }
+    return res;
+}
+
+bool SshKnownHosts::add(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment)
+{
+    QByteArray line = _line(hostname, port, key, comment);
+    if(line.isEmpty())
+    {
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    _refresh();
+    _parseLine(line);
+    m_added.append(line);
+    return true;
+}
+
+/* Appends to the end of the file: no rewrite, no reload */
+bool SshKnownHosts::append(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment)
+{
+    QByteArray line = _line(hostname, port, key, comment);
+    if(line.isEmpty())
+    {
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    _refresh();
+    _parseLine(line);
+    if(m_file.isEmpty())
+    {
+        m_added.append(line);
+        return true;
+    }
+
+    QFile file(m_file);
+    if(!file.open(QIODevice::ReadWrite | QIODevice::Append))
+    {
+        qCWarning(logknownhosts) << "Can't write" << m_file;
+        m_added.append(line);
+        return false;
+    }
+    if(file.size() > 0)
+    {
+        char last = '\n';
+        file.seek(file.size() - 1);
+        file.getChar(&last);
+        if(last != '\n')
+        {
+            line.prepend('\n');
+        }
+    }
+    bool res = (file.write(line + '\n') == line.size() + 1);
+    file.close();
+
+    QFileInfo info(m_file);
+    m_size = info.size();
+    m_mtime = info.lastModified();
+    return res;
+}
+
+/* The key type is the first string of the blob */
+QByteArray SshKnownHosts::_keyType(const QByteArray &key)
+{
+    if(key.size() < 4)
+    {
+        return QByteArray();
+    }
+    quint32 typeLen = qFromBigEndian<quint32>(key.constData());
+    if(typeLen == 0 || typeLen > static_cast<quint32>(key.size() - 4))
+    {
+        return QByteArray();
+    }
+    return key.mid(4, static_cast<int>(typeLen));
+}
+
+QByteArray SshKnownHosts::_line(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment)
+{
+    QByteArray type = _keyType(key);
+    if(type.isEmpty())
+    {
+        return QByteArray();
+    }
+
+    QByteArray line = hostName(hostname, port) + " " + type + " " + key.toBase64();
+    if(!comment.isEmpty())
+    {
+        line += " " + comment;
+    }
+    return line;
+}
+
+/* The current file, untouched, followed by the added hosts */
+bool SshKnownHosts::save(const QString &file)
+{
+    QMutexLocker lock(&m_mutex);
+    QByteArray content;
+    if(!m_file.isEmpty())
+    {
+        QFile current(m_file);
+        if(current.open(QIODevice::ReadOnly))
+        {
+            content = current.readAll();
+        }
+    }
+    if(!content.isEmpty() && !content.endsWith('\n'))
+    {
+        content += '\n';
+    }
+    for(const QByteArray &line: m_added)
+    {
+        content += line + '\n';
+    }
+
+    QSaveFile out(file);
+    if(!out.open(QIODevice::WriteOnly) || out.write(content) != content.size() || !out.commit())
+    {
+        qCWarning(logknownhosts) << "Can't write" << file;
+        return false;
+    }
+
+    if(!m_file.isEmpty() && QFileInfo(file).absoluteFilePath() == m_file)
+    {
+        m_added.clear();
+        m_loaded = false;
+    }
+    return true;
+}
+
+int SshKnownHosts::count()
+{
+    QMutexLocker lock(&m_mutex);
+    _refresh();
+    return m_count;
+}
+
+quint64 SshKnownHosts::generation()
+{
+    QMutexLocker lock(&m_mutex);
+    _refresh();
+    return m_generation;
+}
+
+/* Parse the file again if it changed since the last look */
+void SshKnownHosts::_refresh()
+{
+    qint64 size = -1;
+    QDateTime mtime;
+    if(!m_file.isEmpty())
+    {
+        QFileInfo info(m_file);
+        if(info.exists())
+        {
+            size = info.size();
+            mtime = info.lastModified();
+        }
+    }
+    if(m_loaded && size == m_size && mtime == m_mtime)
+    {
+        return;
+    }
+
+    m_hosts.clear();
+    m_hashed.clear();
+    m_hashedLookups.clear();
+    m_count = 0;
+    if(size >= 0)
+    {
+        QFile file(m_file);
+        if(file.open(QIODevice::ReadOnly))
+        {
+            while(!file.atEnd())
+            {
+                _parseLine(file.readLine());
+            }
+        }
+    }
+    for(const QByteArray &line: m_added)
+    {
+        _parseLine(line);
+    }
+    qCDebug(logknownhosts) << "Loaded" << m_count << "known hosts from" << m_file;
+
+    m_size = size;
+    m_mtime = mtime;
+    m_loaded = true;
+    m_generation++;
+}
+
+/* [@marker] host[,host...] keytype base64 [comment] */
+void SshKnownHosts::_parseLine(const QByteArray &line)
+{
+    QList<QByteArray> fields = line.simplified().split(' ');
+    if(fields.first().isEmpty() || fields.first().startsWith('#'))
+    {
+        return;
+    }
+
+    Entry entry;
+    if(fields.first().startsWith('@'))
+    {
+        /* Certificate authorities are not supported */
+        if(fields.first() != "@revoked")
+        {
+            return;
+        }
+        entry.revoked = true;
+        fields.removeFirst();
+    }
+    if(fields.size() < 3)
+    {
+        return;
+    }
+    entry.key = QByteArray::fromBase64(fields.at(2));
+    if(entry.key.isEmpty())
+    {
+        return;
+    }
+    entry.type = _keyType(entry.key);
+    if(entry.type.isEmpty())
+    {
+        entry.type = fields.at(1);
+    }
+
+    for(const QByteArray &host: fields.at(0).split(','))
+    {
+        if(host.startsWith("|1|"))
+        {
+            QList<QByteArray> parts = host.split('|');
+            if(parts.size() == 4)
+            {
+                HashedEntry hashed;
+                hashed.salt = QByteArray::fromBase64(parts.at(2));
+                hashed.hash = QByteArray::fromBase64(parts.at(3));
+                hashed.entry = entry;
+                m_hashed.append(hashed);
+            }
+        }
+        else if(!host.isEmpty() && !host.startsWith('!'))
+        {
+            m_hosts[host.toLower()].append(entry);
+        }
+    }
+    m_count++;
+}
+
+QList<SshKnownHosts::Entry> SshKnownHosts::_lookup(const QByteArray &name)
+{
+    QList<Entry> entries = m_hosts.value(name);
+    if(m_hashed.isEmpty())
+    {
+        return entries;
+    }
+
+    auto it = m_hashedLookups.constFind(name);
+    if(it == m_hashedLookups.constEnd())
+    {
+        QList<Entry> matches;
+        for(const HashedEntry &hashed: m_hashed)
+        {
+            if(QMessageAuthenticationCode::hash(name, hashed.salt, QCryptographicHash::Sha1) == hashed.hash)
+            {
+                matches.append(hashed.entry);
+            }
+        }
+        it = m_hashedLookups.insert(name, matches);
+    }
+    return entries + it.value();
+}
@@ -0,0 +1,84 @@
+#ifndef SSHKNOWNHOSTS_H
+#define SSHKNOWNHOSTS_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+
+/*
+ * Parsed OpenSSH known_hosts file, shared by every SshClient using the same
+ * file (see shared()). Nothing is read before the first check; the file is
+ * read again only when its size or modification time changes.
+ *
+ * Plain host names are indexed. Hashed ones (|1|salt|hash) are tested once
+ * per looked up name, the result is kept until the next reload.
+ *
+ * Hosts on another port than 22 are named "[host]:port", like OpenSSH.
+ * Keys are raw blobs, as returned by libssh2_session_hostkey(). Only keys of
+ * the offered type are compared: a host known by another type is NotFound.
+ */
+class SshKnownHosts
+{
+public:
+    enum Result {
+        Match,
+        Mismatch,
+        NotFound
+    };
+
+    /* An empty file keeps everything in memory */
+    explicit SshKnownHosts(const QString &file = QString());
+
+    /* The instance of file for the process, created on first use */
+    static QSharedPointer<SshKnownHosts> shared(const QString &file);
+
+    QString file() const;
+    Result check(const QString &hostname, quint16 port, const QByteArray &key);
+
+    /* Added hosts are kept in memory, across reloads, until saved */
+    bool add(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment = QByteArray());
+    bool save(const QString &file);
+    /* Added to memory and to the end of the file at once */
+    bool append(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment = QByteArray());
+    int count();
+    /* Changes each time the file is read again: results checked before are stale */
+    quint64 generation();
+
+    static QByteArray hostName(const QString &hostname, quint16 port);
+
+private:
+    struct Entry {
+        QByteArray key;
+        QByteArray type;
+        bool revoked {false};
+    };
+    struct HashedEntry {
+        QByteArray salt;
+        QByteArray hash;
+        Entry entry;
+    };
+
+    QMutex m_mutex;
+    QString m_file;
+    bool m_loaded {false};
+    qint64 m_size {-1};
+    QDateTime m_mtime;
+    QHash<QByteArray, QList<Entry>> m_hosts;
+    QList<HashedEntry> m_hashed;
+    QHash<QByteArray, QList<Entry>> m_hashedLookups;
+    QList<QByteArray> m_added;
+    int m_count {0};
+    quint64 m_generation {0};
+
+    void _refresh();
+    static QByteArray _keyType(const QByteArray &key);
+    static QByteArray _line(const QString &hostname, quint16 port, const QByteArray &key, const QByteArray &comment);
+    void _parseLine(const QByteArray &line);
+    QList<Entry> _lookup(const QByteArray &name);
+};
+
+#endif // SSHKNOWNHOSTS_H
@@ -0,0 +1,52 @@
+#include "sshmappedfile.h"
+
+SshMappedFile::SshMappedFile(QFile *file)
+    : m_file(file)
+{
+}
+
+SshMappedFile::~SshMappedFile()
+{
+    unmap();
+}
+
+char *SshMappedFile::data(qint64 offset, qint64 &len)
+{
+    if(m_file == nullptr)
+    {
+        len = 0;
+        return nullptr;
+    }
+    if(m_map == nullptr || offset < m_mapOffset || offset >= m_mapOffset + m_mapSize)
+    {
+        unmap();
+        qint64 size = qMin<qint64>(m_file->size() - offset, SSH_MAP_WINDOW);
+        if(size <= 0)
+        {
+            len = 0;
+            return nullptr;
+        }
+        m_map = m_file->map(offset, size);
+        if(m_map == nullptr)
+        {
+            len = 0;
+            return nullptr;
+        }
+        m_mapOffset = offset;
+        m_mapSize = size;
+    }
+
+    len = m_mapOffset + m_mapSize - offset;
+    return reinterpret_cast<char *>(m_map + (offset - m_mapOffset));
+}
+
+void SshMappedFile::unmap()
+{
+    if(m_map)
+    {
+        m_file->unmap(m_map);
+        m_map = nullptr;
+        m_mapOffset = 0;
+        m_mapSize = 0;
+    }
+}
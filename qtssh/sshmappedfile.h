@@ -0,0 +1,34 @@
+#ifndef SSHMAPPEDFILE_H
+#define SSHMAPPEDFILE_H
+
+#include <QFile>
+
+/* Size of the sliding mapping window on local files */
+#define SSH_MAP_WINDOW (64*1024*1024)
+
+/* Slice of a mapped file handed to libssh2 at once */
+#define SSH_MAP_CHUNK (256*1024)
+
+/*
+ * Sliding memory mapping of a local file, used by the transfer engines to
+ * hand file pages directly to libssh2 instead of copying them in a buffer.
+ * The file must be open (ReadWrite to write through the mapping). Without
+ * file (device transfers), nothing is ever mapped.
+ */
+class SshMappedFile
+{
+    QFile *m_file;
+    uchar *m_map {nullptr};
+    qint64 m_mapOffset {0};
+    qint64 m_mapSize {0};
+
+public:
+    explicit SshMappedFile(QFile *file);
+    ~SshMappedFile();
+
+    /* Pointer on file data at offset, len is set to the mapped size available from there */
+    char *data(qint64 offset, qint64 &len);
+    void unmap();
+};
+
+#endif // SSHMAPPEDFILE_H
@@ -53,11 +53,11 @@ void SshProcess::sshDataReceived()
             {
                 return;
             }
-            m_sshChannel = libssh2_channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
+            m_sshChannel = sshTransport()->channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
             m_sshClient->releaseChannelCreationMutex(this);
             if (m_sshChannel == nullptr)
             {
-                int ret = libssh2_session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -84,7 +84,7 @@ void SshProcess::sshDataReceived()
                 return;
             }
             qCDebug(logsshprocess) << "runCommand(" << m_cmd << ")";
-            int ret = libssh2_channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, m_cmd.toStdString().c_str(), static_cast<unsigned int>(m_cmd.size()));
+            int ret = sshTransport()->channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, m_cmd.toStdString().c_str(), static_cast<unsigned int>(m_cmd.size()));
             if (ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -111,7 +111,7 @@ void SshProcess::sshDataReceived()
             ssize_t retsz;
             char buffer[16*1024];
 
-            retsz = libssh2_channel_read_ex(m_sshChannel, 0, buffer, 16 * 1024);
+            retsz = sshTransport()->channel_read_ex(m_sshChannel, 0, buffer, 16 * 1024);
             if(retsz == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -133,7 +133,7 @@ void SshProcess::sshDataReceived()
 
             m_result.append(buffer, static_cast<int>(retsz));
 
-            retsz = libssh2_channel_read_stderr(m_sshChannel, buffer, 16 * 1024);
+            retsz = sshTransport()->channel_read_stderr(m_sshChannel, buffer, 16 * 1024);
             if(retsz == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -162,7 +162,7 @@ void SshProcess::sshDataReceived()
                 m_errMsg << QString("Run command error: (%1)").arg(buffer);
             }
 
-            if (libssh2_channel_eof(m_sshChannel) == 1)
+            if (sshTransport()->channel_eof(m_sshChannel) == 1)
             {
                 qCDebug(logsshprocess) << "runCommand(" << m_cmd << ") RESULT: " << m_result;
                 setChannelState(ChannelState::Close);
@@ -173,7 +173,7 @@ void SshProcess::sshDataReceived()
         FALLTHROUGH; case Close:
         {
             qCDebug(logsshprocess) << "closeChannel:" << m_name;
-            int ret = libssh2_channel_close(m_sshChannel);
+            int ret = sshTransport()->channel_close(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -194,7 +194,7 @@ void SshProcess::sshDataReceived()
         FALLTHROUGH; case WaitClose:
         {
             qCDebug(logsshprocess) << "Wait close channel:" << m_name;
-            int ret = libssh2_channel_wait_closed(m_sshChannel);
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -216,7 +216,7 @@ void SshProcess::sshDataReceived()
         {
             qCDebug(logsshprocess) << "free Channel:" << m_name;
 
-            int ret = libssh2_channel_free(m_sshChannel);
+            int ret = sshTransport()->channel_free(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
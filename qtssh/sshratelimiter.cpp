@@ -0,0 +1,80 @@
+#include "sshratelimiter.h"
+#include <QMutexLocker>
+#include <cmath>
+#include <limits>
+
+SshRateLimiter::SshRateLimiter(qint64 bytesPerSecond, qint64 burst)
+{
+    m_clock.start();
+    setRate(bytesPerSecond, burst);
+}
+
+void SshRateLimiter::setRate(qint64 bytesPerSecond, qint64 burst)
+{
+    QMutexLocker lock(&m_mutex);
+    _refill();
+    bool wasUnlimited = (m_rate == 0);
+    m_rate = qMax<qint64>(bytesPerSecond, 0);
+    m_burst = (burst > 0)?(burst):(qMax<qint64>(m_rate / 4, RATELIMIT_MIN_CHUNK));
+    m_tokens = (wasUnlimited)?(static_cast<double>(m_burst)):(qMin(m_tokens, static_cast<double>(m_burst)));
+}
+
+qint64 SshRateLimiter::rate() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_rate;
+}
+
+qint64 SshRateLimiter::burst() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_burst;
+}
+
+void SshRateLimiter::_refill()
+{
+    qint64 elapsed = m_clock.nsecsElapsed();
+    m_clock.restart();
+    if(m_rate > 0)
+    {
+        m_tokens = qMin(m_tokens + static_cast<double>(m_rate) * static_cast<double>(elapsed) / 1e9, static_cast<double>(m_burst));
+    }
+}
+
+qint64 SshRateLimiter::available()
+{
+    QMutexLocker lock(&m_mutex);
+    if(m_rate == 0)
+    {
+        return std::numeric_limits<qint64>::max();
+    }
+    _refill();
+    return static_cast<qint64>(m_tokens);
+}
+
+void SshRateLimiter::consume(qint64 len)
+{
+    QMutexLocker lock(&m_mutex);
+    if(m_rate == 0)
+    {
+        return;
+    }
+    /* May go negative when a peer pushed more than asked, the debt is paid later */
+    m_tokens -= static_cast<double>(len);
+}
+
+int SshRateLimiter::delay(qint64 len)
+{
+    QMutexLocker lock(&m_mutex);
+    if(m_rate == 0)
+    {
+        return 0;
+    }
+    _refill();
+    double missing = static_cast<double>(qMin(len, m_burst)) - m_tokens;
+    if(missing <= 0)
+    {
+        return 0;
+    }
+    return qMax(1, static_cast<int>(std::ceil(missing * 1000.0 / static_cast<double>(m_rate))));
+}
@@ -0,0 +1,43 @@
+#ifndef SSHRATELIMITER_H
+#define SSHRATELIMITER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+
+/* Smallest amount worth waking up for when the bucket is empty */
+#define RATELIMIT_MIN_CHUNK (4*1024)
+
+/*
+ * Token bucket shared by the tunnel connections it limits (one connection,
+ * every connection of a tunnel, or the whole session). Bytes are counted in
+ * both directions. A rate of 0 means unlimited. Connectors hold data back
+ * instead of dropping it: they read less from the socket or from the SSH
+ * channel and retry after delay().
+ */
+class SshRateLimiter
+{
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    qint64 m_rate {0};
+    qint64 m_burst {0};
+    double m_tokens {0};
+
+    void _refill();
+
+public:
+    explicit SshRateLimiter(qint64 bytesPerSecond = 0, qint64 burst = 0);
+
+    /* burst defaults to a quarter of a second of traffic */
+    void setRate(qint64 bytesPerSecond, qint64 burst = 0);
+    qint64 rate() const;
+    qint64 burst() const;
+
+    /* Bytes that may be transferred now */
+    qint64 available();
+    void consume(qint64 len);
+
+    /* Milliseconds to wait before len bytes are available */
+    int delay(qint64 len);
+};
+
+#endif // SSHRATELIMITER_H
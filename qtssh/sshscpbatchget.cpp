@@ -0,0 +1,455 @@
+#include "sshscpbatchget.h"
+#include "sshclient.h"
+#include "sshfileutils.h"
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(logscpbatchget, "ssh.scpbatchget", QtWarningMsg)
+
+using SshFileUtils::shellQuote;
+using SshFileUtils::filePermissions;
+
+SshScpBatchGet::SshScpBatchGet(const QString &name, SshClient *client):
+    SshChannel(name, client)
+{
+}
+
+SshScpBatchGet::~SshScpBatchGet()
+{
+    qCDebug(logscpbatchget) << "free Channel:" << m_name;
+}
+
+void SshScpBatchGet::close()
+{
+    setChannelState(ChannelState::Close);
+    sshDataReceived();
+}
+
+void SshScpBatchGet::setBufferSize(int size)
+{
+    m_bufferSize = qMax(size, 1);
+}
+
+/* Progress is emitted at most every msec, or every bytes if not 0 */
+void SshScpBatchGet::setProgressInterval(int msec, qint64 bytes)
+{
+    m_progressInterval = msec;
+    m_progressBytes = bytes;
+}
+
+void SshScpBatchGet::emitProgress(bool force)
+{
+    qint64 now = m_elapsed.elapsed();
+    if(!force
+       && (now - m_progressLastTime) < m_progressInterval
+       && (m_progressBytes == 0 || (m_got - m_progressLastBytes) < m_progressBytes))
+    {
+        return;
+    }
+    m_progressLastTime = now;
+    m_progressLastBytes = m_got;
+    /* Average throughput in bytes per second since the transfer started */
+    qint64 rate = (now > 0)?(m_got * 1000 / now):(0);
+    emit progress(m_got, m_total, rate);
+}
+
+QStringList SshScpBatchGet::errMsg() const
+{
+    return m_errMsg;
+}
+
+void SshScpBatchGet::get(const QStringList &sources, const QString &dest)
+{
+    m_sources = sources;
+    m_dest = dest;
+    m_destIsDir = QFileInfo(dest).isDir();
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+void SshScpBatchGet::setError(const QString &msg)
+{
+    qCWarning(logscpbatchget) << m_name << msg;
+    m_errMsg << msg;
+    if(!m_error)
+    {
+        m_error = true;
+        emit failed();
+    }
+}
+
+/* Handle a complete control line from the remote scp, false on fatal error */
+bool SshScpBatchGet::processLine()
+{
+    m_line.chop(1);
+    if(m_line.isEmpty())
+    {
+        setError("Empty scp message");
+        return false;
+    }
+    switch(m_line.at(0))
+    {
+        case '\1':
+            /*
+             * Warning on one entry, the remote goes on with the next one.
+             * Instead of the status after file data, it waits for our ack.
+             */
+            m_warning = true;
+            m_errMsg << QString::fromUtf8(m_line.mid(1));
+            qCWarning(logscpbatchget) << m_name << "Remote scp warning:" << m_line.mid(1);
+            m_line.clear();
+            m_afterAck = Line;
+            m_step = (m_afterData)?(SendAck):(Line);
+            m_afterData = false;
+            return true;
+
+        case '\2':
+            setError(QString("Remote scp error: %1").arg(QString::fromUtf8(m_line.mid(1))));
+            return false;
+
+        case 'T':
+            /* Times are not preserved */
+            m_afterAck = Line;
+            break;
+
+        case 'E':
+            if(m_dirs.isEmpty())
+            {
+                setError("Unbalanced directory end from remote scp");
+                return false;
+            }
+            /* Applied once the content is written: the mode may forbid it */
+            QFile::setPermissions(m_dirs.last().path, filePermissions(m_dirs.last().mode));
+            m_dirs.removeLast();
+            m_afterAck = Line;
+            break;
+
+        case 'C':
+        case 'D':
+        {
+            QList<QByteArray> fields = m_line.mid(1).split(' ');
+            if(fields.size() < 3)
+            {
+                setError(QString("Invalid scp header: %1").arg(QString::fromUtf8(m_line)));
+                return false;
+            }
+            bool okMode, okSize;
+            int mode = fields.at(0).toInt(&okMode, 8);
+            qint64 size = fields.at(1).toLongLong(&okSize);
+            QString name = QFile::decodeName(m_line.mid(1 + fields.at(0).size() + 1 + fields.at(1).size() + 1));
+            if(!okMode || !okSize || size < 0 || name.isEmpty() || name.contains('/') || name == "." || name == "..")
+            {
+                setError(QString("Invalid scp header: %1").arg(QString::fromUtf8(m_line)));
+                return false;
+            }
+
+            /* At top level, dest is the entry itself unless it is an existing directory */
+            QString path;
+            if(!m_dirs.isEmpty())
+            {
+                path = m_dirs.last().path + "/" + name;
+            }
+            else if(m_destIsDir)
+            {
+                path = m_dest + "/" + name;
+            }
+            else
+            {
+                path = m_dest;
+            }
+
+            if(m_line.at(0) == 'D')
+            {
+                if(!QDir().mkpath(path))
+                {
+                    setError("Can't create directory " + path);
+                    return false;
+                }
+                m_dirs.append({path, mode});
+                m_afterAck = Line;
+                break;
+            }
+
+            m_file.setFileName(path);
+            if(!m_file.open(QIODevice::WriteOnly))
+            {
+                setError("Can't open destination file " + path);
+                return false;
+            }
+            m_file.setPermissions(filePermissions(mode));
+            m_fileSize = size;
+            m_fileGot = 0;
+            m_total += size;
+            m_afterAck = Data;
+            break;
+        }
+
+        default:
+            setError(QString("Unexpected scp message: %1").arg(QString::fromUtf8(m_line)));
+            return false;
+    }
+    m_line.clear();
+    m_step = SendAck;
+    return true;
+}
+
+void SshScpBatchGet::sshDataReceived()
+{
+    qCDebug(logscpbatchget) << "Channel "<< m_name << "State:" << channelState();
+    switch(channelState())
+    {
+        case Openning:
+        {
+            if ( ! m_sshClient->takeChannelCreationMutex(this) )
+            {
+                return;
+            }
+            m_sshChannel = sshTransport()->channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
+            m_sshClient->releaseChannelCreationMutex(this);
+            if (m_sshChannel == nullptr)
+            {
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                if(ret == LIBSSH2_ERROR_EAGAIN)
+                {
+                    return;
+                }
+                setError(QString("Channel session open failed: %1").arg(ret));
+                setChannelState(ChannelState::Error);
+                return;
+            }
+            qCDebug(logscpbatchget) << "Channel session opened";
+            setChannelState(ChannelState::Exec);
+        }
+
+        FALLTHROUGH; case Exec:
+        {
+            QString cmd = "scp -r -f";
+            for(const QString &source: m_sources)
+            {
+                cmd += " " + shellQuote(source);
+            }
+            int ret = sshTransport()->channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, cmd.toStdString().c_str(), static_cast<unsigned int>(cmd.toStdString().size()));
+            if (ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret != 0)
+            {
+                setError(QString("Failed to run remote scp: %1").arg(sshErrorToString(ret)));
+                setChannelState(ChannelState::Close);
+                sshDataReceived();
+                return;
+            }
+            m_buffer.resize(m_bufferSize);
+            m_elapsed.start();
+            /* The sink starts the exchange */
+            m_step = SendAck;
+            m_afterAck = Line;
+            setChannelState(ChannelState::Ready);
+            /* OK, next step */
+        }
+
+        FALLTHROUGH; case Ready:
+        {
+            while(channelState() == ChannelState::Ready)
+            {
+                if(m_step == SendAck)
+                {
+                    char ack = 0;
+                    ssize_t retsz = sshTransport()->channel_write_ex(m_sshChannel, 0, &ack, 1);
+                    if(retsz == LIBSSH2_ERROR_EAGAIN)
+                    {
+                        return;
+                    }
+                    if(retsz < 0)
+                    {
+                        setError(QString("Can't write ack (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                    m_step = m_afterAck;
+                    continue;
+                }
+
+                if(m_step == Data && m_fileGot == m_fileSize)
+                {
+                    m_file.close();
+                    emit fileReceived(m_file.fileName());
+                    m_step = Status;
+                    continue;
+                }
+
+                if(m_inPos == m_inLen)
+                {
+                    ssize_t retsz = sshTransport()->channel_read_ex(m_sshChannel, 0, m_buffer.data(), static_cast<size_t>(m_buffer.size()));
+                    if(retsz == LIBSSH2_ERROR_EAGAIN)
+                    {
+                        return;
+                    }
+                    if(retsz < 0)
+                    {
+                        setError(QString("Can't read (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                    if(retsz == 0)
+                    {
+                        if(sshTransport()->channel_eof(m_sshChannel) != 1)
+                        {
+                            return;
+                        }
+                        if(m_step != Line || !m_line.isEmpty() || !m_dirs.isEmpty())
+                        {
+                            setError("Remote scp closed unexpectedly");
+                        }
+                        else if(m_warning)
+                        {
+                            setError("Some entries could not be received");
+                        }
+                        else
+                        {
+                            emitProgress(true);
+                            emit finished();
+                        }
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                    m_inPos = 0;
+                    m_inLen = retsz;
+                }
+
+                const char *begin = m_buffer.constData() + m_inPos;
+                switch(m_step)
+                {
+                    case Line:
+                    {
+                        const char *nl = static_cast<const char *>(memchr(begin, '\n', static_cast<size_t>(m_inLen - m_inPos)));
+                        qint64 len = (nl)?(nl - begin + 1):(m_inLen - m_inPos);
+                        m_line.append(begin, static_cast<int>(len));
+                        m_inPos += len;
+                        if(nl && !processLine())
+                        {
+                            setChannelState(ChannelState::Close);
+                        }
+                        else if(!nl && m_line.size() > 4096)
+                        {
+                            setError("Invalid scp header: line too long");
+                            setChannelState(ChannelState::Close);
+                        }
+                        break;
+                    }
+
+                    case Data:
+                    {
+                        qint64 len = qMin(m_inLen - m_inPos, m_fileSize - m_fileGot);
+                        if(m_file.write(begin, len) != len)
+                        {
+                            setError("Can't write destination file " + m_file.fileName());
+                            setChannelState(ChannelState::Close);
+                            break;
+                        }
+                        m_inPos += len;
+                        m_fileGot += len;
+                        m_got += len;
+                        emitProgress(false);
+                        break;
+                    }
+
+                    case Status:
+                    {
+                        if(*begin != 0)
+                        {
+                            /* Remote failed while reading the file, the status is a message line */
+                            m_afterData = true;
+                            m_step = Line;
+                            break;
+                        }
+                        m_inPos++;
+                        m_afterAck = Line;
+                        m_step = SendAck;
+                        break;
+                    }
+
+                    case SendAck:
+                        break;
+                }
+            }
+        }
+
+        FALLTHROUGH; case Close:
+        {
+            if(m_file.isOpen())
+            {
+                /* Partial file */
+                m_file.close();
+                m_file.remove();
+            }
+            qCDebug(logscpbatchget) << m_name << "closeChannel";
+            int ret = sshTransport()->channel_close(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::WaitClose);
+        }
+
+        FALLTHROUGH; case WaitClose:
+        {
+            qCDebug(logscpbatchget) << "Wait close channel:" << m_name;
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_wait_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::Freeing);
+        }
+
+        FALLTHROUGH; case Freeing:
+        {
+            qCDebug(logscpbatchget) << "free Channel:" << m_name;
+
+            int ret = sshTransport()->channel_free(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to free channel: %1").arg(sshErrorToString(ret)));
+            }
+            if(m_error)
+            {
+                setChannelState(ChannelState::Error);
+            }
+            else
+            {
+                setChannelState(ChannelState::Free);
+            }
+            m_sshChannel = nullptr;
+            QObject::disconnect(m_sshClient, &SshClient::sshDataReceived, this, &SshScpBatchGet::sshDataReceived);
+            return;
+        }
+
+        case Free:
+        {
+            qCDebug(logscpbatchget) << "Channel" << m_name << "is free";
+            return;
+        }
+
+        case Error:
+        {
+            qCDebug(logscpbatchget) << "Channel" << m_name << "is in error state";
+            setChannelState(ChannelState::Free);
+            return;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "sshchannel.h"
+#include "sshscpdefaults.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+Q_DECLARE_LOGGING_CATEGORY(logscpbatchget)
+
+/*
+ * Receive many files and directories (like scp -r) through a single remote
+ * "scp -f" process, speaking the scp protocol directly on the channel.
+ * Modes are applied, times are not preserved.
+ */
+class SshScpBatchGet : public SshChannel
+{
+    Q_OBJECT
+
+protected:
+    SshScpBatchGet(const QString &name, SshClient *client);
+    friend class SshClient;
+
+public:
+    virtual ~SshScpBatchGet() override;
+    void close() override;
+    void setBufferSize(int size);
+    void setProgressInterval(int msec, qint64 bytes = 0);
+    QStringList errMsg() const;
+
+public slots:
+    void get(const QStringList &sources, const QString &dest);
+    void sshDataReceived() override;
+
+private:
+    enum Step {
+        SendAck,
+        Line,
+        Data,
+        Status
+    };
+
+    QStringList m_sources;
+    QString m_dest;
+    bool m_destIsDir {false};
+    struct Dir {
+        QString path;
+        int mode;
+    };
+    QList<Dir> m_dirs;
+    Step m_step {SendAck};
+    Step m_afterAck {Line};
+    QByteArray m_line;
+    LIBSSH2_CHANNEL *m_sshChannel {nullptr};
+    bool m_error {false};
+    bool m_warning {false};
+    bool m_afterData {false};
+    QStringList m_errMsg;
+    QFile m_file;
+    QByteArray m_buffer;
+    int m_bufferSize {SCP_BUFFER_SIZE};
+    qint64 m_inPos {0};
+    qint64 m_inLen {0};
+    qint64 m_fileSize {0};
+    qint64 m_fileGot {0};
+    qint64 m_got {0};
+    qint64 m_total {0};
+    int m_progressInterval {SCP_PROGRESS_INTERVAL};
+    qint64 m_progressBytes {0};
+    qint64 m_progressLastBytes {0};
+    qint64 m_progressLastTime {0};
+    QElapsedTimer m_elapsed;
+
+    bool processLine();
+    void emitProgress(bool force);
+    void setError(const QString &msg);
+
+signals:
+    void fileReceived(const QString &path);
+    void finished();
+    void failed();
+    void progress(qint64 rx, qint64 total, qint64 rate);
+};
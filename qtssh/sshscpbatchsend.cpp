@@ -0,0 +1,431 @@
+#include "sshscpbatchsend.h"
+#include "sshclient.h"
+#include "sshfileutils.h"
+#include <QDir>
+
+Q_LOGGING_CATEGORY(logscpbatchsend, "ssh.scpbatchsend", QtWarningMsg)
+
+using SshFileUtils::shellQuote;
+using SshFileUtils::fileMode;
+
+SshScpBatchSend::SshScpBatchSend(const QString &name, SshClient *client):
+    SshChannel(name, client)
+{
+}
+
+SshScpBatchSend::~SshScpBatchSend()
+{
+    qCDebug(logscpbatchsend) << "free Channel:" << m_name;
+}
+
+void SshScpBatchSend::close()
+{
+    m_keepOpen = false;
+    m_entries.clear();
+    if(channelState() == ChannelState::Ready && m_step == Header)
+    {
+        /* Idle between two files, end the remote scp cleanly */
+        sshDataReceived();
+        return;
+    }
+    setChannelState(ChannelState::Close);
+    sshDataReceived();
+}
+
+void SshScpBatchSend::setKeepOpen(bool keepOpen)
+{
+    m_keepOpen = keepOpen;
+}
+
+void SshScpBatchSend::setBufferSize(int size)
+{
+    m_bufferSize = qMax(size, 1);
+}
+
+/* Progress is emitted at most every msec, or every bytes if not 0 */
+void SshScpBatchSend::setProgressInterval(int msec, qint64 bytes)
+{
+    m_progressInterval = msec;
+    m_progressBytes = bytes;
+}
+
+void SshScpBatchSend::emitProgress(bool force)
+{
+    qint64 now = m_elapsed.elapsed();
+    if(!force
+       && (now - m_progressLastTime) < m_progressInterval
+       && (m_progressBytes == 0 || (m_sent - m_progressLastBytes) < m_progressBytes))
+    {
+        return;
+    }
+    m_progressLastTime = now;
+    m_progressLastBytes = m_sent;
+    /* Average throughput in bytes per second since the transfer started */
+    qint64 rate = (now > 0)?(m_sent * 1000 / now):(0);
+    emit progress(m_sent, m_total, rate);
+}
+
+QStringList SshScpBatchSend::errMsg() const
+{
+    return m_errMsg;
+}
+
+void SshScpBatchSend::send(const QStringList &sources, const QString &dest)
+{
+    m_dest = dest;
+    for(const QString &source: sources)
+    {
+        enqueue(QFileInfo(source));
+    }
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+void SshScpBatchSend::append(const QStringList &sources)
+{
+    for(const QString &source: sources)
+    {
+        enqueue(QFileInfo(source));
+    }
+    if(channelState() == ChannelState::Ready)
+    {
+        sshDataReceived();
+    }
+}
+
+void SshScpBatchSend::enqueue(const QFileInfo &info)
+{
+    if(info.isDir())
+    {
+        m_entries.enqueue({Entry::Directory, info.filePath(), QFile::encodeName(info.fileName()), 0, fileMode(info)});
+        QDir dir(info.filePath());
+        for(const QFileInfo &child: dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot, QDir::Name))
+        {
+            enqueue(child);
+        }
+        m_entries.enqueue({Entry::End, QString(), QByteArray(), 0, 0});
+    }
+    else
+    {
+        m_entries.enqueue({Entry::File, info.filePath(), QFile::encodeName(info.fileName()), info.size(), fileMode(info)});
+        m_total += info.size();
+    }
+    m_pending = true;
+}
+
+void SshScpBatchSend::setError(const QString &msg)
+{
+    qCWarning(logscpbatchsend) << m_name << msg;
+    m_errMsg << msg;
+    if(!m_error)
+    {
+        m_error = true;
+        emit failed();
+    }
+}
+
+void SshScpBatchSend::sshDataReceived()
+{
+    qCDebug(logscpbatchsend) << "Channel "<< m_name << "State:" << channelState();
+    switch(channelState())
+    {
+        case Openning:
+        {
+            if ( ! m_sshClient->takeChannelCreationMutex(this) )
+            {
+                return;
+            }
+            m_sshChannel = sshTransport()->channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
+            m_sshClient->releaseChannelCreationMutex(this);
+            if (m_sshChannel == nullptr)
+            {
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                if(ret == LIBSSH2_ERROR_EAGAIN)
+                {
+                    return;
+                }
+                setError(QString("Channel session open failed: %1").arg(ret));
+                setChannelState(ChannelState::Error);
+                return;
+            }
+            qCDebug(logscpbatchsend) << "Channel session opened";
+            setChannelState(ChannelState::Exec);
+        }
+
+        FALLTHROUGH; case Exec:
+        {
+            /* Remote destination must be a directory when several entries are sent */
+            QString cmd = QString("scp -r %1-t %2").arg((m_keepOpen || m_entries.size() > 1)?("-d "):("")).arg(shellQuote(m_dest));
+            int ret = sshTransport()->channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, cmd.toStdString().c_str(), static_cast<unsigned int>(cmd.toStdString().size()));
+            if (ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret != 0)
+            {
+                setError(QString("Failed to run remote scp: %1").arg(sshErrorToString(ret)));
+                setChannelState(ChannelState::Close);
+                sshDataReceived();
+                return;
+            }
+            m_buffer.resize(m_bufferSize);
+            m_elapsed.start();
+            /* Remote scp starts by acknowledging */
+            m_step = WaitAck;
+            m_afterAck = Header;
+            setChannelState(ChannelState::Ready);
+            /* OK, next step */
+        }
+
+        FALLTHROUGH; case Ready:
+        {
+            while(channelState() == ChannelState::Ready)
+            {
+                switch(m_step)
+                {
+                    case WaitAck:
+                    {
+                        char c;
+                        ssize_t retsz = sshTransport()->channel_read_ex(m_sshChannel, 0, &c, 1);
+                        if(retsz == LIBSSH2_ERROR_EAGAIN)
+                        {
+                            return;
+                        }
+                        if(retsz == 0 && sshTransport()->channel_eof(m_sshChannel) != 1)
+                        {
+                            return;
+                        }
+                        if(retsz <= 0)
+                        {
+                            setError("Remote scp closed unexpectedly");
+                            setChannelState(ChannelState::Close);
+                            break;
+                        }
+                        if(m_ackCode < 0)
+                        {
+                            if(c == 0)
+                            {
+                                m_step = m_afterAck;
+                                break;
+                            }
+                            m_ackCode = c;
+                            m_ackMsg.clear();
+                        }
+                        else if(c != '\n')
+                        {
+                            m_ackMsg.append(c);
+                        }
+                        else
+                        {
+                            /* Any refusal breaks the directory nesting, stop the batch */
+                            setError(QString("Remote scp error: %1").arg(QString::fromUtf8(m_ackMsg)));
+                            m_ackCode = -1;
+                            setChannelState(ChannelState::Close);
+                        }
+                        break;
+                    }
+
+                    case Header:
+                    {
+                        if(m_entries.isEmpty())
+                        {
+                            if(m_pending)
+                            {
+                                m_pending = false;
+                                emitProgress(true);
+                                emit finished();
+                            }
+                            if(m_keepOpen)
+                            {
+                                /* Keep the remote scp hot, wait for append() or close() */
+                                return;
+                            }
+                            m_step = Eof;
+                            break;
+                        }
+                        m_current = m_entries.dequeue();
+                        switch(m_current.type)
+                        {
+                            case Entry::File:
+                                m_file.setFileName(m_current.path);
+                                if(!m_file.open(QIODevice::ReadOnly))
+                                {
+                                    setError("Can't open source file " + m_current.path);
+                                    setChannelState(ChannelState::Close);
+                                    break;
+                                }
+                                m_out = "C" + QByteArray::number(m_current.mode, 8).rightJustified(4, '0') + " " + QByteArray::number(m_current.size) + " " + m_current.name + "\n";
+                                m_fileSent = 0;
+                                m_dataInBuf = 0;
+                                m_offset = 0;
+                                m_afterAck = Data;
+                                break;
+                            case Entry::Directory:
+                                m_out = "D" + QByteArray::number(m_current.mode, 8).rightJustified(4, '0') + " 0 " + m_current.name + "\n";
+                                m_afterAck = Header;
+                                break;
+                            case Entry::End:
+                                m_out = "E\n";
+                                m_afterAck = Header;
+                                break;
+                        }
+                        m_outPos = 0;
+                        m_step = Write;
+                        break;
+                    }
+
+                    case Write:
+                    {
+                        ssize_t retsz = sshTransport()->channel_write_ex(m_sshChannel, 0, m_out.constData() + m_outPos, static_cast<size_t>(m_out.size() - m_outPos));
+                        if(retsz == LIBSSH2_ERROR_EAGAIN)
+                        {
+                            return;
+                        }
+                        if(retsz < 0)
+                        {
+                            setError(QString("Can't write header (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                            setChannelState(ChannelState::Close);
+                            break;
+                        }
+                        m_outPos += retsz;
+                        if(m_outPos == m_out.size())
+                        {
+                            m_step = WaitAck;
+                        }
+                        break;
+                    }
+
+                    case Data:
+                    {
+                        if(m_dataInBuf == 0)
+                        {
+                            qint64 want = qMin<qint64>(m_buffer.size(), m_current.size - m_fileSent);
+                            if(want == 0)
+                            {
+                                /* File done, close it with a status byte */
+                                m_file.close();
+                                emit fileSent(m_current.path);
+                                m_out = QByteArray(1, '\0');
+                                m_outPos = 0;
+                                m_afterAck = Header;
+                                m_step = Write;
+                                break;
+                            }
+                            m_dataInBuf = m_file.read(m_buffer.data(), want);
+                            if(m_dataInBuf <= 0)
+                            {
+                                /* The announced size can't be honoured anymore */
+                                setError("Can't read source file " + m_current.path);
+                                setChannelState(ChannelState::Close);
+                                break;
+                            }
+                            m_offset = 0;
+                        }
+
+                        ssize_t retsz = sshTransport()->channel_write_ex(m_sshChannel, 0, m_buffer.constData() + m_offset, static_cast<size_t>(m_dataInBuf - m_offset));
+                        if(retsz == LIBSSH2_ERROR_EAGAIN)
+                        {
+                            return;
+                        }
+                        if(retsz < 0)
+                        {
+                            setError(QString("Can't write data (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                            setChannelState(ChannelState::Close);
+                            break;
+                        }
+                        m_offset += retsz;
+                        m_fileSent += retsz;
+                        m_sent += retsz;
+                        if(m_offset == m_dataInBuf)
+                        {
+                            m_dataInBuf = 0;
+                        }
+                        emitProgress(false);
+                        break;
+                    }
+
+                    case Eof:
+                    {
+                        int ret = sshTransport()->channel_send_eof(m_sshChannel);
+                        if(ret == LIBSSH2_ERROR_EAGAIN)
+                        {
+                            return;
+                        }
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                }
+            }
+        }
+
+        FALLTHROUGH; case Close:
+        {
+            m_file.close();
+            qCDebug(logscpbatchsend) << m_name << "closeChannel";
+            int ret = sshTransport()->channel_close(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::WaitClose);
+        }
+
+        FALLTHROUGH; case WaitClose:
+        {
+            qCDebug(logscpbatchsend) << "Wait close channel:" << m_name;
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_wait_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::Freeing);
+        }
+
+        FALLTHROUGH; case Freeing:
+        {
+            qCDebug(logscpbatchsend) << "free Channel:" << m_name;
+
+            int ret = sshTransport()->channel_free(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to free channel: %1").arg(sshErrorToString(ret)));
+            }
+            if(m_error)
+            {
+                setChannelState(ChannelState::Error);
+            }
+            else
+            {
+                setChannelState(ChannelState::Free);
+            }
+            m_sshChannel = nullptr;
+            QObject::disconnect(m_sshClient, &SshClient::sshDataReceived, this, &SshScpBatchSend::sshDataReceived);
+            return;
+        }
+
+        case Free:
+        {
+            qCDebug(logscpbatchsend) << "Channel" << m_name << "is free";
+            return;
+        }
+
+        case Error:
+        {
+            qCDebug(logscpbatchsend) << "Channel" << m_name << "is in error state";
+            setChannelState(ChannelState::Free);
+            return;
+        }
+    }
+}
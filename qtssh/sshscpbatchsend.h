@@ -0,0 +1,95 @@
+#pragma once
+
+#include "sshchannel.h"
+#include "sshscpdefaults.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QQueue>
+
+Q_DECLARE_LOGGING_CATEGORY(logscpbatchsend)
+
+/*
+ * Send many files and directories (like scp -r) through a single remote
+ * "scp -t" process, speaking the scp protocol directly on the channel.
+ * With keepOpen, the channel stays ready after the queue is drained and
+ * append() can push more sources without a new channel.
+ * Modes are sent (the remote sink applies them), times are not.
+ */
+class SshScpBatchSend : public SshChannel
+{
+    Q_OBJECT
+
+protected:
+    SshScpBatchSend(const QString &name, SshClient *client);
+    friend class SshClient;
+
+public:
+    virtual ~SshScpBatchSend() override;
+    void close() override;
+    void setKeepOpen(bool keepOpen);
+    void setBufferSize(int size);
+    void setProgressInterval(int msec, qint64 bytes = 0);
+    QStringList errMsg() const;
+
+public slots:
+    void send(const QStringList &sources, const QString &dest);
+    void append(const QStringList &sources);
+    void sshDataReceived() override;
+
+private:
+    struct Entry {
+        enum Type {File, Directory, End};
+        Type type;
+        QString path;
+        QByteArray name;
+        qint64 size;
+        int mode;
+    };
+
+    enum Step {
+        WaitAck,
+        Header,
+        Write,
+        Data,
+        Eof
+    };
+
+    QString m_dest;
+    QQueue<Entry> m_entries;
+    Entry m_current;
+    Step m_step {WaitAck};
+    Step m_afterAck {Header};
+    int m_ackCode {-1};
+    QByteArray m_ackMsg;
+    QByteArray m_out;
+    qint64 m_outPos {0};
+    LIBSSH2_CHANNEL *m_sshChannel {nullptr};
+    bool m_error {false};
+    bool m_keepOpen {false};
+    bool m_pending {false};
+    QStringList m_errMsg;
+    QFile m_file;
+    QByteArray m_buffer;
+    int m_bufferSize {SCP_BUFFER_SIZE};
+    qint64 m_dataInBuf {0};
+    qint64 m_offset {0};
+    qint64 m_fileSent {0};
+    qint64 m_sent {0};
+    qint64 m_total {0};
+    int m_progressInterval {SCP_PROGRESS_INTERVAL};
+    qint64 m_progressBytes {0};
+    qint64 m_progressLastBytes {0};
+    qint64 m_progressLastTime {0};
+    QElapsedTimer m_elapsed;
+
+    void enqueue(const QFileInfo &info);
+    void emitProgress(bool force);
+    void setError(const QString &msg);
+
+signals:
+    void fileSent(const QString &path);
+    void finished();
+    void failed();
+    void progress(qint64 tx, qint64 total, qint64 rate);
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+/* Build-time defaults of the SCP channels, each one can be overridden */
+
+#ifndef SCP_BUFFER_SIZE
+/* Default size of the SCP transfer buffer */
+#define SCP_BUFFER_SIZE (256*1024)
+#endif
+
+#ifndef SCP_PROGRESS_INTERVAL
+/* Default minimum delay between two progress signals (ms) */
+#define SCP_PROGRESS_INTERVAL 100
+#endif
@@ -3,14 +3,11 @@
 #include <QFileInfo>
 #include <qdebug.h>
 
-#ifndef PAGE_SIZE
-#define PAGE_SIZE (4*1024)
-#endif
-
 Q_LOGGING_CATEGORY(logscpget, "ssh.scpget", QtWarningMsg)
 
 SshScpGet::SshScpGet(const QString &name, SshClient *client):
     SshChannel(name, client)
+    , m_map(&m_file)
 {
 }
 
@@ -26,14 +23,74 @@ void SshScpGet::close()
 }
 
 
+void SshScpGet::setMappedIO(bool mapped)
+{
+    m_mappedIO = mapped;
+}
+
+void SshScpGet::setBufferSize(int size)
+{
+    m_bufferSize = qMax(size, 1);
+}
+
+/* Progress is emitted at most every msec, or every bytes if not 0 */
+void SshScpGet::setProgressInterval(int msec, qint64 bytes)
+{
+    m_progressInterval = msec;
+    m_progressBytes = bytes;
+}
+
+void SshScpGet::emitProgress(bool force)
+{
+    qint64 now = m_elapsed.elapsed();
+    if(!force
+       && (now - m_progressLastTime) < m_progressInterval
+       && (m_progressBytes == 0 || (m_got - m_progressLastBytes) < m_progressBytes))
+    {
+        return;
+    }
+    m_progressLastTime = now;
+    m_progressLastBytes = m_got;
+    /* Average throughput in bytes per second since the transfer started */
+    qint64 rate = (now > 0)?(m_got * 1000 / now):(0);
+    emit progress(m_got, m_fileinfo.st_size, rate);
+}
+
+QByteArray SshScpGet::data() const
+{
+    return m_data.data();
+}
+
 void SshScpGet::get(const QString &source, const QString &dest)
 {
     m_source = source;
     m_dest = dest;
+    m_file.setFileName(dest);
+    m_device = &m_file;
+    m_mapped = m_mappedIO;
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+
+/* Stream the remote file in the device, it is opened write only if needed */
+void SshScpGet::getDevice(const QString &source, QIODevice *dest)
+{
+    m_source = source;
+    m_dest.clear();
+    m_device = dest;
+    m_mapped = false;
     setChannelState(ChannelState::Openning);
     sshDataReceived();
 }
 
+/* Receive the remote file in memory, available with data() once finished */
+void SshScpGet::getData(const QString &source)
+{
+    m_data.close();
+    m_data.setData(QByteArray());
+    getDevice(source, &m_data);
+}
 
 void SshScpGet::sshDataReceived()
 {
@@ -46,11 +103,11 @@ void SshScpGet::sshDataReceived()
             {
                 return;
             }
-            m_sshChannel = libssh2_scp_recv2(m_sshClient->session(), qPrintable(m_source), &m_fileinfo);
+            m_sshChannel = sshTransport()->scp_recv2(m_sshClient->session(), qPrintable(m_source), &m_fileinfo);
             m_sshClient->releaseChannelCreationMutex(this);
             if (m_sshChannel == nullptr)
             {
-                int ret = libssh2_session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -70,8 +127,13 @@ void SshScpGet::sshDataReceived()
 
         FALLTHROUGH; case Exec:
         {
-            m_file.setFileName(m_dest);
-            if(!m_file.open(QIODevice::WriteOnly))
+            /* Mapped destination is preallocated to the announced size, mapping needs read access */
+            m_mapped = m_mapped && m_device == &m_file && m_fileinfo.st_size > 0;
+            if(!m_device->isOpen())
+            {
+                m_opened = m_device->open((m_mapped)?(QIODevice::ReadWrite | QIODevice::Truncate):(QIODevice::WriteOnly));
+            }
+            if(!m_device->isOpen())
             {
                 if(!m_error)
                 {
@@ -84,6 +146,14 @@ void SshScpGet::sshDataReceived()
                 return;
             }
 
+            if(m_mapped && !m_file.resize(m_fileinfo.st_size))
+            {
+                m_mapped = false;
+            }
+
+            m_buffer.resize(m_bufferSize);
+            m_elapsed.start();
+
             setChannelState(ChannelState::Ready);
             /* OK, next step */
         }
@@ -92,15 +162,31 @@ void SshScpGet::sshDataReceived()
         {
             while(m_got < m_fileinfo.st_size)
             {
-                char mem[PAGE_SIZE];
-                int amount=sizeof(mem);
+                char *data = m_buffer.data();
+                qint64 amount = m_buffer.size();
+
+                if(m_mapped)
+                {
+                    /* libssh2 writes directly in the mapped destination */
+                    data = m_map.data(m_got, amount);
+                    if(data == nullptr)
+                    {
+                        qCDebug(logscpget) << "Can't map destination file, fallback to buffered write";
+                        m_mapped = false;
+                        m_map.unmap();
+                        m_file.seek(m_got);
+                        data = m_buffer.data();
+                        amount = m_buffer.size();
+                    }
+                    amount = qMin<qint64>(amount, SSH_MAP_CHUNK);
+                }
 
                 if((m_fileinfo.st_size - m_got) < amount) {
-                    amount = static_cast<int>(m_fileinfo.st_size - m_got);
+                    amount = m_fileinfo.st_size - m_got;
                 }
 
 
-                ssize_t retsz = libssh2_channel_read_ex(m_sshChannel, 0, mem, static_cast<size_t>(amount));
+                ssize_t retsz = sshTransport()->channel_read_ex(m_sshChannel, 0, data, static_cast<size_t>(amount));
                 if(retsz == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -119,20 +205,32 @@ void SshScpGet::sshDataReceived()
                     return;
                 }
 
-                m_file.write(mem, retsz);
+                if(!m_mapped)
+                {
+                    m_device->write(data, retsz);
+                }
                 m_got += retsz;
-                emit progress(m_got, m_fileinfo.st_size);
+                emitProgress(false);
             }
+            emitProgress(true);
             setChannelState(ChannelState::Close);
         }
 
         FALLTHROUGH; case Close:
         {
-            m_file.close();
+            m_map.unmap();
+            if(m_opened)
+            {
+                m_device->close();
+                m_opened = false;
+            }
             if(m_got != m_fileinfo.st_size)
             {
                 qCDebug(logscpget) << m_name << "Transfer not completed";
-                m_file.remove();
+                if(m_device == &m_file)
+                {
+                    m_file.remove();
+                }
                 emit failed();
             }
             else
@@ -141,7 +239,7 @@ void SshScpGet::sshDataReceived()
             }
 
             qCDebug(logscpget) << m_name << "closeChannel";
-            int ret = libssh2_channel_close(m_sshChannel);
+            int ret = sshTransport()->channel_close(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -161,7 +259,7 @@ void SshScpGet::sshDataReceived()
         FALLTHROUGH; case WaitClose:
         {
             qCDebug(logscpget) << "Wait close channel:" << m_name;
-            int ret = libssh2_channel_wait_closed(m_sshChannel);
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -182,7 +280,7 @@ void SshScpGet::sshDataReceived()
         {
             qCDebug(logscpget) << "free Channel:" << m_name;
 
-            int ret = libssh2_channel_free(m_sshChannel);
+            int ret = sshTransport()->channel_free(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "sshchannel.h"
+#include "sshscpdefaults.h"
+#include "sshmappedfile.h"
 #include <QFile>
+#include <QBuffer>
+#include <QElapsedTimer>
 
 Q_DECLARE_LOGGING_CATEGORY(logscpget)
 
@@ -16,11 +20,16 @@ protected:
 public:
     virtual ~SshScpGet() override;
     void close() override;
-
+    void setMappedIO(bool mapped);
+    QByteArray data() const;
+    void setBufferSize(int size);
+    void setProgressInterval(int msec, qint64 bytes = 0);
 
 
 public slots:
     void get(const QString &source, const QString &dest);
+    void getDevice(const QString &source, QIODevice *dest);
+    void getData(const QString &source);
     void sshDataReceived() override;
 
 private:
@@ -31,9 +40,25 @@ private:
     LIBSSH2_CHANNEL *m_sshChannel {nullptr};
     bool m_error {false};
     QFile m_file;
+    QBuffer m_data;
+    QIODevice *m_device {nullptr};
+    bool m_opened {false};
+    SshMappedFile m_map;
+    /* Setting of the user, m_mapped is the mode of the current transfer */
+    bool m_mappedIO {false};
+    bool m_mapped {false};
+    QByteArray m_buffer;
+    int m_bufferSize {SCP_BUFFER_SIZE};
+    int m_progressInterval {SCP_PROGRESS_INTERVAL};
+    qint64 m_progressBytes {0};
+    qint64 m_progressLastBytes {0};
+    qint64 m_progressLastTime {0};
+    QElapsedTimer m_elapsed;
+
+    void emitProgress(bool force);
 
 signals:
     void finished();
     void failed();
-    void progress(qint64 tx, qint64 total);
+    void progress(qint64 tx, qint64 total, qint64 rate);
 };
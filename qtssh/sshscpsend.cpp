@@ -8,6 +8,7 @@ Q_LOGGING_CATEGORY(logscpsend, "ssh.scpsend", QtWarningMsg)
 
 SshScpSend::SshScpSend(const QString &name, SshClient *client):
     SshChannel(name, client)
+    , m_map(&m_file)
 {
 }
 
@@ -23,14 +24,74 @@ void SshScpSend::close()
 }
 
 
+void SshScpSend::setMappedIO(bool mapped)
+{
+    m_mappedIO = mapped;
+}
+
+void SshScpSend::setBufferSize(int size)
+{
+    m_bufferSize = qMax(size, 1);
+}
+
+/* Progress is emitted at most every msec, or every bytes if not 0 */
+void SshScpSend::setProgressInterval(int msec, qint64 bytes)
+{
+    m_progressInterval = msec;
+    m_progressBytes = bytes;
+}
+
+void SshScpSend::emitProgress(bool force)
+{
+    qint64 now = m_elapsed.elapsed();
+    if(!force
+       && (now - m_progressLastTime) < m_progressInterval
+       && (m_progressBytes == 0 || (m_sent - m_progressLastBytes) < m_progressBytes))
+    {
+        return;
+    }
+    m_progressLastTime = now;
+    m_progressLastBytes = m_sent;
+    /* Average throughput in bytes per second since the transfer started */
+    qint64 rate = (now > 0)?(m_sent * 1000 / now):(0);
+    emit progress(m_sent, m_size, rate);
+}
+
 void SshScpSend::send(const QString &source, QString dest)
 {
+    struct stat fileinfo = {};
+    stat(source.toStdString().c_str(), &fileinfo);
     m_source = source;
     m_dest = dest;
+    m_size = fileinfo.st_size;
+    m_mode = fileinfo.st_mode & 0777;
+    m_file.setFileName(source);
+    m_device = &m_file;
+    m_mapped = m_mappedIO;
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+/* Stream size bytes from the device current position, it is opened read only if needed */
+void SshScpSend::sendDevice(QIODevice *source, qint64 size, const QString &dest, int mode)
+{
+    m_source.clear();
+    m_dest = dest;
+    m_size = size;
+    m_mode = mode & 0777;
+    m_device = source;
+    m_mapped = false;
     setChannelState(ChannelState::Openning);
     sshDataReceived();
 }
 
+void SshScpSend::sendData(const QByteArray &data, const QString &dest, int mode)
+{
+    m_data.close();
+    m_data.setData(data);
+    sendDevice(&m_data, data.size(), dest, mode);
+}
+
 void SshScpSend::sshDataReceived()
 {
     qCDebug(logscpsend) << "Channel "<< m_name << "State:" << channelState();
@@ -38,16 +99,15 @@ void SshScpSend::sshDataReceived()
     {
         case Openning:
         {
-            stat(m_source.toStdString().c_str(), &m_fileinfo);
             if ( ! m_sshClient->takeChannelCreationMutex(this) )
             {
                 return;
             }
-            m_sshChannel = libssh2_scp_send64(m_sshClient->session(), m_dest.toStdString().c_str(), m_fileinfo.st_mode & 0777, m_fileinfo.st_size, 0, 0);
+            m_sshChannel = sshTransport()->scp_send64(m_sshClient->session(), m_dest.toStdString().c_str(), m_mode, m_size, 0, 0);
             m_sshClient->releaseChannelCreationMutex(this);
             if (m_sshChannel == nullptr)
             {
-                int ret = libssh2_session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -67,8 +127,11 @@ void SshScpSend::sshDataReceived()
 
         FALLTHROUGH; case Exec:
         {
-            m_file.setFileName(m_source);
-            if(!m_file.open(QIODevice::ReadOnly))
+            if(!m_device->isOpen())
+            {
+                m_opened = m_device->open(QIODevice::ReadOnly);
+            }
+            if(!m_device->isOpen())
             {
                 if(!m_error)
                 {
@@ -81,20 +144,50 @@ void SshScpSend::sshDataReceived()
                 return;
             }
 
+            if(!m_mapped)
+            {
+                m_buffer.resize(m_bufferSize);
+            }
+            m_elapsed.start();
+
             setChannelState(ChannelState::Ready);
             /* OK, next step */
         }
 
         FALLTHROUGH; case Ready:
         {
-            while(!m_file.atEnd())
+            while(m_sent < m_size)
             {
-                if(m_dataInBuf == 0)
+                const char *data = m_buffer.constData() + m_offset;
+                qint64 len = m_dataInBuf - m_offset;
+                if(m_mapped)
                 {
-                    m_dataInBuf = m_file.read(m_buffer, PAGE_SIZE);
+                    /* Hand the file pages directly to libssh2 */
+                    data = m_map.data(m_sent, len);
+                    if(data == nullptr)
+                    {
+                        qCDebug(logscpsend) << "Can't map source file, fallback to buffered read";
+                        m_mapped = false;
+                        m_map.unmap();
+                        m_file.seek(m_sent);
+                        m_buffer.resize(m_bufferSize);
+                        continue;
+                    }
+                    len = qMin<qint64>(len, SSH_MAP_CHUNK);
+                }
+                else if(m_dataInBuf == 0)
+                {
+                    m_dataInBuf = m_device->read(m_buffer.data(), qMin<qint64>(m_buffer.size(), m_size - m_sent));
+                    if(m_dataInBuf <= 0)
+                    {
+                        m_dataInBuf = 0;
+                        break;
+                    }
+                    data = m_buffer.constData();
+                    len = m_dataInBuf;
                 }
 
-                ssize_t retsz = libssh2_channel_write_ex(m_sshChannel, 0, m_buffer + m_offset, static_cast<size_t>(m_dataInBuf - m_offset));
+                ssize_t retsz = sshTransport()->channel_write_ex(m_sshChannel, 0, data, static_cast<size_t>(len));
                 if(retsz == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -114,21 +207,30 @@ void SshScpSend::sshDataReceived()
                 }
 
                 m_sent += retsz;
-                m_offset += retsz;
-                if(m_offset == m_dataInBuf)
+                if(!m_mapped)
                 {
-                    m_dataInBuf = 0;
-                    m_offset = 0;
+                    m_offset += retsz;
+                    if(m_offset == m_dataInBuf)
+                    {
+                        m_dataInBuf = 0;
+                        m_offset = 0;
+                    }
                 }
-                emit progress(m_sent, m_file.size());
+                emitProgress(false);
             }
+            emitProgress(true);
             setChannelState(ChannelState::Close);
         }
 
         FALLTHROUGH; case Close:
         {
-            m_file.close();
-            if(m_sent != m_file.size())
+            m_map.unmap();
+            if(m_opened)
+            {
+                m_device->close();
+                m_opened = false;
+            }
+            if(m_sent != m_size)
             {
                 qCDebug(logscpsend) << m_name << "Transfer not completed";
                 emit failed();
@@ -139,7 +241,7 @@ void SshScpSend::sshDataReceived()
             }
 
             qCDebug(logscpsend) << m_name << "closeChannel";
-            int ret = libssh2_channel_close(m_sshChannel);
+            int ret = sshTransport()->channel_close(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -159,7 +261,7 @@ void SshScpSend::sshDataReceived()
         FALLTHROUGH; case WaitClose:
         {
             qCDebug(logscpsend) << "Wait close channel:" << m_name;
-            int ret = libssh2_channel_wait_closed(m_sshChannel);
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -180,7 +282,7 @@ void SshScpSend::sshDataReceived()
         {
             qCDebug(logscpsend) << "free Channel:" << m_name;
 
-            int ret = libssh2_channel_free(m_sshChannel);
+            int ret = sshTransport()->channel_free(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -1,11 +1,11 @@
 #pragma once
 
 #include "sshchannel.h"
+#include "sshscpdefaults.h"
+#include "sshmappedfile.h"
 #include <QFile>
-
-#if !defined(PAGE_SIZE)
-#define PAGE_SIZE (4*1024)
-#endif
+#include <QBuffer>
+#include <QElapsedTimer>
 
 Q_DECLARE_LOGGING_CATEGORY(logscpsend)
 
@@ -20,26 +20,47 @@ protected:
 public:
     virtual ~SshScpSend() override;
     void close() override;
+    void setMappedIO(bool mapped);
+    void setBufferSize(int size);
+    void setProgressInterval(int msec, qint64 bytes = 0);
 
 public slots:
     void send(const QString &source, QString dest);
+    void sendDevice(QIODevice *source, qint64 size, const QString &dest, int mode = 0644);
+    void sendData(const QByteArray &data, const QString &dest, int mode = 0644);
     void sshDataReceived() override;
 
 
 private:
     QString m_source;
     QString m_dest;
-    struct stat m_fileinfo = {};
+    qint64 m_size {0};
+    int m_mode {0644};
     libssh2_struct_stat_size m_sent = 0;
     LIBSSH2_CHANNEL *m_sshChannel {nullptr};
     bool m_error {false};
     QFile m_file;
-    char m_buffer[PAGE_SIZE];
+    QBuffer m_data;
+    QIODevice *m_device {nullptr};
+    bool m_opened {false};
+    QByteArray m_buffer;
+    int m_bufferSize {SCP_BUFFER_SIZE};
+    int m_progressInterval {SCP_PROGRESS_INTERVAL};
+    qint64 m_progressBytes {0};
+    qint64 m_progressLastBytes {0};
+    qint64 m_progressLastTime {0};
+    QElapsedTimer m_elapsed;
     qint64 m_dataInBuf {0};
     qint64 m_offset {0};
+    SshMappedFile m_map;
+    /* Setting of the user, m_mapped is the mode of the current transfer */
+    bool m_mappedIO {false};
+    bool m_mapped {false};
+
+    void emitProgress(bool force);
 
 signals:
     void finished();
     void failed();
-    void progress(qint64 tx, qint64 total);
+    void progress(qint64 tx, qint64 total, qint64 rate);
 };
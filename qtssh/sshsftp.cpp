@@ -3,6 +3,7 @@
 
 #include <QFile>
 #include <QFileInfo>
+#include <QBuffer>
 #include <QCryptographicHash>
 #include "sshsftpcommandsend.h"
 #include "sshsftpcommandget.h"
@@ -10,14 +11,27 @@
 #include "sshsftpcommandmkdir.h"
 #include "sshsftpcommandunlink.h"
 #include "sshsftpcommandfileinfo.h"
+#include "sshsftpcommandsetstat.h"
+#include "sshsftpcommandrename.h"
+#include "sshprocess.h"
 
 Q_LOGGING_CATEGORY(logsshsftp, "ssh.sftp", QtWarningMsg)
 
 #define DEBUGCH qCDebug(logsshsftp) << m_name
 
+static QString fileInfoKey(const QString &path)
+{
+    QString key(path);
+    while(key.size() > 1 && key.endsWith("/"))
+    {
+        key.chop(1);
+    }
+    return key;
+}
+
 SshSFtp::SshSFtp(const QString &name, SshClient *client):
     SshChannel(name, client)
-
+  , m_fileinfo(SFTP_FILEINFO_CACHE_SIZE)
 {
     QObject::connect(client, &SshClient::sshDataReceived, this, &SshSFtp::sshDataReceived, Qt::QueuedConnection);
     QObject::connect(this, &SshSFtp::sendEvent, this, &SshSFtp::_eventLoop, Qt::QueuedConnection);
@@ -39,9 +53,9 @@ void SshSFtp::close()
 }
 
 
-QString SshSFtp::send(const QString &source, QString dest)
+QString SshSFtp::send(const QString &source, QString dest, bool resume)
 {
-    DEBUGCH << "send(" << source << ", " << dest << ")";
+    DEBUGCH << "send(" << source << ", " << dest << ", " << resume << ")";
     QFileInfo src(source);
     if(dest.endsWith("/"))
     {
@@ -55,17 +69,59 @@ QString SshSFtp::send(const QString &source, QString dest)
     QString s(source);
     s.replace("qrc:/", ":/");
 
-    SshSftpCommandSend cmd(s,dest,*this);
-    if(processCmd(&cmd))
+    /* Resume from the remote partial file if it is a prefix of the source */
+    QString remote(dest);
+    qint64 offset = 0;
+    if(resume)
+    {
+        remote += SFTP_PART_SUFFIX;
+        invalidateFileInfo(remote);
+        LIBSSH2_SFTP_ATTRIBUTES fileinfo = getFileInfo(remote);
+        if(LIBSSH2_SFTP_S_ISREG(fileinfo.permissions) && fileinfo.filesize <= static_cast<libssh2_uint64_t>(QFileInfo(s).size()))
+        {
+            offset = static_cast<qint64>(fileinfo.filesize);
+        }
+    }
+
+    bool error = m_error;
+    bool ret = false;
+    bool retry = false;
+    do
+    {
+        SshSftpCommandSend cmd(s,remote,*this);
+        cmd.setResume(offset, m_resumeCheck);
+        ret = processCmd(&cmd);
+        m_digest = cmd.digest();
+        retry = (!ret && cmd.resumeFailed());
+        if(retry)
+        {
+            DEBUGCH << "send(" << source << ", " << dest << ") partial file differs, restart from 0";
+            m_error = error;
+            offset = 0;
+        }
+    } while(retry);
+    invalidateFileInfo(remote);
+
+    if(ret && resume)
+    {
+        invalidateFileInfo(dest);
+        if(isFile(dest))
+        {
+            unlink(dest);
+        }
+        ret = rename(remote, dest);
+    }
+
+    if(ret)
     {
         return dest;
     }
     return QString();
 }
 
-bool SshSFtp::get(const QString &source, QString dest, bool override)
+bool SshSFtp::get(const QString &source, QString dest, bool override, bool resume)
 {
-    DEBUGCH << "get(" << source << ", " << dest << ", " << override << ")";
+    DEBUGCH << "get(" << source << ", " << dest << ", " << override << ", " << resume << ")";
     QFileInfo src(source);
     if(dest.endsWith("/"))
     {
@@ -90,52 +146,162 @@ bool SshSFtp::get(const QString &source, QString dest, bool override)
         }
     }
 
-    SshSftpCommandGet cmd(fout, source, *this);
-    bool ret = processCmd(&cmd);
+    /* Resume from the local partial file if it is not bigger than the source */
+    qint64 offset = 0;
+    if(resume)
+    {
+        fout.setFileName(dest + SFTP_PART_SUFFIX);
+        if(fout.exists())
+        {
+            invalidateFileInfo(source);
+            offset = fout.size();
+            if(static_cast<quint64>(offset) > filesize(source))
+            {
+                offset = 0;
+            }
+        }
+    }
+
+    bool error = m_error;
+    bool ret = false;
+    bool retry = false;
+    do
+    {
+        SshSftpCommandGet cmd(fout, source, *this);
+        cmd.setResume(offset, m_resumeCheck);
+        if(m_mappedIO)
+        {
+            cmd.setExpectedSize(static_cast<qint64>(filesize(source)));
+        }
+        ret = processCmd(&cmd);
+        m_digest = cmd.digest();
+        retry = (!ret && cmd.resumeFailed());
+        if(retry)
+        {
+            DEBUGCH << "get(" << source << ", " << dest << ") partial file differs, restart from 0";
+            m_error = error;
+            offset = 0;
+        }
+    } while(retry);
 
     if(!ret)
         return false;
 
-    /* Remove file if is the same that original */
-    if(dest != original)
+    if(resume)
     {
-        QCryptographicHash hash1( QCryptographicHash::Md5 );
-        QCryptographicHash hash2( QCryptographicHash::Md5 );
-        QFile f1( original );
-        if ( f1.open( QIODevice::ReadOnly ) ) {
-            hash1.addData( f1.readAll() );
-        }
-        QByteArray sig1 = hash1.result();
-        QFile f2( dest );
-        if ( f2.open( QIODevice::ReadOnly ) ) {
-            hash2.addData( f2.readAll() );
+        QFile::remove(dest);
+        if(!fout.rename(dest))
+        {
+            m_error = true;
+            m_errMsg << "Can't rename " + fout.fileName() + " to " + dest;
+            return false;
         }
-        QByteArray sig2 = hash2.result();
-        if(sig1 == sig2)
+    }
+
+    /* Remove file if is the same that original, the new file digest was computed during the transfer */
+    if(dest != original && QFileInfo(original).size() == QFileInfo(dest).size())
+    {
+        QCryptographicHash hash(m_hashAlgorithm);
+        QFile f(original);
+        if(f.open(QIODevice::ReadOnly) && hash.addData(&f) && hash.result() == m_digest)
         {
-            f2.remove();
+            f.close();
+            QFile::remove(dest);
         }
     }
     return true;
 }
 
+/* Stream the device from its current position to its end, it is opened read only if needed */
+bool SshSFtp::sendDevice(QIODevice *source, const QString &dest)
+{
+    DEBUGCH << "sendDevice(" << dest << ")";
+    SshSftpCommandSend cmd(*source, dest, *this);
+    bool ret = processCmd(&cmd);
+    m_digest = cmd.digest();
+    invalidateFileInfo(dest);
+    return ret;
+}
+
+bool SshSFtp::sendData(const QByteArray &data, const QString &dest)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    return sendDevice(&buffer, dest);
+}
+
+/* Stream the remote file in the device, it is opened write only if needed */
+bool SshSFtp::getDevice(const QString &source, QIODevice *dest)
+{
+    DEBUGCH << "getDevice(" << source << ")";
+    SshSftpCommandGet cmd(*dest, source, *this);
+    bool ret = processCmd(&cmd);
+    m_digest = cmd.digest();
+    return ret;
+}
+
+QByteArray SshSFtp::getData(const QString &source)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    if(!getDevice(source, &buffer))
+    {
+        return QByteArray();
+    }
+    return data;
+}
+
 int SshSFtp::mkdir(const QString &dest, int mode)
 {
     SshSftpCommandMkdir cmd(dest, mode, *this);
     DEBUGCH << "mkdir(" << dest << "," << mode << ")";
     processCmd(&cmd);
+    invalidateFileInfo(dest);
     DEBUGCH << "mkdir(" << dest << ") = " << ((cmd.error())?("FAIL"):("OK"));
     if(cmd.error()) return -1;
     return 0;
 }
 
 QStringList SshSFtp::readdir(const QString &d)
+{
+    QStringList names;
+    for(const SshSftpDirEntry &entry: readdirEntries(d))
+    {
+        names.append(entry.name);
+    }
+    return names;
+}
+
+QList<SshSftpDirEntry> SshSFtp::readdirEntries(const QString &d)
 {
     SshSftpCommandReadDir cmd(d, *this);
     DEBUGCH << "readdir(" << d << ")";
     processCmd(&cmd);
     DEBUGCH << "readdir(" << d << ") = " << cmd.result();
-    return cmd.result();
+
+    /*
+     * Prefetch: readdir already returns the attributes of every entry.
+     * Kept out of the cache, a large directory would evict itself.
+     */
+    const QList<SshSftpDirEntry> entries = cmd.entries();
+    m_listed.clear();
+    m_listedDir = fileInfoKey(d);
+    if(!m_listedDir.endsWith("/"))
+    {
+        m_listedDir += "/";
+    }
+    m_listedTimestamp = QDateTime::currentMSecsSinceEpoch();
+    if(m_fileinfoTtl <= 0)
+        return entries;
+    m_listed.reserve(entries.size());
+    for(const SshSftpDirEntry &entry: entries)
+    {
+        /* Symlinks are not followed by readdir, stat would return the target */
+        if(entry.name == "." || entry.name == ".." || !(entry.attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) || LIBSSH2_SFTP_S_ISLNK(entry.attrs.permissions))
+            continue;
+        m_listed.insert(entry.name, entry.attrs);
+    }
+    return entries;
 }
 
 bool SshSFtp::isDir(const QString &d)
@@ -173,17 +339,161 @@ bool SshSFtp::unlink(const QString &d)
     SshSftpCommandUnlink cmd(d, *this);
     DEBUGCH << "unlink(" << d << "," << d << ")";
     processCmd(&cmd);
+    invalidateFileInfo(d);
     DEBUGCH << "unlink(" << d << ") = " << ((cmd.error())?("FAIL"):("OK"));
     if(cmd.error()) return -1;
     return 0;
 }
 
+bool SshSFtp::rename(const QString &source, const QString &dest)
+{
+    SshSftpCommandRename cmd(source, dest, *this);
+    DEBUGCH << "rename(" << source << "," << dest << ")";
+    processCmd(&cmd);
+    invalidateFileInfo(source);
+    invalidateFileInfo(dest);
+    DEBUGCH << "rename(" << source << "," << dest << ") = " << ((cmd.error())?("FAIL"):("OK"));
+    return !cmd.error();
+}
+
 quint64 SshSFtp::filesize(const QString &d)
 {
     DEBUGCH << "filesize(" << d << ")";
     return getFileInfo(d).filesize;
 }
 
+bool SshSFtp::setFileTime(const QString &d, const QDateTime &mtime)
+{
+    DEBUGCH << "setFileTime(" << d << "," << mtime << ")";
+    LIBSSH2_SFTP_ATTRIBUTES attrs = {};
+    attrs.flags = LIBSSH2_SFTP_ATTR_ACMODTIME;
+    attrs.atime = static_cast<unsigned long>(mtime.toMSecsSinceEpoch() / 1000);
+    attrs.mtime = attrs.atime;
+    SshSftpCommandSetStat cmd(d, attrs, *this);
+    processCmd(&cmd);
+    invalidateFileInfo(d);
+    DEBUGCH << "setFileTime(" << d << ") = " << ((cmd.error())?("FAIL"):("OK"));
+    return !cmd.error();
+}
+
+QString SshSFtp::sync(const QString &source, QString dest, SyncCheck check)
+{
+    DEBUGCH << "sync(" << source << ", " << dest << ", " << check << ")";
+    QFileInfo src(source);
+    QString target(dest);
+    if(target.endsWith("/"))
+    {
+        target += src.fileName();
+    }
+
+    if(isSameFile(source, target, check))
+    {
+        DEBUGCH << "sync(" << source << ", " << target << ") = unchanged";
+        return target;
+    }
+
+    QString res = send(source, dest);
+    invalidateFileInfo(target);
+    if(!res.isEmpty())
+    {
+        /* Keep the local mtime on the remote copy so the next sync only costs a stat */
+        setFileTime(res, src.lastModified());
+    }
+    return res;
+}
+
+bool SshSFtp::syncGet(const QString &source, QString dest, SyncCheck check)
+{
+    DEBUGCH << "syncGet(" << source << ", " << dest << ", " << check << ")";
+    if(dest.endsWith("/"))
+    {
+        dest += QFileInfo(source).fileName();
+    }
+
+    if(isSameFile(dest, source, check))
+    {
+        DEBUGCH << "syncGet(" << source << ", " << dest << ") = unchanged";
+        return true;
+    }
+
+    if(!get(source, dest, true))
+        return false;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+    LIBSSH2_SFTP_ATTRIBUTES fileinfo = getFileInfo(source);
+    if(fileinfo.flags & LIBSSH2_SFTP_ATTR_ACMODTIME)
+    {
+        QFile fout(dest);
+        if(fout.open(QIODevice::Append))
+        {
+            fout.setFileTime(QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(fileinfo.mtime) * 1000), QFileDevice::FileModificationTime);
+        }
+    }
+#endif
+    return true;
+}
+
+bool SshSFtp::isSameFile(const QString &local, const QString &remote, SyncCheck check)
+{
+    QFileInfo localinfo(local);
+    if(!localinfo.isFile())
+        return false;
+
+    LIBSSH2_SFTP_ATTRIBUTES fileinfo = getFileInfo(remote);
+    if(!(fileinfo.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) || !LIBSSH2_SFTP_S_ISREG(fileinfo.permissions))
+        return false;
+
+    if(!(fileinfo.flags & LIBSSH2_SFTP_ATTR_SIZE) || fileinfo.filesize != static_cast<libssh2_uint64_t>(localinfo.size()))
+        return false;
+
+    if(check == SyncChecksum)
+    {
+        QCryptographicHash::Algorithm algorithm = m_hashAlgorithm;
+        QString command;
+        switch(algorithm)
+        {
+            case QCryptographicHash::Md5:    command = "md5sum";    break;
+            case QCryptographicHash::Sha1:   command = "sha1sum";   break;
+            case QCryptographicHash::Sha224: command = "sha224sum"; break;
+            case QCryptographicHash::Sha384: command = "sha384sum"; break;
+            case QCryptographicHash::Sha512: command = "sha512sum"; break;
+            default:
+                /* No standard remote tool for this digest */
+                algorithm = QCryptographicHash::Sha256;
+                command = "sha256sum";
+                break;
+        }
+
+        QFile f(local);
+        QCryptographicHash hash(algorithm);
+        if(!f.open(QIODevice::ReadOnly) || !hash.addData(&f))
+            return false;
+        return hash.result() == remoteChecksum(remote, command);
+    }
+
+    return (fileinfo.flags & LIBSSH2_SFTP_ATTR_ACMODTIME) && static_cast<qint64>(fileinfo.mtime) == localinfo.lastModified().toMSecsSinceEpoch() / 1000;
+}
+
+QByteArray SshSFtp::remoteChecksum(const QString &path, const QString &command)
+{
+    QString quoted(path);
+    quoted.replace("'", "'\\''");
+
+    SshProcess *proc = m_sshClient->getChannel<SshProcess>(QString("%1_checksum_%2").arg(m_name).arg(m_checksumCounter++));
+    QByteArray result;
+    bool done = false;
+    QEventLoop wait(this);
+    QObject::connect(proc, &SshProcess::finished, &wait, [&](){ result = proc->result(); done = true; wait.quit(); });
+    QObject::connect(proc, &SshProcess::failed, &wait, [&](){ done = true; wait.quit(); });
+    proc->runCommand(QString("%1 '%2'").arg(command, quoted));
+    while(!done)
+    {
+        wait.exec();
+    }
+    DEBUGCH << "remoteChecksum(" << path << ") = " << result;
+    return QByteArray::fromHex(result.split(' ').first());
+}
+
 void SshSFtp::sshDataReceived()
 {
     // Nothing to do
@@ -200,13 +510,13 @@ void SshSFtp::_eventLoop()
             {
                 return;
             }
-            m_sftpSession = libssh2_sftp_init(m_sshClient->session());
+            m_sftpSession = sshTransport()->sftp_init(m_sshClient->session());
             m_sshClient->releaseChannelCreationMutex(this);
             if(m_sftpSession == nullptr)
             {
                 char *emsg;
                 int size;
-                int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), &emsg, &size, 0);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
@@ -263,7 +573,7 @@ void SshSFtp::_eventLoop()
         case Close:
         {
             DEBUGCH << "closeChannel";
-            if(libssh2_sftp_shutdown(m_sftpSession) != 0)
+            if(sshTransport()->sftp_shutdown(m_sftpSession) != 0)
             {
                 return;
             }
@@ -328,16 +638,106 @@ QStringList SshSFtp::errMsg()
     return m_errMsg;
 }
 
+QCryptographicHash::Algorithm SshSFtp::hashAlgorithm() const
+{
+    return m_hashAlgorithm;
+}
+
+void SshSFtp::setHashAlgorithm(QCryptographicHash::Algorithm algorithm)
+{
+    m_hashAlgorithm = algorithm;
+}
+
+QByteArray SshSFtp::digest() const
+{
+    return m_digest;
+}
+
+void SshSFtp::setResumeCheck(bool check)
+{
+    m_resumeCheck = check;
+}
+
+bool SshSFtp::mappedIO() const
+{
+    return m_mappedIO;
+}
+
+void SshSFtp::setMappedIO(bool mapped)
+{
+    m_mappedIO = mapped;
+}
+
 LIBSSH2_SFTP_ATTRIBUTES SshSFtp::getFileInfo(const QString &path)
 {
-    if(!m_fileinfo.contains(path))
+    QString key = fileInfoKey(path);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    FileInfoCacheEntry *cached = m_fileinfo.object(key);
+    if(cached && (now - cached->timestamp) < m_fileinfoTtl)
+    {
+        return cached->attrs;
+    }
+    if(!m_listed.isEmpty() && (now - m_listedTimestamp) < m_fileinfoTtl
+       && key.startsWith(m_listedDir) && key.indexOf("/", m_listedDir.size()) < 0)
+    {
+        auto it = m_listed.constFind(key.mid(m_listedDir.size()));
+        if(it != m_listed.constEnd())
+        {
+            return it.value();
+        }
+    }
+
+    SshSftpCommandFileInfo cmd(path, *this);
+    DEBUGCH << "fileinfo(" << path << ")";
+    processCmd(&cmd);
+    DEBUGCH << "fileinfo(" << path << ") = " << ((cmd.error())?("FAIL"):("OK"));
+    LIBSSH2_SFTP_ATTRIBUTES fileinfo = cmd.fileinfo();
+    cacheFileInfo(path, fileinfo);
+    return fileinfo;
+}
+
+void SshSFtp::cacheFileInfo(const QString &path, const LIBSSH2_SFTP_ATTRIBUTES &fileinfo)
+{
+    if(m_fileinfoTtl <= 0)
+        return;
+
+    FileInfoCacheEntry *entry = new FileInfoCacheEntry;
+    entry->attrs = fileinfo;
+    entry->timestamp = QDateTime::currentMSecsSinceEpoch();
+    m_fileinfo.insert(fileInfoKey(path), entry);
+}
+
+void SshSFtp::setFileInfoCacheSize(int entries)
+{
+    m_fileinfo.setMaxCost(entries);
+}
+
+void SshSFtp::setFileInfoCacheTtl(int msec)
+{
+    m_fileinfoTtl = msec;
+    if(m_fileinfoTtl <= 0)
+    {
+        m_fileinfo.clear();
+        m_listed.clear();
+    }
+}
+
+void SshSFtp::invalidateFileInfo(const QString &path)
+{
+    /* The parent directory changes too (mtime, nlink) */
+    QString key = fileInfoKey(path);
+    m_fileinfo.remove(key);
+    if(key.startsWith(m_listedDir))
+    {
+        m_listed.remove(key.mid(m_listedDir.size()));
+    }
+    int sep = key.lastIndexOf("/");
+    if(sep > 0)
+    {
+        m_fileinfo.remove(key.left(sep));
+    }
+    else if(sep == 0)
     {
-        SshSftpCommandFileInfo cmd(path, *this);
-        DEBUGCH << "fileinfo(" << path << ")";
-        processCmd(&cmd);
-        DEBUGCH << "fileinfo(" << path << ") = " << ((cmd.error())?("FAIL"):("OK"));
-        LIBSSH2_SFTP_ATTRIBUTES fileinfo = cmd.fileinfo();
-        m_fileinfo[path] = fileinfo;
+        m_fileinfo.remove("/");
     }
-    return m_fileinfo[path];
 }
@@ -6,11 +6,32 @@
 #include <QEventLoop>
 #include <QTimer>
 #include <QStringList>
+#include <QCache>
 #include <QHash>
+#include <QDateTime>
+#include <QCryptographicHash>
 #include <QLoggingCategory>
 
 class SshSftpCommand;
 
+/* Suffix of partial files kept for resumable transfers */
+#define SFTP_PART_SUFFIX ".part"
+
+/* Directory entry with the attributes returned by readdir (not following symlinks) */
+struct SshSftpDirEntry
+{
+    QString name;
+    QString longname;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+};
+
+/*
+ * File attributes cache: number of entries and time to live (msec).
+ * The attributes of the last listed directory are kept aside, whatever its size.
+ */
+#define SFTP_FILEINFO_CACHE_SIZE 1024
+#define SFTP_FILEINFO_CACHE_TTL  5000
+
 Q_DECLARE_LOGGING_CATEGORY(logsshsftp)
 
 class SshSFtp : public SshChannel
@@ -26,27 +47,60 @@ private:
     QList<SshSftpCommand *> m_cmd;
     SshSftpCommand *m_currentCmd {nullptr};
 
-    QHash<QString,  LIBSSH2_SFTP_ATTRIBUTES> m_fileinfo;
+    struct FileInfoCacheEntry {
+        LIBSSH2_SFTP_ATTRIBUTES attrs;
+        qint64 timestamp;
+    };
+    QCache<QString, FileInfoCacheEntry> m_fileinfo;
+    QString m_listedDir;
+    QHash<QString, LIBSSH2_SFTP_ATTRIBUTES> m_listed;
+    qint64 m_listedTimestamp {0};
+    int m_fileinfoTtl {SFTP_FILEINFO_CACHE_TTL};
     LIBSSH2_SFTP_ATTRIBUTES getFileInfo(const QString &path);
+    void cacheFileInfo(const QString &path, const LIBSSH2_SFTP_ATTRIBUTES &fileinfo);
+    int m_checksumCounter {0};
+    QByteArray remoteChecksum(const QString &path, const QString &command);
+
+    QCryptographicHash::Algorithm m_hashAlgorithm {QCryptographicHash::Sha256};
+    QByteArray m_digest;
+    bool m_resumeCheck {true};
+    bool m_mappedIO {false};
 
 protected:
     
     friend class SshClient;
 
 public:
+    enum SyncCheck {
+        SyncSizeTime,   /* Same size and same modification time */
+        SyncChecksum    /* Same size and same content (hashAlgorithm() digest computed remotely) */
+    };
+    Q_ENUM(SyncCheck)
+
     SshSFtp(const QString &name, SshClient * client);
     virtual ~SshSFtp() override;
     void close() override;
 
-    QString send(const QString &source, QString dest);
-    bool get(const QString &source, QString dest, bool override = false);
+    QString send(const QString &source, QString dest, bool resume = false);
+    bool get(const QString &source, QString dest, bool override = false, bool resume = false);
+    bool sendDevice(QIODevice *source, const QString &dest);
+    bool sendData(const QByteArray &data, const QString &dest);
+    bool getDevice(const QString &source, QIODevice *dest);
+    QByteArray getData(const QString &source);
     int mkdir(const QString &dest, int mode = 0755);
     QStringList readdir(const QString &d);
+    QList<SshSftpDirEntry> readdirEntries(const QString &d);
     bool isDir(const QString &d);
     bool isFile(const QString &d);
     int mkpath(const QString &dest);
     bool unlink(const QString &d);
+    bool rename(const QString &source, const QString &dest);
     quint64 filesize(const QString &d);
+    bool setFileTime(const QString &d, const QDateTime &mtime);
+
+    QString sync(const QString &source, QString dest, SyncCheck check = SyncSizeTime);
+    bool syncGet(const QString &source, QString dest, SyncCheck check = SyncSizeTime);
+    bool isSameFile(const QString &local, const QString &remote, SyncCheck check = SyncSizeTime);
 
     LIBSSH2_SFTP *getSftpSession() const;
     bool processCmd(SshSftpCommand *cmd);
@@ -54,6 +108,17 @@ public:
     bool isError();
     QStringList errMsg();
 
+    QCryptographicHash::Algorithm hashAlgorithm() const;
+    void setHashAlgorithm(QCryptographicHash::Algorithm algorithm);
+    QByteArray digest() const;
+    void setResumeCheck(bool check);
+    bool mappedIO() const;
+    void setMappedIO(bool mapped);
+
+    void setFileInfoCacheSize(int entries);
+    void setFileInfoCacheTtl(int msec);
+    void invalidateFileInfo(const QString &path);
+
 public slots:
     void sshDataReceived() override;
 
@@ -26,7 +26,7 @@ void SshSftpCommandFileInfo::process()
     switch(m_state)
     {
     case Openning:
-        res = libssh2_sftp_stat_ex(
+        res = sshTransport()->sftp_stat_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_path),
                     static_cast<unsigned int>(m_path.size()),
@@ -45,7 +45,7 @@ void SshSftpCommandFileInfo::process()
             qCWarning(logsshsftp) << "SFTP unlink error " << res;
             if (res == LIBSSH2_ERROR_SFTP_PROTOCOL)
             {
-                int err = libssh2_sftp_last_error(sftp().getSftpSession());
+                int err = sshTransport()->sftp_last_error(sftp().getSftpSession());
                 if (err == LIBSSH2_FX_NO_SUCH_FILE)
                 {
                     qCWarning(logsshsftp) << "No such file or directory: " << m_path;
@@ -1,12 +1,37 @@
 #include "sshsftpcommandget.h"
 #include "sshclient.h"
 
-SshSftpCommandGet::SshSftpCommandGet(QFile &fout, const QString &source, SshSFtp &parent)
+/* Any device can be the sink, only files can be preallocated and mapped */
+SshSftpCommandGet::SshSftpCommandGet(QIODevice &fout, const QString &source, SshSFtp &parent)
     : SshSftpCommand(parent)
     , m_fout(fout)
+    , m_file(qobject_cast<QFile *>(&fout))
+    , m_map(m_file)
     , m_src(source)
+    , m_hash(parent.hashAlgorithm())
 {
-    setName(QString("get(%1, %2)").arg(source).arg(fout.fileName()));
+    setName(QString("get(%1, %2)").arg(source).arg((m_file)?(m_file->fileName()):(QString("device"))));
+}
+
+QByteArray SshSftpCommandGet::digest() const
+{
+    return m_hash.result();
+}
+
+void SshSftpCommandGet::setResume(qint64 offset, bool check)
+{
+    m_offset = offset;
+    m_checkLen = (check)?(qMin<qint64>(offset, SFTP_BUFFER_SIZE)):(0);
+}
+
+void SshSftpCommandGet::setExpectedSize(qint64 size)
+{
+    m_expectedSize = size;
+}
+
+bool SshSftpCommandGet::resumeFailed() const
+{
+    return m_resumeFailed;
 }
 
 void SshSftpCommandGet::process()
@@ -14,7 +39,7 @@ void SshSftpCommandGet::process()
     switch(m_state)
     {
     case Openning:
-        m_sftpfile = libssh2_sftp_open_ex(
+        m_sftpfile = sshTransport()->sftp_open_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_src),
                     static_cast<unsigned int>(m_src.size()),
@@ -27,7 +52,7 @@ void SshSftpCommandGet::process()
         {
             char *emsg;
             int size;
-            int ret = libssh2_session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
+            int ret = sshTransport()->session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -39,17 +64,91 @@ void SshSftpCommandGet::process()
             return;
         }
 
-        if(!m_fout.open(QIODevice::WriteOnly))
+        /* Mapped destination is preallocated to the remote size, mapping needs read access */
+        m_mapped = sftp().mappedIO() && m_file && m_expectedSize > m_offset && !m_fout.isOpen();
+        if(!m_fout.isOpen())
+        {
+            m_opened = m_fout.open((m_offset > 0 || m_mapped)?(QIODevice::ReadWrite):(QIODevice::WriteOnly));
+        }
+        if(!m_fout.isOpen())
         {
             m_error = true;
+            m_errMsg << "Can't open local file " + ((m_file)?(m_file->fileName()):(QString()));
             setState(CommandState::Closing);
         }
+        else if(m_offset > 0)
+        {
+            /* Resume: the digest has to cover the part already received */
+            qint64 left = m_offset;
+            while(left > 0)
+            {
+                qint64 len = m_fout.read(m_buffer, qMin<qint64>(left, SFTP_BUFFER_SIZE));
+                if(len <= 0)
+                    break;
+                m_hash.addData(m_buffer, static_cast<int>(len));
+                left -= len;
+            }
+            sshTransport()->sftp_seek64(m_sftpfile, static_cast<libssh2_uint64_t>(m_offset - m_checkLen));
+            qCDebug(logsshsftp) << "Resume " << m_src << " at " << m_offset;
+        }
+        if(m_mapped && (m_error || !m_file->resize(m_expectedSize)))
+        {
+            m_mapped = false;
+        }
+        m_position = m_offset;
         setState(CommandState::Exec);
         FALLTHROUGH;
     case Exec:
-        while(1)
+        /* Resume: the overlapping tail must be the same on both sides */
+        while(!m_error && m_checked < m_checkLen)
+        {
+            ssize_t rc = sshTransport()->sftp_read(m_sftpfile, m_buffer + m_checked, static_cast<size_t>(m_checkLen - m_checked));
+            if(rc == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(rc <= 0)
+            {
+                break;
+            }
+            m_checked += rc;
+        }
+        if(!m_error && m_checkLen > 0)
+        {
+            m_fout.seek(m_offset - m_checkLen);
+            if(m_checked != m_checkLen || m_fout.read(m_checkLen) != QByteArray::fromRawData(m_buffer, static_cast<int>(m_checkLen)))
+            {
+                qCWarning(logsshsftp) << "SFTP resume check failed on " << m_src;
+                m_resumeFailed = true;
+                m_error = true;
+                m_errMsg << "SFTP resume check failed on " + m_src;
+                setState(CommandState::Closing);
+            }
+            m_fout.seek(m_offset);
+            sshTransport()->sftp_seek64(m_sftpfile, static_cast<libssh2_uint64_t>(m_offset));
+            m_checkLen = 0;
+        }
+        while(!m_error)
         {
-            ssize_t rc = libssh2_sftp_read(m_sftpfile, m_buffer, SFTP_BUFFER_SIZE);
+            char *data = m_buffer;
+            qint64 len = SFTP_BUFFER_SIZE;
+            if(m_mapped)
+            {
+                /* libssh2 writes directly in the mapped destination */
+                data = m_map.data(m_position, len);
+                if(data == nullptr)
+                {
+                    /* Past the expected size or mapping failed, continue with the buffer */
+                    m_mapped = false;
+                    m_map.unmap();
+                    m_fout.seek(m_position);
+                    data = m_buffer;
+                    len = SFTP_BUFFER_SIZE;
+                }
+                len = qMin<qint64>(len, SSH_MAP_CHUNK);
+            }
+
+            ssize_t rc = sshTransport()->sftp_read(m_sftpfile, data, static_cast<size_t>(len));
             if(rc < 0)
             {
                 if(rc == LIBSSH2_ERROR_EAGAIN)
@@ -65,15 +164,35 @@ void SshSftpCommandGet::process()
             else if(rc == 0)
             {
                 // EOF
+                m_map.unmap();
+                if(m_file && m_opened && m_file->size() > m_position)
+                {
+                    /* Remote file is smaller than expected */
+                    m_file->resize(m_position);
+                }
                 setState(CommandState::Closing);
                 break;
             }
             else
             {
-                char *begin = m_buffer;
+                m_hash.addData(data, static_cast<int>(rc));
+                m_position += rc;
+                if(m_mapped)
+                {
+                    continue;
+                }
+                char *begin = data;
                 while(rc)
                 {
-                    ssize_t wrc = m_fout.write(begin, rc);
+                    qint64 wrc = m_fout.write(begin, rc);
+                    if(wrc <= 0)
+                    {
+                        qCWarning(logsshsftp) << "Local write error " << m_fout.errorString();
+                        m_error = true;
+                        m_errMsg << "Local write error " + m_fout.errorString();
+                        setState(CommandState::Closing);
+                        break;
+                    }
                     rc -= wrc;
                     begin += wrc;
                 }
@@ -82,11 +201,13 @@ void SshSftpCommandGet::process()
 
     case Closing:
     {
-        if(m_fout.isOpen())
+        m_map.unmap();
+        if(m_opened)
         {
             m_fout.close();
+            m_opened = false;
         }
-        int rc = libssh2_sftp_close_handle(m_sftpfile);
+        int rc = sshTransport()->sftp_close_handle(m_sftpfile);
         if(rc < 0)
         {
             if(rc == LIBSSH2_ERROR_EAGAIN)
@@ -3,21 +3,40 @@
 
 #include <QObject>
 #include <QFile>
+#include <QCryptographicHash>
+#include <sshmappedfile.h>
 #include <sshsftpcommand.h>
 
 class SshSftpCommandGet : public SshSftpCommand
 {
     Q_OBJECT
 
-    QFile &m_fout;
+    QIODevice &m_fout;
+    QFile *m_file;
+    bool m_opened {false};
+    SshMappedFile m_map;
+    bool m_mapped {false};
+    qint64 m_expectedSize {0};
+    qint64 m_position {0};
     const QString &m_src;
     LIBSSH2_SFTP_HANDLE *m_sftpfile;
     bool m_error {false};
     char m_buffer[SFTP_BUFFER_SIZE];
+    QCryptographicHash m_hash;
+
+    /* Resume */
+    qint64 m_offset {0};
+    qint64 m_checkLen {0};
+    qint64 m_checked {0};
+    bool m_resumeFailed {false};
 
 public:
-    SshSftpCommandGet(QFile &fout, const QString &source, SshSFtp &parent);
+    SshSftpCommandGet(QIODevice &fout, const QString &source, SshSFtp &parent);
     void process() override;
+    QByteArray digest() const;
+    void setResume(qint64 offset, bool check);
+    void setExpectedSize(qint64 size);
+    bool resumeFailed() const;
 };
 
 #endif // SSHSFTPCOMMANDGET_H
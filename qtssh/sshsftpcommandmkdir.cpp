@@ -21,7 +21,7 @@ void SshSftpCommandMkdir::process()
     switch(m_state)
     {
     case Openning:
-        res = libssh2_sftp_mkdir_ex(
+        res = sshTransport()->sftp_mkdir_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_dir),
                     static_cast<unsigned int>(m_dir.size()),
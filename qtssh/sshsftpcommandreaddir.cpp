@@ -3,7 +3,18 @@
 
 QStringList SshSftpCommandReadDir::result() const
 {
-    return m_result;
+    QStringList names;
+    names.reserve(m_entries.size());
+    for(const SshSftpDirEntry &entry: m_entries)
+    {
+        names.append(entry.name);
+    }
+    return names;
+}
+
+QList<SshSftpDirEntry> SshSftpCommandReadDir::entries() const
+{
+    return m_entries;
 }
 
 SshSftpCommandReadDir::SshSftpCommandReadDir(const QString &dir, SshSFtp &parent)
@@ -18,7 +29,7 @@ void SshSftpCommandReadDir::process()
     switch(m_state)
     {
     case Openning:
-        m_sftpdir = libssh2_sftp_open_ex(
+        m_sftpdir = sshTransport()->sftp_open_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_dir),
                     static_cast<unsigned int>(m_dir.size()),
@@ -31,7 +42,7 @@ void SshSftpCommandReadDir::process()
         {
             char *emsg;
             int size;
-            int ret = libssh2_session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
+            int ret = sshTransport()->session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -50,7 +61,7 @@ void SshSftpCommandReadDir::process()
     case Exec:
         while(1)
         {
-            ssize_t rc = libssh2_sftp_readdir_ex(m_sftpdir, m_buffer, SFTP_BUFFER_SIZE, nullptr, 0, &m_attrs);
+            ssize_t rc = sshTransport()->sftp_readdir_ex(m_sftpdir, m_buffer, SFTP_BUFFER_SIZE, m_longentry, SFTP_BUFFER_SIZE, &m_attrs);
             if(rc < 0)
             {
                 if(rc == LIBSSH2_ERROR_EAGAIN)
@@ -59,6 +70,9 @@ void SshSftpCommandReadDir::process()
                 }
                 qCWarning(logsshsftp) << "SFTP readdir error " << rc;
                 m_errMsg << QString("SFTP readdir error: %1").arg(rc);
+                m_error = true;
+                setState(Closing);
+                break;
             }
             else if(rc == 0)
             {
@@ -68,13 +82,17 @@ void SshSftpCommandReadDir::process()
             }
             else
             {
-                m_result.append(QString(m_buffer));
+                SshSftpDirEntry entry;
+                entry.name = QString::fromUtf8(m_buffer, static_cast<int>(rc));
+                entry.longname = QString::fromUtf8(m_longentry);
+                entry.attrs = m_attrs;
+                m_entries.append(entry);
             }
         }
 
     case Closing:
     {
-        int rc = libssh2_sftp_close_handle(m_sftpdir);
+        int rc = sshTransport()->sftp_close_handle(m_sftpdir);
         if(rc < 0)
         {
             if(rc == LIBSSH2_ERROR_EAGAIN)
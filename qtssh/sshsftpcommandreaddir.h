@@ -9,9 +9,10 @@ class SshSftpCommandReadDir : public SshSftpCommand
     Q_OBJECT
     const QString &m_dir;
 
-    QStringList m_result;
+    QList<SshSftpDirEntry> m_entries;
     LIBSSH2_SFTP_HANDLE *m_sftpdir;
     char m_buffer[SFTP_BUFFER_SIZE];
+    char m_longentry[SFTP_BUFFER_SIZE];
     bool m_error {false};
     LIBSSH2_SFTP_ATTRIBUTES m_attrs;
 
@@ -19,6 +20,7 @@ public:
     SshSftpCommandReadDir(const QString &dir, SshSFtp &parent);
     void process() override;
     QStringList result() const;
+    QList<SshSftpDirEntry> entries() const;
 };
 
 #endif // SSHSFTPCOMMANDREADDIR_H
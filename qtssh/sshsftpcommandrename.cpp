@@ -0,0 +1,56 @@
+#include "sshsftpcommandrename.h"
+#include "sshclient.h"
+
+SshSftpCommandRename::SshSftpCommandRename(const QString &source, const QString &dest, SshSFtp &parent)
+    : SshSftpCommand(parent)
+    , m_source(source)
+    , m_dest(dest)
+{
+    setName(QString("rename(%1, %2)").arg(source, dest));
+}
+
+bool SshSftpCommandRename::error() const
+{
+    return m_error;
+}
+
+void SshSftpCommandRename::process()
+{
+    int res;
+    switch(m_state)
+    {
+    case Openning:
+        res = sshTransport()->sftp_rename_ex(
+                    sftp().getSftpSession(),
+                    qPrintable(m_source),
+                    static_cast<unsigned int>(m_source.size()),
+                    qPrintable(m_dest),
+                    static_cast<unsigned int>(m_dest.size()),
+                    LIBSSH2_SFTP_RENAME_OVERWRITE | LIBSSH2_SFTP_RENAME_ATOMIC | LIBSSH2_SFTP_RENAME_NATIVE
+                    );
+
+        if(res < 0)
+        {
+            if(res == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            m_error = true;
+            m_errMsg << QString("SFTP rename error: %1").arg(res);
+            qCWarning(logsshsftp) << "SFTP rename error " << res;
+            setState(CommandState::Error);
+            break;
+        }
+        setState(CommandState::Terminate);
+        FALLTHROUGH;
+    case Terminate:
+        break;
+
+    case Error:
+        break;
+
+    default:
+        setState(CommandState::Terminate);
+        break;
+    }
+}
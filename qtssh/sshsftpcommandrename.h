@@ -0,0 +1,20 @@
+#ifndef SSHSFTPCOMMANDRENAME_H
+#define SSHSFTPCOMMANDRENAME_H
+
+#include <QObject>
+#include <sshsftpcommand.h>
+
+class SshSftpCommandRename : public SshSftpCommand
+{
+    Q_OBJECT
+    const QString &m_source;
+    const QString &m_dest;
+    bool m_error {false};
+
+public:
+    SshSftpCommandRename(const QString &source, const QString &dest, SshSFtp &parent);
+    void process() override;
+    bool error() const;
+};
+
+#endif // SSHSFTPCOMMANDRENAME_H
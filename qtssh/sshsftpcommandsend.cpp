@@ -5,20 +5,50 @@ SshSftpCommandSend::SshSftpCommandSend(const QString &source, QString dest, SshS
     : SshSftpCommand(parent)
     , m_dest(dest)
     , m_localfile(source)
+    , m_device(m_localfile)
+    , m_map(&m_localfile)
+    , m_hash(parent.hashAlgorithm())
 {
     setName(QString("send(%1, %2)").arg(source, dest));
 }
 
+/* Stream from any device, read from its current position until its end */
+SshSftpCommandSend::SshSftpCommandSend(QIODevice &source, QString dest, SshSFtp &parent)
+    : SshSftpCommand(parent)
+    , m_dest(dest)
+    , m_device(source)
+    , m_map(nullptr)
+    , m_hash(parent.hashAlgorithm())
+{
+    setName(QString("send(device, %1)").arg(dest));
+}
+
+QByteArray SshSftpCommandSend::digest() const
+{
+    return m_hash.result();
+}
+
+void SshSftpCommandSend::setResume(qint64 offset, bool check)
+{
+    m_offset = offset;
+    m_checkLen = (check)?(qMin<qint64>(offset, SFTP_BUFFER_SIZE)):(0);
+}
+
+bool SshSftpCommandSend::resumeFailed() const
+{
+    return m_resumeFailed;
+}
+
 void SshSftpCommandSend::process()
 {
     switch(m_state)
     {
     case Openning:
-        m_sftpfile = libssh2_sftp_open_ex(
+        m_sftpfile = sshTransport()->sftp_open_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_dest),
                     static_cast<unsigned int>(m_dest.size()),
-                    LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
+                    (m_offset > 0)?(LIBSSH2_FXF_READ|LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT):(LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC),
                     LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR| LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH,
                     LIBSSH2_SFTP_OPENFILE
                     );
@@ -27,7 +57,7 @@ void SshSftpCommandSend::process()
         {
             char *emsg;
             int size;
-            int ret = libssh2_session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
+            int ret = sshTransport()->session_last_error(sftp().sshClient()->session(), &emsg, &size, 0);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -39,32 +69,101 @@ void SshSftpCommandSend::process()
             return;
         }
 
-        if(!m_localfile.open(QIODevice::ReadOnly))
+        if(!m_device.isOpen())
         {
-            qCWarning(logsshsftp) << "Can't open local file " << m_localfile.fileName();
-            m_error = true;
-            m_errMsg << "Can't open local file " + m_localfile.fileName();
-            setState(CommandState::Closing);
-            break;
+            if(!m_device.open(QIODevice::ReadOnly))
+            {
+                qCWarning(logsshsftp) << "Can't open local file " << m_localfile.fileName();
+                m_error = true;
+                m_errMsg << "Can't open local file " + m_localfile.fileName();
+                setState(CommandState::Closing);
+                break;
+            }
+            m_opened = true;
+        }
+        if(m_offset > 0)
+        {
+            /* Resume: the digest has to cover the part already sent */
+            qint64 left = m_offset;
+            while(left > 0)
+            {
+                qint64 len = m_device.read(m_buffer, qMin<qint64>(left, SFTP_BUFFER_SIZE));
+                if(len <= 0)
+                    break;
+                m_hash.addData(m_buffer, static_cast<int>(len));
+                left -= len;
+            }
+            sshTransport()->sftp_seek64(m_sftpfile, static_cast<libssh2_uint64_t>(m_offset - m_checkLen));
+            qCDebug(logsshsftp) << "Resume " << m_dest << " at " << m_offset;
         }
+        m_position = m_offset;
+        m_mapped = sftp().mappedIO() && &m_device == &m_localfile;
         setState(CommandState::Exec);
         FALLTHROUGH;
     case Exec:
-        while(1)
+        /* Resume: the overlapping tail must be the same on both sides */
+        while(!m_error && m_checked < m_checkLen)
         {
-            if(m_nread == 0 && m_localfile.isOpen())
+            ssize_t rc = sshTransport()->sftp_read(m_sftpfile, m_buffer + m_checked, static_cast<size_t>(m_checkLen - m_checked));
+            if(rc == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(rc <= 0)
+            {
+                break;
+            }
+            m_checked += rc;
+        }
+        if(!m_error && m_checkLen > 0)
+        {
+            m_device.seek(m_offset - m_checkLen);
+            if(m_checked != m_checkLen || m_device.read(m_checkLen) != QByteArray::fromRawData(m_buffer, static_cast<int>(m_checkLen)))
+            {
+                qCWarning(logsshsftp) << "SFTP resume check failed on " << m_dest;
+                m_resumeFailed = true;
+                m_error = true;
+                m_errMsg << "SFTP resume check failed on " + m_dest;
+                setState(CommandState::Closing);
+            }
+            m_device.seek(m_offset);
+            sshTransport()->sftp_seek64(m_sftpfile, static_cast<libssh2_uint64_t>(m_offset));
+            m_checkLen = 0;
+        }
+        while(!m_error)
+        {
+            if(m_nread == 0 && m_device.isOpen())
             {
-                m_nread = m_localfile.read(m_buffer, SFTP_BUFFER_SIZE);
-                if (m_nread <= 0) {
+                qint64 len = 0;
+                if(m_mapped)
+                {
+                    /* Hand the mapped pages directly to libssh2 */
+                    m_begin = m_map.data(m_position, len);
+                    if(m_begin == nullptr && m_position < m_localfile.size())
+                    {
+                        qCDebug(logsshsftp) << "Can't map " << m_localfile.fileName() << ", use buffered read";
+                        m_mapped = false;
+                        m_device.seek(m_position);
+                    }
+                    len = qMin<qint64>(len, SSH_MAP_CHUNK);
+                }
+                if(!m_mapped)
+                {
+                    len = m_device.read(m_buffer, SFTP_BUFFER_SIZE);
+                    m_begin = m_buffer;
+                }
+                if (len <= 0) {
                     /* end of file */
                     setState(CommandState::Closing);
                     break;
                 }
-                m_begin = m_buffer;
+                m_nread = static_cast<size_t>(len);
+                m_position += len;
+                m_hash.addData(m_begin, static_cast<int>(len));
             }
             while(m_nread != 0)
             {
-                ssize_t rc = libssh2_sftp_write(m_sftpfile, m_begin, m_nread);
+                ssize_t rc = sshTransport()->sftp_write(m_sftpfile, m_begin, m_nread);
                 if(rc < 0)
                 {
                     if(rc == LIBSSH2_ERROR_EAGAIN)
@@ -72,20 +171,26 @@ void SshSftpCommandSend::process()
                         return;
                     }
                     qCWarning(logsshsftp) << "SFTP Write error " << rc;
+                    m_error = true;
+                    m_errMsg << QString("SFTP write error: %1").arg(rc);
+                    setState(CommandState::Closing);
+                    break;
                 }
-                m_nread -= rc;
+                m_nread -= static_cast<size_t>(rc);
                 m_begin += rc;
             }
         }
-        break;
+        FALLTHROUGH;
 
     case Closing:
     {
-        if(m_localfile.isOpen())
+        m_map.unmap();
+        if(m_opened)
         {
-            m_localfile.close();
+            m_device.close();
+            m_opened = false;
         }
-        int rc = libssh2_sftp_close_handle(m_sftpfile);
+        int rc = sshTransport()->sftp_close_handle(m_sftpfile);
         if(rc < 0)
         {
             if(rc == LIBSSH2_ERROR_EAGAIN)
@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QFile>
 #include <QFileInfo>
+#include <QCryptographicHash>
+#include <sshmappedfile.h>
 #include <sshsftpcommand.h>
 
 class SshSFtp;
@@ -18,14 +20,30 @@ class SshSftpCommandSend: public SshSftpCommand
     bool m_error {false};
 
     QFile m_localfile;
+    QIODevice &m_device;
+    bool m_opened {false};
+    SshMappedFile m_map;
+    bool m_mapped {false};
+    qint64 m_position {0};
     char m_buffer[SFTP_BUFFER_SIZE];
     char *m_begin {nullptr};
     size_t m_nread {0};
     LIBSSH2_SFTP_HANDLE *m_sftpfile {nullptr};
+    QCryptographicHash m_hash;
+
+    /* Resume */
+    qint64 m_offset {0};
+    qint64 m_checkLen {0};
+    qint64 m_checked {0};
+    bool m_resumeFailed {false};
 
 public:
     SshSftpCommandSend(const QString &source, QString dest, SshSFtp &parent);
+    SshSftpCommandSend(QIODevice &source, QString dest, SshSFtp &parent);
     void process() override;
+    QByteArray digest() const;
+    void setResume(qint64 offset, bool check);
+    bool resumeFailed() const;
 };
 
 #endif // SSHSFTPCOMMANDSEND_H
@@ -0,0 +1,55 @@
+#include "sshsftpcommandsetstat.h"
+#include "sshclient.h"
+
+SshSftpCommandSetStat::SshSftpCommandSetStat(const QString &path, const LIBSSH2_SFTP_ATTRIBUTES &attrs, SshSFtp &parent)
+    : SshSftpCommand(parent)
+    , m_path(path)
+    , m_attrs(attrs)
+{
+    setName(QString("setstat(%1)").arg(path));
+}
+
+bool SshSftpCommandSetStat::error() const
+{
+    return m_error;
+}
+
+void SshSftpCommandSetStat::process()
+{
+    int res;
+    switch(m_state)
+    {
+    case Openning:
+        res = sshTransport()->sftp_stat_ex(
+                    sftp().getSftpSession(),
+                    qPrintable(m_path),
+                    static_cast<unsigned int>(m_path.size()),
+                    LIBSSH2_SFTP_SETSTAT,
+                    &m_attrs
+                    );
+
+        if(res < 0)
+        {
+            if(res == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            m_error = true;
+            m_errMsg << QString("SFTP setstat error: %1").arg(res);
+            qCWarning(logsshsftp) << "SFTP setstat error " << res;
+            setState(CommandState::Error);
+            break;
+        }
+        setState(CommandState::Terminate);
+        FALLTHROUGH;
+    case Terminate:
+        break;
+
+    case Error:
+        break;
+
+    default:
+        setState(CommandState::Terminate);
+        break;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef SSHSFTPCOMMANDSETSTAT_H
+#define SSHSFTPCOMMANDSETSTAT_H
+
+#include <QObject>
+#include <sshsftpcommand.h>
+
+class SshSftpCommandSetStat : public SshSftpCommand
+{
+    Q_OBJECT
+    const QString &m_path;
+    LIBSSH2_SFTP_ATTRIBUTES m_attrs;
+    bool m_error {false};
+
+public:
+    SshSftpCommandSetStat(const QString &path, const LIBSSH2_SFTP_ATTRIBUTES &attrs, SshSFtp &parent);
+    void process() override;
+    bool error() const;
+};
+
+#endif // SSHSFTPCOMMANDSETSTAT_H
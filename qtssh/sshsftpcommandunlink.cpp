@@ -19,7 +19,7 @@ void SshSftpCommandUnlink::process()
     switch(m_state)
     {
     case Openning:
-        res = libssh2_sftp_unlink_ex(
+        res = sshTransport()->sftp_unlink_ex(
                     sftp().getSftpSession(),
                     qPrintable(m_path),
                     static_cast<unsigned int>(m_path.size())
@@ -0,0 +1,500 @@
+#include "sshtarget.h"
+#include "sshclient.h"
+#include "sshfileutils.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(logtarget, "ssh.target", QtWarningMsg)
+
+using SshFileUtils::shellQuote;
+using SshFileUtils::filePermissions;
+
+/* Octal numeric field, or base-256 when the high bit is set (GNU extension) */
+static qint64 tarNumber(const char *field, int len)
+{
+    qint64 value = 0;
+    if(static_cast<unsigned char>(field[0]) & 0x80)
+    {
+        value = field[0] & 0x7f;
+        for(int i = 1; i < len; ++i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+    int i = 0;
+    while(i < len && field[i] == ' ')
+    {
+        ++i;
+    }
+    while(i < len && field[i] >= '0' && field[i] <= '7')
+    {
+        value = (value << 3) | (field[i] - '0');
+        ++i;
+    }
+    return value;
+}
+
+SshTarGet::SshTarGet(const QString &name, SshClient *client):
+    SshChannel(name, client)
+{
+}
+
+SshTarGet::~SshTarGet()
+{
+    qCDebug(logtarget) << "free Channel:" << m_name;
+}
+
+void SshTarGet::close()
+{
+    setChannelState(ChannelState::Close);
+    sshDataReceived();
+}
+
+QStringList SshTarGet::errMsg() const
+{
+    return m_errMsg;
+}
+
+/* Receive the content of the remote source directory in the local dest directory */
+void SshTarGet::get(const QString &source, const QString &dest)
+{
+    m_source = source;
+    m_dest = dest;
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+void SshTarGet::setError(const QString &msg)
+{
+    qCWarning(logtarget) << m_name << msg;
+    m_errMsg << msg;
+    if(!m_error)
+    {
+        m_error = true;
+        emit failed();
+    }
+}
+
+void SshTarGet::finishFile()
+{
+    m_file.flush();
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+    m_file.setFileTime(QDateTime::fromMSecsSinceEpoch(m_mtime * 1000), QFileDevice::FileModificationTime);
+#endif
+    m_file.close();
+    emit fileReceived(m_file.fileName());
+    m_remaining = m_pad;
+    m_step = (m_pad > 0)?(Skip):(Header);
+}
+
+/* Deepest first, like tar: a read-only directory no longer blocks its children */
+void SshTarGet::applyDirModes()
+{
+    std::stable_sort(m_dirModes.begin(), m_dirModes.end(), [](const QPair<QString, qint64> &a, const QPair<QString, qint64> &b) {
+        return a.first.count('/') > b.first.count('/');
+    });
+    for(const QPair<QString, qint64> &dir: m_dirModes)
+    {
+        QFile::setPermissions(dir.first, filePermissions(dir.second));
+    }
+    m_dirModes.clear();
+}
+
+/* Handle a complete header block, false on fatal error */
+bool SshTarGet::processHeader()
+{
+    const char *h = m_block.constData();
+
+    bool zero = true;
+    unsigned int sum = 0;
+    for(int i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+        zero = zero && h[i] == 0;
+        sum += (i >= 148 && i < 156)?(' '):(static_cast<unsigned char>(h[i]));
+    }
+    if(zero)
+    {
+        /* End of archive */
+        m_step = End;
+        return true;
+    }
+    if(static_cast<qint64>(sum) != tarNumber(h + 148, 8))
+    {
+        setError("Invalid tar header checksum");
+        return false;
+    }
+
+    qint64 size = tarNumber(h + 124, 12);
+    qint64 mode = tarNumber(h + 100, 8);
+    m_mtime = tarNumber(h + 136, 12);
+    m_pad = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    char type = h[156];
+
+    if(type == 'L' || type == 'x')
+    {
+        /* Metadata for the next entry */
+        m_meta.clear();
+        if(size > TAR_META_MAX_SIZE)
+        {
+            setError(QString("Tar %1 header too large (%2 bytes)").arg((type == 'L')?("long name"):("pax")).arg(size));
+            return false;
+        }
+        m_remaining = size;
+        if(size > 0)
+        {
+            m_step = (type == 'L')?(LongName):(Pax);
+        }
+        return true;
+    }
+
+    QString path = m_nextPath;
+    m_nextPath.clear();
+    if(path.isEmpty())
+    {
+        QByteArray name(h, static_cast<int>(strnlen(h, 100)));
+        if(memcmp(h + 257, "ustar", 5) == 0 && h[345] != 0)
+        {
+            name = QByteArray(h + 345, static_cast<int>(strnlen(h + 345, 155))) + "/" + name;
+        }
+        path = QFile::decodeName(name);
+    }
+
+    /* Never write outside dest */
+    QStringList parts;
+    bool unsafe = false;
+    for(const QString &part: path.split('/'))
+    {
+        if(part.isEmpty() || part == ".")
+            continue;
+        unsafe = unsafe || part == "..";
+        parts << part;
+    }
+
+    m_remaining = size + m_pad;
+    m_step = (m_remaining > 0)?(Skip):(Header);
+    if(unsafe)
+    {
+        m_errMsg << "Unsafe path in archive: " + path;
+        qCWarning(logtarget) << m_name << "Skip unsafe path" << path;
+        return true;
+    }
+    QString local = (parts.isEmpty())?(m_dest):(m_dest + "/" + parts.join('/'));
+
+    switch(type)
+    {
+        case '5':
+            if(!QDir().mkpath(local))
+            {
+                setError("Can't create directory " + local);
+                return false;
+            }
+            m_dirModes.append(qMakePair(local, mode));
+            return true;
+
+        case '0':
+        case '7':
+        case '\0':
+            break;
+
+        default:
+            /* Links and special files */
+            qCDebug(logtarget) << m_name << "Skip entry" << path << "of type" << type;
+            return true;
+    }
+
+    QDir().mkpath(QFileInfo(local).path());
+    m_file.setFileName(local);
+    if(!m_file.open(QIODevice::WriteOnly))
+    {
+        /* Not fatal, skip its content */
+        setError("Can't open destination file " + local);
+        return true;
+    }
+    m_file.setPermissions(filePermissions(mode));
+    m_remaining = size;
+    m_step = Data;
+    if(size == 0)
+    {
+        finishFile();
+    }
+    return true;
+}
+
+void SshTarGet::consume(const char *data, qint64 len)
+{
+    while(len > 0 && channelState() == ChannelState::Ready)
+    {
+        qint64 n = qMin(len, (m_step == Header)?(TAR_BLOCK_SIZE - m_block.size()):(m_remaining));
+        switch(m_step)
+        {
+            case Header:
+                m_block.append(data, static_cast<int>(n));
+                if(m_block.size() == TAR_BLOCK_SIZE)
+                {
+                    if(!processHeader())
+                    {
+                        setChannelState(ChannelState::Close);
+                    }
+                    m_block.clear();
+                }
+                break;
+
+            case Data:
+                m_remaining -= n;
+                m_got += n;
+                if(m_file.write(data, n) != n)
+                {
+                    setError("Can't write destination file " + m_file.fileName());
+                    m_file.close();
+                    m_file.remove();
+                    m_remaining += m_pad;
+                    m_step = (m_remaining > 0)?(Skip):(Header);
+                    break;
+                }
+                emit progress(m_got);
+                if(m_remaining == 0)
+                {
+                    finishFile();
+                }
+                break;
+
+            case LongName:
+            case Pax:
+                m_meta.append(data, static_cast<int>(n));
+                m_remaining -= n;
+                if(m_remaining > 0)
+                {
+                    break;
+                }
+                if(m_step == LongName)
+                {
+                    m_nextPath = QFile::decodeName(m_meta.left(m_meta.indexOf('\0')));
+                }
+                else
+                {
+                    /* Records are "<len> <key>=<value>\n" */
+                    int pos = 0;
+                    while(pos < m_meta.size())
+                    {
+                        int space = m_meta.indexOf(' ', pos);
+                        int reclen = (space > pos)?(m_meta.mid(pos, space - pos).toInt()):(0);
+                        if(reclen <= 0 || pos + reclen > m_meta.size())
+                            break;
+                        QByteArray record = m_meta.mid(space + 1, pos + reclen - space - 2);
+                        if(record.startsWith("path="))
+                        {
+                            m_nextPath = QString::fromUtf8(record.mid(5));
+                        }
+                        pos += reclen;
+                    }
+                }
+                m_remaining = m_pad;
+                m_step = (m_pad > 0)?(Skip):(Header);
+                break;
+
+            case Skip:
+                m_remaining -= n;
+                if(m_remaining == 0)
+                {
+                    m_step = Header;
+                }
+                break;
+
+            case End:
+                /* Trailing blocks */
+                n = len;
+                break;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void SshTarGet::sshDataReceived()
+{
+    qCDebug(logtarget) << "Channel "<< m_name << "State:" << channelState();
+    switch(channelState())
+    {
+        case Openning:
+        {
+            if ( ! m_sshClient->takeChannelCreationMutex(this) )
+            {
+                return;
+            }
+            m_sshChannel = sshTransport()->channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
+            m_sshClient->releaseChannelCreationMutex(this);
+            if (m_sshChannel == nullptr)
+            {
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                if(ret == LIBSSH2_ERROR_EAGAIN)
+                {
+                    return;
+                }
+                setError(QString("Channel session open failed: %1").arg(ret));
+                setChannelState(ChannelState::Error);
+                return;
+            }
+            qCDebug(logtarget) << "Channel session opened";
+            setChannelState(ChannelState::Exec);
+        }
+
+        FALLTHROUGH; case Exec:
+        {
+            QString cmd = QString("tar -c -f - -C %1 .").arg(shellQuote(m_source));
+            int ret = sshTransport()->channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, cmd.toStdString().c_str(), static_cast<unsigned int>(cmd.toStdString().size()));
+            if (ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret != 0)
+            {
+                setError(QString("Failed to run remote tar: %1").arg(sshErrorToString(ret)));
+                setChannelState(ChannelState::Close);
+                sshDataReceived();
+                return;
+            }
+            if(!QDir().mkpath(m_dest))
+            {
+                setError("Can't create directory " + m_dest);
+                setChannelState(ChannelState::Close);
+                sshDataReceived();
+                return;
+            }
+            m_buffer.resize(TAR_BUFFER_SIZE);
+            m_step = Header;
+            setChannelState(ChannelState::Ready);
+            /* OK, next step */
+        }
+
+        FALLTHROUGH; case Ready:
+        {
+            while(channelState() == ChannelState::Ready)
+            {
+                char errbuf[1024];
+                ssize_t retsz = sshTransport()->channel_read_stderr(m_sshChannel, errbuf, sizeof(errbuf));
+                if(retsz > 0)
+                {
+                    m_stderr.append(errbuf, static_cast<int>(retsz));
+                }
+
+                retsz = sshTransport()->channel_read_ex(m_sshChannel, 0, m_buffer.data(), static_cast<size_t>(m_buffer.size()));
+                if(retsz == LIBSSH2_ERROR_EAGAIN)
+                {
+                    return;
+                }
+                if(retsz < 0)
+                {
+                    setError(QString("Can't read archive (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                    setChannelState(ChannelState::Close);
+                    break;
+                }
+                if(retsz == 0)
+                {
+                    if(sshTransport()->channel_eof(m_sshChannel) != 1)
+                    {
+                        return;
+                    }
+                    if(m_step != End)
+                    {
+                        setError("Truncated archive");
+                    }
+                    setChannelState(ChannelState::Close);
+                    break;
+                }
+                consume(m_buffer.constData(), retsz);
+            }
+        }
+
+        FALLTHROUGH; case Close:
+        {
+            if(m_file.isOpen())
+            {
+                /* Partial file */
+                m_file.close();
+                m_file.remove();
+            }
+            applyDirModes();
+            qCDebug(logtarget) << m_name << "closeChannel";
+            int ret = sshTransport()->channel_close(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_close: %1").arg(sshErrorToString(ret)));
+            }
+            else if(m_step == End)
+            {
+                int status = sshTransport()->channel_get_exit_status(m_sshChannel);
+                if(status != 0)
+                {
+                    setError(QString("Remote tar failed (%1): %2").arg(status).arg(QString::fromUtf8(m_stderr)));
+                }
+                else if(!m_error)
+                {
+                    emit finished();
+                }
+            }
+            setChannelState(ChannelState::WaitClose);
+        }
+
+        FALLTHROUGH; case WaitClose:
+        {
+            qCDebug(logtarget) << "Wait close channel:" << m_name;
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_wait_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::Freeing);
+        }
+
+        FALLTHROUGH; case Freeing:
+        {
+            qCDebug(logtarget) << "free Channel:" << m_name;
+
+            int ret = sshTransport()->channel_free(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to free channel: %1").arg(sshErrorToString(ret)));
+            }
+            if(m_error)
+            {
+                setChannelState(ChannelState::Error);
+            }
+            else
+            {
+                setChannelState(ChannelState::Free);
+            }
+            m_sshChannel = nullptr;
+            QObject::disconnect(m_sshClient, &SshClient::sshDataReceived, this, &SshTarGet::sshDataReceived);
+            return;
+        }
+
+        case Free:
+        {
+            qCDebug(logtarget) << "Channel" << m_name << "is free";
+            return;
+        }
+
+        case Error:
+        {
+            qCDebug(logtarget) << "Channel" << m_name << "is in error state";
+            setChannelState(ChannelState::Free);
+            return;
+        }
+    }
+}
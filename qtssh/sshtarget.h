@@ -0,0 +1,77 @@
+#pragma once
+
+#include "sshchannel.h"
+#include "sshtarsend.h"
+#include <QFile>
+#include <QList>
+#include <QPair>
+
+Q_DECLARE_LOGGING_CATEGORY(logtarget)
+
+/* Largest GNU long name or pax header accepted, a bigger one fails the transfer */
+#define TAR_META_MAX_SIZE (1024*1024)
+
+/*
+ * Download a remote directory tree as a single stream: the output of a
+ * remote "tar c" is parsed on the fly and the files are written locally.
+ * ustar, GNU long names and pax path records are understood; links and
+ * special files are skipped.
+ */
+class SshTarGet : public SshChannel
+{
+    Q_OBJECT
+
+protected:
+    SshTarGet(const QString &name, SshClient *client);
+    friend class SshClient;
+
+public:
+    virtual ~SshTarGet() override;
+    void close() override;
+    QStringList errMsg() const;
+
+public slots:
+    void get(const QString &source, const QString &dest);
+    void sshDataReceived() override;
+
+private:
+    enum Step {
+        Header,
+        Data,
+        LongName,
+        Pax,
+        Skip,
+        End
+    };
+
+    QString m_source;
+    QString m_dest;
+    Step m_step {Header};
+    QByteArray m_block;
+    QByteArray m_meta;
+    QString m_nextPath;
+    qint64 m_remaining {0};
+    qint64 m_pad {0};
+    LIBSSH2_CHANNEL *m_sshChannel {nullptr};
+    bool m_error {false};
+    QStringList m_errMsg;
+    QByteArray m_stderr;
+    QByteArray m_buffer;
+    QFile m_file;
+    qint64 m_mtime {0};
+    qint64 m_got {0};
+    /* Directory modes, applied once their content is written */
+    QList<QPair<QString, qint64>> m_dirModes;
+
+    bool processHeader();
+    void finishFile();
+    void applyDirModes();
+    void consume(const char *data, qint64 len);
+    void setError(const QString &msg);
+
+signals:
+    void fileReceived(const QString &path);
+    void finished();
+    void failed();
+    void progress(qint64 rx);
+};
@@ -0,0 +1,414 @@
+#include "sshtarsend.h"
+#include "sshclient.h"
+#include "sshfileutils.h"
+#include <QDateTime>
+#include <QDir>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(logtarsend, "ssh.tarsend", QtWarningMsg)
+
+using SshFileUtils::shellQuote;
+using SshFileUtils::fileMode;
+
+/* Octal numeric field, base-256 when the value does not fit (GNU extension) */
+static void tarNumber(char *field, int len, qint64 value)
+{
+    QByteArray oct = QByteArray::number(value, 8);
+    if(oct.size() > len - 1)
+    {
+        memset(field, 0, static_cast<size_t>(len));
+        for(int i = len - 1; i > 0 && value; --i)
+        {
+            field[i] = static_cast<char>(value & 0xff);
+            value >>= 8;
+        }
+        field[0] = static_cast<char>(0x80);
+        return;
+    }
+    oct = oct.rightJustified(len - 1, '0');
+    memcpy(field, oct.constData(), static_cast<size_t>(len - 1));
+    field[len - 1] = 0;
+}
+
+static QByteArray tarBlock(const QByteArray &name, const QByteArray &prefix, char type, qint64 size, int mode, qint64 mtime)
+{
+    QByteArray block(TAR_BLOCK_SIZE, '\0');
+    char *h = block.data();
+    memcpy(h, name.constData(), static_cast<size_t>(qMin(name.size(), 100)));
+    tarNumber(h + 100, 8, mode);
+    tarNumber(h + 108, 8, 0);
+    tarNumber(h + 116, 8, 0);
+    tarNumber(h + 124, 12, size);
+    tarNumber(h + 136, 12, mtime);
+    h[156] = type;
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    memcpy(h + 345, prefix.constData(), static_cast<size_t>(qMin(prefix.size(), 155)));
+
+    /* Checksum is computed with its own field filled with spaces */
+    memset(h + 148, ' ', 8);
+    unsigned int sum = 0;
+    for(int i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+        sum += static_cast<unsigned char>(h[i]);
+    }
+    tarNumber(h + 148, 7, sum);
+    return block;
+}
+
+SshTarSend::SshTarSend(const QString &name, SshClient *client):
+    SshChannel(name, client)
+{
+}
+
+SshTarSend::~SshTarSend()
+{
+    qCDebug(logtarsend) << "free Channel:" << m_name;
+}
+
+void SshTarSend::close()
+{
+    setChannelState(ChannelState::Close);
+    sshDataReceived();
+}
+
+QStringList SshTarSend::errMsg() const
+{
+    return m_errMsg;
+}
+
+/* Send the content of the source directory (or the source file) in the remote dest directory */
+void SshTarSend::send(const QString &source, const QString &dest)
+{
+    m_dest = dest;
+    QFileInfo info(source);
+    if(info.isDir())
+    {
+        enqueue(info.absoluteFilePath(), info.absoluteFilePath());
+    }
+    else
+    {
+        m_entries.enqueue({info.filePath(), QFile::encodeName(info.fileName()), info});
+        m_total += info.size();
+    }
+    setChannelState(ChannelState::Openning);
+    sshDataReceived();
+}
+
+void SshTarSend::enqueue(const QString &root, const QString &path)
+{
+    QDir dir(path);
+    QDir base(root);
+    for(const QFileInfo &info: dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDir::Name))
+    {
+        QByteArray name = QFile::encodeName(base.relativeFilePath(info.absoluteFilePath()));
+        if(info.isDir())
+        {
+            if(info.isSymLink())
+            {
+                /* Don't follow directory links, they may loop */
+                qCDebug(logtarsend) << "Skip directory link" << info.filePath();
+                continue;
+            }
+            m_entries.enqueue({info.filePath(), name + "/", info});
+            enqueue(root, info.filePath());
+        }
+        else if(info.isFile())
+        {
+            m_entries.enqueue({info.filePath(), name, info});
+            m_total += info.size();
+        }
+    }
+}
+
+QByteArray SshTarSend::header(const Entry &entry) const
+{
+    QByteArray res;
+    QByteArray name = entry.name;
+    QByteArray prefix;
+    char type = (entry.info.isDir())?('5'):('0');
+    qint64 size = (entry.info.isDir())?(0):(entry.info.size());
+
+    if(name.size() > 100)
+    {
+        /* ustar split in prefix/name, GNU long name record if it can't be split */
+        int slash = name.indexOf('/', qMax(0, name.size() - 101));
+        if(slash > 0 && slash <= 155 && slash < name.size() - 1)
+        {
+            prefix = name.left(slash);
+            name = name.mid(slash + 1);
+        }
+        else
+        {
+            QByteArray longname = name + '\0';
+            res += tarBlock("././@LongLink", QByteArray(), 'L', longname.size(), 0644, 0);
+            longname.append(QByteArray((TAR_BLOCK_SIZE - longname.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE, '\0'));
+            res += longname;
+            name.truncate(100);
+        }
+    }
+    res += tarBlock(name, prefix, type, size, fileMode(entry.info), entry.info.lastModified().toMSecsSinceEpoch() / 1000);
+    return res;
+}
+
+void SshTarSend::setError(const QString &msg)
+{
+    qCWarning(logtarsend) << m_name << msg;
+    m_errMsg << msg;
+    if(!m_error)
+    {
+        m_error = true;
+        emit failed();
+    }
+}
+
+void SshTarSend::sshDataReceived()
+{
+    qCDebug(logtarsend) << "Channel "<< m_name << "State:" << channelState();
+    switch(channelState())
+    {
+        case Openning:
+        {
+            if ( ! m_sshClient->takeChannelCreationMutex(this) )
+            {
+                return;
+            }
+            m_sshChannel = sshTransport()->channel_open_ex(m_sshClient->session(), "session", sizeof("session") - 1, LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, nullptr, 0);
+            m_sshClient->releaseChannelCreationMutex(this);
+            if (m_sshChannel == nullptr)
+            {
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), nullptr, nullptr, 0);
+                if(ret == LIBSSH2_ERROR_EAGAIN)
+                {
+                    return;
+                }
+                setError(QString("Channel session open failed: %1").arg(ret));
+                setChannelState(ChannelState::Error);
+                return;
+            }
+            qCDebug(logtarsend) << "Channel session opened";
+            setChannelState(ChannelState::Exec);
+        }
+
+        FALLTHROUGH; case Exec:
+        {
+            QString cmd = QString("mkdir -p %1 && tar -x -f - -C %1").arg(shellQuote(m_dest));
+            int ret = sshTransport()->channel_process_startup(m_sshChannel, "exec", sizeof("exec") - 1, cmd.toStdString().c_str(), static_cast<unsigned int>(cmd.toStdString().size()));
+            if (ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret != 0)
+            {
+                setError(QString("Failed to run remote tar: %1").arg(sshErrorToString(ret)));
+                setChannelState(ChannelState::Close);
+                sshDataReceived();
+                return;
+            }
+            m_step = Header;
+            setChannelState(ChannelState::Ready);
+            /* OK, next step */
+        }
+
+        FALLTHROUGH; case Ready:
+        {
+            while(channelState() == ChannelState::Ready)
+            {
+                /* Remote tar only speaks on errors, keep its output drained */
+                char discard[1024];
+                ssize_t retsz = sshTransport()->channel_read_stderr(m_sshChannel, discard, sizeof(discard));
+                if(retsz > 0)
+                {
+                    m_stderr.append(discard, static_cast<int>(retsz));
+                }
+                sshTransport()->channel_read_ex(m_sshChannel, 0, discard, sizeof(discard));
+
+                if(m_outPos < m_out.size())
+                {
+                    retsz = sshTransport()->channel_write_ex(m_sshChannel, 0, m_out.constData() + m_outPos, static_cast<size_t>(m_out.size() - m_outPos));
+                    if(retsz == LIBSSH2_ERROR_EAGAIN)
+                    {
+                        return;
+                    }
+                    if(retsz < 0)
+                    {
+                        setError(QString("Can't write archive (%1)").arg(sshErrorToString(static_cast<int>(retsz))));
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                    m_outPos += retsz;
+                    if(m_step == Data && m_fileSent > 0)
+                    {
+                        /* File content, not its header */
+                        m_sent += retsz;
+                        emit progress(m_sent, m_total);
+                    }
+                    continue;
+                }
+
+                m_outPos = 0;
+                switch(m_step)
+                {
+                    case Header:
+                    {
+                        if(m_entries.isEmpty())
+                        {
+                            m_step = Trailer;
+                            break;
+                        }
+                        m_current = m_entries.dequeue();
+                        if(!m_current.info.isDir())
+                        {
+                            m_file.setFileName(m_current.path);
+                            if(!m_file.open(QIODevice::ReadOnly))
+                            {
+                                /* Skip it, the archive stays consistent */
+                                setError("Can't open source file " + m_current.path);
+                                m_out.clear();
+                                break;
+                            }
+                            m_fileSent = 0;
+                            m_step = Data;
+                        }
+                        m_out = header(m_current);
+                        break;
+                    }
+
+                    case Data:
+                    {
+                        qint64 remaining = m_current.info.size() - m_fileSent;
+                        if(remaining == 0)
+                        {
+                            /* Pad the file to the next block */
+                            m_file.close();
+                            m_out = QByteArray(static_cast<int>((TAR_BLOCK_SIZE - m_current.info.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE), '\0');
+                            m_step = Header;
+                            emit fileSent(m_current.path);
+                            break;
+                        }
+                        m_out = m_file.read(qMin<qint64>(remaining, TAR_BUFFER_SIZE));
+                        if(m_out.isEmpty())
+                        {
+                            /* File shrunk: keep the announced size */
+                            setError("Can't read source file " + m_current.path);
+                            m_out = QByteArray(static_cast<int>(qMin<qint64>(remaining, TAR_BUFFER_SIZE)), '\0');
+                        }
+                        m_fileSent += m_out.size();
+                        break;
+                    }
+
+                    case Trailer:
+                    {
+                        m_out = QByteArray(2 * TAR_BLOCK_SIZE, '\0');
+                        m_step = Eof;
+                        break;
+                    }
+
+                    case Eof:
+                    {
+                        int ret = sshTransport()->channel_send_eof(m_sshChannel);
+                        if(ret == LIBSSH2_ERROR_EAGAIN)
+                        {
+                            return;
+                        }
+                        m_out.clear();
+                        m_step = WaitExit;
+                        break;
+                    }
+
+                    case WaitExit:
+                    {
+                        if(sshTransport()->channel_eof(m_sshChannel) != 1)
+                        {
+                            return;
+                        }
+                        setChannelState(ChannelState::Close);
+                        break;
+                    }
+                }
+            }
+        }
+
+        FALLTHROUGH; case Close:
+        {
+            m_file.close();
+            qCDebug(logtarsend) << m_name << "closeChannel";
+            int ret = sshTransport()->channel_close(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_close: %1").arg(sshErrorToString(ret)));
+            }
+            else if(m_step == WaitExit)
+            {
+                int status = sshTransport()->channel_get_exit_status(m_sshChannel);
+                if(status != 0)
+                {
+                    setError(QString("Remote tar failed (%1): %2").arg(status).arg(QString::fromUtf8(m_stderr)));
+                }
+                else if(!m_error)
+                {
+                    emit finished();
+                }
+            }
+            setChannelState(ChannelState::WaitClose);
+        }
+
+        FALLTHROUGH; case WaitClose:
+        {
+            qCDebug(logtarsend) << "Wait close channel:" << m_name;
+            int ret = sshTransport()->channel_wait_closed(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to channel_wait_close: %1").arg(sshErrorToString(ret)));
+            }
+            setChannelState(ChannelState::Freeing);
+        }
+
+        FALLTHROUGH; case Freeing:
+        {
+            qCDebug(logtarsend) << "free Channel:" << m_name;
+
+            int ret = sshTransport()->channel_free(m_sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                return;
+            }
+            if(ret < 0)
+            {
+                setError(QString("Failed to free channel: %1").arg(sshErrorToString(ret)));
+            }
+            if(m_error)
+            {
+                setChannelState(ChannelState::Error);
+            }
+            else
+            {
+                setChannelState(ChannelState::Free);
+            }
+            m_sshChannel = nullptr;
+            QObject::disconnect(m_sshClient, &SshClient::sshDataReceived, this, &SshTarSend::sshDataReceived);
+            return;
+        }
+
+        case Free:
+        {
+            qCDebug(logtarsend) << "Channel" << m_name << "is free";
+            return;
+        }
+
+        case Error:
+        {
+            qCDebug(logtarsend) << "Channel" << m_name << "is in error state";
+            setChannelState(ChannelState::Free);
+            return;
+        }
+    }
+}
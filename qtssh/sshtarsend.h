@@ -0,0 +1,74 @@
+#pragma once
+
+#include "sshchannel.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QQueue>
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_BUFFER_SIZE (256*1024)
+
+Q_DECLARE_LOGGING_CATEGORY(logtarsend)
+
+/*
+ * Upload a local directory tree as a single stream: a ustar archive is
+ * generated on the fly and piped in a remote "tar x". Many small files
+ * cost no round-trip each, unlike SFTP or SCP.
+ */
+class SshTarSend : public SshChannel
+{
+    Q_OBJECT
+
+protected:
+    SshTarSend(const QString &name, SshClient *client);
+    friend class SshClient;
+
+public:
+    virtual ~SshTarSend() override;
+    void close() override;
+    QStringList errMsg() const;
+
+public slots:
+    void send(const QString &source, const QString &dest);
+    void sshDataReceived() override;
+
+private:
+    struct Entry {
+        QString path;
+        QByteArray name;
+        QFileInfo info;
+    };
+
+    enum Step {
+        Header,
+        Data,
+        Trailer,
+        Eof,
+        WaitExit
+    };
+
+    QString m_dest;
+    QQueue<Entry> m_entries;
+    Entry m_current;
+    Step m_step {Header};
+    QByteArray m_out;
+    qint64 m_outPos {0};
+    LIBSSH2_CHANNEL *m_sshChannel {nullptr};
+    bool m_error {false};
+    QStringList m_errMsg;
+    QByteArray m_stderr;
+    QFile m_file;
+    qint64 m_fileSent {0};
+    qint64 m_sent {0};
+    qint64 m_total {0};
+
+    void enqueue(const QString &root, const QString &path);
+    QByteArray header(const Entry &entry) const;
+    void setError(const QString &msg);
+
+signals:
+    void fileSent(const QString &path);
+    void finished();
+    void failed();
+    void progress(qint64 tx, qint64 total);
+};
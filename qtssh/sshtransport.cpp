@@ -0,0 +1,252 @@
+#include "sshtransport.h"
+
+static SshTransport s_libssh2;
+static SshTransport *s_transport = &s_libssh2;
+
+SshTransport::~SshTransport()
+{
+}
+
+SshTransport *SshTransport::instance()
+{
+    return s_transport;
+}
+
+void SshTransport::setInstance(SshTransport *transport)
+{
+    s_transport = (transport)?(transport):(&s_libssh2);
+}
+
+void SshTransport::setWakeup(LIBSSH2_SESSION *, const std::function<void()> &)
+{
+}
+
+LIBSSH2_SESSION *SshTransport::session_init_ex(LIBSSH2_ALLOC_FUNC((*my_alloc)), LIBSSH2_FREE_FUNC((*my_free)), LIBSSH2_REALLOC_FUNC((*my_realloc)), void *abstract)
+{
+    return libssh2_session_init_ex(my_alloc, my_free, my_realloc, abstract);
+}
+
+void *SshTransport::session_callback_set(LIBSSH2_SESSION *session, int cbtype, void *callback)
+{
+    return libssh2_session_callback_set(session, cbtype, callback);
+}
+
+void SshTransport::session_set_blocking(LIBSSH2_SESSION *session, int blocking)
+{
+    libssh2_session_set_blocking(session, blocking);
+}
+
+int SshTransport::session_handshake(LIBSSH2_SESSION *session, libssh2_socket_t sock)
+{
+    return libssh2_session_handshake(session, sock);
+}
+
+const char *SshTransport::session_hostkey(LIBSSH2_SESSION *session, size_t *len, int *type)
+{
+    return libssh2_session_hostkey(session, len, type);
+}
+
+const char *SshTransport::hostkey_hash(LIBSSH2_SESSION *session, int hash_type)
+{
+    return libssh2_hostkey_hash(session, hash_type);
+}
+
+const char *SshTransport::session_banner_get(LIBSSH2_SESSION *session)
+{
+    return libssh2_session_banner_get(session);
+}
+
+int SshTransport::session_last_error(LIBSSH2_SESSION *session, char **errmsg, int *errmsg_len, int want_buf)
+{
+    return libssh2_session_last_error(session, errmsg, errmsg_len, want_buf);
+}
+
+int SshTransport::session_disconnect_ex(LIBSSH2_SESSION *session, int reason, const char *description, const char *lang)
+{
+    return libssh2_session_disconnect_ex(session, reason, description, lang);
+}
+
+int SshTransport::session_free(LIBSSH2_SESSION *session)
+{
+    return libssh2_session_free(session);
+}
+
+void SshTransport::keepalive_config(LIBSSH2_SESSION *session, int want_reply, unsigned int interval)
+{
+    libssh2_keepalive_config(session, want_reply, interval);
+}
+
+int SshTransport::keepalive_send(LIBSSH2_SESSION *session, int *seconds_to_next)
+{
+    return libssh2_keepalive_send(session, seconds_to_next);
+}
+
+char *SshTransport::userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len)
+{
+    return libssh2_userauth_list(session, username, username_len);
+}
+
+int SshTransport::userauth_authenticated(LIBSSH2_SESSION *session)
+{
+    return libssh2_userauth_authenticated(session);
+}
+
+int SshTransport::userauth_publickey(LIBSSH2_SESSION *session, const char *username, const unsigned char *pubkeydata, size_t pubkeydata_len, LIBSSH2_USERAUTH_PUBLICKEY_SIGN_FUNC((*sign_callback)), void **abstract)
+{
+    return libssh2_userauth_publickey(session, username, pubkeydata, pubkeydata_len, sign_callback, abstract);
+}
+
+int SshTransport::userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len, const char *publickeyfiledata, size_t publickeyfiledata_len, const char *privatekeyfiledata, size_t privatekeyfiledata_len, const char *passphrase)
+{
+    return libssh2_userauth_publickey_frommemory(session, username, username_len, publickeyfiledata, publickeyfiledata_len, privatekeyfiledata, privatekeyfiledata_len, passphrase);
+}
+
+int SshTransport::userauth_password_ex(LIBSSH2_SESSION *session, const char *username, unsigned int username_len, const char *password, unsigned int password_len, LIBSSH2_PASSWD_CHANGEREQ_FUNC((*passwd_change_cb)))
+{
+    return libssh2_userauth_password_ex(session, username, username_len, password, password_len, passwd_change_cb);
+}
+
+LIBSSH2_CHANNEL *SshTransport::channel_open_ex(LIBSSH2_SESSION *session, const char *channel_type, unsigned int channel_type_len, unsigned int window_size, unsigned int packet_size, const char *message, unsigned int message_len)
+{
+    return libssh2_channel_open_ex(session, channel_type, channel_type_len, window_size, packet_size, message, message_len);
+}
+
+LIBSSH2_CHANNEL *SshTransport::channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port, const char *shost, int sport)
+{
+    return libssh2_channel_direct_tcpip_ex(session, host, port, shost, sport);
+}
+
+int SshTransport::channel_process_startup(LIBSSH2_CHANNEL *channel, const char *request, unsigned int request_len, const char *message, unsigned int message_len)
+{
+    return libssh2_channel_process_startup(channel, request, request_len, message, message_len);
+}
+
+ssize_t SshTransport::channel_read_ex(LIBSSH2_CHANNEL *channel, int stream_id, char *buf, size_t buflen)
+{
+    return libssh2_channel_read_ex(channel, stream_id, buf, buflen);
+}
+
+ssize_t SshTransport::channel_write_ex(LIBSSH2_CHANNEL *channel, int stream_id, const char *buf, size_t buflen)
+{
+    return libssh2_channel_write_ex(channel, stream_id, buf, buflen);
+}
+
+int SshTransport::channel_eof(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_eof(channel);
+}
+
+int SshTransport::channel_send_eof(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_send_eof(channel);
+}
+
+int SshTransport::channel_close(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_close(channel);
+}
+
+int SshTransport::channel_wait_closed(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_wait_closed(channel);
+}
+
+int SshTransport::channel_free(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_free(channel);
+}
+
+int SshTransport::channel_get_exit_status(LIBSSH2_CHANNEL *channel)
+{
+    return libssh2_channel_get_exit_status(channel);
+}
+
+LIBSSH2_LISTENER *SshTransport::channel_forward_listen_ex(LIBSSH2_SESSION *session, const char *host, int port, int *bound_port, int queue_maxsize)
+{
+    return libssh2_channel_forward_listen_ex(session, host, port, bound_port, queue_maxsize);
+}
+
+LIBSSH2_CHANNEL *SshTransport::channel_forward_accept(LIBSSH2_LISTENER *listener)
+{
+    return libssh2_channel_forward_accept(listener);
+}
+
+int SshTransport::channel_forward_cancel(LIBSSH2_LISTENER *listener)
+{
+    return libssh2_channel_forward_cancel(listener);
+}
+
+LIBSSH2_CHANNEL *SshTransport::scp_send64(LIBSSH2_SESSION *session, const char *path, int mode, libssh2_int64_t size, time_t mtime, time_t atime)
+{
+    return libssh2_scp_send64(session, path, mode, size, mtime, atime);
+}
+
+LIBSSH2_CHANNEL *SshTransport::scp_recv2(LIBSSH2_SESSION *session, const char *path, libssh2_struct_stat *sb)
+{
+    return libssh2_scp_recv2(session, path, sb);
+}
+
+LIBSSH2_SFTP *SshTransport::sftp_init(LIBSSH2_SESSION *session)
+{
+    return libssh2_sftp_init(session);
+}
+
+int SshTransport::sftp_shutdown(LIBSSH2_SFTP *sftp)
+{
+    return libssh2_sftp_shutdown(sftp);
+}
+
+unsigned long SshTransport::sftp_last_error(LIBSSH2_SFTP *sftp)
+{
+    return libssh2_sftp_last_error(sftp);
+}
+
+LIBSSH2_SFTP_HANDLE *SshTransport::sftp_open_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len, unsigned long flags, long mode, int open_type)
+{
+    return libssh2_sftp_open_ex(sftp, filename, filename_len, flags, mode, open_type);
+}
+
+int SshTransport::sftp_close_handle(LIBSSH2_SFTP_HANDLE *handle)
+{
+    return libssh2_sftp_close_handle(handle);
+}
+
+ssize_t SshTransport::sftp_read(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen)
+{
+    return libssh2_sftp_read(handle, buffer, buffer_maxlen);
+}
+
+ssize_t SshTransport::sftp_write(LIBSSH2_SFTP_HANDLE *handle, const char *buffer, size_t count)
+{
+    return libssh2_sftp_write(handle, buffer, count);
+}
+
+void SshTransport::sftp_seek64(LIBSSH2_SFTP_HANDLE *handle, libssh2_uint64_t offset)
+{
+    libssh2_sftp_seek64(handle, offset);
+}
+
+int SshTransport::sftp_readdir_ex(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen, char *longentry, size_t longentry_maxlen, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    return libssh2_sftp_readdir_ex(handle, buffer, buffer_maxlen, longentry, longentry_maxlen, attrs);
+}
+
+int SshTransport::sftp_stat_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, int stat_type, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    return libssh2_sftp_stat_ex(sftp, path, path_len, stat_type, attrs);
+}
+
+int SshTransport::sftp_mkdir_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, long mode)
+{
+    return libssh2_sftp_mkdir_ex(sftp, path, path_len, mode);
+}
+
+int SshTransport::sftp_rename_ex(LIBSSH2_SFTP *sftp, const char *source_filename, unsigned int source_filename_len, const char *dest_filename, unsigned int dest_filename_len, long flags)
+{
+    return libssh2_sftp_rename_ex(sftp, source_filename, source_filename_len, dest_filename, dest_filename_len, flags);
+}
+
+int SshTransport::sftp_unlink_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len)
+{
+    return libssh2_sftp_unlink_ex(sftp, filename, filename_len);
+}
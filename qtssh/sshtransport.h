@@ -0,0 +1,115 @@
+#ifndef SSHTRANSPORT_H
+#define SSHTRANSPORT_H
+
+#include <functional>
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+
+/*
+ * Every libssh2 call of the library goes through the current transport.
+ * The default one forwards to libssh2; a test can install another one
+ * (see test/SshFake) to run the whole library without a server.
+ *
+ * Methods keep the libssh2 names and arguments, without the prefix, so
+ * the libssh2 documentation applies. The inline helpers mirror the libssh2
+ * macros used by the library.
+ *
+ * The transport must be set before the first SshClient connects and stay
+ * alive until the last one is destroyed.
+ */
+class SshTransport
+{
+public:
+    virtual ~SshTransport();
+
+    static SshTransport *instance();
+    /* nullptr restores libssh2 */
+    static void setInstance(SshTransport *transport);
+
+    /*
+     * libssh2 sessions are woken up by their socket. A transport that does
+     * not use the socket calls wakeup when the session may progress.
+     */
+    virtual void setWakeup(LIBSSH2_SESSION *session, const std::function<void()> &wakeup);
+
+    /* Session */
+    virtual LIBSSH2_SESSION *session_init_ex(LIBSSH2_ALLOC_FUNC((*my_alloc)), LIBSSH2_FREE_FUNC((*my_free)), LIBSSH2_REALLOC_FUNC((*my_realloc)), void *abstract);
+    virtual void *session_callback_set(LIBSSH2_SESSION *session, int cbtype, void *callback);
+    virtual void session_set_blocking(LIBSSH2_SESSION *session, int blocking);
+    virtual int session_handshake(LIBSSH2_SESSION *session, libssh2_socket_t sock);
+    virtual const char *session_hostkey(LIBSSH2_SESSION *session, size_t *len, int *type);
+    virtual const char *hostkey_hash(LIBSSH2_SESSION *session, int hash_type);
+    virtual const char *session_banner_get(LIBSSH2_SESSION *session);
+    virtual int session_last_error(LIBSSH2_SESSION *session, char **errmsg, int *errmsg_len, int want_buf);
+    virtual int session_disconnect_ex(LIBSSH2_SESSION *session, int reason, const char *description, const char *lang);
+    virtual int session_free(LIBSSH2_SESSION *session);
+    virtual void keepalive_config(LIBSSH2_SESSION *session, int want_reply, unsigned int interval);
+    virtual int keepalive_send(LIBSSH2_SESSION *session, int *seconds_to_next);
+
+    /* Authentication */
+    virtual char *userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len);
+    virtual int userauth_authenticated(LIBSSH2_SESSION *session);
+    virtual int userauth_publickey(LIBSSH2_SESSION *session, const char *username, const unsigned char *pubkeydata, size_t pubkeydata_len, LIBSSH2_USERAUTH_PUBLICKEY_SIGN_FUNC((*sign_callback)), void **abstract);
+    virtual int userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len, const char *publickeyfiledata, size_t publickeyfiledata_len, const char *privatekeyfiledata, size_t privatekeyfiledata_len, const char *passphrase);
+    virtual int userauth_password_ex(LIBSSH2_SESSION *session, const char *username, unsigned int username_len, const char *password, unsigned int password_len, LIBSSH2_PASSWD_CHANGEREQ_FUNC((*passwd_change_cb)));
+
+    /* Channels */
+    virtual LIBSSH2_CHANNEL *channel_open_ex(LIBSSH2_SESSION *session, const char *channel_type, unsigned int channel_type_len, unsigned int window_size, unsigned int packet_size, const char *message, unsigned int message_len);
+    virtual LIBSSH2_CHANNEL *channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port, const char *shost, int sport);
+    virtual int channel_process_startup(LIBSSH2_CHANNEL *channel, const char *request, unsigned int request_len, const char *message, unsigned int message_len);
+    virtual ssize_t channel_read_ex(LIBSSH2_CHANNEL *channel, int stream_id, char *buf, size_t buflen);
+    virtual ssize_t channel_write_ex(LIBSSH2_CHANNEL *channel, int stream_id, const char *buf, size_t buflen);
+    virtual int channel_eof(LIBSSH2_CHANNEL *channel);
+    virtual int channel_send_eof(LIBSSH2_CHANNEL *channel);
+    virtual int channel_close(LIBSSH2_CHANNEL *channel);
+    virtual int channel_wait_closed(LIBSSH2_CHANNEL *channel);
+    virtual int channel_free(LIBSSH2_CHANNEL *channel);
+    virtual int channel_get_exit_status(LIBSSH2_CHANNEL *channel);
+    virtual LIBSSH2_LISTENER *channel_forward_listen_ex(LIBSSH2_SESSION *session, const char *host, int port, int *bound_port, int queue_maxsize);
+    virtual LIBSSH2_CHANNEL *channel_forward_accept(LIBSSH2_LISTENER *listener);
+    virtual int channel_forward_cancel(LIBSSH2_LISTENER *listener);
+
+    /* SCP */
+    virtual LIBSSH2_CHANNEL *scp_send64(LIBSSH2_SESSION *session, const char *path, int mode, libssh2_int64_t size, time_t mtime, time_t atime);
+    virtual LIBSSH2_CHANNEL *scp_recv2(LIBSSH2_SESSION *session, const char *path, libssh2_struct_stat *sb);
+
+    /* SFTP */
+    virtual LIBSSH2_SFTP *sftp_init(LIBSSH2_SESSION *session);
+    virtual int sftp_shutdown(LIBSSH2_SFTP *sftp);
+    virtual unsigned long sftp_last_error(LIBSSH2_SFTP *sftp);
+    virtual LIBSSH2_SFTP_HANDLE *sftp_open_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len, unsigned long flags, long mode, int open_type);
+    virtual int sftp_close_handle(LIBSSH2_SFTP_HANDLE *handle);
+    virtual ssize_t sftp_read(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen);
+    virtual ssize_t sftp_write(LIBSSH2_SFTP_HANDLE *handle, const char *buffer, size_t count);
+    virtual void sftp_seek64(LIBSSH2_SFTP_HANDLE *handle, libssh2_uint64_t offset);
+    virtual int sftp_readdir_ex(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen, char *longentry, size_t longentry_maxlen, LIBSSH2_SFTP_ATTRIBUTES *attrs);
+    virtual int sftp_stat_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, int stat_type, LIBSSH2_SFTP_ATTRIBUTES *attrs);
+    virtual int sftp_mkdir_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, long mode);
+    virtual int sftp_rename_ex(LIBSSH2_SFTP *sftp, const char *source_filename, unsigned int source_filename_len, const char *dest_filename, unsigned int dest_filename_len, long flags);
+    virtual int sftp_unlink_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len);
+
+    /* libssh2 macros */
+    inline ssize_t channel_read(LIBSSH2_CHANNEL *channel, char *buf, size_t buflen)
+    {
+        return channel_read_ex(channel, 0, buf, buflen);
+    }
+    inline ssize_t channel_read_stderr(LIBSSH2_CHANNEL *channel, char *buf, size_t buflen)
+    {
+        return channel_read_ex(channel, SSH_EXTENDED_DATA_STDERR, buf, buflen);
+    }
+    inline ssize_t channel_write(LIBSSH2_CHANNEL *channel, const char *buf, size_t buflen)
+    {
+        return channel_write_ex(channel, 0, buf, buflen);
+    }
+    inline LIBSSH2_CHANNEL *channel_direct_tcpip(LIBSSH2_SESSION *session, const char *host, int port)
+    {
+        return channel_direct_tcpip_ex(session, host, port, "127.0.0.1", 22);
+    }
+};
+
+inline SshTransport *sshTransport()
+{
+    return SshTransport::instance();
+}
+
+#endif // SSHTRANSPORT_H
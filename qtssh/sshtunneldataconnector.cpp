@@ -1,30 +1,121 @@
 #include "sshtunneldataconnector.h"
 #include <QTcpSocket>
 #include <QEventLoop>
-#include "sshclient.h"
+#include "sshtransport.h"
+#include "sshtunnelscheduler.h"
 
 Q_LOGGING_CATEGORY(logxfer, "ssh.tunnel.transfer", QtWarningMsg)
 #define DEBUGCH qCDebug(logxfer) << m_name
 
-SshTunnelDataConnector::SshTunnelDataConnector(SshClient *client, const QString &name, QObject *parent)
+SshTunnelDataConnector::SshTunnelDataConnector(const QString &name, QObject *parent)
     : QObject(parent)
-    , m_sshClient(client)
     , m_name(name)
 {
     DEBUGCH << "SshTunnelDataConnector constructor";
     m_tx_data_on_sock = true;
+    m_rateTimer.setSingleShot(true);
+    QObject::connect(&m_rateTimer, &QTimer::timeout, this, &SshTunnelDataConnector::scheduled);
 }
 
 SshTunnelDataConnector::~SshTunnelDataConnector()
 {
     emit processed();
+    if(m_scheduler) m_scheduler->remove(this);
     if(m_sock) QObject::disconnect(m_sock);
     DEBUGCH << "TOTAL TRANSFERED: Tx:" << m_total_TxToSsh << " | Rx:" << m_total_RxToSock;
 }
 
-void SshTunnelDataConnector::setChannel(LIBSSH2_CHANNEL *channel)
+/* session is only used to report errors */
+void SshTunnelDataConnector::setChannel(LIBSSH2_CHANNEL *channel, LIBSSH2_SESSION *session)
 {
     m_sshChannel = channel;
+    m_sshSession = session;
+}
+
+/* Normally the session's one, given by the channel owning the connector */
+void SshTunnelDataConnector::setScheduler(SshTunnelScheduler *scheduler)
+{
+    if(m_scheduler) m_scheduler->remove(this);
+    m_scheduler = scheduler;
+    if(m_scheduler) m_scheduler->add(this, m_priority);
+}
+
+/* Limit of this connection alone in bytes per second (both directions), 0 for no limit */
+void SshTunnelDataConnector::setRateLimit(qint64 bytesPerSecond)
+{
+    if(!m_rateLimiter)
+    {
+        m_rateLimiter.reset(new SshRateLimiter());
+        m_rateLimiters.prepend(m_rateLimiter);
+    }
+    m_rateLimiter->setRate(bytesPerSecond);
+    emit sendEvent();
+}
+
+/* Limit shared with other connections (tunnel, session) */
+void SshTunnelDataConnector::addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter)
+{
+    if(limiter && !m_rateLimiters.contains(limiter))
+    {
+        m_rateLimiters.append(limiter);
+    }
+}
+
+/* Bytes we may move now, up to wanted; when 0 a retry is armed */
+qint64 SshTunnelDataConnector::_rateBudget(qint64 wanted)
+{
+    qint64 budget = wanted;
+    for(const QSharedPointer<SshRateLimiter> &limiter: m_rateLimiters)
+    {
+        budget = qMin(budget, limiter->available());
+    }
+    if(budget > 0)
+    {
+        return budget;
+    }
+
+    int wait = 0;
+    for(const QSharedPointer<SshRateLimiter> &limiter: m_rateLimiters)
+    {
+        wait = qMax(wait, limiter->delay(qMin<qint64>(wanted, RATELIMIT_MIN_CHUNK)));
+    }
+    if(!m_rateTimer.isActive())
+    {
+        DEBUGCH << "Rate limit reached, retry in" << wait << "ms";
+        m_rateTimer.start(qMax(wait, 1));
+    }
+    return 0;
+}
+
+void SshTunnelDataConnector::_rateConsume(qint64 len)
+{
+    for(const QSharedPointer<SshRateLimiter> &limiter: m_rateLimiters)
+    {
+        limiter->consume(len);
+    }
+}
+
+/* Share of the session given to this connection against the other tunnels (>= 1) */
+void SshTunnelDataConnector::setPriority(int priority)
+{
+    m_priority = qMax(priority, 1);
+    if(m_scheduler) m_scheduler->setPriority(this, m_priority);
+}
+
+int SshTunnelDataConnector::priority() const
+{
+    return m_priority;
+}
+
+/*
+ * Called by the scheduler when a new round gives us bytes to send, and by
+ * m_rateTimer once the rate allows more: the next allowance() joins the
+ * round again.
+ */
+void SshTunnelDataConnector::scheduled()
+{
+    emit processed();
+    emit sendEvent();
 }
 
 void SshTunnelDataConnector::setSock(QTcpSocket *sock)
@@ -112,10 +203,23 @@ ssize_t SshTunnelDataConnector::_transferSockToTx()
         return -1;
     }
 
-    len = m_sock->read(m_tx_buffer, BUFFER_SIZE);
+    qint64 budget = _rateBudget(BUFFER_SIZE);
+    if(budget == 0)
+    {
+        /*
+         * Data stays in the socket, m_rateTimer re-arms us. Leave the round
+         * meanwhile: the other tunnels must not wait for our rate.
+         */
+        m_tx_data_on_sock = (m_sock->bytesAvailable() > 0);
+        if(m_scheduler) m_scheduler->idle(this);
+        return 0;
+    }
+
+    len = m_sock->read(m_tx_buffer, budget);
     m_tx_data_on_sock = (m_sock->bytesAvailable() > 0);
     if(len > 0)
     {
+        _rateConsume(len);
         m_tx_start_ptr = m_tx_buffer;
         m_tx_stop_ptr = m_tx_buffer + len;
         m_total_sockToTx += len;
@@ -155,25 +259,41 @@ ssize_t SshTunnelDataConnector::_transferTxToSsh()
 
     while(_txBufferLen() > 0)
     {
-        ssize_t len = libssh2_channel_write(m_sshChannel, m_tx_start_ptr, _txBufferLen());
+        size_t towrite = _txBufferLen();
+        if(m_scheduler)
+        {
+            qint64 allowed = m_scheduler->allowance(this);
+            if(allowed <= 0)
+            {
+                /* Not our turn, the scheduler re-arms us */
+                DEBUGCH << "_transferTxToSsh: wait for next round";
+                return LIBSSH2_ERROR_EAGAIN;
+            }
+            towrite = static_cast<size_t>(qMin<qint64>(allowed, static_cast<qint64>(towrite)));
+        }
+        ssize_t len = sshTransport()->channel_write(m_sshChannel, m_tx_start_ptr, towrite);
         if(len == LIBSSH2_ERROR_EAGAIN)
         {
+            if(m_scheduler) m_scheduler->idle(this);
             return LIBSSH2_ERROR_EAGAIN;
         }
         if (len < 0)
         {
             char *emsg;
             int size;
-            int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
+            int ret = sshTransport()->session_last_error(m_sshSession, &emsg, &size, 0);
             qCCritical(logxfer) << m_name << "Error" << ret << "libssh2_channel_write" << QString(emsg);
+            if(m_scheduler) m_scheduler->idle(this);
             return ret;
         }
         if (len == 0)
         {
             qCWarning(logxfer) << m_name << "ERROR:  libssh2_channel_write return 0";
+            if(m_scheduler) m_scheduler->idle(this);
             return 0;
         }
         /* xfer OK */
+        if(m_scheduler) m_scheduler->consumed(this, len);
 
         m_total_TxToSsh += len;
         m_tx_start_ptr += len;
@@ -188,6 +308,7 @@ ssize_t SshTunnelDataConnector::_transferTxToSsh()
         }
     }
 
+    if(m_scheduler && !m_tx_data_on_sock) m_scheduler->idle(this);
     emit processed();
     return transfered;
 }
@@ -217,7 +338,15 @@ ssize_t SshTunnelDataConnector::_transferSshToRx()
         return 0;
     }
 
-    ssize_t len = libssh2_channel_read(m_sshChannel, m_rx_buffer, BUFFER_SIZE);
+    qint64 budget = _rateBudget(BUFFER_SIZE);
+    if(budget == 0)
+    {
+        /* Data stays in the SSH channel window, m_rateTimer re-arms us */
+        if(m_scheduler && _txBufferLen() == 0) m_scheduler->idle(this);
+        return 0;
+    }
+
+    ssize_t len = sshTransport()->channel_read(m_sshChannel, m_rx_buffer, static_cast<size_t>(budget));
     if(len == LIBSSH2_ERROR_EAGAIN)
         return 0;
 
@@ -229,18 +358,19 @@ ssize_t SshTunnelDataConnector::_transferSshToRx()
 
         char *emsg;
         int size;
-        int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
+        int ret = sshTransport()->session_last_error(m_sshSession, &emsg, &size, 0);
         qCCritical(logxfer) << m_name << "Error" << ret << QString("libssh2_channel_read (%1 / %2)").arg(len).arg(BUFFER_SIZE) << QString(emsg);
         return 0;
     }
 
     m_total_SshToRx += len;
+    _rateConsume(len);
 
-    if(len < BUFFER_SIZE)
+    if(len < budget)
     {
         DEBUGCH << "_transferSshToRx: Xfer " << len << "bytes";
         m_rx_data_on_ssh = false;
-        if (libssh2_channel_eof(m_sshChannel))
+        if (sshTransport()->channel_eof(m_sshChannel))
         {
             m_rx_eof = true;
             DEBUGCH << "_transferSshToRx: Ssh channel closed";
@@ -329,7 +459,7 @@ bool SshTunnelDataConnector::process()
     if(!m_tx_closed && m_tx_eof && (m_sock->bytesAvailable() == 0) && (_txBufferLen() == 0))
     {
         DEBUGCH << "Send EOF to SSH";
-        int ret = libssh2_channel_send_eof(m_sshChannel);
+        int ret = sshTransport()->channel_send_eof(m_sshChannel);
         if(ret == 0)
         {
             m_tx_closed = true;
@@ -389,7 +519,13 @@ void SshTunnelDataConnector::flushTx()
 
         if(m_sock->bytesAvailable() > 0)
         {
-            _transferSockToTx();
+            if(_transferSockToTx() == 0 && _txBufferLen() == 0 && m_rateTimer.isActive())
+            {
+                QEventLoop wait(this);
+                QObject::connect(this, &SshTunnelDataConnector::processed, &wait, &QEventLoop::quit);
+                wait.exec();
+                continue;
+            }
         }
 
         if(_txBufferLen() > 0)
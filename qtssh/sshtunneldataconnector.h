@@ -3,8 +3,13 @@
 
 #include <QObject>
 #include <QLoggingCategory>
-#include "sshchannel.h"
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+#include <libssh2.h>
+#include "sshratelimiter.h"
 class QTcpSocket;
+class SshTunnelScheduler;
 
 #define BUFFER_SIZE (128*1024)
 
@@ -14,10 +19,19 @@ class SshTunnelDataConnector : public QObject
 {
     Q_OBJECT
 
-    SshClient *m_sshClient  {nullptr};
+    LIBSSH2_SESSION *m_sshSession {nullptr};
     LIBSSH2_CHANNEL *m_sshChannel {nullptr};
     QTcpSocket *m_sock  {nullptr};
     QString m_name;
+    QPointer<SshTunnelScheduler> m_scheduler;
+    int m_priority {1};
+
+    /* Rate limits: own, then tunnel and session ones */
+    QSharedPointer<SshRateLimiter> m_rateLimiter;
+    QList<QSharedPointer<SshRateLimiter>> m_rateLimiters;
+    QTimer m_rateTimer;
+    qint64 _rateBudget(qint64 wanted);
+    void _rateConsume(qint64 len);
 
     /* Transfer functions */
 
@@ -61,10 +75,16 @@ public slots:
     void flushTx();
 
 public:
-    explicit SshTunnelDataConnector(SshClient *client, const QString &name, QObject *parent = nullptr);
+    explicit SshTunnelDataConnector(const QString &name, QObject *parent = nullptr);
     virtual ~SshTunnelDataConnector();
-    void setChannel(LIBSSH2_CHANNEL *channel);
+    void setChannel(LIBSSH2_CHANNEL *channel, LIBSSH2_SESSION *session = nullptr);
     void setSock(QTcpSocket *sock);
+    void setScheduler(SshTunnelScheduler *scheduler);
+    void setPriority(int priority);
+    int priority() const;
+    void scheduled();
+    void setRateLimit(qint64 bytesPerSecond);
+    void addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter);
 
 signals:
     void sendEvent();
@@ -5,6 +5,8 @@
 #include <QEventLoop>
 #include <cerrno>
 #include <QTime>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <sshtunnelinconnection.h>
 
 Q_LOGGING_CATEGORY(logsshtunnelin, "ssh.tunnelin", QtWarningMsg)
@@ -47,6 +49,80 @@ quint16 SshTunnelIn::remotePort()
     return static_cast<unsigned short>(m_remoteTcpPort);
 }
 
+/* Number of connections kept in advance while listening, 0 to create them on accept */
+void SshTunnelIn::setSpareConnections(int count)
+{
+    m_spareCount = qMax(count, 0);
+    while(m_spare.size() > m_spareCount)
+    {
+        m_spare.takeLast()->close();
+    }
+    _fillSpare();
+}
+
+/* Weight of this tunnel's connections in the session scheduler, e.g. 1 for bulk and 4 for a console */
+void SshTunnelIn::setPriority(int priority)
+{
+    m_priority = qMax(priority, 1);
+    for(SshTunnelInConnection *connection: m_connection)
+    {
+        connection->setPriority(m_priority);
+    }
+}
+
+/* Bytes per second shared by all connections of this tunnel (both directions), 0 for no limit */
+void SshTunnelIn::setRateLimit(qint64 bytesPerSecond)
+{
+    m_rateLimiter->setRate(bytesPerSecond);
+}
+
+quint64 SshTunnelIn::acceptCount() const
+{
+    return m_acceptCount;
+}
+
+/*
+ * Average per-connection setup time in microseconds. The wait of the
+ * forwarded channel in libssh2 before the accept is not included.
+ */
+qint64 SshTunnelIn::setupTimeAverage() const
+{
+    if(m_acceptCount == 0)
+        return 0;
+    return m_setupTimeTotal / static_cast<qint64>(m_acceptCount);
+}
+
+/* Maximum per-connection setup time in microseconds */
+qint64 SshTunnelIn::setupTimeMax() const
+{
+    return m_setupTimeMax;
+}
+
+/* Most connections accepted on a single wakeup */
+int SshTunnelIn::acceptBatchMax() const
+{
+    return m_acceptBatchMax;
+}
+
+SshTunnelInConnection *SshTunnelIn::takeConnection()
+{
+    if(!m_spare.isEmpty())
+    {
+        return m_spare.takeFirst();
+    }
+    return m_sshClient->getChannel<SshTunnelInConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
+}
+
+void SshTunnelIn::_fillSpare()
+{
+    while(channelState() == ChannelState::Ready && m_spare.size() < m_spareCount)
+    {
+        SshTunnelInConnection *connection = m_sshClient->getChannel<SshTunnelInConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
+        QObject::connect(connection, &SshTunnelInConnection::stateChanged, this, &SshTunnelIn::connectionStateChanged, Qt::UniqueConnection);
+        m_spare.append(connection);
+    }
+}
+
 void SshTunnelIn::sshDataReceived()
 {
     switch(channelState())
@@ -67,14 +143,14 @@ void SshTunnelIn::sshDataReceived()
                     return;
                 }
 
-                m_sshListener = libssh2_channel_forward_listen_ex(m_sshClient->session(), qPrintable(m_listenhost), m_remoteTcpPort, &m_boundPort, m_queueSize);
+                m_sshListener = sshTransport()->channel_forward_listen_ex(m_sshClient->session(), qPrintable(m_listenhost), m_remoteTcpPort, &m_boundPort, m_queueSize);
                 m_sshClient->releaseChannelCreationMutex(this);
 
                 if(m_sshListener == nullptr)
                 {
                     char *emsg;
                     int size;
-                    int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
+                    int ret = sshTransport()->session_last_error(m_sshClient->session(), &emsg, &size, 0);
                     if(ret == LIBSSH2_ERROR_EAGAIN)
                     {
                         return;
@@ -103,47 +179,75 @@ void SshTunnelIn::sshDataReceived()
             } while (m_sshListener == nullptr);
             /* OK, next step */
             setChannelState(ChannelState::Ready);
+            _fillSpare();
         }
 
         FALLTHROUGH; case Ready:
         {
-            LIBSSH2_CHANNEL *newChannel;
-            if ( ! m_sshClient->takeChannelCreationMutex(this) )
+            /* Drain every pending forwarded channel on this wakeup */
+            QElapsedTimer wakeup;
+            wakeup.start();
+            int batch = 0;
+            while(true)
             {
-                return;
-            }
-            newChannel = libssh2_channel_forward_accept(m_sshListener);
-            m_sshClient->releaseChannelCreationMutex(this);
+                LIBSSH2_CHANNEL *newChannel;
+                if ( ! m_sshClient->takeChannelCreationMutex(this) )
+                {
+                    break;
+                }
+                newChannel = sshTransport()->channel_forward_accept(m_sshListener);
+                m_sshClient->releaseChannelCreationMutex(this);
 
-            if(newChannel == nullptr)
-            {
-                char *emsg;
-                int size;
-                int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
-                if(ret == LIBSSH2_ERROR_EAGAIN)
+                if(newChannel == nullptr)
                 {
-                    return;
+                    char *emsg;
+                    int size;
+                    int ret = sshTransport()->session_last_error(m_sshClient->session(), &emsg, &size, 0);
+                    if(ret != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        qCWarning(logsshtunnelin) << "Channel session open failed: " << emsg;
+                    }
+                    break;
                 }
 
-                qCWarning(logsshtunnelin) << "Channel session open failed: " << emsg;
-                return;
+                /* We have a new connection on the remote port, need to create a connection tunnel */
+                qCDebug(logsshtunnelin) << "SshTunnelIn new connection";
+                QElapsedTimer setup;
+                setup.start();
+                SshTunnelInConnection *connection = takeConnection();
+                connection->setPriority(m_priority);
+                connection->addRateLimiter(m_rateLimiter);
+                connection->configure(newChannel, m_localTcpPort, m_targethost);
+                m_connection.append(connection);
+                QObject::connect(connection, &SshTunnelInConnection::stateChanged, this, &SshTunnelIn::connectionStateChanged, Qt::UniqueConnection);
+
+                qint64 setupTime = setup.nsecsElapsed() / 1000;
+                m_acceptCount++;
+                m_setupTimeTotal += setupTime;
+                m_setupTimeMax = qMax(m_setupTimeMax, setupTime);
+                ++batch;
             }
 
-            /* We have a new connection on the remote port, need to create a connection tunnel */
-            qCDebug(logsshtunnelin) << "SshTunnelIn new connection";
-            SshTunnelInConnection *connection = m_sshClient->getChannel<SshTunnelInConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
-            connection->configure(newChannel, m_localTcpPort, m_targethost);
-            m_connection.append(connection);
-            QObject::connect(connection, &SshTunnelInConnection::stateChanged, this, &SshTunnelIn::connectionStateChanged);
-            emit connectionChanged(m_connection.size());
+            if(batch > 0)
+            {
+                m_acceptBatchMax = qMax(m_acceptBatchMax, batch);
+                qCDebug(logsshtunnelin) << m_name << "accepted" << batch << "connections in" << wakeup.nsecsElapsed() / 1000 << "us";
+                emit connectionChanged(m_connection.size());
+                /* Replenish outside of the burst */
+                QTimer::singleShot(0, this, &SshTunnelIn::_fillSpare);
+            }
             break;
         }
 
         case Close:
         {
+            while(!m_spare.isEmpty())
+            {
+                m_spare.takeLast()->close();
+            }
             if(m_sshListener)
             {
-                if(libssh2_channel_forward_cancel(m_sshListener) == LIBSSH2_ERROR_EAGAIN)
+                if(sshTransport()->channel_forward_cancel(m_sshListener) == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
                 }
@@ -192,6 +296,7 @@ void SshTunnelIn::connectionStateChanged()
     {
         if(connection->channelState() == SshChannel::ChannelState::Free)
         {
+            m_spare.removeAll(connection);
             m_connection.removeAll(connection);
             emit connectionChanged(m_connection.count());
 
@@ -3,9 +3,14 @@
 #include "sshchannel.h"
 #include <QAbstractSocket>
 #include <QLoggingCategory>
+#include <QSharedPointer>
+#include "sshratelimiter.h"
 
 class SshTunnelInConnection;
 
+/* Connections created in advance, ready to take a burst of forwarded channels */
+#define TUNNELIN_SPARE_CONNECTIONS 4
+
 Q_DECLARE_LOGGING_CATEGORY(logsshtunnelin)
 
 class SshTunnelIn : public SshChannel
@@ -23,6 +28,18 @@ private:
     LIBSSH2_LISTENER *m_sshListener {nullptr};
     int  m_connectionCounter {0};
     QList<SshTunnelInConnection*> m_connection;
+    QList<SshTunnelInConnection*> m_spare;
+    int m_spareCount {TUNNELIN_SPARE_CONNECTIONS};
+    int m_priority {1};
+    QSharedPointer<SshRateLimiter> m_rateLimiter {new SshRateLimiter()};
+
+    /* Accept statistics, setup time from channel accepted to connection handoff */
+    quint64 m_acceptCount {0};
+    qint64 m_setupTimeTotal {0};
+    qint64 m_setupTimeMax {0};
+    int m_acceptBatchMax {0};
+
+    SshTunnelInConnection *takeConnection();
 
 protected:
     explicit SshTunnelIn(const QString &name, SshClient *client);
@@ -34,12 +51,22 @@ public:
     void close() override;
     quint16 localPort();
     quint16 remotePort();
+    void setSpareConnections(int count);
+    void setPriority(int priority);
+    void setRateLimit(qint64 bytesPerSecond);
+    quint64 acceptCount() const;
+    qint64 setupTimeAverage() const;
+    qint64 setupTimeMax() const;
+    int acceptBatchMax() const;
 
 public slots:
     void sshDataReceived() override;
     void connectionStateChanged();
     void flushTx() const;
 
+private slots:
+    void _fillSpare();
+
 signals:
     void connectionChanged(int);
 };
@@ -16,7 +16,7 @@ Q_LOGGING_CATEGORY(logsshtunnelinconnection, "ssh.tunnelin.connection", QtWarnin
 
 SshTunnelInConnection::SshTunnelInConnection(const QString &name, SshClient *client)
     : SshChannel(name, client)
-    , m_connector(client, name)
+    , m_connector(name)
 {
     QObject::connect(&m_sock, &QTcpSocket::connected, this, &SshTunnelInConnection::_socketConnected);
     QObject::connect(this, &SshTunnelInConnection::sendEvent, this, &SshTunnelInConnection::_eventLoop, Qt::QueuedConnection);
@@ -39,6 +39,11 @@ SshTunnelInConnection::~SshTunnelInConnection()
 
 void SshTunnelInConnection::close()
 {
+    if(m_sshChannel == nullptr)
+    {
+        /* Spare connection never configured, nothing to release */
+        setChannelState(ChannelState::Free);
+    }
 }
 
 void SshTunnelInConnection::_eventLoop()
@@ -47,6 +52,11 @@ void SshTunnelInConnection::_eventLoop()
     {
         case Openning:
         {
+            if(m_sshChannel == nullptr)
+            {
+                /* Spare connection, wait configure() */
+                return;
+            }
             DEBUGCH << "Channel session opened:" << m_hostname << ":" << m_port;
             m_sock.connectToHost(m_hostname, m_port);
             setChannelState(SshChannel::Exec);
@@ -86,7 +96,7 @@ void SshTunnelInConnection::_eventLoop()
         {
             DEBUGCH << "Freeing Channel";
 
-            int ret = libssh2_channel_free(m_sshChannel);
+            int ret = sshTransport()->channel_free(m_sshChannel);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -133,6 +143,21 @@ void SshTunnelInConnection::sshDataReceived()
     emit sendEvent();
 }
 
+void SshTunnelInConnection::setPriority(int priority)
+{
+    m_connector.setPriority(priority);
+}
+
+void SshTunnelInConnection::setRateLimit(qint64 bytesPerSecond)
+{
+    m_connector.setRateLimit(bytesPerSecond);
+}
+
+void SshTunnelInConnection::addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter)
+{
+    m_connector.addRateLimiter(limiter);
+}
+
 void SshTunnelInConnection::flushTx()
 {
     m_connector.flushTx();
@@ -141,7 +166,9 @@ void SshTunnelInConnection::flushTx()
 void SshTunnelInConnection::_socketConnected()
 {
     DEBUGCH << "Socket connection established";
-    m_connector.setChannel(m_sshChannel);
+    m_connector.setChannel(m_sshChannel, m_sshClient->session());
+    m_connector.setScheduler(m_sshClient->tunnelScheduler());
+    m_connector.addRateLimiter(m_sshClient->rateLimiter());
     m_connector.setSock(&m_sock);
     setChannelState(ChannelState::Ready);
     emit sendEvent();
@@ -21,6 +21,9 @@ public:
     void configure(LIBSSH2_CHANNEL* channel, quint16 port, QString hostname);
     virtual ~SshTunnelInConnection() override;
     void close() override;
+    void setPriority(int priority);
+    void setRateLimit(qint64 bytesPerSecond);
+    void addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter);
 
 private:
     SshTunnelDataConnector m_connector;
@@ -1,6 +1,7 @@
 #include "sshtunnelout.h"
 #include "sshclient.h"
 #include <QDateTime>
+#include <QTimer>
 
 Q_LOGGING_CATEGORY(logsshtunnelout, "ssh.tunnelout", QtWarningMsg)
 
@@ -9,6 +10,7 @@ SshTunnelOut::SshTunnelOut(const QString &name, SshClient *client)
     : SshChannel(name, client)
 {
     QObject::connect(&m_tcpserver, &QTcpServer::newConnection, this, &SshTunnelOut::_createConnection);
+    QObject::connect(&m_warmRecycle, &QTimer::timeout, this, &SshTunnelOut::_recycleWarm);
     sshDataReceived();
 }
 
@@ -30,6 +32,82 @@ void SshTunnelOut::listen(quint16 port, QString hostTarget, QString hostListen)
     m_hostTarget = hostTarget;
     m_tcpserver.listen(QHostAddress(hostListen), 0);
     setChannelState(ChannelState::Ready);
+    _fillWarm();
+}
+
+/*
+ * Number of direct-tcpip channels opened in advance while listening, so a
+ * new client does not wait for the channel open round-trip. Each warm
+ * channel holds a connection to the target. 0 (default) to open on accept.
+ *
+ * Targets drop idle connections: a warm channel is replaced once it is
+ * maxIdleMsec old (0 to keep it) or closed by the target.
+ */
+void SshTunnelOut::setWarmChannels(int count, int maxIdleMsec)
+{
+    m_warmCount = qMax(count, 0);
+    m_warmMaxIdle = qMax(maxIdleMsec, 0);
+    while(m_warm.size() > m_warmCount)
+    {
+        m_warm.takeLast()->close();
+    }
+    if(m_warmCount > 0 && m_warmMaxIdle > 0)
+    {
+        m_warmRecycle.start(qMax(m_warmMaxIdle / 2, 100));
+    }
+    else
+    {
+        m_warmRecycle.stop();
+    }
+    _fillWarm();
+}
+
+/* Close the warm channels no longer worth handing out, open fresh ones */
+void SshTunnelOut::_recycleWarm()
+{
+    for(auto it = m_warm.begin(); it != m_warm.end();)
+    {
+        SshTunnelOutConnection *connection = *it;
+        if(connection->isWarm(m_warmMaxIdle))
+        {
+            ++it;
+            continue;
+        }
+        qCDebug(logsshtunnelout) << "Recycle warm channel" << connection->name();
+        it = m_warm.erase(it);
+        if(connection->channelState() == ChannelState::Exec)
+        {
+            connection->close();
+        }
+    }
+    _fillWarm();
+}
+
+/* Weight of this tunnel's connections in the session scheduler, e.g. 1 for bulk and 4 for a console */
+void SshTunnelOut::setPriority(int priority)
+{
+    m_priority = qMax(priority, 1);
+    for(SshTunnelOutConnection *connection: m_connection)
+    {
+        connection->setPriority(m_priority);
+    }
+}
+
+/* Bytes per second shared by all connections of this tunnel (both directions), 0 for no limit */
+void SshTunnelOut::setRateLimit(qint64 bytesPerSecond)
+{
+    m_rateLimiter->setRate(bytesPerSecond);
+}
+
+void SshTunnelOut::_fillWarm()
+{
+    while(channelState() == ChannelState::Ready && m_warm.size() < m_warmCount)
+    {
+        SshTunnelOutConnection *connection = m_sshClient->getChannel<SshTunnelOutConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
+        connection->configureWarm(m_port, m_hostTarget);
+        QObject::connect(connection, &SshTunnelOutConnection::stateChanged, this, &SshTunnelOut::connectionStateChanged, Qt::UniqueConnection);
+        m_warm.append(connection);
+    }
 }
 
 void SshTunnelOut::sshDataReceived()
@@ -59,13 +137,18 @@ void SshTunnelOut::sshDataReceived()
         {
             qCDebug(logsshtunnelout) << m_name << "Close server";
             m_tcpserver.close();
+            m_warmRecycle.stop();
+            for(SshTunnelOutConnection *connection : m_warm)
+            {
+                connection->close();
+            }
             setChannelState(ChannelState::WaitClose);
         }
 
         FALLTHROUGH; case WaitClose:
         {
-            qCDebug(logsshtunnelout) << "Wait close channel:" << m_name << " (connections:"<< m_connection.count() << ")";
-            if(m_connection.count() == 0)
+            qCDebug(logsshtunnelout) << "Wait close channel:" << m_name << " (connections:"<< m_connection.count() << " warm:" << m_warm.count() << ")";
+            if(m_connection.count() == 0 && m_warm.count() == 0)
             {
                 setChannelState(ChannelState::Freeing);
             }
@@ -119,10 +202,13 @@ void SshTunnelOut::connectionStateChanged()
     {
         if(connection->channelState() == SshChannel::ChannelState::Free)
         {
-            m_connection.removeAll(connection);
-            emit connectionChanged(m_connection.count());
+            if(m_warm.removeAll(connection) == 0)
+            {
+                m_connection.removeAll(connection);
+                emit connectionChanged(m_connection.count());
+            }
 
-            if(m_connection.count() == 0 && channelState() == SshChannel::ChannelState::WaitClose)
+            if(m_connection.count() == 0 && m_warm.count() == 0 && channelState() == SshChannel::ChannelState::WaitClose)
             {
                 setChannelState(SshChannel::ChannelState::Freeing);
             }
@@ -146,10 +232,43 @@ quint16 SshTunnelOut::port() const
 void SshTunnelOut::_createConnection()
 {
     qCDebug(logsshtunnelout) << "SshTunnelOut new connection";
-    SshTunnelOutConnection *connection = m_sshClient->getChannel<SshTunnelOutConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
-    connection->configure(&m_tcpserver, m_port, m_hostTarget);
+    SshTunnelOutConnection *connection = nullptr;
+    while(!m_warm.isEmpty() && connection == nullptr)
+    {
+        SshTunnelOutConnection *warm = m_warm.takeFirst();
+        if(warm->isWarm(m_warmMaxIdle))
+        {
+            connection = warm;
+        }
+        else
+        {
+            qCDebug(logsshtunnelout) << "Drop stale warm channel" << warm->name();
+            if(warm->channelState() == ChannelState::Exec)
+            {
+                warm->close();
+            }
+        }
+    }
+
+    if(connection)
+    {
+        qCDebug(logsshtunnelout) << "Use warm channel" << connection->name();
+        connection->attach(&m_tcpserver);
+        QTimer::singleShot(0, this, &SshTunnelOut::_fillWarm);
+    }
+    else
+    {
+        connection = m_sshClient->getChannel<SshTunnelOutConnection>(m_name + QString("_%1").arg(m_connectionCounter++));
+        connection->configure(&m_tcpserver, m_port, m_hostTarget);
+        QObject::connect(connection, &SshTunnelOutConnection::stateChanged, this, &SshTunnelOut::connectionStateChanged, Qt::UniqueConnection);
+        if(m_warmCount > 0)
+        {
+            QTimer::singleShot(0, this, &SshTunnelOut::_fillWarm);
+        }
+    }
+    connection->setPriority(m_priority);
+    connection->addRateLimiter(m_rateLimiter);
     m_connection.append(connection);
-    QObject::connect(connection, &SshTunnelOutConnection::stateChanged, this, &SshTunnelOut::connectionStateChanged);
     emit connectionChanged(m_connection.count());
 }
 
@@ -4,6 +4,11 @@
 #include "sshchannel.h"
 #include "sshtunneloutconnection.h"
 #include <QTcpServer>
+#include <QTimer>
+#include <QSharedPointer>
+#include "sshratelimiter.h"
+
+#define WARM_CHANNEL_MAX_IDLE (10*1000)
 
 Q_DECLARE_LOGGING_CATEGORY(logsshtunnelout)
 
@@ -20,6 +25,9 @@ public:
     void close() override;
     quint16 localPort();
     quint16 port() const;
+    void setWarmChannels(int count, int maxIdleMsec = WARM_CHANNEL_MAX_IDLE);
+    void setPriority(int priority);
+    void setRateLimit(qint64 bytesPerSecond);
 
 public slots:
     void listen(quint16 port, QString hostTarget = "127.0.0.1", QString hostListen = "127.0.0.1");
@@ -35,10 +43,18 @@ private:
     int                     m_connectionCounter {0};
     QString                 m_hostTarget;
     QList<SshTunnelOutConnection*> m_connection;
+    QList<SshTunnelOutConnection*> m_warm;
+    int                     m_warmCount {0};
+    int                     m_warmMaxIdle {WARM_CHANNEL_MAX_IDLE};
+    QTimer                  m_warmRecycle;
+    int                     m_priority {1};
+    QSharedPointer<SshRateLimiter> m_rateLimiter {new SshRateLimiter()};
 
 
 private slots:
     void _createConnection();
+    void _fillWarm();
+    void _recycleWarm();
 
 signals:
     void connectionChanged(int);
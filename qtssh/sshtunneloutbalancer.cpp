@@ -0,0 +1,243 @@
+#include "sshtunneloutbalancer.h"
+#include "sshtunneloutconnection.h"
+#include "sshclient.h"
+#include <QTcpSocket>
+
+Q_LOGGING_CATEGORY(logsshtunneloutbalancer, "ssh.tunnelout.balancer", QtWarningMsg)
+
+SshTunnelOutBalancerServer::SshTunnelOutBalancerServer(QObject *parent)
+    : QTcpServer(parent)
+{
+}
+
+void SshTunnelOutBalancerServer::incomingConnection(qintptr socketDescriptor)
+{
+    emit newDescriptor(socketDescriptor);
+}
+
+SshTunnelOutBalancer::SshTunnelOutBalancer(const QString &name, QObject *parent)
+    : QObject(parent)
+    , m_name(name)
+{
+    QObject::connect(&m_tcpserver, &SshTunnelOutBalancerServer::newDescriptor, this, &SshTunnelOutBalancer::_dispatch);
+}
+
+SshTunnelOutBalancer::~SshTunnelOutBalancer()
+{
+    qCDebug(logsshtunneloutbalancer) << "delete SshTunnelOutBalancer:" << m_name;
+}
+
+void SshTunnelOutBalancer::addClient(SshClient *client)
+{
+    for(const Session &session: m_sessions)
+    {
+        if(session.client == client)
+        {
+            return;
+        }
+    }
+    QObject::connect(client, &SshClient::sshStateChanged, this, [this, client](SshClient::SshState state) {
+        _setReady(client, state == SshClient::Ready);
+    }, Qt::QueuedConnection);
+
+    Session session;
+    session.client = client;
+    if(client->thread() == thread())
+    {
+        session.ready = (client->sshState() == SshClient::Ready);
+        m_sessions.append(session);
+        return;
+    }
+    m_sessions.append(session);
+
+    /* Current state, read in the thread of the client and queued after its earlier signals */
+    QPointer<SshTunnelOutBalancer> balancer(this);
+    QMetaObject::invokeMethod(client, [client, balancer]() {
+        bool ready = (client->sshState() == SshClient::Ready);
+        if(balancer)
+        {
+            QMetaObject::invokeMethod(balancer.data(), [client, balancer, ready]() {
+                if(balancer)
+                {
+                    balancer->_setReady(client, ready);
+                }
+            }, Qt::QueuedConnection);
+        }
+    }, Qt::QueuedConnection);
+}
+
+/* Stop placing new connections on this session, open ones are left running */
+void SshTunnelOutBalancer::removeClient(SshClient *client)
+{
+    for(int i = 0; i < m_sessions.size(); i++)
+    {
+        if(m_sessions.at(i).client == client)
+        {
+            QObject::disconnect(client, nullptr, this, nullptr);
+            m_connections -= m_sessions.at(i).load;
+            m_sessions.removeAt(i);
+            emit connectionChanged(m_connections);
+            return;
+        }
+    }
+}
+
+void SshTunnelOutBalancer::setPlacement(Placement placement)
+{
+    m_placement = placement;
+}
+
+SshTunnelOutBalancer::Placement SshTunnelOutBalancer::placement() const
+{
+    return m_placement;
+}
+
+/* Weight of new connections in the scheduler of their session */
+void SshTunnelOutBalancer::setPriority(int priority)
+{
+    m_priority = qMax(priority, 1);
+}
+
+/* Bytes per second shared by all connections, whatever their session */
+void SshTunnelOutBalancer::setRateLimit(qint64 bytesPerSecond)
+{
+    m_rateLimiter->setRate(bytesPerSecond);
+}
+
+bool SshTunnelOutBalancer::listen(quint16 port, QString hostTarget, QString hostListen)
+{
+    m_port = port;
+    m_hostTarget = hostTarget;
+    return m_tcpserver.listen(QHostAddress(hostListen), 0);
+}
+
+void SshTunnelOutBalancer::close()
+{
+    m_tcpserver.close();
+}
+
+quint16 SshTunnelOutBalancer::localPort() const
+{
+    return m_tcpserver.serverPort();
+}
+
+quint16 SshTunnelOutBalancer::port() const
+{
+    return m_port;
+}
+
+int SshTunnelOutBalancer::connections() const
+{
+    return m_connections;
+}
+
+int SshTunnelOutBalancer::connections(SshClient *client) const
+{
+    for(const Session &session: m_sessions)
+    {
+        if(session.client == client)
+        {
+            return session.load;
+        }
+    }
+    return 0;
+}
+
+/* Index of the session for the next connection, -1 if none is connected */
+int SshTunnelOutBalancer::_pick()
+{
+    int best = -1;
+    for(int n = 0; n < m_sessions.size(); n++)
+    {
+        int i = (m_next + n) % m_sessions.size();
+        const Session &session = m_sessions.at(i);
+        if(session.client.isNull() || !session.ready)
+        {
+            continue;
+        }
+        if(m_placement == RoundRobin)
+        {
+            best = i;
+            break;
+        }
+        if(best < 0 || session.load < m_sessions.at(best).load)
+        {
+            best = i;
+        }
+    }
+    if(best >= 0)
+    {
+        m_next = (best + 1) % m_sessions.size();
+    }
+    return best;
+}
+
+void SshTunnelOutBalancer::_dispatch(qintptr socketDescriptor)
+{
+    int index = _pick();
+    if(index < 0)
+    {
+        qCWarning(logsshtunneloutbalancer) << m_name << "No session available, refuse client";
+        QTcpSocket sock;
+        sock.setSocketDescriptor(socketDescriptor);
+        sock.close();
+        return;
+    }
+
+    Session &session = m_sessions[index];
+    session.load++;
+    m_connections++;
+    emit connectionChanged(m_connections);
+
+    SshClient *client = session.client.data();
+    QPointer<SshTunnelOutBalancer> balancer(this);
+    QString name = m_name + QString("_%1").arg(m_connectionCounter++);
+    quint16 port = m_port;
+    QString target = m_hostTarget;
+    int priority = m_priority;
+    QSharedPointer<SshRateLimiter> limiter = m_rateLimiter;
+    qCDebug(logsshtunneloutbalancer) << m_name << "New connection" << name << "on" << client->getName();
+
+    /* The channel must be created in the thread of its session */
+    QMetaObject::invokeMethod(client, [client, balancer, name, socketDescriptor, port, target, priority, limiter]() {
+        SshTunnelOutConnection *connection = client->getChannel<SshTunnelOutConnection>(name);
+        if(balancer)
+        {
+            QObject::connect(connection, &SshChannel::stateChanged, balancer.data(), [balancer, client](SshChannel::ChannelState state) {
+                if(balancer && state == SshChannel::ChannelState::Free)
+                {
+                    balancer->_released(client);
+                }
+            });
+        }
+        connection->setPriority(priority);
+        connection->addRateLimiter(limiter);
+        connection->configureDescriptor(socketDescriptor, port, target);
+    }, Qt::QueuedConnection);
+}
+
+void SshTunnelOutBalancer::_released(SshClient *client)
+{
+    for(Session &session: m_sessions)
+    {
+        if(session.client == client)
+        {
+            session.load--;
+            m_connections--;
+            emit connectionChanged(m_connections);
+            return;
+        }
+    }
+}
+
+void SshTunnelOutBalancer::_setReady(SshClient *client, bool ready)
+{
+    for(Session &session: m_sessions)
+    {
+        if(session.client == client)
+        {
+            session.ready = ready;
+            return;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QObject>
+#include <QTcpServer>
+#include <QPointer>
+#include <QSharedPointer>
+#include "sshratelimiter.h"
+#include <QLoggingCategory>
+
+class SshClient;
+
+Q_DECLARE_LOGGING_CATEGORY(logsshtunneloutbalancer)
+
+/* Listening socket handing accepted descriptors over instead of QTcpSocket objects */
+class SshTunnelOutBalancerServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit SshTunnelOutBalancerServer(QObject *parent = nullptr);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+signals:
+    void newDescriptor(qintptr socketDescriptor);
+};
+
+/*
+ * Local port forwarded through several SSH sessions to the same host.
+ * Each accepted client gets a direct-tcpip channel on one of the sessions,
+ * chosen round-robin or on the session with the fewest open connections.
+ * Sessions may live in other threads: the channel is created in the thread
+ * of its SshClient and only the socket descriptor crosses threads. Their
+ * state is never read from here, it comes with queued signals.
+ */
+class SshTunnelOutBalancer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Placement {
+        RoundRobin,
+        LeastLoaded
+    };
+    Q_ENUM(Placement)
+
+    explicit SshTunnelOutBalancer(const QString &name, QObject *parent = nullptr);
+    virtual ~SshTunnelOutBalancer() override;
+
+    void addClient(SshClient *client);
+    void removeClient(SshClient *client);
+    void setPlacement(Placement placement);
+    Placement placement() const;
+    void setPriority(int priority);
+    void setRateLimit(qint64 bytesPerSecond);
+
+    bool listen(quint16 port, QString hostTarget = "127.0.0.1", QString hostListen = "127.0.0.1");
+    void close();
+    quint16 localPort() const;
+    quint16 port() const;
+    int connections() const;
+    int connections(SshClient *client) const;
+
+private:
+    struct Session {
+        QPointer<SshClient> client;
+        int load {0};
+        /* Followed by queued signals, the client may live in another thread */
+        bool ready {false};
+    };
+
+    QString                     m_name;
+    SshTunnelOutBalancerServer  m_tcpserver;
+    QList<Session>              m_sessions;
+    Placement                   m_placement {LeastLoaded};
+    int                         m_next {0};
+    int                         m_connections {0};
+    int                         m_connectionCounter {0};
+    int                         m_priority {1};
+    QSharedPointer<SshRateLimiter> m_rateLimiter {new SshRateLimiter()};
+    quint16                     m_port {0};
+    QString                     m_hostTarget;
+
+    int _pick();
+
+private slots:
+    void _dispatch(qintptr socketDescriptor);
+    void _released(SshClient *client);
+    void _setReady(SshClient *client, bool ready);
+
+signals:
+    void connectionChanged(int);
+};
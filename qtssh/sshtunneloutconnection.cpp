@@ -12,7 +12,7 @@ Q_LOGGING_CATEGORY(logsshtunneloutconnectiontransfer, "ssh.tunnelout.connection.
 
 SshTunnelOutConnection::SshTunnelOutConnection(const QString &name, SshClient *client)
     : SshChannel(name, client)
-    , m_connector(client, name)
+    , m_connector(name)
 {
     QObject::connect(this, &SshTunnelOutConnection::sendEvent, this, &SshTunnelOutConnection::_eventLoop, Qt::QueuedConnection);
     QObject::connect(&m_connector, &SshTunnelDataConnector::sendEvent, this, &SshTunnelOutConnection::sendEvent);
@@ -27,6 +27,74 @@ void SshTunnelOutConnection::configure(QTcpServer *server, quint16 remotePort, Q
     m_target = target;
 }
 
+/* Open the channel in advance, it waits in Exec state until attach() */
+void SshTunnelOutConnection::configureWarm(quint16 remotePort, QString target)
+{
+    m_server = nullptr;
+    m_port = remotePort;
+    m_target = target;
+    m_warm = true;
+}
+
+/* Client accepted elsewhere (see SshTunnelOutBalancer), the socket is created in this thread */
+void SshTunnelOutConnection::configureDescriptor(qintptr socketDescriptor, quint16 remotePort, QString target)
+{
+    m_server = nullptr;
+    m_descriptor = socketDescriptor;
+    m_port = remotePort;
+    m_target = target;
+    emit sendEvent();
+}
+
+/* Hand the next pending client of the server to a warm connection */
+void SshTunnelOutConnection::attach(QTcpServer *server)
+{
+    m_server = server;
+    m_warm = false;
+    emit sendEvent();
+}
+
+/*
+ * Still worth handing to a client: opening, or open without EOF from the
+ * target (idle timeouts of HTTP keep-alive, databases...) and opened less
+ * than maxIdle ms ago (0 for no limit).
+ */
+bool SshTunnelOutConnection::isWarm(qint64 maxIdle) const
+{
+    if(!m_warm)
+    {
+        return false;
+    }
+    if(channelState() == ChannelState::Openning)
+    {
+        return true;
+    }
+    if(channelState() != ChannelState::Exec || m_sshChannel == nullptr)
+    {
+        return false;
+    }
+    if(sshTransport()->channel_eof(m_sshChannel))
+    {
+        return false;
+    }
+    return (maxIdle <= 0 || m_warmSince.elapsed() < maxIdle);
+}
+
+void SshTunnelOutConnection::setPriority(int priority)
+{
+    m_connector.setPriority(priority);
+}
+
+void SshTunnelOutConnection::setRateLimit(qint64 bytesPerSecond)
+{
+    m_connector.setRateLimit(bytesPerSecond);
+}
+
+void SshTunnelOutConnection::addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter)
+{
+    m_connector.addRateLimiter(limiter);
+}
+
 SshTunnelOutConnection::~SshTunnelOutConnection()
 {
     DEBUGCH << "Free SshTunnelOutConnection (destructor)";
@@ -36,6 +104,13 @@ SshTunnelOutConnection::~SshTunnelOutConnection()
 void SshTunnelOutConnection::close()
 {
     DEBUGCH << "Close SshTunnelOutConnection asked";
+    if(channelState() == ChannelState::Openning)
+    {
+        /* Let libssh2 finish the channel opening in progress, then close */
+        m_closeRequested = true;
+        emit sendEvent();
+        return;
+    }
     if(channelState() != ChannelState::Error)
     {
         setChannelState(ChannelState::Close);
@@ -65,18 +140,26 @@ void SshTunnelOutConnection::_eventLoop()
             {
                 return;
             }
-            m_sshChannel = libssh2_channel_direct_tcpip(m_sshClient->session(), qPrintable(m_target), m_port);
+            m_sshChannel = sshTransport()->channel_direct_tcpip(m_sshClient->session(), qPrintable(m_target), m_port);
             m_sshClient->releaseChannelCreationMutex(this);
             if (m_sshChannel == nullptr)
             {
                 char *emsg;
                 int size;
-                int ret = libssh2_session_last_error(m_sshClient->session(), &emsg, &size, 0);
+                int ret = sshTransport()->session_last_error(m_sshClient->session(), &emsg, &size, 0);
                 if(ret == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
                 }
-                if(!m_error)
+                if(!m_error && m_descriptor >= 0)
+                {
+                    qCDebug(logsshtunneloutconnection) << "Refuse client socket connection" << QString(emsg);
+                    m_error = true;
+                    m_sock = new QTcpSocket();
+                    m_sock->setSocketDescriptor(m_descriptor);
+                    m_sock->close();
+                }
+                if(!m_error && m_server)
                 {
                     qCDebug(logsshtunneloutconnection) << "Refuse client socket connection on " << m_server->serverPort() << QString(emsg);
                     m_error = true;
@@ -92,15 +175,43 @@ void SshTunnelOutConnection::_eventLoop()
                 return;
             }
             DEBUGCH << "Channel session opened";
+            m_warmSince.start();
+            if(m_closeRequested)
+            {
+                setChannelState(ChannelState::Close);
+                emit sendEvent();
+                return;
+            }
             setChannelState(ChannelState::Exec);
         }
 
         FALLTHROUGH; case Exec:
         {
-            m_sock = m_server->nextPendingConnection();
+            if(m_descriptor >= 0)
+            {
+                m_sock = new QTcpSocket();
+                if(!m_sock->setSocketDescriptor(m_descriptor))
+                {
+                    qCWarning(logsshtunneloutconnection) << "Invalid client socket descriptor";
+                    delete m_sock;
+                    m_sock = nullptr;
+                }
+            }
+            else if(m_server == nullptr)
+            {
+                /* Warm channel, wait for a client */
+                return;
+            }
+            else
+            {
+                m_sock = m_server->nextPendingConnection();
+            }
             if(!m_sock)
             {
-                m_server->close();
+                if(m_server)
+                {
+                    m_server->close();
+                }
                 setChannelState(ChannelState::Error);
                 qCWarning(logsshtunneloutconnection) << "Fail to get client socket";
                 setChannelState(ChannelState::Close);
@@ -110,7 +221,9 @@ void SshTunnelOutConnection::_eventLoop()
             QObject::connect(m_sock, &QObject::destroyed, [this](){ DEBUGCH << "Client Socket destroyed";});
             m_name = QString(m_name + ":%1").arg(m_sock->localPort());
             DEBUGCH << "createConnection: " << m_sock << m_sock->localPort();
-            m_connector.setChannel(m_sshChannel);
+            m_connector.setChannel(m_sshChannel, m_sshClient->session());
+            m_connector.setScheduler(m_sshClient->tunnelScheduler());
+            m_connector.addRateLimiter(m_sshClient->rateLimiter());
             m_connector.setSock(m_sock);
             setChannelState(ChannelState::Ready);
             /* OK, next step */
@@ -128,6 +241,13 @@ void SshTunnelOutConnection::_eventLoop()
         case Close:
         {
             DEBUGCH << "closeChannel";
+            if(m_sock == nullptr)
+            {
+                /* Never attached to a client, only the SSH channel to release */
+                setChannelState(ChannelState::Freeing);
+                emit sendEvent();
+                return;
+            }
             m_connector.close();
             setChannelState(ChannelState::WaitClose);
         }
@@ -150,7 +270,7 @@ void SshTunnelOutConnection::_eventLoop()
         {
             DEBUGCH << "free Channel";
 
-            int ret = libssh2_channel_free(m_sshChannel);
+            int ret = (m_sshChannel)?(sshTransport()->channel_free(m_sshChannel)):(0);
             if(ret == LIBSSH2_ERROR_EAGAIN)
             {
                 return;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QTcpServer>
 #include <QLoggingCategory>
 #include "sshchannel.h"
@@ -18,17 +19,28 @@ protected:
 
 public:
     void configure(QTcpServer *server, quint16 remotePort, QString target = "127.0.0.1");
+    void configureWarm(quint16 remotePort, QString target = "127.0.0.1");
+    void configureDescriptor(qintptr socketDescriptor, quint16 remotePort, QString target = "127.0.0.1");
+    void attach(QTcpServer *server);
+    bool isWarm(qint64 maxIdle = 0) const;
     virtual ~SshTunnelOutConnection() override;
     void close() override;
+    void setPriority(int priority);
+    void setRateLimit(qint64 bytesPerSecond);
+    void addRateLimiter(const QSharedPointer<SshRateLimiter> &limiter);
 
 private:
     SshTunnelDataConnector m_connector;
     LIBSSH2_CHANNEL *m_sshChannel {nullptr};
-    QTcpSocket *m_sock;
-    QTcpServer *m_server;
-    quint16 m_port;
+    QTcpSocket *m_sock {nullptr};
+    QTcpServer *m_server {nullptr};
+    qintptr m_descriptor {-1};
+    quint16 m_port {0};
     QString m_target;
     bool m_error {false};
+    bool m_warm {false};
+    QElapsedTimer m_warmSince;
+    bool m_closeRequested {false};
 
 private slots:
     void _eventLoop();
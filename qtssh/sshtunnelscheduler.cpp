@@ -0,0 +1,149 @@
+#include "sshtunnelscheduler.h"
+#include "sshtunneldataconnector.h"
+#include <limits>
+
+Q_LOGGING_CATEGORY(logtunnelscheduler, "ssh.tunnel.scheduler", QtWarningMsg)
+
+SshTunnelScheduler::SshTunnelScheduler(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SshTunnelScheduler::setQuantum(qint64 quantum)
+{
+    m_quantum = qMax<qint64>(quantum, 1);
+}
+
+qint64 SshTunnelScheduler::quantum() const
+{
+    return m_quantum;
+}
+
+void SshTunnelScheduler::add(SshTunnelDataConnector *connector, int priority)
+{
+    Flow &flow = m_flows[connector];
+    flow.priority = qMax(priority, 1);
+}
+
+void SshTunnelScheduler::remove(SshTunnelDataConnector *connector)
+{
+    m_flows.remove(connector);
+    m_waiting.removeAll(connector);
+    if(!m_waiting.isEmpty() && _roundDone(nullptr))
+    {
+        _newRound();
+    }
+}
+
+void SshTunnelScheduler::setPriority(SshTunnelDataConnector *connector, int priority)
+{
+    auto it = m_flows.find(connector);
+    if(it != m_flows.end())
+    {
+        it->priority = qMax(priority, 1);
+    }
+}
+
+/* Bytes the connector may write on SSH now, 0 to wait for its next turn */
+qint64 SshTunnelScheduler::allowance(SshTunnelDataConnector *connector)
+{
+    auto it = m_flows.find(connector);
+    if(it == m_flows.end())
+    {
+        return std::numeric_limits<qint64>::max();
+    }
+    Flow &flow = *it;
+    if(!flow.backlogged)
+    {
+        flow.backlogged = true;
+        flow.deficit = m_quantum * flow.priority;
+    }
+
+    bool contention = false;
+    for(auto f = m_flows.cbegin(); f != m_flows.cend(); ++f)
+    {
+        if(f.key() != connector && f->backlogged)
+        {
+            contention = true;
+            break;
+        }
+    }
+    if(!contention)
+    {
+        flow.deficit = m_quantum * flow.priority;
+        return std::numeric_limits<qint64>::max();
+    }
+
+    if(flow.deficit > 0)
+    {
+        return flow.deficit;
+    }
+    if(_roundDone(connector))
+    {
+        _newRound();
+        return flow.deficit;
+    }
+    if(!m_waiting.contains(connector))
+    {
+        qCDebug(logtunnelscheduler) << "Connector waits for next round";
+        m_waiting.append(connector);
+    }
+    return 0;
+}
+
+void SshTunnelScheduler::consumed(SshTunnelDataConnector *connector, qint64 len)
+{
+    auto it = m_flows.find(connector);
+    if(it != m_flows.end())
+    {
+        it->deficit = qMax<qint64>(it->deficit - len, 0);
+    }
+}
+
+/* Nothing more to write for now, or SSH can't take more: leave the round */
+void SshTunnelScheduler::idle(SshTunnelDataConnector *connector)
+{
+    auto it = m_flows.find(connector);
+    if(it == m_flows.end() || !it->backlogged)
+    {
+        return;
+    }
+    it->backlogged = false;
+    it->deficit = 0;
+    m_waiting.removeAll(connector);
+    if(!m_waiting.isEmpty() && _roundDone(nullptr))
+    {
+        _newRound();
+    }
+}
+
+/* True when no busy connection other than except has bytes left in this round */
+bool SshTunnelScheduler::_roundDone(SshTunnelDataConnector *except) const
+{
+    for(auto f = m_flows.cbegin(); f != m_flows.cend(); ++f)
+    {
+        if(f.key() != except && f->backlogged && f->deficit > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SshTunnelScheduler::_newRound()
+{
+    for(auto f = m_flows.begin(); f != m_flows.end(); ++f)
+    {
+        if(f->backlogged)
+        {
+            f->deficit += m_quantum * f->priority;
+        }
+    }
+    QList<SshTunnelDataConnector*> waiting = m_waiting;
+    m_waiting.clear();
+    qCDebug(logtunnelscheduler) << "New round, wake" << waiting.size() << "connectors";
+    for(SshTunnelDataConnector *connector: waiting)
+    {
+        connector->scheduled();
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QLoggingCategory>
+
+class SshTunnelDataConnector;
+
+#define TUNNEL_SCHEDULER_QUANTUM (16*1024)
+
+Q_DECLARE_LOGGING_CATEGORY(logtunnelscheduler)
+
+/*
+ * Deficit round-robin between the tunnel connections of one session.
+ * Each connection with data for SSH gets quantum * priority bytes per
+ * round; once spent it waits until every other busy connection has spent
+ * its share too, then all are re-armed. An interactive tunnel thus waits
+ * at most one quantum of a bulk transfer. A lone connection is not limited.
+ */
+class SshTunnelScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SshTunnelScheduler(QObject *parent = nullptr);
+
+    void setQuantum(qint64 quantum);
+    qint64 quantum() const;
+
+    void add(SshTunnelDataConnector *connector, int priority = 1);
+    void remove(SshTunnelDataConnector *connector);
+    void setPriority(SshTunnelDataConnector *connector, int priority);
+
+    qint64 allowance(SshTunnelDataConnector *connector);
+    void consumed(SshTunnelDataConnector *connector, qint64 len);
+    void idle(SshTunnelDataConnector *connector);
+
+private:
+    struct Flow {
+        int priority {1};
+        qint64 deficit {0};
+        bool backlogged {false};
+    };
+
+    QHash<SshTunnelDataConnector*, Flow> m_flows;
+    QList<SshTunnelDataConnector*> m_waiting;
+    qint64 m_quantum {TUNNEL_SCHEDULER_QUANTUM};
+
+    bool _roundDone(SshTunnelDataConnector *except) const;
+    void _newRound();
+};
@@ -0,0 +1,437 @@
+#include "benchmark.h"
+#include <sshclient.h>
+#include <sshprocess.h>
+#include <sshtunnelin.h>
+#include <sshtunnelout.h>
+#include <sshsftp.h>
+#include <sshscpsend.h>
+#include <sshscpget.h>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(bench, "test.ssh.benchmark", QtInfoMsg)
+
+Benchmark::Benchmark(SshClient *ssh, const QString &workDir, QObject *parent)
+    : QObject(parent)
+    , m_ssh(ssh)
+    , m_workDir(workDir)
+{
+    setPayloadSize(4*1024*1024);
+    m_target.setMaxPendingConnections(10000);
+    m_target.listen(QHostAddress::LocalHost, 0);
+    m_rssSampler.setInterval(RSS_SAMPLE_INTERVAL);
+    QObject::connect(&m_rssSampler, &QTimer::timeout, this, [this]() {
+        m_rssPeakKb = qMax(m_rssPeakKb, currentRssKb());
+    });
+}
+
+void Benchmark::setRepeat(int repeat)
+{
+    m_repeat = qMax(repeat, 1);
+}
+
+/* Needed by suites opening their own sessions */
+void Benchmark::setConnection(const QString &user, quint16 port, const QByteArray &publicKey, const QByteArray &privateKey)
+{
+    m_user = user;
+    m_port = port;
+    m_publicKey = publicKey;
+    m_privateKey = privateKey;
+}
+
+void Benchmark::setMaxFileSize(qint64 size)
+{
+    m_maxFileSize = qMax<qint64>(size, 1024);
+}
+
+/* One-way delays added by a local proxy for the transfer suite, 0 for direct */
+void Benchmark::setLatencies(const QList<int> &oneWayMsec)
+{
+    m_latencies = oneWayMsec;
+}
+
+/* Largest number of concurrent channels of the channels suite */
+void Benchmark::setMaxChannels(int count)
+{
+    m_maxChannels = qMax(count, 1);
+}
+
+void Benchmark::setPayloadSize(int size)
+{
+    m_payload.resize(size);
+    for(int i = 0; i < size; i++)
+    {
+        m_payload[i] = static_cast<char>((i * 7 + i / 4093) & 0xFF);
+    }
+}
+
+QStringList Benchmark::suites()
+{
+    return {"tunnelout", "tunnelin", "sftp", "scp", "exec", "transfer", "channels", "latency"};
+}
+
+bool Benchmark::run(const QStringList &suites)
+{
+    for(const QString &suite: suites)
+    {
+        qCInfo(bench) << "Running" << suite;
+        if(suite == "tunnelout")
+            benchTunnelOut();
+        else if(suite == "tunnelin")
+            benchTunnelIn();
+        else if(suite == "sftp")
+            benchSftp();
+        else if(suite == "scp")
+            benchScp();
+        else if(suite == "exec")
+            benchExec();
+        else if(suite == "transfer")
+            benchTransfer();
+        else if(suite == "channels")
+            benchChannels();
+        else if(suite == "latency")
+            benchLatency();
+        else
+        {
+            qCCritical(bench) << "Unknown suite" << suite;
+            return false;
+        }
+    }
+    return m_failures == 0;
+}
+
+QJsonArray Benchmark::results() const
+{
+    return m_results;
+}
+
+int Benchmark::failures() const
+{
+    return m_failures;
+}
+
+void Benchmark::record(const QString &suite, const QString &name, QJsonObject metrics)
+{
+    metrics["suite"] = suite;
+    metrics["name"] = name;
+    qCInfo(bench) << suite << name << metrics;
+    m_results.append(metrics);
+}
+
+void Benchmark::fail(const QString &suite, const QString &name, const QString &message)
+{
+    qCCritical(bench) << suite << name << "failed:" << message;
+    QJsonObject res;
+    res["suite"] = suite;
+    res["name"] = name;
+    res["error"] = message;
+    m_results.append(res);
+    m_failures++;
+}
+
+QString Benchmark::channelName(const QString &prefix)
+{
+    return QString("%1_%2").arg(prefix).arg(m_channelCounter++);
+}
+
+/* Local file of the given size filled with the payload pattern */
+QString Benchmark::localFile(const QString &name, qint64 size)
+{
+    QString path = QDir(m_workDir).filePath(name);
+    QFile file(path);
+    if(file.exists() && file.size() == size)
+    {
+        return path;
+    }
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return QString();
+    }
+    qint64 left = size;
+    while(left > 0)
+    {
+        qint64 len = qMin<qint64>(left, m_payload.size());
+        if(file.write(m_payload.constData(), len) != len)
+        {
+            return QString();
+        }
+        left -= len;
+    }
+    return path;
+}
+
+QJsonObject Benchmark::throughput(qint64 bytes, qint64 nsecs)
+{
+    QJsonObject res;
+    res["bytes"] = bytes;
+    res["elapsed_ms"] = static_cast<double>(nsecs) / 1e6;
+    res["mb_per_s"] = (nsecs > 0)?(static_cast<double>(bytes) * 1e3 / static_cast<double>(nsecs)):(0.0);
+    return res;
+}
+
+/* Distribution of samples (any unit) */
+QJsonObject Benchmark::percentiles(QVector<qint64> samples)
+{
+    QJsonObject res;
+    res["count"] = samples.size();
+    if(samples.isEmpty())
+    {
+        return res;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double p) {
+        int i = static_cast<int>(p * (samples.size() - 1) + 0.5);
+        return samples.at(i);
+    };
+    res["min"] = samples.first();
+    res["p50"] = at(0.50);
+    res["p90"] = at(0.90);
+    res["p99"] = at(0.99);
+    res["p999"] = at(0.999);
+    res["max"] = samples.last();
+    return res;
+}
+
+/*
+ * Connect to port (a tunnel entry) and move total bytes to or from the peer
+ * accepted by m_target. Returns the elapsed nanoseconds, -1 on failure.
+ */
+qint64 Benchmark::pump(quint16 port, Direction direction, qint64 total)
+{
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+
+    QTcpSocket cli;
+    QTcpSocket *srv = nullptr;
+    QObject::connect(&m_target, &QTcpServer::newConnection, &loop, &QEventLoop::quit);
+    cli.connectToHost(QHostAddress::LocalHost, port);
+    timeout.start(BENCH_TIMEOUT);
+    if(!m_target.hasPendingConnections() && loop.exec() != 0)
+    {
+        return -1;
+    }
+    QObject::disconnect(&m_target, &QTcpServer::newConnection, &loop, &QEventLoop::quit);
+    srv = m_target.nextPendingConnection();
+    if(!srv)
+    {
+        return -1;
+    }
+
+    QTcpSocket *writer = (direction == Upload)?(&cli):(srv);
+    QTcpSocket *reader = (direction == Upload)?(srv):(&cli);
+    qint64 written = 0;
+    qint64 received = 0;
+    auto feed = [&]() {
+        while(written < total && writer->bytesToWrite() < m_payload.size())
+        {
+            qint64 len = qMin<qint64>(total - written, m_payload.size());
+            writer->write(m_payload.constData(), len);
+            written += len;
+        }
+    };
+    QObject::connect(writer, &QTcpSocket::bytesWritten, &loop, feed);
+    QObject::connect(reader, &QTcpSocket::readyRead, &loop, [&]() {
+        received += reader->readAll().size();
+        if(received >= total)
+        {
+            loop.quit();
+        }
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    feed();
+    int ret = loop.exec();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    cli.disconnectFromHost();
+    srv->disconnectFromHost();
+    srv->deleteLater();
+    return (ret == 0)?(elapsed):(-1);
+}
+
+void Benchmark::benchTunnelOut()
+{
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>(channelName("bench_out"));
+    out->listen(m_target.serverPort());
+    qint64 total = static_cast<qint64>(m_payload.size()) * m_repeat;
+
+    qint64 ns = pump(out->localPort(), Upload, total);
+    if(ns < 0)
+        fail("tunnelout", "upload", "transfer timeout");
+    else
+        record("tunnelout", "upload", throughput(total, ns));
+
+    ns = pump(out->localPort(), Download, total);
+    if(ns < 0)
+        fail("tunnelout", "download", "transfer timeout");
+    else
+        record("tunnelout", "download", throughput(total, ns));
+
+    out->close();
+}
+
+void Benchmark::benchTunnelIn()
+{
+    SshTunnelIn *in = m_ssh->getChannel<SshTunnelIn>(channelName("bench_in"));
+    in->listen("127.0.0.1", m_target.serverPort(), 0);
+    if(!in->waitForState(SshChannel::Ready))
+    {
+        fail("tunnelin", "listen", "remote listen failed");
+        return;
+    }
+    qint64 total = static_cast<qint64>(m_payload.size()) * m_repeat;
+
+    qint64 ns = pump(in->remotePort(), Upload, total);
+    if(ns < 0)
+        fail("tunnelin", "upload", "transfer timeout");
+    else
+        record("tunnelin", "upload", throughput(total, ns));
+
+    ns = pump(in->remotePort(), Download, total);
+    if(ns < 0)
+        fail("tunnelin", "download", "transfer timeout");
+    else
+        record("tunnelin", "download", throughput(total, ns));
+
+    in->close();
+}
+
+void Benchmark::benchSftp()
+{
+    qint64 size = static_cast<qint64>(m_payload.size()) * m_repeat;
+    QString local = localFile("sftp_src.bin", size);
+    QString remote = QDir(m_workDir).filePath("sftp_remote.bin");
+    QString back = QDir(m_workDir).filePath("sftp_back.bin");
+    if(local.isEmpty())
+    {
+        fail("sftp", "send", "can't create local file");
+        return;
+    }
+
+    SshSFtp *sftp = m_ssh->getChannel<SshSFtp>(channelName("bench_sftp"));
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = !sftp->send(local, remote).isEmpty();
+    qint64 ns = timer.nsecsElapsed();
+    if(ok)
+        record("sftp", "send", throughput(size, ns));
+    else
+        fail("sftp", "send", sftp->errMsg().join("; "));
+
+    QFile::remove(back);
+    timer.restart();
+    ok = ok && sftp->get(remote, back, true);
+    ns = timer.nsecsElapsed();
+    if(ok && QFileInfo(back).size() == size)
+        record("sftp", "get", throughput(size, ns));
+    else
+        fail("sftp", "get", sftp->errMsg().join("; "));
+
+    sftp->close();
+    QFile::remove(remote);
+    QFile::remove(back);
+}
+
+void Benchmark::benchScp()
+{
+    qint64 size = static_cast<qint64>(m_payload.size()) * m_repeat;
+    QString local = localFile("scp_src.bin", size);
+    QString remote = QDir(m_workDir).filePath("scp_remote.bin");
+    QString back = QDir(m_workDir).filePath("scp_back.bin");
+    if(local.isEmpty())
+    {
+        fail("scp", "send", "can't create local file");
+        return;
+    }
+
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+
+    SshScpSend *send = m_ssh->getChannel<SshScpSend>(channelName("bench_scpsend"));
+    QObject::connect(send, &SshScpSend::finished, &loop, &QEventLoop::quit);
+    QObject::connect(send, &SshScpSend::failed, &loop, [&loop](){ loop.exit(1); });
+    QElapsedTimer timer;
+    timer.start();
+    timeout.start(BENCH_TIMEOUT);
+    send->send(local, remote);
+    int ret = loop.exec();
+    qint64 ns = timer.nsecsElapsed();
+    if(ret == 0)
+        record("scp", "send", throughput(size, ns));
+    else
+        fail("scp", "send", (ret < 0)?("timeout"):("transfer failed"));
+    send->close();
+
+    QFile::remove(back);
+    SshScpGet *get = m_ssh->getChannel<SshScpGet>(channelName("bench_scpget"));
+    QObject::connect(get, &SshScpGet::finished, &loop, &QEventLoop::quit);
+    QObject::connect(get, &SshScpGet::failed, &loop, [&loop](){ loop.exit(1); });
+    timer.restart();
+    timeout.start(BENCH_TIMEOUT);
+    get->get(remote, back);
+    ret = loop.exec();
+    ns = timer.nsecsElapsed();
+    if(ret == 0 && QFileInfo(back).size() == size)
+        record("scp", "get", throughput(size, ns));
+    else
+        fail("scp", "get", (ret < 0)?("timeout"):("transfer failed"));
+    get->close();
+
+    QFile::remove(remote);
+    QFile::remove(back);
+}
+
+void Benchmark::benchExec()
+{
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+
+    /* Channel open + exec + close round-trips */
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < m_repeat; i++)
+    {
+        SshProcess *proc = m_ssh->getChannel<SshProcess>(channelName("bench_exec"));
+        QObject::connect(proc, &SshProcess::finished, &loop, &QEventLoop::quit);
+        QObject::connect(proc, &SshProcess::failed, &loop, [&loop](){ loop.exit(1); });
+        timeout.start(BENCH_TIMEOUT);
+        proc->runCommand("true");
+        if(loop.exec() != 0)
+        {
+            fail("exec", "roundtrip", proc->errMsg().join("; "));
+            return;
+        }
+    }
+    QJsonObject res;
+    res["count"] = m_repeat;
+    res["avg_ms"] = static_cast<double>(timer.nsecsElapsed()) / 1e6 / m_repeat;
+    record("exec", "roundtrip", res);
+
+    /* Bulk output of a remote command */
+    qint64 size = static_cast<qint64>(m_payload.size()) * m_repeat;
+    SshProcess *proc = m_ssh->getChannel<SshProcess>(channelName("bench_exec"));
+    QObject::connect(proc, &SshProcess::finished, &loop, &QEventLoop::quit);
+    QObject::connect(proc, &SshProcess::failed, &loop, [&loop](){ loop.exit(1); });
+    timer.restart();
+    timeout.start(BENCH_TIMEOUT);
+    proc->runCommand(QString("head -c %1 /dev/zero").arg(size));
+    int ret = loop.exec();
+    qint64 ns = timer.nsecsElapsed();
+    if(ret == 0 && proc->result().size() == size)
+        record("exec", "output", throughput(size, ns));
+    else
+        fail("exec", "output", proc->errMsg().join("; "));
+}
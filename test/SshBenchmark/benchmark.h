@@ -0,0 +1,103 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QObject>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTimer>
+#include <QLoggingCategory>
+#include <QVector>
+#include <functional>
+
+class SshClient;
+
+Q_DECLARE_LOGGING_CATEGORY(bench)
+
+#define BENCH_TIMEOUT (120*1000)
+/* Resident size polling during a measurement (msec) */
+#define RSS_SAMPLE_INTERVAL 10
+
+/*
+ * Benchmarks run against one connected SshClient. Each measurement is
+ * appended to results() as a JSON object with at least "suite" and "name".
+ */
+class Benchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Benchmark(SshClient *ssh, const QString &workDir, QObject *parent = nullptr);
+
+    void setRepeat(int repeat);
+    void setPayloadSize(int size);
+    void setConnection(const QString &user, quint16 port, const QByteArray &publicKey, const QByteArray &privateKey);
+    void setMaxFileSize(qint64 size);
+    void setLatencies(const QList<int> &oneWayMsec);
+    void setMaxChannels(int count);
+    static QStringList suites();
+    bool run(const QStringList &suites);
+    QJsonArray results() const;
+    int failures() const;
+
+private:
+    enum Direction {
+        Upload,
+        Download
+    };
+
+    struct Usage {
+        qint64 cpuNs {0};
+        qint64 rssKb {0};
+    };
+
+    SshClient *m_ssh;
+    QString m_workDir;
+    int m_repeat {25};
+    QByteArray m_payload;
+    QJsonArray m_results;
+    int m_failures {0};
+    int m_channelCounter {0};
+    QTcpServer m_target;
+    QString m_user;
+    quint16 m_port {0};
+    QByteArray m_publicKey;
+    QByteArray m_privateKey;
+    qint64 m_maxFileSize {64*1024*1024};
+    QList<int> m_latencies {0, 20};
+    int m_maxChannels {5000};
+    QTimer m_rssSampler;
+    qint64 m_rssPeakKb {0};
+
+    void record(const QString &suite, const QString &name, QJsonObject metrics);
+    void fail(const QString &suite, const QString &name, const QString &message);
+    QString channelName(const QString &prefix);
+    QString localFile(const QString &name, qint64 size);
+    qint64 pump(quint16 port, Direction direction, qint64 total);
+    static QJsonObject throughput(qint64 bytes, qint64 nsecs);
+    static QJsonObject percentiles(QVector<qint64> samples);
+    SshClient *connectClient(quint16 port, const QString &name);
+    static Usage usage();
+    Usage beginUsage();
+    void addUsage(QJsonObject &metrics, const Usage &before, qint64 bytes);
+    bool scpSend(SshClient *ssh, const QStringList &locals, const QString &remoteDir, int bufferSize);
+    bool scpGet(SshClient *ssh, const QStringList &remotes, const QString &localDir, int bufferSize);
+    static qint64 currentRssKb();
+    static int raiseFileLimit();
+    static bool waitUntil(const std::function<bool()> &done, int timeoutMsec);
+    void channelScale(const QString &kind, quint16 port, int count, const std::function<int()> &connections);
+    void channelChurn(const QString &kind, quint16 port, const std::function<int()> &connections);
+    static void startEcho(QTcpServer &echo);
+    QVector<qint64> pingPong(quint16 port, int iterations);
+
+    void benchTunnelOut();
+    void benchTunnelIn();
+    void benchSftp();
+    void benchScp();
+    void benchExec();
+    void benchTransfer();
+    void benchChannels();
+    void benchLatency();
+};
+
+#endif // BENCHMARK_H
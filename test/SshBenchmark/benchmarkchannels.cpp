@@ -0,0 +1,292 @@
+#include "benchmark.h"
+#include <sshclient.h>
+#include <sshtunnelin.h>
+#include <sshtunnelout.h>
+#include <QFile>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QPointer>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define CHANNELS_PACKET_SIZE 64
+#define CHANNELS_MIN_PACKETS 10000
+#define CHURN_RATE 50
+#define CHURN_DURATION (5*1000)
+
+/* Current resident size, unlike ru_maxrss which only grows */
+qint64 Benchmark::currentRssKb()
+{
+    QFile statm("/proc/self/statm");
+    if(!statm.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if(fields.size() < 2)
+    {
+        return 0;
+    }
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+/* Each channel uses three descriptors here (client, tunnel and target sockets) */
+int Benchmark::raiseFileLimit()
+{
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) != 0)
+    {
+        return 1024;
+    }
+    if(rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return static_cast<int>(qMin<rlim_t>(rl.rlim_cur, 1 << 20));
+}
+
+/* Wait until done() is true, polling the event loop; false on timeout */
+bool Benchmark::waitUntil(const std::function<bool()> &done, int timeoutMsec)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, &QEventLoop::quit);
+    poll.start(10);
+    while(!done())
+    {
+        if(timer.elapsed() > timeoutMsec)
+        {
+            return false;
+        }
+        loop.exec();
+    }
+    return true;
+}
+
+/*
+ * Open count connections through the tunnel entry port at once, then push
+ * small packets round-robin over all of them. Every client first sends its
+ * index so the target side can time the channel setup.
+ */
+void Benchmark::channelScale(const QString &kind, quint16 port, int count, const std::function<int()> &connections)
+{
+    QString name = QString("%1_%2").arg(kind).arg(count);
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> started(count, 0);
+    QVector<qint64> openLatency;
+    openLatency.reserve(count);
+    QList<QTcpSocket*> clients;
+    QList<QTcpSocket*> peers;
+    qint64 received = 0;
+
+    QMetaObject::Connection accept = QObject::connect(&m_target, &QTcpServer::newConnection, this, [&]() {
+        while(m_target.hasPendingConnections())
+        {
+            QTcpSocket *peer = m_target.nextPendingConnection();
+            peers << peer;
+            QObject::connect(peer, &QTcpSocket::readyRead, peer, [&, peer]() {
+                if(!peer->property("identified").toBool())
+                {
+                    if(peer->bytesAvailable() < 4)
+                        return;
+                    char index[4];
+                    peer->read(index, 4);
+                    qint32 i = qFromBigEndian<qint32>(index);
+                    if(i >= 0 && i < count)
+                        openLatency << (clock.nsecsElapsed() - started.at(i)) / 1000;
+                    peer->setProperty("identified", true);
+                }
+                received += peer->readAll().size();
+            });
+        }
+    });
+
+    qint64 rssBefore = currentRssKb();
+    for(int i = 0; i < count; i++)
+    {
+        QTcpSocket *cli = new QTcpSocket(this);
+        char index[4];
+        qToBigEndian<qint32>(i, index);
+        started[i] = clock.nsecsElapsed();
+        cli->connectToHost(QHostAddress::LocalHost, port);
+        cli->write(index, 4);
+        clients << cli;
+    }
+    bool opened = waitUntil([&]() { return openLatency.size() == count; }, BENCH_TIMEOUT);
+    qint64 openNs = clock.nsecsElapsed();
+    qint64 rssAfter = currentRssKb();
+
+    if(!opened)
+    {
+        fail("channels", name, QString("only %1 channels opened").arg(openLatency.size()));
+    }
+    else
+    {
+        QJsonObject metrics;
+        metrics["channels"] = count;
+        metrics["open_total_ms"] = static_cast<double>(openNs) / 1e6;
+        metrics["open_latency_us"] = percentiles(openLatency);
+        /* Includes the benchmark's own two sockets per channel */
+        metrics["rss_per_channel_bytes"] = static_cast<double>(rssAfter - rssBefore) * 1024.0 / count;
+
+        int packets = qMax(CHANNELS_MIN_PACKETS, count);
+        qint64 expected = received + static_cast<qint64>(packets) * CHANNELS_PACKET_SIZE;
+        QByteArray packet(CHANNELS_PACKET_SIZE, 'p');
+        Usage before = usage();
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < packets; i++)
+        {
+            clients.at(i % count)->write(packet);
+        }
+        bool ok = waitUntil([&]() { return received >= expected; }, BENCH_TIMEOUT);
+        qint64 ns = timer.nsecsElapsed();
+        Usage after = usage();
+        if(ok)
+        {
+            metrics["packets"] = packets;
+            metrics["packet_wall_ns"] = static_cast<double>(ns) / packets;
+            metrics["packet_cpu_ns"] = static_cast<double>(after.cpuNs - before.cpuNs) / packets;
+            record("channels", name, metrics);
+        }
+        else
+        {
+            fail("channels", name, "packets lost");
+        }
+    }
+
+    QObject::disconnect(accept);
+    qDeleteAll(clients);
+    qDeleteAll(peers);
+    if(!waitUntil([&]() { return connections() == 0; }, BENCH_TIMEOUT))
+    {
+        fail("channels", name + "_close", QString("%1 connections left open").arg(connections()));
+    }
+}
+
+/*
+ * Short-lived connections at a fixed rate: open, send one byte, close from
+ * the target side. Reports setup latency and what is left afterwards.
+ */
+void Benchmark::channelChurn(const QString &kind, quint16 port, const std::function<int()> &connections)
+{
+    QString name = kind + "_churn";
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> started;
+    QVector<qint64> latency;
+    QList<QPointer<QTcpSocket>> sockets;
+    int launched = 0;
+    int total = CHURN_RATE * CHURN_DURATION / 1000;
+    int channelsBefore = m_ssh->findChildren<SshChannel*>().size();
+    qint64 rssBefore = currentRssKb();
+
+    QMetaObject::Connection accept = QObject::connect(&m_target, &QTcpServer::newConnection, this, [&]() {
+        while(m_target.hasPendingConnections())
+        {
+            QTcpSocket *peer = m_target.nextPendingConnection();
+            sockets << peer;
+            QObject::connect(peer, &QTcpSocket::disconnected, peer, &QObject::deleteLater);
+            QObject::connect(peer, &QTcpSocket::readyRead, peer, [&, peer]() {
+                if(peer->bytesAvailable() < 4)
+                    return;
+                char index[4];
+                peer->read(index, 4);
+                qint32 i = qFromBigEndian<qint32>(index);
+                if(i >= 0 && i < started.size())
+                    latency << (clock.nsecsElapsed() - started.at(i)) / 1000;
+                peer->disconnectFromHost();
+            });
+        }
+    });
+
+    QTimer tick;
+    tick.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&tick, &QTimer::timeout, this, [&]() {
+        if(launched == total)
+        {
+            tick.stop();
+            return;
+        }
+        QTcpSocket *cli = new QTcpSocket(this);
+        sockets << cli;
+        QObject::connect(cli, &QTcpSocket::disconnected, cli, &QObject::deleteLater);
+        char index[4];
+        qToBigEndian<qint32>(launched, index);
+        started << clock.nsecsElapsed();
+        cli->connectToHost(QHostAddress::LocalHost, port);
+        cli->write(index, 4);
+        launched++;
+    });
+    tick.start(1000 / CHURN_RATE);
+
+    bool ok = waitUntil([&]() { return launched == total && latency.size() == total; }, CHURN_DURATION + BENCH_TIMEOUT);
+    tick.stop();
+    QObject::disconnect(accept);
+    bool settled = waitUntil([&]() { return connections() == 0; }, BENCH_TIMEOUT);
+
+    QJsonObject metrics;
+    metrics["rate"] = CHURN_RATE;
+    metrics["launched"] = launched;
+    metrics["completed"] = latency.size();
+    metrics["open_latency_us"] = percentiles(latency);
+    metrics["connections_left"] = connections();
+    metrics["channels_left"] = m_ssh->findChildren<SshChannel*>().size() - channelsBefore;
+    metrics["rss_growth_kb"] = currentRssKb() - rssBefore;
+    /* Stragglers still reference this frame */
+    for(const QPointer<QTcpSocket> &sock: sockets)
+    {
+        delete sock.data();
+    }
+    if(ok && settled)
+        record("channels", name, metrics);
+    else
+        fail("channels", name, QString("%1/%2 connections completed, %3 left open").arg(latency.size()).arg(total).arg(connections()));
+}
+
+void Benchmark::benchChannels()
+{
+    int maxChannels = qMin(m_maxChannels, (raiseFileLimit() - 64) / 3);
+    QList<int> counts;
+    for(int count: {1, 10, 100, 1000, 5000})
+    {
+        if(count <= maxChannels)
+            counts << count;
+        else
+            qCWarning(bench) << "Skip" << count << "channels, limit is" << maxChannels;
+    }
+
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>(channelName("bench_chout"));
+    out->listen(m_target.serverPort());
+    for(int count: counts)
+    {
+        channelScale("tunnelout", out->localPort(), count, [out]() { return out->connections(); });
+    }
+    channelChurn("tunnelout", out->localPort(), [out]() { return out->connections(); });
+    out->close();
+
+    SshTunnelIn *in = m_ssh->getChannel<SshTunnelIn>(channelName("bench_chin"));
+    int inConnections = 0;
+    QObject::connect(in, &SshTunnelIn::connectionChanged, this, [&inConnections](int count) { inConnections = count; });
+    in->listen("127.0.0.1", m_target.serverPort(), 0, "127.0.0.1", 1024);
+    if(!in->waitForState(SshChannel::Ready))
+    {
+        fail("channels", "tunnelin", "remote listen failed");
+        return;
+    }
+    for(int count: counts)
+    {
+        channelScale("tunnelin", in->remotePort(), count, [&inConnections]() { return inConnections; });
+    }
+    channelChurn("tunnelin", in->remotePort(), [&inConnections]() { return inConnections; });
+    QObject::disconnect(in, &SshTunnelIn::connectionChanged, this, nullptr);
+    in->close();
+}
@@ -0,0 +1,138 @@
+#include "benchmark.h"
+#include <sshclient.h>
+#include <sshprocess.h>
+#include <sshtunnelin.h>
+#include <sshtunnelout.h>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+
+#define LATENCY_MESSAGE_SIZE 32
+#define LATENCY_WARMUP 100
+#define LATENCY_EXEC_DIVIDER 20
+
+/* Echo everything back, with Nagle disabled so only the path under test adds delay */
+void Benchmark::startEcho(QTcpServer &echo)
+{
+    QObject::connect(&echo, &QTcpServer::newConnection, &echo, [&echo]() {
+        while(echo.hasPendingConnections())
+        {
+            QTcpSocket *sock = echo.nextPendingConnection();
+            sock->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            QObject::connect(sock, &QTcpSocket::readyRead, sock, [sock]() { sock->write(sock->readAll()); });
+            QObject::connect(sock, &QTcpSocket::disconnected, sock, &QObject::deleteLater);
+        }
+    });
+    echo.listen(QHostAddress::LocalHost, 0);
+}
+
+/* Round-trip times in microseconds of small messages echoed through port, empty on failure */
+QVector<qint64> Benchmark::pingPong(quint16 port, int iterations)
+{
+    QVector<qint64> samples;
+    samples.reserve(iterations);
+    QTcpSocket cli;
+    cli.connectToHost(QHostAddress::LocalHost, port);
+    if(!waitUntil([&cli]() { return cli.state() == QAbstractSocket::ConnectedState; }, BENCH_TIMEOUT))
+    {
+        return QVector<qint64>();
+    }
+    cli.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    QByteArray message(LATENCY_MESSAGE_SIZE, 'x');
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+    QElapsedTimer rtt;
+    int round = 0;
+    int got = 0;
+    QObject::connect(&cli, &QTcpSocket::readyRead, &loop, [&]() {
+        got += cli.readAll().size();
+        if(got < LATENCY_MESSAGE_SIZE)
+            return;
+        if(round >= LATENCY_WARMUP)
+            samples << rtt.nsecsElapsed() / 1000;
+        if(++round == iterations + LATENCY_WARMUP)
+        {
+            loop.quit();
+            return;
+        }
+        got = 0;
+        rtt.start();
+        cli.write(message);
+    });
+    QObject::connect(&cli, &QTcpSocket::disconnected, &loop, [&loop](){ loop.exit(1); });
+
+    timeout.start(BENCH_TIMEOUT);
+    rtt.start();
+    cli.write(message);
+    int ret = loop.exec();
+    cli.disconnectFromHost();
+    return (ret == 0)?(samples):(QVector<qint64>());
+}
+
+/*
+ * Small message round-trips: plain loopback as reference, then through
+ * SshTunnelOut and SshTunnelIn, then a whole SshProcess per round-trip.
+ * The gap to the reference is what the library adds (queued signal hops,
+ * event loop turns, SSH framing).
+ */
+void Benchmark::benchLatency()
+{
+    QTcpServer echo;
+    startEcho(echo);
+    int iterations = m_repeat * 200;
+
+    auto report = [this](const QString &name, const QVector<qint64> &samples) {
+        if(samples.isEmpty())
+        {
+            fail("latency", name, "round-trip failed");
+            return;
+        }
+        QJsonObject metrics;
+        metrics["message"] = LATENCY_MESSAGE_SIZE;
+        metrics["rtt_us"] = percentiles(samples);
+        record("latency", name, metrics);
+    };
+
+    report("loopback", pingPong(echo.serverPort(), iterations));
+
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>(channelName("bench_latout"));
+    out->listen(echo.serverPort());
+    report("tunnelout", pingPong(out->localPort(), iterations));
+    out->close();
+
+    SshTunnelIn *in = m_ssh->getChannel<SshTunnelIn>(channelName("bench_latin"));
+    in->listen("127.0.0.1", echo.serverPort(), 0);
+    if(in->waitForState(SshChannel::Ready))
+        report("tunnelin", pingPong(in->remotePort(), iterations));
+    else
+        fail("latency", "tunnelin", "remote listen failed");
+    in->close();
+
+    /* Channel open, exec, output and close for each sample */
+    QVector<qint64> samples;
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+    for(int i = 0; i < iterations / LATENCY_EXEC_DIVIDER; i++)
+    {
+        SshProcess *proc = m_ssh->getChannel<SshProcess>(channelName("bench_latexec"));
+        QObject::connect(proc, &SshProcess::finished, &loop, &QEventLoop::quit);
+        QObject::connect(proc, &SshProcess::failed, &loop, [&loop](){ loop.exit(1); });
+        QElapsedTimer rtt;
+        rtt.start();
+        timeout.start(BENCH_TIMEOUT);
+        proc->runCommand("echo ping");
+        if(loop.exec() != 0 || !proc->result().startsWith("ping"))
+        {
+            samples.clear();
+            break;
+        }
+        samples << rtt.nsecsElapsed() / 1000;
+    }
+    report("exec_echo", samples);
+}
@@ -0,0 +1,237 @@
+#include "benchmark.h"
+#include "delayproxy.h"
+#include <sshclient.h>
+#include <sshsftp.h>
+#include <sshscpsend.h>
+#include <sshscpget.h>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <sys/resource.h>
+
+SshClient *Benchmark::connectClient(quint16 port, const QString &name)
+{
+    SshClient *ssh = new SshClient(name, this);
+    ssh->setKeys(QString::fromUtf8(m_publicKey), QString::fromUtf8(m_privateKey));
+    QEventLoop wait;
+    QObject::connect(ssh, &SshClient::sshReady, &wait, &QEventLoop::quit);
+    QObject::connect(ssh, &SshClient::sshError, &wait, &QEventLoop::quit);
+    ssh->connectToHost(m_user, "127.0.0.1", port, {"publickey"});
+    wait.exec();
+    if(ssh->sshState() != SshClient::SshState::Ready)
+    {
+        delete ssh;
+        return nullptr;
+    }
+    return ssh;
+}
+
+/* CPU time and current resident size of this process (the client side only) */
+Benchmark::Usage Benchmark::usage()
+{
+    Usage res;
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) == 0)
+    {
+        res.cpuNs = (static_cast<qint64>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+    }
+    res.rssKb = currentRssKb();
+    return res;
+}
+
+/*
+ * Start of one measurement: the resident size is polled until addUsage(),
+ * ru_maxrss would only repeat the peak of an earlier run.
+ */
+Benchmark::Usage Benchmark::beginUsage()
+{
+    Usage res = usage();
+    m_rssPeakKb = res.rssKb;
+    m_rssSampler.start();
+    return res;
+}
+
+void Benchmark::addUsage(QJsonObject &metrics, const Usage &before, qint64 bytes)
+{
+    m_rssSampler.stop();
+    Usage after = usage();
+    m_rssPeakKb = qMax(m_rssPeakKb, after.rssKb);
+    metrics["cpu_ms"] = static_cast<double>(after.cpuNs - before.cpuNs) / 1e6;
+    metrics["cpu_ns_per_byte"] = (bytes > 0)?(static_cast<double>(after.cpuNs - before.cpuNs) / static_cast<double>(bytes)):(0.0);
+    metrics["peak_rss_growth_kb"] = m_rssPeakKb - before.rssKb;
+}
+
+/* Send every local file on its own channel at the same time */
+bool Benchmark::scpSend(SshClient *ssh, const QStringList &locals, const QString &remoteDir, int bufferSize)
+{
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+    int pending = locals.size();
+    for(int i = 0; i < locals.size(); i++)
+    {
+        SshScpSend *send = ssh->getChannel<SshScpSend>(channelName("xfer_scpsend"));
+        send->setBufferSize(bufferSize);
+        QObject::connect(send, &SshScpSend::finished, &loop, [&loop, &pending, send]() {
+            send->close();
+            if(--pending == 0)
+                loop.quit();
+        });
+        QObject::connect(send, &SshScpSend::failed, &loop, [&loop](){ loop.exit(1); });
+        send->send(locals.at(i), QDir(remoteDir).filePath(QString("%1_%2").arg(i).arg(QFileInfo(locals.at(i)).fileName())));
+    }
+    timeout.start(BENCH_TIMEOUT * 10);
+    return loop.exec() == 0;
+}
+
+bool Benchmark::scpGet(SshClient *ssh, const QStringList &remotes, const QString &localDir, int bufferSize)
+{
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+    int pending = remotes.size();
+    for(int i = 0; i < remotes.size(); i++)
+    {
+        SshScpGet *get = ssh->getChannel<SshScpGet>(channelName("xfer_scpget"));
+        get->setBufferSize(bufferSize);
+        QObject::connect(get, &SshScpGet::finished, &loop, [&loop, &pending, get]() {
+            get->close();
+            if(--pending == 0)
+                loop.quit();
+        });
+        QObject::connect(get, &SshScpGet::failed, &loop, [&loop](){ loop.exit(1); });
+        get->get(remotes.at(i), QDir(localDir).filePath(QFileInfo(remotes.at(i)).fileName()));
+    }
+    timeout.start(BENCH_TIMEOUT * 10);
+    return loop.exec() == 0;
+}
+
+/*
+ * SFTP and SCP throughput over file size, buffer size and number of
+ * parallel transfers, directly and through a delaying proxy.
+ */
+void Benchmark::benchTransfer()
+{
+    QList<qint64> sizes;
+    for(qint64 size = 1024; size <= m_maxFileSize; size *= 16)
+    {
+        sizes << size;
+    }
+    if(sizes.last() != m_maxFileSize)
+    {
+        sizes << m_maxFileSize;
+    }
+    const QList<int> bufferSizes = {32*1024, 256*1024, 1024*1024};
+    const QList<int> concurrencies = {1, 4};
+
+    QString remoteDir = QDir(m_workDir).filePath("xfer_remote");
+    QString backDir = QDir(m_workDir).filePath("xfer_back");
+    QDir().mkpath(remoteDir);
+    QDir().mkpath(backDir);
+
+    for(int latency: m_latencies)
+    {
+        DelayProxy proxy;
+        quint16 port = m_port;
+        if(latency > 0)
+        {
+            proxy.listen("127.0.0.1", m_port, latency);
+            port = proxy.port();
+        }
+        SshClient *ssh = connectClient(port, QString("xfer_%1ms").arg(latency));
+        if(!ssh)
+        {
+            fail("transfer", QString("connect_%1ms").arg(latency), "can't connect");
+            continue;
+        }
+
+        for(qint64 size: sizes)
+        {
+            QString local = localFile(QString("xfer_%1.bin").arg(size), size);
+            if(local.isEmpty())
+            {
+                fail("transfer", "prepare", QString("can't create %1 bytes file").arg(size));
+                continue;
+            }
+
+            /* SFTP, one blocking transfer at a time */
+            SshSFtp *sftp = ssh->getChannel<SshSFtp>(channelName("xfer_sftp"));
+            QString remote = QDir(remoteDir).filePath("sftp.bin");
+            QString back = QDir(backDir).filePath("sftp.bin");
+            QFile::remove(back);
+            for(Direction direction: {Upload, Download})
+            {
+                QString name = (direction == Upload)?("sftp_send"):("sftp_get");
+                Usage before = beginUsage();
+                QElapsedTimer timer;
+                timer.start();
+                bool ok = (direction == Upload)?(!sftp->send(local, remote).isEmpty()):(sftp->get(remote, back, true));
+                qint64 ns = timer.nsecsElapsed();
+                if(!ok)
+                {
+                    fail("transfer", name, sftp->errMsg().join("; "));
+                    continue;
+                }
+                QJsonObject metrics = throughput(size, ns);
+                metrics["size"] = size;
+                metrics["latency_ms"] = latency;
+                addUsage(metrics, before, size);
+                record("transfer", name, metrics);
+            }
+            sftp->close();
+
+            /* SCP, buffer size and parallel channels */
+            for(int bufferSize: bufferSizes)
+            {
+                for(int concurrency: concurrencies)
+                {
+                    QStringList locals;
+                    QStringList remotes;
+                    for(int i = 0; i < concurrency; i++)
+                    {
+                        locals << local;
+                        remotes << QDir(remoteDir).filePath(QString("%1_%2").arg(i).arg(QFileInfo(local).fileName()));
+                    }
+                    qint64 bytes = size * concurrency;
+                    for(Direction direction: {Upload, Download})
+                    {
+                        QString name = (direction == Upload)?("scp_send"):("scp_get");
+                        Usage before = beginUsage();
+                        QElapsedTimer timer;
+                        timer.start();
+                        bool ok = (direction == Upload)?(scpSend(ssh, locals, remoteDir, bufferSize)):(scpGet(ssh, remotes, backDir, bufferSize));
+                        qint64 ns = timer.nsecsElapsed();
+                        if(!ok)
+                        {
+                            fail("transfer", name, QString("size %1 buffer %2 concurrency %3").arg(size).arg(bufferSize).arg(concurrency));
+                            continue;
+                        }
+                        QJsonObject metrics = throughput(bytes, ns);
+                        metrics["size"] = size;
+                        metrics["buffer"] = bufferSize;
+                        metrics["concurrency"] = concurrency;
+                        metrics["latency_ms"] = latency;
+                        addUsage(metrics, before, bytes);
+                        record("transfer", name, metrics);
+                    }
+                }
+            }
+
+            for(const QString &file: QDir(remoteDir).entryList(QDir::Files))
+                QFile::remove(QDir(remoteDir).filePath(file));
+            for(const QString &file: QDir(backDir).entryList(QDir::Files))
+                QFile::remove(QDir(backDir).filePath(file));
+            if(size > 64*1024*1024)
+                QFile::remove(local);
+        }
+
+        ssh->disconnectFromHost();
+        ssh->waitForState(SshClient::SshState::Unconnected);
+        delete ssh;
+    }
+}
@@ -0,0 +1,74 @@
+#include "delayproxy.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QPointer>
+
+DelayProxy::DelayProxy(QObject *parent)
+    : QObject(parent)
+{
+    QObject::connect(&m_server, &QTcpServer::newConnection, this, &DelayProxy::_newConnection);
+}
+
+bool DelayProxy::listen(const QString &targetHost, quint16 targetPort, int delayMsec)
+{
+    m_targetHost = targetHost;
+    m_targetPort = targetPort;
+    m_delay = qMax(delayMsec, 0);
+    return m_server.listen(QHostAddress::LocalHost, 0);
+}
+
+void DelayProxy::close()
+{
+    m_server.close();
+}
+
+quint16 DelayProxy::port() const
+{
+    return m_server.serverPort();
+}
+
+int DelayProxy::delay() const
+{
+    return m_delay;
+}
+
+void DelayProxy::_newConnection()
+{
+    while(m_server.hasPendingConnections())
+    {
+        QTcpSocket *client = m_server.nextPendingConnection();
+        QTcpSocket *target = new QTcpSocket(client);
+        client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        target->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        /* Written data is kept until connected */
+        target->connectToHost(m_targetHost, m_targetPort);
+        _relay(client, target);
+        _relay(target, client);
+        QObject::connect(client, &QTcpSocket::disconnected, client, &QObject::deleteLater);
+    }
+}
+
+/* Forward what from receives to to, m_delay later; timers of equal delay keep the order */
+void DelayProxy::_relay(QTcpSocket *from, QTcpSocket *to)
+{
+    QPointer<QTcpSocket> dest(to);
+    int delay = m_delay;
+    QObject::connect(from, &QTcpSocket::readyRead, to, [from, dest, delay]() {
+        QByteArray data = from->readAll();
+        if(delay == 0)
+        {
+            dest->write(data);
+            return;
+        }
+        QTimer::singleShot(delay, Qt::PreciseTimer, dest.data(), [dest, data]() {
+            if(dest)
+                dest->write(data);
+        });
+    });
+    QObject::connect(from, &QTcpSocket::disconnected, to, [dest, delay]() {
+        QTimer::singleShot(delay, Qt::PreciseTimer, dest.data(), [dest]() {
+            if(dest)
+                dest->disconnectFromHost();
+        });
+    });
+}
@@ -0,0 +1,36 @@
+#ifndef DELAYPROXY_H
+#define DELAYPROXY_H
+
+#include <QObject>
+#include <QTcpServer>
+
+class QTcpSocket;
+
+/*
+ * Local TCP relay adding a fixed one-way delay in both directions, to run
+ * the benchmarks as if the server was far away (round-trip = 2 * delay).
+ */
+class DelayProxy : public QObject
+{
+    Q_OBJECT
+
+    QTcpServer m_server;
+    QString m_targetHost;
+    quint16 m_targetPort {0};
+    int m_delay {0};
+
+    void _relay(QTcpSocket *from, QTcpSocket *to);
+
+public:
+    explicit DelayProxy(QObject *parent = nullptr);
+
+    bool listen(const QString &targetHost, quint16 targetPort, int delayMsec);
+    void close();
+    quint16 port() const;
+    int delay() const;
+
+private slots:
+    void _newConnection();
+};
+
+#endif // DELAYPROXY_H
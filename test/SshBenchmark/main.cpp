@@ -0,0 +1,105 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QEventLoop>
+#include <QFile>
+#include <QSysInfo>
+#include <sshclient.h>
+
+#include "sshdserver.h"
+#include "benchmark.h"
+
+/*
+ * Self-contained benchmark: starts a private sshd, runs the selected suites
+ * through QtSsh and prints the results as JSON (stdout or --output).
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sshbenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("QtSsh benchmarks against a throw-away local sshd");
+    parser.addHelpOption();
+    QCommandLineOption outputOpt({"o", "output"}, "Write JSON results to <file>.", "file");
+    QCommandLineOption suitesOpt({"s", "suites"}, "Comma separated suites (" + Benchmark::suites().join(",") + ").", "list", Benchmark::suites().join(","));
+    QCommandLineOption repeatOpt({"r", "repeat"}, "Payload repetitions per measurement.", "count", "25");
+    QCommandLineOption payloadOpt({"p", "payload"}, "Payload size in bytes.", "bytes", QString::number(4*1024*1024));
+    QCommandLineOption maxSizeOpt("max-size", "Largest file of the transfer suite in bytes (up to 4 GB).", "bytes", QString::number(64*1024*1024));
+    QCommandLineOption latencyOpt("latency", "Comma separated one-way delays in ms for the transfer suite.", "list", "0,20");
+    QCommandLineOption maxChannelsOpt("max-channels", "Most concurrent channels of the channels suite.", "count", "5000");
+    parser.addOptions({outputOpt, suitesOpt, repeatOpt, payloadOpt, maxSizeOpt, latencyOpt, maxChannelsOpt});
+    parser.process(app);
+
+    SshdServer sshd;
+    if(!sshd.start())
+    {
+        qCCritical(bench) << "Can't start sshd:" << sshd.errorString();
+        return 2;
+    }
+
+    SshClient ssh("benchmark");
+    ssh.setKeys(QString::fromUtf8(sshd.publicKey()), QString::fromUtf8(sshd.privateKey()));
+    QEventLoop waitssh;
+    QObject::connect(&ssh, &SshClient::sshReady, &waitssh, &QEventLoop::quit);
+    QObject::connect(&ssh, &SshClient::sshError, &waitssh, &QEventLoop::quit);
+    ssh.connectToHost(sshd.user(), "127.0.0.1", sshd.port(), {"publickey"});
+    waitssh.exec();
+    if(ssh.sshState() != SshClient::SshState::Ready)
+    {
+        qCCritical(bench) << "Can't connect to local sshd";
+        return 2;
+    }
+
+    Benchmark benchmark(&ssh, sshd.workDir());
+    benchmark.setRepeat(parser.value(repeatOpt).toInt());
+    benchmark.setPayloadSize(parser.value(payloadOpt).toInt());
+    benchmark.setConnection(sshd.user(), sshd.port(), sshd.publicKey(), sshd.privateKey());
+    benchmark.setMaxFileSize(parser.value(maxSizeOpt).toLongLong());
+    QList<int> latencies;
+    for(const QString &latency: parser.value(latencyOpt).split(',', QString::SkipEmptyParts))
+    {
+        latencies << latency.toInt();
+    }
+    benchmark.setLatencies(latencies);
+    benchmark.setMaxChannels(parser.value(maxChannelsOpt).toInt());
+    bool ok = benchmark.run(parser.value(suitesOpt).split(',', QString::SkipEmptyParts));
+
+    QJsonObject report;
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["kernel"] = QSysInfo::kernelVersion();
+    report["qt"] = QString(qVersion());
+    report["libssh2"] = QString(libssh2_version(0));
+    report["sshd"] = sshd.version();
+    report["repeat"] = parser.value(repeatOpt).toInt();
+    report["payload"] = parser.value(payloadOpt).toInt();
+    report["failures"] = benchmark.failures();
+    report["results"] = benchmark.results();
+
+    ssh.disconnectFromHost();
+    ssh.waitForState(SshClient::SshState::Unconnected);
+    sshd.stop();
+
+    QByteArray json = QJsonDocument(report).toJson();
+    if(parser.isSet(outputOpt))
+    {
+        QFile out(parser.value(outputOpt));
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qCCritical(bench) << "Can't write" << out.fileName();
+            return 2;
+        }
+        out.write(json);
+    }
+    else
+    {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+    return (ok)?(0):(1);
+}
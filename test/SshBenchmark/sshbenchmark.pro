@@ -0,0 +1,13 @@
+QT -= gui
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += main.cpp benchmark.cpp benchmarktransfer.cpp benchmarkchannels.cpp benchmarklatency.cpp sshdserver.cpp delayproxy.cpp
+HEADERS += benchmark.h sshdserver.h delayproxy.h
+
+include(../../QtSsh.pri)
+
+LIBS += -lssh2
@@ -0,0 +1,252 @@
+#include "sshdserver.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QThread>
+
+Q_LOGGING_CATEGORY(benchsshd, "test.ssh.benchmark.sshd", QtInfoMsg)
+
+#define SSHD_START_TIMEOUT (10*1000)
+
+SshdServer::SshdServer(QObject *parent)
+    : QObject(parent)
+{
+    m_user = qEnvironmentVariable("USER", qEnvironmentVariable("LOGNAME"));
+    m_process.setProcessChannelMode(QProcess::SeparateChannels);
+}
+
+SshdServer::~SshdServer()
+{
+    stop();
+}
+
+quint16 SshdServer::_freePort()
+{
+    QTcpServer probe;
+    if(!probe.listen(QHostAddress::LocalHost, 0))
+    {
+        return 0;
+    }
+    quint16 port = probe.serverPort();
+    probe.close();
+    return port;
+}
+
+QString SshdServer::_findSshd()
+{
+    QString path = qEnvironmentVariable("QTSSH_BENCH_SSHD");
+    if(!path.isEmpty())
+    {
+        return path;
+    }
+    /* sshd refuses to start when not run with an absolute path */
+    return QStandardPaths::findExecutable("sshd", {"/usr/sbin", "/usr/local/sbin", "/sbin", "/usr/bin"});
+}
+
+QString SshdServer::_findSftpServer()
+{
+    QString path = qEnvironmentVariable("QTSSH_BENCH_SFTP_SERVER");
+    if(!path.isEmpty())
+    {
+        return path;
+    }
+    const QStringList candidates = {
+        "/usr/lib/openssh/sftp-server",
+        "/usr/libexec/openssh/sftp-server",
+        "/usr/libexec/sftp-server",
+        "/usr/lib/ssh/sftp-server",
+        "/usr/local/libexec/sftp-server"
+    };
+    for(const QString &candidate: candidates)
+    {
+        if(QFileInfo(candidate).isExecutable())
+        {
+            return candidate;
+        }
+    }
+    return QString();
+}
+
+bool SshdServer::_keygen(const QString &file)
+{
+    /* RSA in PEM format is understood by every libssh2 build */
+    QProcess keygen;
+    keygen.start("ssh-keygen", {"-q", "-t", "rsa", "-b", "2048", "-m", "PEM", "-N", "", "-f", file});
+    if(!keygen.waitForFinished() || keygen.exitCode() != 0)
+    {
+        m_errorString = "ssh-keygen failed: " + QString::fromLocal8Bit(keygen.readAllStandardError());
+        return false;
+    }
+    return true;
+}
+
+bool SshdServer::_writeConfig(const QString &sftpServer)
+{
+    QFile config(m_dir.filePath("sshd_config"));
+    if(!config.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        m_errorString = "Can't write " + config.fileName();
+        return false;
+    }
+    QByteArray conf;
+    conf += "Port " + QByteArray::number(m_port) + "\n";
+    conf += "ListenAddress 127.0.0.1\n";
+    conf += "HostKey " + QFile::encodeName(m_dir.filePath("host_key")) + "\n";
+    conf += "PidFile " + QFile::encodeName(m_dir.filePath("sshd.pid")) + "\n";
+    conf += "AuthorizedKeysFile " + QFile::encodeName(m_dir.filePath("authorized_keys")) + "\n";
+    conf += "PubkeyAuthentication yes\n";
+    conf += "PasswordAuthentication no\n";
+    conf += "KbdInteractiveAuthentication no\n";
+    conf += "StrictModes no\n";
+    conf += "AllowTcpForwarding yes\n";
+    conf += "MaxSessions 10000\n";
+    conf += "MaxStartups 1000\n";
+    conf += "LogLevel ERROR\n";
+    if(!sftpServer.isEmpty())
+    {
+        conf += "Subsystem sftp " + QFile::encodeName(sftpServer) + "\n";
+    }
+    config.write(conf);
+    return true;
+}
+
+bool SshdServer::_waitListening(int timeoutMsec)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while(timer.elapsed() < timeoutMsec)
+    {
+        if(m_process.state() != QProcess::Running)
+        {
+            m_errorString = "sshd exited: " + QString::fromLocal8Bit(m_process.readAllStandardError());
+            return false;
+        }
+        QTcpSocket probe;
+        probe.connectToHost(QHostAddress::LocalHost, m_port);
+        if(probe.waitForConnected(200))
+        {
+            probe.abort();
+            return true;
+        }
+        QThread::msleep(50);
+    }
+    m_errorString = "sshd did not start listening";
+    return false;
+}
+
+bool SshdServer::start()
+{
+    if(!m_dir.isValid())
+    {
+        m_errorString = "Can't create temporary directory";
+        return false;
+    }
+    QString sshd = _findSshd();
+    if(sshd.isEmpty())
+    {
+        m_errorString = "sshd not found (set QTSSH_BENCH_SSHD)";
+        return false;
+    }
+    QString sftpServer = _findSftpServer();
+    if(sftpServer.isEmpty())
+    {
+        qCWarning(benchsshd) << "sftp-server not found, SFTP benchmarks will fail";
+    }
+
+    if(!_keygen(m_dir.filePath("host_key")) || !_keygen(m_dir.filePath("client_key")))
+    {
+        return false;
+    }
+    QFile priv(m_dir.filePath("client_key"));
+    QFile pub(m_dir.filePath("client_key.pub"));
+    if(!priv.open(QIODevice::ReadOnly) || !pub.open(QIODevice::ReadOnly))
+    {
+        m_errorString = "Can't read generated client key";
+        return false;
+    }
+    m_privateKey = priv.readAll();
+    m_publicKey = pub.readAll();
+    if(!QFile::copy(pub.fileName(), m_dir.filePath("authorized_keys")))
+    {
+        m_errorString = "Can't write authorized_keys";
+        return false;
+    }
+    QDir(m_dir.path()).mkpath("work");
+
+    m_port = _freePort();
+    if(m_port == 0 || !_writeConfig(sftpServer))
+    {
+        if(m_errorString.isEmpty())
+            m_errorString = "No free local port";
+        return false;
+    }
+
+    qCInfo(benchsshd) << "Starting" << sshd << "on port" << m_port;
+    m_process.start(sshd, {"-D", "-e", "-f", m_dir.filePath("sshd_config")});
+    if(!m_process.waitForStarted())
+    {
+        m_errorString = "Can't run " + sshd + ": " + m_process.errorString();
+        return false;
+    }
+    return _waitListening(SSHD_START_TIMEOUT);
+}
+
+void SshdServer::stop()
+{
+    if(m_process.state() == QProcess::NotRunning)
+    {
+        return;
+    }
+    m_process.terminate();
+    if(!m_process.waitForFinished(3000))
+    {
+        m_process.kill();
+        m_process.waitForFinished();
+    }
+}
+
+quint16 SshdServer::port() const
+{
+    return m_port;
+}
+
+QString SshdServer::user() const
+{
+    return m_user;
+}
+
+QByteArray SshdServer::publicKey() const
+{
+    return m_publicKey;
+}
+
+QByteArray SshdServer::privateKey() const
+{
+    return m_privateKey;
+}
+
+QString SshdServer::workDir() const
+{
+    return m_dir.filePath("work");
+}
+
+QString SshdServer::errorString() const
+{
+    return m_errorString;
+}
+
+QString SshdServer::version() const
+{
+    /* "ssh -V" prints the OpenSSH version on stderr */
+    QProcess ssh;
+    ssh.start("ssh", {"-V"});
+    if(!ssh.waitForFinished())
+    {
+        return QString();
+    }
+    return QString::fromLocal8Bit(ssh.readAllStandardError()).trimmed();
+}
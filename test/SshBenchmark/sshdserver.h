@@ -0,0 +1,53 @@
+#ifndef SSHDSERVER_H
+#define SSHDSERVER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(benchsshd)
+
+/*
+ * Throw-away OpenSSH server for the benchmarks: runs as the current user on
+ * a random local port, with generated host and client keys in a temporary
+ * directory. Nothing on the system is touched and no account is needed.
+ * QTSSH_BENCH_SSHD and QTSSH_BENCH_SFTP_SERVER override the binaries.
+ */
+class SshdServer : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+    QProcess m_process;
+    quint16 m_port {0};
+    QString m_user;
+    QByteArray m_publicKey;
+    QByteArray m_privateKey;
+    QString m_errorString;
+
+    bool _keygen(const QString &file);
+    bool _writeConfig(const QString &sftpServer);
+    bool _waitListening(int timeoutMsec);
+    static quint16 _freePort();
+    static QString _findSshd();
+    static QString _findSftpServer();
+
+public:
+    explicit SshdServer(QObject *parent = nullptr);
+    virtual ~SshdServer() override;
+
+    bool start();
+    void stop();
+
+    quint16 port() const;
+    QString user() const;
+    QByteArray publicKey() const;
+    QByteArray privateKey() const;
+    /* Scratch directory, also reachable from the remote side */
+    QString workDir() const;
+    QString errorString() const;
+    QString version() const;
+};
+
+#endif // SSHDSERVER_H
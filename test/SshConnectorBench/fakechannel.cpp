@@ -0,0 +1,90 @@
+#include "fakechannel.h"
+#include <cstring>
+
+void FakeChannel::reset()
+{
+    written = 0;
+    rxRemaining = 0;
+    eof = false;
+    window = 0;
+    eagainEvery = 0;
+    calls = 0;
+    wake = nullptr;
+    onWrite = nullptr;
+}
+
+bool FakeChannel::again()
+{
+    if(eagainEvery <= 0 || (++calls % eagainEvery) != 0)
+    {
+        return false;
+    }
+    if(wake) wake();
+    return true;
+}
+
+LIBSSH2_CHANNEL *FakeChannel::handle()
+{
+    return reinterpret_cast<LIBSSH2_CHANNEL *>(this);
+}
+
+FakeChannel *FakeChannel::from(LIBSSH2_CHANNEL *channel)
+{
+    return reinterpret_cast<FakeChannel *>(channel);
+}
+
+ssize_t FakeChannelTransport::channel_read_ex(LIBSSH2_CHANNEL *handle, int, char *buf, size_t buflen)
+{
+    FakeChannel *channel = FakeChannel::from(handle);
+    if(channel->again())
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    size_t len = static_cast<size_t>(qMin<qint64>(channel->rxRemaining, static_cast<qint64>(buflen)));
+    if(channel->window > 0)
+    {
+        len = qMin(len, channel->window);
+    }
+    if(len == 0)
+    {
+        return (channel->eof)?(0):(LIBSSH2_ERROR_EAGAIN);
+    }
+    memset(buf, 'r', len);
+    channel->rxRemaining -= static_cast<qint64>(len);
+    /* Short read with more to come: the session socket would signal it */
+    if(len < buflen && channel->rxRemaining > 0 && channel->wake) channel->wake();
+    return static_cast<ssize_t>(len);
+}
+
+ssize_t FakeChannelTransport::channel_write_ex(LIBSSH2_CHANNEL *handle, int, const char *, size_t buflen)
+{
+    FakeChannel *channel = FakeChannel::from(handle);
+    if(channel->again())
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    size_t len = (channel->window > 0)?(qMin(buflen, channel->window)):(buflen);
+    channel->written += static_cast<qint64>(len);
+    if(channel->onWrite) channel->onWrite();
+    return static_cast<ssize_t>(len);
+}
+
+int FakeChannelTransport::channel_eof(LIBSSH2_CHANNEL *handle)
+{
+    FakeChannel *channel = FakeChannel::from(handle);
+    return (channel->eof && channel->rxRemaining == 0)?(1):(0);
+}
+
+int FakeChannelTransport::channel_send_eof(LIBSSH2_CHANNEL *)
+{
+    return 0;
+}
+
+int FakeChannelTransport::session_last_error(LIBSSH2_SESSION *, char **errmsg, int *errmsg_len, int)
+{
+    static char msg[] = "fake channel";
+    if(errmsg) *errmsg = msg;
+    if(errmsg_len) *errmsg_len = sizeof(msg) - 1;
+    return LIBSSH2_ERROR_CHANNEL_FAILURE;
+}
+
@@ -0,0 +1,47 @@
+#ifndef FAKECHANNEL_H
+#define FAKECHANNEL_H
+
+#include <QtGlobal>
+#include <sshtransport.h>
+#include <functional>
+
+/*
+ * In-memory stand-in for a libssh2 channel, handed to the connector as a
+ * LIBSSH2_CHANNEL pointer. FakeChannelTransport implements the transport
+ * calls used by SshTunnelDataConnector on top of it, so the connector runs
+ * without a session.
+ *
+ * Writes are swallowed (counted), reads produce a fixed pattern until
+ * rxRemaining is spent. window caps the bytes accepted per call and every
+ * eagainEvery-th call fails with LIBSSH2_ERROR_EAGAIN. wake() stands for
+ * the session socket activity that would follow (window adjust, more data).
+ */
+struct FakeChannel
+{
+    qint64 written {0};
+    qint64 rxRemaining {0};
+    bool eof {false};
+    size_t window {0};
+    int eagainEvery {0};
+    int calls {0};
+    std::function<void()> wake;
+    std::function<void()> onWrite;
+
+    void reset();
+    bool again();
+
+    LIBSSH2_CHANNEL *handle();
+    static FakeChannel *from(LIBSSH2_CHANNEL *channel);
+};
+
+class FakeChannelTransport : public SshTransport
+{
+public:
+    ssize_t channel_read_ex(LIBSSH2_CHANNEL *channel, int stream_id, char *buf, size_t buflen) override;
+    ssize_t channel_write_ex(LIBSSH2_CHANNEL *channel, int stream_id, const char *buf, size_t buflen) override;
+    int channel_eof(LIBSSH2_CHANNEL *channel) override;
+    int channel_send_eof(LIBSSH2_CHANNEL *channel) override;
+    int session_last_error(LIBSSH2_SESSION *session, char **errmsg, int *errmsg_len, int want_buf) override;
+};
+
+#endif // FAKECHANNEL_H
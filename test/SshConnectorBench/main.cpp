@@ -0,0 +1,269 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSysInfo>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <sshtunneldataconnector.h>
+#include <sshtunnelscheduler.h>
+#include <sys/resource.h>
+#include <algorithm>
+
+#include "fakechannel.h"
+
+Q_LOGGING_CATEGORY(connbench, "test.ssh.connectorbench", QtInfoMsg)
+
+#define CONNBENCH_CHUNK (256*1024)
+#define CONNBENCH_TIMEOUT (60*1000)
+
+struct Scenario
+{
+    QString name;
+    bool tx;
+    size_t window;
+    int eagainEvery;
+    qint64 rate;
+    bool scheduler;
+};
+
+struct Sample
+{
+    bool ok {false};
+    qint64 wallNs {0};
+    qint64 cpuNs {0};
+};
+
+static qint64 cpuNs()
+{
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) != 0)
+    {
+        return 0;
+    }
+    return (static_cast<qint64>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+/*
+ * Move total bytes through one connector: from the application socket to
+ * the fake channel (tx) or the other way round (rx). The connector is
+ * driven like SshTunnelOutConnection drives it, through queued sendEvent.
+ */
+static Sample runOnce(const Scenario &scenario, qint64 total)
+{
+    Sample sample;
+    QTcpServer server;
+    QTcpSocket app;
+    if(!server.listen(QHostAddress::LocalHost, 0))
+    {
+        return sample;
+    }
+    app.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    if(!app.waitForConnected(CONNBENCH_TIMEOUT) || !server.waitForNewConnection(CONNBENCH_TIMEOUT))
+    {
+        return sample;
+    }
+    QTcpSocket *tunnel = server.nextPendingConnection();
+
+    FakeChannel channel;
+    channel.window = scenario.window;
+    channel.eagainEvery = scenario.eagainEvery;
+    SshTunnelScheduler scheduler;
+    SshTunnelDataConnector connector(scenario.name);
+    QObject::connect(&connector, &SshTunnelDataConnector::sendEvent, &connector, &SshTunnelDataConnector::process, Qt::QueuedConnection);
+    channel.wake = [&connector]() {
+        QMetaObject::invokeMethod(&connector, [&connector]() {
+            connector.sshDataReceived();
+            connector.process();
+        }, Qt::QueuedConnection);
+    };
+    if(scenario.scheduler)
+        connector.setScheduler(&scheduler);
+    if(scenario.rate > 0)
+        connector.setRateLimit(scenario.rate);
+    connector.setSock(tunnel);
+    connector.setChannel(channel.handle());
+
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop](){ loop.exit(-1); });
+
+    QByteArray chunk(CONNBENCH_CHUNK, 't');
+    qint64 queued = 0;
+    qint64 received = 0;
+    if(scenario.tx)
+    {
+        /* Keep a few chunks in flight so the socket never runs dry */
+        auto feed = [&]() {
+            while(queued < total && app.bytesToWrite() < 4 * CONNBENCH_CHUNK)
+            {
+                qint64 len = qMin<qint64>(CONNBENCH_CHUNK, total - queued);
+                app.write(chunk.constData(), len);
+                queued += len;
+            }
+        };
+        QObject::connect(&app, &QTcpSocket::bytesWritten, &loop, feed);
+        channel.onWrite = [&]() {
+            if(channel.written >= total)
+                loop.quit();
+        };
+        QTimer::singleShot(0, &loop, feed);
+    }
+    else
+    {
+        channel.rxRemaining = total;
+        QObject::connect(&app, &QTcpSocket::readyRead, &loop, [&]() {
+            received += app.readAll().size();
+            if(received >= total)
+                loop.quit();
+        });
+        channel.wake();
+    }
+
+    timeout.start(CONNBENCH_TIMEOUT);
+    qint64 cpuBefore = cpuNs();
+    QElapsedTimer timer;
+    timer.start();
+    int ret = loop.exec();
+    sample.wallNs = timer.nsecsElapsed();
+    sample.cpuNs = cpuNs() - cpuBefore;
+    sample.ok = (ret == 0);
+
+    channel.wake = nullptr;
+    channel.onWrite = nullptr;
+    return sample;
+}
+
+static QJsonObject nsPerByte(QVector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    QJsonObject res;
+    res["min"] = values.first();
+    res["median"] = values.at(values.size() / 2);
+    res["max"] = values.last();
+    return res;
+}
+
+/* Discard the debug output, only its cost is of interest */
+static void nullMessageHandler(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+/*
+ * SshTunnelDataConnector alone: no network, no sshd, no session. The SSH
+ * side is fakechannel.cpp, the socket side a loopback pair. Reports the
+ * cost of the buffer management in nanoseconds per byte.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sshconnectorbench");
+    FakeChannelTransport transport;
+    SshTransport::setInstance(&transport);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SshTunnelDataConnector microbenchmark over a fake libssh2 channel");
+    parser.addHelpOption();
+    QCommandLineOption outputOpt({"o", "output"}, "Write JSON results to <file>.", "file");
+    QCommandLineOption repeatOpt({"r", "repeat"}, "Runs per scenario.", "count", "5");
+    QCommandLineOption bytesOpt({"b", "bytes"}, "Bytes moved per run.", "bytes", QString::number(64*1024*1024));
+    QCommandLineOption debugOpt("debug", "Enable (and discard) the transfer debug logs to measure their cost.");
+    parser.addOptions({outputOpt, repeatOpt, bytesOpt, debugOpt});
+    parser.process(app);
+
+    int repeat = qMax(parser.value(repeatOpt).toInt(), 1);
+    qint64 total = qMax<qint64>(parser.value(bytesOpt).toLongLong(), BUFFER_SIZE);
+    if(parser.isSet(debugOpt))
+    {
+        QLoggingCategory::setFilterRules("ssh.tunnel.transfer.debug=true");
+        qInstallMessageHandler(nullMessageHandler);
+    }
+
+    /* Rate limit high enough to never throttle: only its bookkeeping is measured */
+    const qint64 unthrottled = Q_INT64_C(1) << 40;
+    const QList<Scenario> scenarios = {
+        {"tx",              true,  0,         0, 0,           false},
+        {"tx_window32k",    true,  32*1024,   0, 0,           false},
+        {"tx_eagain",       true,  0,         4, 0,           false},
+        {"tx_scheduler",    true,  0,         0, 0,           true},
+        {"tx_ratelimiter",  true,  0,         0, unthrottled, false},
+        {"rx",              false, 0,         0, 0,           false},
+        {"rx_window32k",    false, 32*1024,   0, 0,           false},
+        {"rx_eagain",       false, 0,         4, 0,           false},
+        {"rx_ratelimiter",  false, 0,         0, unthrottled, false},
+    };
+
+    QJsonArray results;
+    int failures = 0;
+    for(const Scenario &scenario: scenarios)
+    {
+        QVector<double> wall;
+        QVector<double> cpu;
+        for(int i = 0; i < repeat; i++)
+        {
+            Sample sample = runOnce(scenario, total);
+            if(!sample.ok)
+            {
+                break;
+            }
+            wall << static_cast<double>(sample.wallNs) / static_cast<double>(total);
+            cpu << static_cast<double>(sample.cpuNs) / static_cast<double>(total);
+        }
+
+        QJsonObject res;
+        res["suite"] = "connector";
+        res["name"] = scenario.name;
+        if(wall.size() != repeat)
+        {
+            qCCritical(connbench) << scenario.name << "failed: transfer timed out";
+            res["error"] = "transfer timed out";
+            failures++;
+        }
+        else
+        {
+            res["bytes"] = total;
+            res["window"] = static_cast<qint64>(scenario.window);
+            res["eagain_every"] = scenario.eagainEvery;
+            res["wall_ns_per_byte"] = nsPerByte(wall);
+            res["cpu_ns_per_byte"] = nsPerByte(cpu);
+            qCInfo(connbench) << scenario.name << res;
+        }
+        results.append(res);
+    }
+
+    QJsonObject report;
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["qt"] = QString(qVersion());
+    report["repeat"] = repeat;
+    report["debug_logs"] = parser.isSet(debugOpt);
+    report["failures"] = failures;
+    report["results"] = results;
+
+    QByteArray json = QJsonDocument(report).toJson();
+    if(parser.isSet(outputOpt))
+    {
+        QFile out(parser.value(outputOpt));
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qCCritical(connbench) << "Can't write" << out.fileName();
+            return 2;
+        }
+        out.write(json);
+    }
+    else
+    {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+    return (failures == 0)?(0):(1);
+}
@@ -0,0 +1,24 @@
+QT -= gui
+QT += network
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Only the data pump, over fakechannel.cpp installed as the transport
+INCLUDEPATH += ../../qtssh
+
+SOURCES += main.cpp fakechannel.cpp \
+    ../../qtssh/sshtunneldataconnector.cpp \
+    ../../qtssh/sshtunnelscheduler.cpp \
+    ../../qtssh/sshratelimiter.cpp \
+    ../../qtssh/sshtransport.cpp
+
+HEADERS += fakechannel.h \
+    ../../qtssh/sshtunneldataconnector.h \
+    ../../qtssh/sshtunnelscheduler.h \
+    ../../qtssh/sshratelimiter.h \
+    ../../qtssh/sshtransport.h
+
+LIBS += -lssh2
@@ -0,0 +1,10 @@
+# In-memory libssh2 transport and ssh-agent for tests, see sshfaketransport.h
+HEADERS += \
+    $$PWD/sshfaketransport.h \
+    $$PWD/sshfakeagent.h
+
+SOURCES += \
+    $$PWD/sshfaketransport.cpp \
+    $$PWD/sshfakeagent.cpp
+
+INCLUDEPATH += $$PWD
@@ -0,0 +1,183 @@
+#include "sshfakeagent.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QtEndian>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static QByteArray sshString(const QByteArray &value)
+{
+    char len[4];
+    qToBigEndian<quint32>(static_cast<quint32>(value.size()), len);
+    return QByteArray(len, 4) + value;
+}
+
+static bool recvAll(int fd, char *data, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if(n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+SshFakeAgent::SshFakeAgent(const QList<QByteArray> &keys)
+    : m_keys(keys)
+{
+}
+
+SshFakeAgent::~SshFakeAgent()
+{
+    if(m_fd >= 0)
+    {
+        ::shutdown(m_fd, SHUT_RDWR);
+        int client = m_clientFd.load();
+        if(client >= 0)
+        {
+            ::shutdown(client, SHUT_RDWR);
+        }
+        m_thread.join();
+        ::close(m_fd);
+        QFile::remove(m_path);
+    }
+}
+
+bool SshFakeAgent::listen(const QString &path)
+{
+    QByteArray name = path.toLocal8Bit();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if(static_cast<size_t>(name.size()) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, name.constData(), static_cast<size_t>(name.size()));
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_fd < 0)
+    {
+        return false;
+    }
+    if(::bind(m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(m_fd, 4) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_path = path;
+    m_thread = std::thread(&SshFakeAgent::_serve, this);
+    return true;
+}
+
+QString SshFakeAgent::path() const
+{
+    return m_path;
+}
+
+int SshFakeAgent::connections() const
+{
+    return m_connections;
+}
+
+int SshFakeAgent::identityRequests() const
+{
+    return m_identityRequests;
+}
+
+int SshFakeAgent::signRequests() const
+{
+    return m_signRequests;
+}
+
+int SshFakeAgent::lastSignFlags() const
+{
+    return m_lastSignFlags;
+}
+
+void SshFakeAgent::setStalled(bool stalled)
+{
+    m_stalled = stalled;
+}
+
+/* One client at a time, like the single connection SshAgent keeps */
+void SshFakeAgent::_serve()
+{
+    for(;;)
+    {
+        int client = ::accept(m_fd, nullptr, nullptr);
+        if(client < 0)
+        {
+            return;
+        }
+        m_connections++;
+        m_clientFd = client;
+        _client(client);
+        m_clientFd = -1;
+        ::close(client);
+    }
+}
+
+void SshFakeAgent::_client(int fd)
+{
+    for(;;)
+    {
+        char header[4];
+        if(!recvAll(fd, header, 4))
+        {
+            return;
+        }
+        quint32 len = qFromBigEndian<quint32>(header);
+        QByteArray request(static_cast<int>(len), '\0');
+        if(len == 0 || !recvAll(fd, request.data(), len))
+        {
+            return;
+        }
+
+        if(m_stalled)
+        {
+            continue;
+        }
+
+        QByteArray reply;
+        if(request.at(0) == 11)
+        {
+            m_identityRequests++;
+            char count[4];
+            qToBigEndian<quint32>(static_cast<quint32>(m_keys.size()), count);
+            reply = QByteArray(1, 12) + QByteArray(count, 4);
+            for(const QByteArray &key: m_keys)
+            {
+                reply += sshString(key) + sshString("fake agent key");
+            }
+        }
+        else if(request.at(0) == 13)
+        {
+            m_signRequests++;
+            if(request.size() >= 4)
+            {
+                m_lastSignFlags = static_cast<int>(qFromBigEndian<quint32>(request.constData() + request.size() - 4));
+            }
+            QByteArray digest = QCryptographicHash::hash(request, QCryptographicHash::Sha256);
+            reply = QByteArray(1, 14) + sshString(sshString("ssh-ed25519") + sshString(digest));
+        }
+        else
+        {
+            reply = QByteArray(1, 5);
+        }
+
+        reply = sshString(reply);
+        if(::send(fd, reply.constData(), static_cast<size_t>(reply.size()), MSG_NOSIGNAL) != static_cast<ssize_t>(reply.size()))
+        {
+            return;
+        }
+    }
+}
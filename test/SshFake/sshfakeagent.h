@@ -0,0 +1,49 @@
+#ifndef SSHFAKEAGENT_H
+#define SSHFAKEAGENT_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <atomic>
+#include <thread>
+
+/*
+ * Minimal ssh-agent on a unix socket, served from its own thread: lists the
+ * given public key blobs and signs anything with them (the signature is a
+ * hash of the data, nothing checks it). Counts what SshAgent asks for.
+ *
+ * A stalled agent reads the requests and never answers.
+ */
+class SshFakeAgent
+{
+public:
+    explicit SshFakeAgent(const QList<QByteArray> &keys);
+    ~SshFakeAgent();
+
+    bool listen(const QString &path);
+    QString path() const;
+
+    int connections() const;
+    int identityRequests() const;
+    int signRequests() const;
+    /* Flags of the last sign request (SSH_AGENT_RSA_SHA2_*) */
+    int lastSignFlags() const;
+    void setStalled(bool stalled);
+
+private:
+    QList<QByteArray> m_keys;
+    QString m_path;
+    int m_fd {-1};
+    std::atomic<int> m_clientFd {-1};
+    std::thread m_thread;
+    std::atomic<int> m_connections {0};
+    std::atomic<int> m_identityRequests {0};
+    std::atomic<int> m_signRequests {0};
+    std::atomic<int> m_lastSignFlags {-1};
+    std::atomic<bool> m_stalled {false};
+
+    void _serve();
+    void _client(int fd);
+};
+
+#endif // SSHFAKEAGENT_H
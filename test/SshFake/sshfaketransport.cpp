@@ -0,0 +1,1597 @@
+#include "sshfaketransport.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSet>
+#include <QTcpSocket>
+#include <QtEndian>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#define FAKE_BANNER "SSH-2.0-QtSshFake"
+#define FAKE_AUTH_LIST "publickey,password"
+
+struct SshFakeSession
+{
+    std::function<void()> wakeup;
+    bool authenticated {false};
+    bool kick {false};
+    int lastError {0};
+    QByteArray lastMessage;
+    qint64 upBusy {0};
+    qint64 downBusy {0};
+    qint64 pingAt {0};
+    QList<SshFakeChannel *> channels;
+    QByteArray hostkey;
+    QByteArray hash[3];
+    QByteArray authList {FAKE_AUTH_LIST};
+};
+
+struct SshFakeTransport::Listener
+{
+    SshFakeSession *session;
+    QString host;
+    int port;
+    QList<QPair<qint64, SshFakeChannel *>> queue;
+};
+
+struct SshFakeTransport::Sftp
+{
+    SshFakeSession *session;
+    unsigned long lastError {LIBSSH2_FX_OK};
+};
+
+struct SshFakeTransport::SftpHandle
+{
+    Sftp *sftp;
+    QString path;
+    bool dir {false};
+    qint64 offset {0};
+    QStringList entries;
+    bool listed {false};
+    qint64 pendingAt {0};
+    qint64 pendingLen {0};
+};
+
+template<typename T, typename H>
+static inline T *fromHandle(H *handle)
+{
+    return reinterpret_cast<T *>(handle);
+}
+
+template<typename H, typename T>
+static inline H *toHandle(T *object)
+{
+    return reinterpret_cast<H *>(object);
+}
+
+SshFakeChannel::SshFakeChannel(SshFakeTransport *transport, SshFakeSession *session, Kind kind)
+    : QObject(transport)
+    , m_transport(transport)
+    , m_session(session)
+    , m_kind(kind)
+{
+}
+
+SshFakeChannel::Kind SshFakeChannel::kind() const
+{
+    return m_kind;
+}
+
+QString SshFakeChannel::command() const
+{
+    return m_command;
+}
+
+QString SshFakeChannel::host() const
+{
+    return m_host;
+}
+
+int SshFakeChannel::port() const
+{
+    return m_port;
+}
+
+qint64 SshFakeChannel::bytesAvailable() const
+{
+    return m_peerInbox.size();
+}
+
+QByteArray SshFakeChannel::read(qint64 maxlen)
+{
+    QByteArray res = m_peerInbox.left(static_cast<int>(qMin<qint64>(maxlen, m_peerInbox.size())));
+    m_peerInbox.remove(0, res.size());
+    if(res.size() > 0)
+    {
+        /* Window adjust back to the client */
+        m_transport->_credit(this, res.size(), false);
+    }
+    return res;
+}
+
+QByteArray SshFakeChannel::readAll()
+{
+    return read(m_peerInbox.size());
+}
+
+bool SshFakeChannel::clientEof() const
+{
+    return m_clientEof;
+}
+
+bool SshFakeChannel::clientClosed() const
+{
+    return m_clientClosed;
+}
+
+void SshFakeChannel::write(const QByteArray &data)
+{
+    if(m_peerEofPending || m_peerEofSent || m_peerClosePending || m_peerCloseSent)
+    {
+        return;
+    }
+    m_peerOutbox[0].append(data);
+    _flush();
+}
+
+void SshFakeChannel::writeStderr(const QByteArray &data)
+{
+    if(m_peerClosePending || m_peerCloseSent)
+    {
+        return;
+    }
+    m_peerOutbox[1].append(data);
+    _flush();
+}
+
+void SshFakeChannel::sendEof()
+{
+    if(!m_peerEofSent)
+    {
+        m_peerEofPending = true;
+        _flush();
+    }
+}
+
+void SshFakeChannel::setExitStatus(int status)
+{
+    m_exitStatus = status;
+}
+
+void SshFakeChannel::close()
+{
+    if(!m_peerCloseSent)
+    {
+        m_peerClosePending = true;
+        _flush();
+    }
+}
+
+/* Send what the client window allows, then EOF and close once drained */
+void SshFakeChannel::_flush()
+{
+    for(int stream = 0; stream < 2; stream++)
+    {
+        while(!m_peerOutbox[stream].isEmpty() && m_peerWindow > 0)
+        {
+            qint64 len = qMin<qint64>(qMin<qint64>(m_peerOutbox[stream].size(), m_peerWindow), m_transport->m_conditions.packetSize);
+            Segment segment;
+            segment.stream = stream;
+            segment.data = m_peerOutbox[stream].left(static_cast<int>(len));
+            segment.at = m_transport->_deliveryTime(m_session, false, len);
+            m_peerOutbox[stream].remove(0, static_cast<int>(len));
+            m_peerWindow -= len;
+            m_transport->m_stats.bytesDown += len;
+            m_down.append(segment);
+            m_transport->_schedule(segment.at);
+        }
+    }
+    if(!m_peerOutbox[0].isEmpty() || !m_peerOutbox[1].isEmpty())
+    {
+        return;
+    }
+
+    qint64 at = m_transport->_now() + static_cast<qint64>(m_transport->m_conditions.latency) * 1000000;
+    if(m_peerEofPending)
+    {
+        Segment segment;
+        segment.at = at;
+        segment.eof = true;
+        segment.status = m_exitStatus;
+        m_down.append(segment);
+        m_peerEofPending = false;
+        m_peerEofSent = true;
+        m_transport->_schedule(at);
+    }
+    if(m_peerClosePending)
+    {
+        Segment segment;
+        segment.at = at;
+        segment.eof = true;
+        segment.close = true;
+        segment.status = m_exitStatus;
+        m_down.append(segment);
+        m_peerClosePending = false;
+        m_peerCloseSent = true;
+        m_transport->_schedule(at);
+    }
+}
+
+SshFakeTransport::SshFakeTransport(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&m_timer, &QTimer::timeout, this, &SshFakeTransport::_advance);
+
+    m_execHandler = [](SshFakeChannel *channel) {
+        QString command = channel->command();
+        if(command == "cat")
+        {
+            QObject::connect(channel, &SshFakeChannel::dataReceived, channel, [channel]() {
+                channel->write(channel->readAll());
+                if(channel->clientEof())
+                {
+                    channel->sendEof();
+                    channel->close();
+                }
+            });
+            return true;
+        }
+        if(command == "echo" || command.startsWith("echo "))
+        {
+            channel->write(command.mid(5).toUtf8() + "\n");
+        }
+        else if(command != "true")
+        {
+            channel->writeStderr(QString("sh: %1: command not found\n").arg(command.section(' ', 0, 0)).toUtf8());
+            channel->setExitStatus(127);
+        }
+        channel->sendEof();
+        channel->close();
+        return true;
+    };
+
+    m_directTcpipHandler = [](SshFakeChannel *channel) {
+        QObject::connect(channel, &SshFakeChannel::dataReceived, channel, [channel]() {
+            channel->write(channel->readAll());
+            if(channel->clientEof())
+            {
+                channel->sendEof();
+                channel->close();
+            }
+        });
+        return true;
+    };
+
+    QObject::connect(&m_server, &QTcpServer::newConnection, this, [this]() {
+        while(m_server.hasPendingConnections())
+        {
+            QTcpSocket *sock = m_server.nextPendingConnection();
+            QObject::connect(sock, &QTcpSocket::disconnected, sock, &QObject::deleteLater);
+        }
+    });
+}
+
+SshFakeTransport::~SshFakeTransport()
+{
+    if(SshTransport::instance() == this)
+    {
+        SshTransport::setInstance(nullptr);
+    }
+    qDeleteAll(m_listeners);
+    qDeleteAll(m_sessions);
+}
+
+void SshFakeTransport::setConditions(const Conditions &conditions)
+{
+    m_conditions = conditions;
+    m_conditions.latency = qMax(m_conditions.latency, 0);
+    m_conditions.packetSize = qMax(m_conditions.packetSize, 1);
+    m_conditions.eagainStorm = qMax(m_conditions.eagainStorm, 1);
+}
+
+SshFakeTransport::Conditions SshFakeTransport::conditions() const
+{
+    return m_conditions;
+}
+
+void SshFakeTransport::setExecHandler(const Handler &handler)
+{
+    m_execHandler = handler;
+}
+
+void SshFakeTransport::setDirectTcpipHandler(const Handler &handler)
+{
+    m_directTcpipHandler = handler;
+}
+
+void SshFakeTransport::setAuthentication(bool accept)
+{
+    m_acceptAuth = accept;
+}
+
+void SshFakeTransport::setAuthorizedKeys(const QList<QByteArray> &keys)
+{
+    m_authorizedKeys = keys;
+}
+
+quint16 SshFakeTransport::listen()
+{
+    if(!m_server.isListening())
+    {
+        m_server.listen(QHostAddress::LocalHost, 0);
+    }
+    return m_server.serverPort();
+}
+
+SshFakeChannel *SshFakeTransport::connectForward(int port, const QString &host)
+{
+    for(Listener *listener: m_listeners)
+    {
+        if(listener->port == port)
+        {
+            SshFakeChannel *channel = _newChannel(listener->session, SshFakeChannel::Forwarded);
+            channel->m_host = host;
+            channel->m_port = port;
+            qint64 at = _now() + static_cast<qint64>(m_conditions.latency) * 1000000;
+            listener->queue.append(qMakePair(at, channel));
+            _schedule(at);
+            return channel;
+        }
+    }
+    return nullptr;
+}
+
+QMap<QString, SshFakeTransport::File> &SshFakeTransport::files()
+{
+    return m_files;
+}
+
+SshFakeTransport::Stats SshFakeTransport::stats() const
+{
+    return m_stats;
+}
+
+void SshFakeTransport::resetStats()
+{
+    m_stats = Stats();
+}
+
+qint64 SshFakeTransport::_now() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+void SshFakeTransport::_schedule(qint64 at)
+{
+    if(m_nextEvent >= 0 && m_nextEvent <= at && m_timer.isActive())
+    {
+        return;
+    }
+    m_nextEvent = at;
+    qint64 delay = qMax<qint64>(at - _now(), 0);
+    m_timer.start(static_cast<int>((delay + 999999) / 1000000));
+}
+
+/* Arrival time of len bytes sent now, after the ones still on the wire */
+qint64 SshFakeTransport::_deliveryTime(SshFakeSession *session, bool up, qint64 len)
+{
+    qint64 now = _now();
+    qint64 sent = now;
+    if(m_conditions.bandwidth > 0)
+    {
+        qint64 &busy = (up)?(session->upBusy):(session->downBusy);
+        sent = qMax(busy, now) + len * 1000000000 / m_conditions.bandwidth;
+        busy = sent;
+    }
+    return sent + static_cast<qint64>(m_conditions.latency) * 1000000;
+}
+
+/* EAGAIN storm: true when this call must fail; the session is woken right after */
+bool SshFakeTransport::_again(SshFakeSession *session)
+{
+    m_stats.calls++;
+    if(m_conditions.eagainEvery <= 0)
+    {
+        return false;
+    }
+    if(m_stormLeft == 0)
+    {
+        if(++m_callCount % m_conditions.eagainEvery != 0)
+        {
+            return false;
+        }
+        m_stormLeft = m_conditions.eagainStorm;
+    }
+    m_stormLeft--;
+    m_stats.eagain++;
+    _setError(session, LIBSSH2_ERROR_EAGAIN);
+    if(session)
+    {
+        session->kick = true;
+        _schedule(_now());
+    }
+    return true;
+}
+
+/* Request answered after roundTrips round-trips; false (EAGAIN) until then */
+bool SshFakeTransport::_request(SshFakeSession *session, void *handle, const QByteArray &op, int roundTrips)
+{
+    QPair<void *, QByteArray> key = qMakePair(handle, op);
+    auto it = m_requests.find(key);
+    if(it == m_requests.end())
+    {
+        if(m_conditions.latency == 0)
+        {
+            return true;
+        }
+        qint64 at = _now() + static_cast<qint64>(roundTrips) * 2 * m_conditions.latency * 1000000;
+        m_requests.insert(key, at);
+        _schedule(at);
+    }
+    else if(it.value() == 0 || it.value() <= _now())
+    {
+        m_requests.erase(it);
+        return true;
+    }
+    m_stats.eagain++;
+    _setError(session, LIBSSH2_ERROR_EAGAIN);
+    return false;
+}
+
+void SshFakeTransport::_setError(SshFakeSession *session, int error, const QByteArray &message)
+{
+    if(session)
+    {
+        session->lastError = error;
+        session->lastMessage = (message.isEmpty())?(QByteArray("fake transport error ") + QByteArray::number(error)):(message);
+    }
+}
+
+SshFakeChannel *SshFakeTransport::_newChannel(SshFakeSession *session, SshFakeChannel::Kind kind, unsigned int window)
+{
+    SshFakeChannel *channel = new SshFakeChannel(this, session, kind);
+    channel->m_clientWindow = m_conditions.window;
+    channel->m_peerWindow = (window > 0)?(window):(LIBSSH2_CHANNEL_WINDOW_DEFAULT);
+    session->channels.append(channel);
+    return channel;
+}
+
+/* Window adjust for len consumed bytes, arriving after the one-way latency */
+void SshFakeTransport::_credit(SshFakeChannel *channel, qint64 len, bool toPeer)
+{
+    SshFakeChannel::Segment segment;
+    segment.at = _now() + static_cast<qint64>(m_conditions.latency) * 1000000;
+    segment.credit = len;
+    if(toPeer)
+        channel->m_up.append(segment);
+    else
+        channel->m_down.append(segment);
+    _schedule(segment.at);
+}
+
+void SshFakeTransport::_fillAttributes(const File &file, LIBSSH2_SFTP_ATTRIBUTES *attrs) const
+{
+    memset(attrs, 0, sizeof(*attrs));
+    attrs->flags = LIBSSH2_SFTP_ATTR_SIZE | LIBSSH2_SFTP_ATTR_UIDGID | LIBSSH2_SFTP_ATTR_PERMISSIONS | LIBSSH2_SFTP_ATTR_ACMODTIME;
+    attrs->filesize = static_cast<libssh2_uint64_t>(file.data.size());
+    attrs->uid = 1000;
+    attrs->gid = 1000;
+    attrs->permissions = static_cast<unsigned long>(((file.dir)?(LIBSSH2_SFTP_S_IFDIR):(LIBSSH2_SFTP_S_IFREG)) | (file.mode & 07777));
+    attrs->mtime = static_cast<unsigned long>(file.mtime.toSecsSinceEpoch());
+    attrs->atime = attrs->mtime;
+}
+
+QString SshFakeTransport::_cleanPath(const char *path, unsigned int len) const
+{
+    return QDir::cleanPath(QString::fromUtf8(path, static_cast<int>(len)));
+}
+
+static QString parentPath(const QString &path)
+{
+    int slash = path.lastIndexOf('/');
+    if(slash < 0)
+        return ".";
+    if(slash == 0)
+        return "/";
+    return path.left(slash);
+}
+
+/* Deliver what arrived, forward window adjusts, complete requests, wake sessions */
+void SshFakeTransport::_advance()
+{
+    m_nextEvent = -1;
+    qint64 now = _now();
+    qint64 next = -1;
+    auto consider = [&next](qint64 at) {
+        if(next < 0 || at < next)
+            next = at;
+    };
+    QSet<SshFakeSession *> changed;
+
+    for(auto it = m_requests.begin(); it != m_requests.end(); ++it)
+    {
+        if(it.value() == 0)
+            continue;
+        if(it.value() <= now)
+        {
+            it.value() = 0;
+            for(SshFakeSession *session: m_sessions)
+                changed.insert(session);
+        }
+        else
+        {
+            consider(it.value());
+        }
+    }
+
+    for(Listener *listener: m_listeners)
+    {
+        if(!listener->queue.isEmpty())
+        {
+            if(listener->queue.first().first <= now)
+                changed.insert(listener->session);
+            else
+                consider(listener->queue.first().first);
+        }
+    }
+
+    for(SshFakeSession *session: m_sessions)
+    {
+        if(session->kick)
+        {
+            session->kick = false;
+            changed.insert(session);
+        }
+        if(session->pingAt > 0)
+        {
+            if(session->pingAt <= now)
+            {
+                session->pingAt = 0;
+                changed.insert(session);
+            }
+            else
+            {
+                consider(session->pingAt);
+            }
+        }
+
+        const QList<SshFakeChannel *> channels = session->channels;
+        for(SshFakeChannel *channel: channels)
+        {
+            bool received = false;
+            bool closing = false;
+            while(!channel->m_up.isEmpty() && channel->m_up.first().at <= now)
+            {
+                SshFakeChannel::Segment segment = channel->m_up.takeFirst();
+                if(segment.credit > 0)
+                {
+                    channel->m_peerWindow += segment.credit;
+                    channel->_flush();
+                }
+                if(!segment.data.isEmpty())
+                {
+                    channel->m_peerInbox.append(segment.data);
+                    received = true;
+                }
+                if(segment.eof)
+                {
+                    channel->m_clientEof = true;
+                    received = true;
+                }
+                if(segment.close)
+                {
+                    channel->m_clientClosed = true;
+                    closing = true;
+                }
+            }
+            while(!channel->m_down.isEmpty() && channel->m_down.first().at <= now)
+            {
+                SshFakeChannel::Segment segment = channel->m_down.takeFirst();
+                channel->m_clientWindow += segment.credit;
+                if(!segment.data.isEmpty())
+                {
+                    channel->m_clientInbox[segment.stream].append(segment.data);
+                }
+                if(segment.eof)
+                {
+                    channel->m_peerEof = true;
+                    channel->m_receivedExitStatus = segment.status;
+                }
+                if(segment.close)
+                {
+                    channel->m_peerClosed = true;
+                }
+                changed.insert(session);
+            }
+
+            if(received)
+            {
+                emit channel->dataReceived();
+            }
+            if(closing)
+            {
+                emit channel->clientClosing();
+                channel->close();
+            }
+            if(!channel->m_up.isEmpty())
+                consider(channel->m_up.first().at);
+            if(!channel->m_down.isEmpty())
+                consider(channel->m_down.first().at);
+        }
+    }
+
+    for(SshFakeSession *session: changed)
+    {
+        if(session->wakeup && m_sessions.contains(session))
+        {
+            m_stats.wakeups++;
+            session->wakeup();
+        }
+    }
+
+    if(next >= 0)
+    {
+        _schedule(next);
+    }
+}
+
+/* Session */
+
+void SshFakeTransport::setWakeup(LIBSSH2_SESSION *session, const std::function<void()> &wakeup)
+{
+    fromHandle<SshFakeSession>(session)->wakeup = wakeup;
+}
+
+LIBSSH2_SESSION *SshFakeTransport::session_init_ex(LIBSSH2_ALLOC_FUNC((*my_alloc)), LIBSSH2_FREE_FUNC((*my_free)), LIBSSH2_REALLOC_FUNC((*my_realloc)), void *abstract)
+{
+    Q_UNUSED(my_alloc)
+    Q_UNUSED(my_free)
+    Q_UNUSED(my_realloc)
+    Q_UNUSED(abstract)
+    SshFakeSession *session = new SshFakeSession();
+    /* RSA public key blob: string "ssh-rsa", mpint e, mpint n */
+    QByteArray blob;
+    auto addString = [&blob](const QByteArray &s) {
+        char len[4] = {static_cast<char>(s.size() >> 24), static_cast<char>(s.size() >> 16), static_cast<char>(s.size() >> 8), static_cast<char>(s.size())};
+        blob.append(len, 4);
+        blob.append(s);
+    };
+    addString("ssh-rsa");
+    addString(QByteArray("\x01\x00\x01", 3));
+    addString(QByteArray(1, '\0') + QCryptographicHash::hash("qtssh fake host key", QCryptographicHash::Sha512).repeated(4));
+    session->hostkey = blob;
+    session->hash[0] = QCryptographicHash::hash(blob, QCryptographicHash::Md5);
+    session->hash[1] = QCryptographicHash::hash(blob, QCryptographicHash::Sha1);
+    session->hash[2] = QCryptographicHash::hash(blob, QCryptographicHash::Sha256);
+    m_sessions.append(session);
+    return toHandle<LIBSSH2_SESSION>(session);
+}
+
+void *SshFakeTransport::session_callback_set(LIBSSH2_SESSION *session, int cbtype, void *callback)
+{
+    Q_UNUSED(session)
+    Q_UNUSED(cbtype)
+    Q_UNUSED(callback)
+    return nullptr;
+}
+
+void SshFakeTransport::session_set_blocking(LIBSSH2_SESSION *session, int blocking)
+{
+    Q_UNUSED(session)
+    Q_UNUSED(blocking)
+}
+
+int SshFakeTransport::session_handshake(LIBSSH2_SESSION *session, libssh2_socket_t sock)
+{
+    Q_UNUSED(sock)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "handshake", 2))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    return 0;
+}
+
+const char *SshFakeTransport::session_hostkey(LIBSSH2_SESSION *session, size_t *len, int *type)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(len) *len = static_cast<size_t>(s->hostkey.size());
+    if(type) *type = LIBSSH2_HOSTKEY_TYPE_RSA;
+    return s->hostkey.constData();
+}
+
+const char *SshFakeTransport::hostkey_hash(LIBSSH2_SESSION *session, int hash_type)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    switch(hash_type)
+    {
+        case LIBSSH2_HOSTKEY_HASH_MD5:
+            return s->hash[0].constData();
+        case LIBSSH2_HOSTKEY_HASH_SHA1:
+            return s->hash[1].constData();
+        case LIBSSH2_HOSTKEY_HASH_SHA256:
+            return s->hash[2].constData();
+    }
+    return nullptr;
+}
+
+const char *SshFakeTransport::session_banner_get(LIBSSH2_SESSION *session)
+{
+    Q_UNUSED(session)
+    return FAKE_BANNER;
+}
+
+int SshFakeTransport::session_last_error(LIBSSH2_SESSION *session, char **errmsg, int *errmsg_len, int want_buf)
+{
+    Q_UNUSED(want_buf)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(!s)
+    {
+        return 0;
+    }
+    if(errmsg) *errmsg = s->lastMessage.data();
+    if(errmsg_len) *errmsg_len = s->lastMessage.size();
+    return s->lastError;
+}
+
+int SshFakeTransport::session_disconnect_ex(LIBSSH2_SESSION *session, int reason, const char *description, const char *lang)
+{
+    Q_UNUSED(reason)
+    Q_UNUSED(description)
+    Q_UNUSED(lang)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    return (_again(s))?(LIBSSH2_ERROR_EAGAIN):(0);
+}
+
+int SshFakeTransport::session_free(LIBSSH2_SESSION *session)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    m_sessions.removeAll(s);
+    for(auto it = m_listeners.begin(); it != m_listeners.end();)
+    {
+        if((*it)->session == s)
+        {
+            delete *it;
+            it = m_listeners.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for(SshFakeChannel *channel: s->channels)
+    {
+        channel->deleteLater();
+    }
+    for(auto it = m_requests.begin(); it != m_requests.end();)
+    {
+        if(it.key().first == s)
+            it = m_requests.erase(it);
+        else
+            ++it;
+    }
+    delete s;
+    return 0;
+}
+
+void SshFakeTransport::keepalive_config(LIBSSH2_SESSION *session, int want_reply, unsigned int interval)
+{
+    Q_UNUSED(session)
+    Q_UNUSED(want_reply)
+    Q_UNUSED(interval)
+}
+
+/* The reply wakes the session up one round-trip later */
+int SshFakeTransport::keepalive_send(LIBSSH2_SESSION *session, int *seconds_to_next)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(seconds_to_next) *seconds_to_next = 5;
+    s->pingAt = _now() + static_cast<qint64>(2 * m_conditions.latency) * 1000000 + 1;
+    _schedule(s->pingAt);
+    return 0;
+}
+
+/* Authentication */
+
+char *SshFakeTransport::userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len)
+{
+    Q_UNUSED(username)
+    Q_UNUSED(username_len)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "userauth-list"))
+    {
+        return nullptr;
+    }
+    return s->authList.data();
+}
+
+int SshFakeTransport::userauth_authenticated(LIBSSH2_SESSION *session)
+{
+    return (fromHandle<SshFakeSession>(session)->authenticated)?(1):(0);
+}
+
+static QByteArray sshString(const QByteArray &value)
+{
+    char len[4];
+    qToBigEndian<quint32>(static_cast<quint32>(value.size()), len);
+    return QByteArray(len, 4) + value;
+}
+
+/*
+ * What libssh2 gives the sign callback: session id, then the userauth request.
+ * RSA keys are upgraded to rsa-sha2-512, as with a server announcing
+ * server-sig-algs.
+ */
+QByteArray SshFakeTransport::_userauthRequest(SshFakeSession *s, const QByteArray &username, const QByteArray &blob)
+{
+    QByteArray algorithm;
+    if(blob.size() >= 4)
+    {
+        algorithm = blob.mid(4, static_cast<int>(qFromBigEndian<quint32>(blob.constData())));
+    }
+    if(algorithm == "ssh-rsa")
+    {
+        algorithm = "rsa-sha2-512";
+    }
+    QByteArray sessionId = QCryptographicHash::hash(s->hostkey + QByteArray::number(reinterpret_cast<quintptr>(s)), QCryptographicHash::Sha256);
+    return sshString(sessionId) + char(50) + sshString(username) + sshString("ssh-connection")
+            + sshString("publickey") + char(1) + sshString(algorithm) + sshString(blob);
+}
+
+/* The signature is not checked, only that the callback produced one */
+int SshFakeTransport::userauth_publickey(LIBSSH2_SESSION *session, const char *username, const unsigned char *pubkeydata, size_t pubkeydata_len, LIBSSH2_USERAUTH_PUBLICKEY_SIGN_FUNC((*sign_callback)), void **abstract)
+{
+    Q_UNUSED(username)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "userauth"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    m_stats.publickeyAttempts++;
+    QByteArray blob(reinterpret_cast<const char *>(pubkeydata), static_cast<int>(pubkeydata_len));
+    QByteArray data = _userauthRequest(s, QByteArray(username), blob);
+    unsigned char *sig = nullptr;
+    size_t sigLen = 0;
+    int ret = sign_callback(session, &sig, &sigLen, reinterpret_cast<const unsigned char *>(data.constData()), static_cast<size_t>(data.size()), abstract);
+    free(sig);
+    if(ret != 0 || sigLen == 0 || !m_acceptAuth || (!m_authorizedKeys.isEmpty() && !m_authorizedKeys.contains(blob)))
+    {
+        _setError(s, LIBSSH2_ERROR_PUBLICKEY_UNVERIFIED);
+        return LIBSSH2_ERROR_PUBLICKEY_UNVERIFIED;
+    }
+    s->authenticated = true;
+    return 0;
+}
+
+int SshFakeTransport::userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len, const char *publickeyfiledata, size_t publickeyfiledata_len, const char *privatekeyfiledata, size_t privatekeyfiledata_len, const char *passphrase)
+{
+    Q_UNUSED(username)
+    Q_UNUSED(username_len)
+    Q_UNUSED(publickeyfiledata)
+    Q_UNUSED(publickeyfiledata_len)
+    Q_UNUSED(privatekeyfiledata)
+    Q_UNUSED(privatekeyfiledata_len)
+    Q_UNUSED(passphrase)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "userauth"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(!m_acceptAuth)
+    {
+        _setError(s, LIBSSH2_ERROR_AUTHENTICATION_FAILED);
+        return LIBSSH2_ERROR_AUTHENTICATION_FAILED;
+    }
+    s->authenticated = true;
+    return 0;
+}
+
+int SshFakeTransport::userauth_password_ex(LIBSSH2_SESSION *session, const char *username, unsigned int username_len, const char *password, unsigned int password_len, LIBSSH2_PASSWD_CHANGEREQ_FUNC((*passwd_change_cb)))
+{
+    Q_UNUSED(password)
+    Q_UNUSED(password_len)
+    Q_UNUSED(passwd_change_cb)
+    return userauth_publickey_frommemory(session, username, username_len, nullptr, 0, nullptr, 0, nullptr);
+}
+
+/* Channels */
+
+LIBSSH2_CHANNEL *SshFakeTransport::channel_open_ex(LIBSSH2_SESSION *session, const char *channel_type, unsigned int channel_type_len, unsigned int window_size, unsigned int packet_size, const char *message, unsigned int message_len)
+{
+    Q_UNUSED(packet_size)
+    Q_UNUSED(message)
+    Q_UNUSED(message_len)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "channel-open"))
+    {
+        return nullptr;
+    }
+    if(QByteArray(channel_type, static_cast<int>(channel_type_len)) != "session")
+    {
+        _setError(s, LIBSSH2_ERROR_CHANNEL_FAILURE, "unsupported channel type");
+        return nullptr;
+    }
+    return toHandle<LIBSSH2_CHANNEL>(_newChannel(s, SshFakeChannel::Exec, window_size));
+}
+
+LIBSSH2_CHANNEL *SshFakeTransport::channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port, const char *shost, int sport)
+{
+    Q_UNUSED(shost)
+    Q_UNUSED(sport)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "direct-tcpip"))
+    {
+        return nullptr;
+    }
+    SshFakeChannel *channel = _newChannel(s, SshFakeChannel::DirectTcpip);
+    channel->m_host = QString::fromUtf8(host);
+    channel->m_port = port;
+    if(m_directTcpipHandler && !m_directTcpipHandler(channel))
+    {
+        s->channels.removeAll(channel);
+        delete channel;
+        _setError(s, LIBSSH2_ERROR_CHANNEL_FAILURE, "connect failed");
+        return nullptr;
+    }
+    return toHandle<LIBSSH2_CHANNEL>(channel);
+}
+
+int SshFakeTransport::channel_process_startup(LIBSSH2_CHANNEL *channel, const char *request, unsigned int request_len, const char *message, unsigned int message_len)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    if(_again(ch->m_session) || !_request(ch->m_session, ch, "exec"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(QByteArray(request, static_cast<int>(request_len)) != "exec")
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_CHANNEL_REQUEST_DENIED);
+        return LIBSSH2_ERROR_CHANNEL_REQUEST_DENIED;
+    }
+    ch->m_command = QString::fromUtf8(message, static_cast<int>(message_len));
+    if(m_execHandler && !m_execHandler(ch))
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_CHANNEL_REQUEST_DENIED);
+        return LIBSSH2_ERROR_CHANNEL_REQUEST_DENIED;
+    }
+    return 0;
+}
+
+ssize_t SshFakeTransport::channel_read_ex(LIBSSH2_CHANNEL *channel, int stream_id, char *buf, size_t buflen)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    m_stats.reads++;
+    if(_again(ch->m_session))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    QByteArray &inbox = ch->m_clientInbox[(stream_id == SSH_EXTENDED_DATA_STDERR)?(1):(0)];
+    if(inbox.isEmpty())
+    {
+        if(ch->m_peerEof || ch->m_peerClosed)
+        {
+            return 0;
+        }
+        m_stats.eagain++;
+        _setError(ch->m_session, LIBSSH2_ERROR_EAGAIN);
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    int len = static_cast<int>(qMin<qint64>(static_cast<qint64>(buflen), inbox.size()));
+    memcpy(buf, inbox.constData(), static_cast<size_t>(len));
+    inbox.remove(0, len);
+    _credit(ch, len, true);
+    return len;
+}
+
+ssize_t SshFakeTransport::channel_write_ex(LIBSSH2_CHANNEL *channel, int stream_id, const char *buf, size_t buflen)
+{
+    Q_UNUSED(stream_id)
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    m_stats.writes++;
+    if(_again(ch->m_session))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(ch->m_clientEofSent)
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_CHANNEL_EOF_SENT);
+        return LIBSSH2_ERROR_CHANNEL_EOF_SENT;
+    }
+    if(ch->m_peerClosed)
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_CHANNEL_CLOSED);
+        return LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    if(ch->m_clientWindow <= 0)
+    {
+        /* Window exhausted, woken up by the next window adjust */
+        m_stats.eagain++;
+        _setError(ch->m_session, LIBSSH2_ERROR_EAGAIN);
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    qint64 len = qMin<qint64>(qMin<qint64>(static_cast<qint64>(buflen), ch->m_clientWindow), m_conditions.packetSize);
+    SshFakeChannel::Segment segment;
+    segment.data = QByteArray(buf, static_cast<int>(len));
+    segment.at = _deliveryTime(ch->m_session, true, len);
+    ch->m_up.append(segment);
+    ch->m_clientWindow -= len;
+    m_stats.bytesUp += len;
+    _schedule(segment.at);
+    return static_cast<ssize_t>(len);
+}
+
+int SshFakeTransport::channel_eof(LIBSSH2_CHANNEL *channel)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    return ((ch->m_peerEof || ch->m_peerClosed) && ch->m_clientInbox[0].isEmpty())?(1):(0);
+}
+
+int SshFakeTransport::channel_send_eof(LIBSSH2_CHANNEL *channel)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    if(_again(ch->m_session))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(!ch->m_clientEofSent)
+    {
+        SshFakeChannel::Segment segment;
+        segment.at = _now() + static_cast<qint64>(m_conditions.latency) * 1000000;
+        segment.eof = true;
+        ch->m_up.append(segment);
+        ch->m_clientEofSent = true;
+        _schedule(segment.at);
+    }
+    return 0;
+}
+
+int SshFakeTransport::channel_close(LIBSSH2_CHANNEL *channel)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    if(_again(ch->m_session))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(!ch->m_clientCloseSent)
+    {
+        SshFakeChannel::Segment segment;
+        segment.at = _now() + static_cast<qint64>(m_conditions.latency) * 1000000;
+        segment.eof = !ch->m_clientEofSent;
+        segment.close = true;
+        ch->m_up.append(segment);
+        ch->m_clientEofSent = true;
+        ch->m_clientCloseSent = true;
+        _schedule(segment.at);
+    }
+    return 0;
+}
+
+int SshFakeTransport::channel_wait_closed(LIBSSH2_CHANNEL *channel)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    if(!ch->m_clientCloseSent)
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_INVAL);
+        return LIBSSH2_ERROR_INVAL;
+    }
+    if(_again(ch->m_session) || !ch->m_peerClosed)
+    {
+        _setError(ch->m_session, LIBSSH2_ERROR_EAGAIN);
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    return 0;
+}
+
+int SshFakeTransport::channel_free(LIBSSH2_CHANNEL *channel)
+{
+    SshFakeChannel *ch = fromHandle<SshFakeChannel>(channel);
+    ch->m_session->channels.removeAll(ch);
+    for(Listener *listener: m_listeners)
+    {
+        for(int i = listener->queue.size() - 1; i >= 0; i--)
+        {
+            if(listener->queue.at(i).second == ch)
+                listener->queue.removeAt(i);
+        }
+    }
+    for(auto it = m_requests.begin(); it != m_requests.end();)
+    {
+        if(it.key().first == ch)
+            it = m_requests.erase(it);
+        else
+            ++it;
+    }
+    ch->deleteLater();
+    return 0;
+}
+
+int SshFakeTransport::channel_get_exit_status(LIBSSH2_CHANNEL *channel)
+{
+    return fromHandle<SshFakeChannel>(channel)->m_receivedExitStatus;
+}
+
+LIBSSH2_LISTENER *SshFakeTransport::channel_forward_listen_ex(LIBSSH2_SESSION *session, const char *host, int port, int *bound_port, int queue_maxsize)
+{
+    Q_UNUSED(queue_maxsize)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "tcpip-forward"))
+    {
+        return nullptr;
+    }
+    Listener *listener = new Listener();
+    listener->session = s;
+    listener->host = QString::fromUtf8(host);
+    listener->port = (port > 0)?(port):(m_nextBoundPort++);
+    if(bound_port) *bound_port = listener->port;
+    m_listeners.append(listener);
+    return toHandle<LIBSSH2_LISTENER>(listener);
+}
+
+LIBSSH2_CHANNEL *SshFakeTransport::channel_forward_accept(LIBSSH2_LISTENER *listener)
+{
+    Listener *l = fromHandle<Listener>(listener);
+    if(_again(l->session))
+    {
+        return nullptr;
+    }
+    if(l->queue.isEmpty() || l->queue.first().first > _now())
+    {
+        _setError(l->session, LIBSSH2_ERROR_EAGAIN);
+        return nullptr;
+    }
+    return toHandle<LIBSSH2_CHANNEL>(l->queue.takeFirst().second);
+}
+
+int SshFakeTransport::channel_forward_cancel(LIBSSH2_LISTENER *listener)
+{
+    Listener *l = fromHandle<Listener>(listener);
+    if(_again(l->session) || !_request(l->session, l, "cancel-tcpip-forward"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    for(const QPair<qint64, SshFakeChannel *> &pending: l->queue)
+    {
+        pending.second->close();
+    }
+    m_listeners.removeAll(l);
+    delete l;
+    return 0;
+}
+
+/* SCP, on the shared in-memory file system */
+
+LIBSSH2_CHANNEL *SshFakeTransport::scp_send64(LIBSSH2_SESSION *session, const char *path, int mode, libssh2_int64_t size, time_t mtime, time_t atime)
+{
+    Q_UNUSED(mtime)
+    Q_UNUSED(atime)
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "scp-send"))
+    {
+        return nullptr;
+    }
+    QString file = QDir::cleanPath(QString::fromUtf8(path));
+    if(m_files.value(file).dir || (parentPath(file) != "." && parentPath(file) != "/" && !m_files.value(parentPath(file)).dir))
+    {
+        _setError(s, LIBSSH2_ERROR_SCP_PROTOCOL, "scp: No such file or directory");
+        return nullptr;
+    }
+    SshFakeChannel *channel = _newChannel(s, SshFakeChannel::ScpSend);
+    channel->m_path = file;
+    channel->m_size = size;
+    File &dest = m_files[file];
+    dest.data.clear();
+    dest.dir = false;
+    dest.mode = mode & 07777;
+    dest.mtime = QDateTime::currentDateTimeUtc();
+    QObject::connect(channel, &SshFakeChannel::dataReceived, channel, [this, channel]() {
+        QByteArray data = channel->readAll();
+        if(m_files.contains(channel->m_path))
+        {
+            m_files[channel->m_path].data.append(data);
+        }
+        if(channel->clientEof())
+        {
+            channel->sendEof();
+            channel->close();
+        }
+    });
+    return toHandle<LIBSSH2_CHANNEL>(channel);
+}
+
+LIBSSH2_CHANNEL *SshFakeTransport::scp_recv2(LIBSSH2_SESSION *session, const char *path, libssh2_struct_stat *sb)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "scp-recv"))
+    {
+        return nullptr;
+    }
+    QString file = QDir::cleanPath(QString::fromUtf8(path));
+    if(!m_files.contains(file) || m_files.value(file).dir)
+    {
+        _setError(s, LIBSSH2_ERROR_SCP_PROTOCOL, "scp: No such file or directory");
+        return nullptr;
+    }
+    const File &src = m_files[file];
+    if(sb)
+    {
+        memset(sb, 0, sizeof(*sb));
+        sb->st_size = src.data.size();
+        sb->st_mode = static_cast<decltype(sb->st_mode)>(S_IFREG | (src.mode & 07777));
+        sb->st_mtime = static_cast<time_t>(src.mtime.toSecsSinceEpoch());
+        sb->st_atime = sb->st_mtime;
+    }
+    SshFakeChannel *channel = _newChannel(s, SshFakeChannel::ScpRecv);
+    channel->m_path = file;
+    channel->m_size = src.data.size();
+    channel->write(src.data);
+    channel->sendEof();
+    return toHandle<LIBSSH2_CHANNEL>(channel);
+}
+
+/* SFTP, every request costs a round-trip */
+
+LIBSSH2_SFTP *SshFakeTransport::sftp_init(LIBSSH2_SESSION *session)
+{
+    SshFakeSession *s = fromHandle<SshFakeSession>(session);
+    if(_again(s) || !_request(s, s, "sftp-init", 2))
+    {
+        return nullptr;
+    }
+    Sftp *sftp = new Sftp();
+    sftp->session = s;
+    return toHandle<LIBSSH2_SFTP>(sftp);
+}
+
+int SshFakeTransport::sftp_shutdown(LIBSSH2_SFTP *sftp)
+{
+    delete fromHandle<Sftp>(sftp);
+    return 0;
+}
+
+unsigned long SshFakeTransport::sftp_last_error(LIBSSH2_SFTP *sftp)
+{
+    return fromHandle<Sftp>(sftp)->lastError;
+}
+
+LIBSSH2_SFTP_HANDLE *SshFakeTransport::sftp_open_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len, unsigned long flags, long mode, int open_type)
+{
+    Sftp *sf = fromHandle<Sftp>(sftp);
+    if(_again(sf->session) || !_request(sf->session, sf, "open"))
+    {
+        return nullptr;
+    }
+    QString path = _cleanPath(filename, filename_len);
+    auto fail = [this, sf](unsigned long error) {
+        sf->lastError = error;
+        _setError(sf->session, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return nullptr;
+    };
+
+    SftpHandle *handle = new SftpHandle();
+    handle->sftp = sf;
+    handle->path = path;
+    if(open_type == LIBSSH2_SFTP_OPENDIR)
+    {
+        bool root = (path == "/" || path == ".");
+        if(!root && !m_files.value(path).dir)
+        {
+            delete handle;
+            return fail(LIBSSH2_FX_NO_SUCH_FILE);
+        }
+        handle->dir = true;
+        handle->entries << "." << "..";
+        QString prefix = (path == "/")?(path):((root)?(QString()):(path + "/"));
+        for(auto it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+        {
+            QString name = it.key();
+            if(prefix.isEmpty() && !name.startsWith('/') && !name.contains('/'))
+                handle->entries << name;
+            else if(!prefix.isEmpty() && name.startsWith(prefix) && name.size() > prefix.size() && !name.mid(prefix.size()).contains('/'))
+                handle->entries << name.mid(prefix.size());
+        }
+    }
+    else
+    {
+        QString parent = parentPath(path);
+        if(m_files.value(path).dir)
+        {
+            delete handle;
+            return fail(LIBSSH2_FX_FAILURE);
+        }
+        if(!m_files.contains(path))
+        {
+            if(!(flags & LIBSSH2_FXF_CREAT) || (parent != "." && parent != "/" && !m_files.value(parent).dir))
+            {
+                delete handle;
+                return fail(LIBSSH2_FX_NO_SUCH_FILE);
+            }
+            File file;
+            file.mode = static_cast<int>(mode & 07777);
+            file.mtime = QDateTime::currentDateTimeUtc();
+            m_files.insert(path, file);
+        }
+        if(flags & LIBSSH2_FXF_TRUNC)
+        {
+            m_files[path].data.clear();
+        }
+        if(flags & LIBSSH2_FXF_APPEND)
+        {
+            handle->offset = m_files.value(path).data.size();
+        }
+    }
+    sf->lastError = LIBSSH2_FX_OK;
+    return toHandle<LIBSSH2_SFTP_HANDLE>(handle);
+}
+
+int SshFakeTransport::sftp_close_handle(LIBSSH2_SFTP_HANDLE *handle)
+{
+    SftpHandle *h = fromHandle<SftpHandle>(handle);
+    if(_again(h->sftp->session) || !_request(h->sftp->session, h, "close"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    delete h;
+    return 0;
+}
+
+/* One request per call: up to buffer_maxlen bytes after a round-trip and their transfer time */
+ssize_t SshFakeTransport::sftp_read(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen)
+{
+    SftpHandle *h = fromHandle<SftpHandle>(handle);
+    SshFakeSession *s = h->sftp->session;
+    m_stats.reads++;
+    if(_again(s))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    const QByteArray &data = m_files.value(h->path).data;
+    if(h->pendingAt == 0)
+    {
+        h->pendingLen = qBound<qint64>(0, data.size() - h->offset, static_cast<qint64>(buffer_maxlen));
+        h->pendingAt = (m_conditions.latency > 0 || m_conditions.bandwidth > 0)?(_deliveryTime(s, false, h->pendingLen) + static_cast<qint64>(m_conditions.latency) * 1000000):(-1);
+        if(h->pendingAt > 0)
+        {
+            _schedule(h->pendingAt);
+        }
+    }
+    if(h->pendingAt > _now())
+    {
+        m_stats.eagain++;
+        _setError(s, LIBSSH2_ERROR_EAGAIN);
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    qint64 len = qBound<qint64>(0, qMin<qint64>(h->pendingLen, data.size() - h->offset), static_cast<qint64>(buffer_maxlen));
+    memcpy(buffer, data.constData() + h->offset, static_cast<size_t>(len));
+    h->offset += len;
+    h->pendingAt = 0;
+    m_stats.bytesDown += len;
+    return static_cast<ssize_t>(len);
+}
+
+/* Acknowledged after the upload time and a round-trip; the caller repeats the same buffer meanwhile */
+ssize_t SshFakeTransport::sftp_write(LIBSSH2_SFTP_HANDLE *handle, const char *buffer, size_t count)
+{
+    SftpHandle *h = fromHandle<SftpHandle>(handle);
+    SshFakeSession *s = h->sftp->session;
+    m_stats.writes++;
+    if(_again(s))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    if(h->pendingAt == 0)
+    {
+        h->pendingLen = static_cast<qint64>(count);
+        h->pendingAt = (m_conditions.latency > 0 || m_conditions.bandwidth > 0)?(_deliveryTime(s, true, h->pendingLen) + static_cast<qint64>(m_conditions.latency) * 1000000):(-1);
+        if(h->pendingAt > 0)
+        {
+            _schedule(h->pendingAt);
+        }
+    }
+    if(h->pendingAt > _now())
+    {
+        m_stats.eagain++;
+        _setError(s, LIBSSH2_ERROR_EAGAIN);
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    qint64 len = qMin<qint64>(h->pendingLen, static_cast<qint64>(count));
+    h->pendingAt = 0;
+    if(!m_files.contains(h->path))
+    {
+        h->sftp->lastError = LIBSSH2_FX_NO_SUCH_FILE;
+        _setError(s, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return LIBSSH2_ERROR_SFTP_PROTOCOL;
+    }
+    File &file = m_files[h->path];
+    if(file.data.size() < h->offset + len)
+    {
+        file.data.resize(static_cast<int>(h->offset + len));
+    }
+    memcpy(file.data.data() + h->offset, buffer, static_cast<size_t>(len));
+    file.mtime = QDateTime::currentDateTimeUtc();
+    h->offset += len;
+    m_stats.bytesUp += len;
+    return static_cast<ssize_t>(len);
+}
+
+void SshFakeTransport::sftp_seek64(LIBSSH2_SFTP_HANDLE *handle, libssh2_uint64_t offset)
+{
+    SftpHandle *h = fromHandle<SftpHandle>(handle);
+    h->offset = static_cast<qint64>(offset);
+    h->pendingAt = 0;
+}
+
+int SshFakeTransport::sftp_readdir_ex(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen, char *longentry, size_t longentry_maxlen, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    SftpHandle *h = fromHandle<SftpHandle>(handle);
+    SshFakeSession *s = h->sftp->session;
+    if(_again(s))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    /* The whole listing comes with the first answer */
+    if(!h->listed)
+    {
+        if(!_request(s, h, "readdir"))
+        {
+            return LIBSSH2_ERROR_EAGAIN;
+        }
+        h->listed = true;
+    }
+    if(h->entries.isEmpty())
+    {
+        return 0;
+    }
+    QString name = h->entries.takeFirst();
+    QByteArray utf8 = name.toUtf8();
+    if(static_cast<size_t>(utf8.size()) >= buffer_maxlen)
+    {
+        return LIBSSH2_ERROR_BUFFER_TOO_SMALL;
+    }
+    memcpy(buffer, utf8.constData(), static_cast<size_t>(utf8.size()) + 1);
+
+    File file;
+    file.dir = true;
+    file.mode = 0755;
+    if(name != "." && name != "..")
+    {
+        QString full = (h->path == "/")?("/" + name):((h->path == ".")?(name):(h->path + "/" + name));
+        file = m_files.value(full);
+    }
+    if(attrs)
+    {
+        _fillAttributes(file, attrs);
+    }
+    if(longentry && longentry_maxlen > 0)
+    {
+        QByteArray longname = QString("%1rw-r--r--    1 fake     fake     %2 %3 %4")
+                .arg((file.dir)?('d'):('-'))
+                .arg(file.data.size(), 8)
+                .arg(file.mtime.toString("MMM dd hh:mm"))
+                .arg(name).toUtf8();
+        size_t len = qMin(static_cast<size_t>(longname.size()), longentry_maxlen - 1);
+        memcpy(longentry, longname.constData(), len);
+        longentry[len] = '\0';
+    }
+    return utf8.size();
+}
+
+int SshFakeTransport::sftp_stat_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, int stat_type, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    Sftp *sf = fromHandle<Sftp>(sftp);
+    if(_again(sf->session) || !_request(sf->session, sf, "stat"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    QString file = _cleanPath(path, path_len);
+    bool root = (file == "/" || file == ".");
+    if(!root && !m_files.contains(file))
+    {
+        sf->lastError = LIBSSH2_FX_NO_SUCH_FILE;
+        _setError(sf->session, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return LIBSSH2_ERROR_SFTP_PROTOCOL;
+    }
+    sf->lastError = LIBSSH2_FX_OK;
+    if(stat_type == LIBSSH2_SFTP_SETSTAT)
+    {
+        if(root)
+            return 0;
+        File &f = m_files[file];
+        if(attrs->flags & LIBSSH2_SFTP_ATTR_PERMISSIONS)
+            f.mode = static_cast<int>(attrs->permissions & 07777);
+        if(attrs->flags & LIBSSH2_SFTP_ATTR_ACMODTIME)
+            f.mtime = QDateTime::fromSecsSinceEpoch(static_cast<qint64>(attrs->mtime), Qt::UTC);
+        if(attrs->flags & LIBSSH2_SFTP_ATTR_SIZE)
+            f.data.resize(static_cast<int>(attrs->filesize));
+        return 0;
+    }
+    File dir;
+    dir.dir = true;
+    dir.mode = 0755;
+    _fillAttributes((root)?(dir):(m_files.value(file)), attrs);
+    return 0;
+}
+
+int SshFakeTransport::sftp_mkdir_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, long mode)
+{
+    Sftp *sf = fromHandle<Sftp>(sftp);
+    if(_again(sf->session) || !_request(sf->session, sf, "mkdir"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    QString dir = _cleanPath(path, path_len);
+    QString parent = parentPath(dir);
+    unsigned long error = LIBSSH2_FX_OK;
+    if(m_files.contains(dir) || dir == "/" || dir == ".")
+        error = LIBSSH2_FX_FILE_ALREADY_EXISTS;
+    else if(parent != "." && parent != "/" && !m_files.value(parent).dir)
+        error = LIBSSH2_FX_NO_SUCH_FILE;
+    sf->lastError = error;
+    if(error != LIBSSH2_FX_OK)
+    {
+        _setError(sf->session, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return LIBSSH2_ERROR_SFTP_PROTOCOL;
+    }
+    File file;
+    file.dir = true;
+    file.mode = static_cast<int>(mode & 07777);
+    file.mtime = QDateTime::currentDateTimeUtc();
+    m_files.insert(dir, file);
+    return 0;
+}
+
+int SshFakeTransport::sftp_rename_ex(LIBSSH2_SFTP *sftp, const char *source_filename, unsigned int source_filename_len, const char *dest_filename, unsigned int dest_filename_len, long flags)
+{
+    Sftp *sf = fromHandle<Sftp>(sftp);
+    if(_again(sf->session) || !_request(sf->session, sf, "rename"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    QString source = _cleanPath(source_filename, source_filename_len);
+    QString dest = _cleanPath(dest_filename, dest_filename_len);
+    unsigned long error = LIBSSH2_FX_OK;
+    if(!m_files.contains(source))
+        error = LIBSSH2_FX_NO_SUCH_FILE;
+    else if(m_files.contains(dest) && !(flags & LIBSSH2_SFTP_RENAME_OVERWRITE))
+        error = LIBSSH2_FX_FILE_ALREADY_EXISTS;
+    sf->lastError = error;
+    if(error != LIBSSH2_FX_OK)
+    {
+        _setError(sf->session, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return LIBSSH2_ERROR_SFTP_PROTOCOL;
+    }
+    m_files.insert(dest, m_files.take(source));
+    QString prefix = source + "/";
+    for(const QString &name: m_files.keys())
+    {
+        if(name.startsWith(prefix))
+            m_files.insert(dest + "/" + name.mid(prefix.size()), m_files.take(name));
+    }
+    return 0;
+}
+
+int SshFakeTransport::sftp_unlink_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len)
+{
+    Sftp *sf = fromHandle<Sftp>(sftp);
+    if(_again(sf->session) || !_request(sf->session, sf, "unlink"))
+    {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    QString file = _cleanPath(filename, filename_len);
+    unsigned long error = LIBSSH2_FX_OK;
+    if(!m_files.contains(file))
+        error = LIBSSH2_FX_NO_SUCH_FILE;
+    else if(m_files.value(file).dir)
+        error = LIBSSH2_FX_FAILURE;
+    sf->lastError = error;
+    if(error != LIBSSH2_FX_OK)
+    {
+        _setError(sf->session, LIBSSH2_ERROR_SFTP_PROTOCOL);
+        return LIBSSH2_ERROR_SFTP_PROTOCOL;
+    }
+    m_files.remove(file);
+    return 0;
+}
@@ -0,0 +1,287 @@
+#ifndef SSHFAKETRANSPORT_H
+#define SSHFAKETRANSPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QTcpServer>
+#include <QTimer>
+#include <functional>
+#include <sshtransport.h>
+
+class SshFakeTransport;
+struct SshFakeSession;
+
+/*
+ * Remote end of a fake channel, what the server would do with it. Handlers
+ * installed on SshFakeTransport get one per opened channel. Data written by
+ * the client stays here until read: a peer that does not read exhausts the
+ * client's window, like a slow server.
+ *
+ * Valid until the client frees the channel (destroyed with deleteLater).
+ */
+class SshFakeChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind {
+        Exec,
+        DirectTcpip,
+        Forwarded,
+        ScpSend,
+        ScpRecv
+    };
+    Q_ENUM(Kind)
+
+    Kind kind() const;
+    QString command() const;
+    QString host() const;
+    int port() const;
+
+    /* Data from the client */
+    qint64 bytesAvailable() const;
+    QByteArray read(qint64 maxlen);
+    QByteArray readAll();
+    bool clientEof() const;
+    bool clientClosed() const;
+
+    /* Data to the client, sent as the client's window allows */
+    void write(const QByteArray &data);
+    void writeStderr(const QByteArray &data);
+    void sendEof();
+    void setExitStatus(int status);
+    void close();
+
+signals:
+    /* New data or EOF from the client */
+    void dataReceived();
+    void clientClosing();
+
+private:
+    friend class SshFakeTransport;
+    explicit SshFakeChannel(SshFakeTransport *transport, SshFakeSession *session, Kind kind);
+
+    struct Segment {
+        qint64 at {0};
+        int stream {0};
+        QByteArray data;
+        qint64 credit {0};
+        bool eof {false};
+        bool close {false};
+        int status {0};
+    };
+
+    SshFakeTransport *m_transport;
+    SshFakeSession *m_session;
+    Kind m_kind;
+    QString m_command;
+    QString m_host;
+    int m_port {0};
+    QString m_path;
+    qint64 m_size {0};
+
+    /* Client to peer: m_clientWindow is what the client may still send */
+    QList<Segment> m_up;
+    QByteArray m_peerInbox;
+    qint64 m_clientWindow {0};
+    bool m_clientEofSent {false};
+    bool m_clientCloseSent {false};
+    bool m_clientEof {false};
+    bool m_clientClosed {false};
+
+    /* Peer to client: m_peerWindow is what the peer may still send */
+    QByteArray m_peerOutbox[2];
+    QList<Segment> m_down;
+    QByteArray m_clientInbox[2];
+    qint64 m_peerWindow {0};
+    bool m_peerEofPending {false};
+    bool m_peerClosePending {false};
+    bool m_peerEofSent {false};
+    bool m_peerCloseSent {false};
+    bool m_peerEof {false};
+    bool m_peerClosed {false};
+    int m_exitStatus {0};
+    int m_receivedExitStatus {0};
+
+    void _flush();
+};
+
+/*
+ * In-memory SshTransport: sessions, channels, SCP and SFTP without any
+ * server, with scripted network conditions. Install it with
+ * SshTransport::setInstance() before connecting. SshClient still opens its
+ * TCP socket, so it must reach something that accepts (listen() provides
+ * a port); nothing is exchanged on it.
+ *
+ * Conditions apply to every session:
+ *  - latency: one-way delay; each request (handshake, auth, channel open,
+ *    exec, SFTP operation...) costs a round-trip, data and window adjusts
+ *    arrive latency after they are sent.
+ *  - bandwidth: bytes per second of each direction, shared by the channels
+ *    of a session (0 for unlimited).
+ *  - window: the peer's receive window of each channel. Writes return
+ *    EAGAIN once the client has that much data unread by the peer.
+ *  - eagainEvery / eagainStorm: every eagainEvery-th call returns EAGAIN
+ *    eagainStorm times in a row before doing anything.
+ *
+ * SFTP and SCP share one in-memory file system (files()).
+ */
+class SshFakeTransport : public QObject, public SshTransport
+{
+    Q_OBJECT
+
+public:
+    struct Conditions {
+        int latency {0};
+        qint64 bandwidth {0};
+        qint64 window {LIBSSH2_CHANNEL_WINDOW_DEFAULT};
+        int packetSize {LIBSSH2_CHANNEL_PACKET_DEFAULT};
+        int eagainEvery {0};
+        int eagainStorm {1};
+    };
+
+    struct File {
+        QByteArray data;
+        bool dir {false};
+        int mode {0644};
+        QDateTime mtime;
+    };
+
+    struct Stats {
+        qint64 calls {0};
+        qint64 eagain {0};
+        qint64 writes {0};
+        qint64 reads {0};
+        qint64 bytesUp {0};
+        qint64 bytesDown {0};
+        qint64 wakeups {0};
+        qint64 publickeyAttempts {0};
+    };
+
+    /* Return false to refuse the channel (exec denied, connect failed) */
+    typedef std::function<bool(SshFakeChannel *channel)> Handler;
+
+    explicit SshFakeTransport(QObject *parent = nullptr);
+    virtual ~SshFakeTransport() override;
+
+    void setConditions(const Conditions &conditions);
+    Conditions conditions() const;
+
+    /* Default exec: "echo ...", "cat" and "true"; default direct-tcpip: echo */
+    void setExecHandler(const Handler &handler);
+    void setDirectTcpipHandler(const Handler &handler);
+    void setAuthentication(bool accept);
+    /* Public key blobs accepted by userauth_publickey, any when empty */
+    void setAuthorizedKeys(const QList<QByteArray> &keys);
+
+    /* Local port SshClient can connect to */
+    quint16 listen();
+
+    /* Open a channel through the reverse tunnel bound on port, nullptr if none */
+    SshFakeChannel *connectForward(int port, const QString &host = "127.0.0.1");
+
+    QMap<QString, File> &files();
+    Stats stats() const;
+    void resetStats();
+
+    /* SshTransport */
+    void setWakeup(LIBSSH2_SESSION *session, const std::function<void()> &wakeup) override;
+    LIBSSH2_SESSION *session_init_ex(LIBSSH2_ALLOC_FUNC((*my_alloc)), LIBSSH2_FREE_FUNC((*my_free)), LIBSSH2_REALLOC_FUNC((*my_realloc)), void *abstract) override;
+    void *session_callback_set(LIBSSH2_SESSION *session, int cbtype, void *callback) override;
+    void session_set_blocking(LIBSSH2_SESSION *session, int blocking) override;
+    int session_handshake(LIBSSH2_SESSION *session, libssh2_socket_t sock) override;
+    const char *session_hostkey(LIBSSH2_SESSION *session, size_t *len, int *type) override;
+    const char *hostkey_hash(LIBSSH2_SESSION *session, int hash_type) override;
+    const char *session_banner_get(LIBSSH2_SESSION *session) override;
+    int session_last_error(LIBSSH2_SESSION *session, char **errmsg, int *errmsg_len, int want_buf) override;
+    int session_disconnect_ex(LIBSSH2_SESSION *session, int reason, const char *description, const char *lang) override;
+    int session_free(LIBSSH2_SESSION *session) override;
+    void keepalive_config(LIBSSH2_SESSION *session, int want_reply, unsigned int interval) override;
+    int keepalive_send(LIBSSH2_SESSION *session, int *seconds_to_next) override;
+
+    char *userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len) override;
+    int userauth_authenticated(LIBSSH2_SESSION *session) override;
+    int userauth_publickey(LIBSSH2_SESSION *session, const char *username, const unsigned char *pubkeydata, size_t pubkeydata_len, LIBSSH2_USERAUTH_PUBLICKEY_SIGN_FUNC((*sign_callback)), void **abstract) override;
+    int userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len, const char *publickeyfiledata, size_t publickeyfiledata_len, const char *privatekeyfiledata, size_t privatekeyfiledata_len, const char *passphrase) override;
+    int userauth_password_ex(LIBSSH2_SESSION *session, const char *username, unsigned int username_len, const char *password, unsigned int password_len, LIBSSH2_PASSWD_CHANGEREQ_FUNC((*passwd_change_cb))) override;
+
+    LIBSSH2_CHANNEL *channel_open_ex(LIBSSH2_SESSION *session, const char *channel_type, unsigned int channel_type_len, unsigned int window_size, unsigned int packet_size, const char *message, unsigned int message_len) override;
+    LIBSSH2_CHANNEL *channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port, const char *shost, int sport) override;
+    int channel_process_startup(LIBSSH2_CHANNEL *channel, const char *request, unsigned int request_len, const char *message, unsigned int message_len) override;
+    ssize_t channel_read_ex(LIBSSH2_CHANNEL *channel, int stream_id, char *buf, size_t buflen) override;
+    ssize_t channel_write_ex(LIBSSH2_CHANNEL *channel, int stream_id, const char *buf, size_t buflen) override;
+    int channel_eof(LIBSSH2_CHANNEL *channel) override;
+    int channel_send_eof(LIBSSH2_CHANNEL *channel) override;
+    int channel_close(LIBSSH2_CHANNEL *channel) override;
+    int channel_wait_closed(LIBSSH2_CHANNEL *channel) override;
+    int channel_free(LIBSSH2_CHANNEL *channel) override;
+    int channel_get_exit_status(LIBSSH2_CHANNEL *channel) override;
+    LIBSSH2_LISTENER *channel_forward_listen_ex(LIBSSH2_SESSION *session, const char *host, int port, int *bound_port, int queue_maxsize) override;
+    LIBSSH2_CHANNEL *channel_forward_accept(LIBSSH2_LISTENER *listener) override;
+    int channel_forward_cancel(LIBSSH2_LISTENER *listener) override;
+
+    LIBSSH2_CHANNEL *scp_send64(LIBSSH2_SESSION *session, const char *path, int mode, libssh2_int64_t size, time_t mtime, time_t atime) override;
+    LIBSSH2_CHANNEL *scp_recv2(LIBSSH2_SESSION *session, const char *path, libssh2_struct_stat *sb) override;
+
+    LIBSSH2_SFTP *sftp_init(LIBSSH2_SESSION *session) override;
+    int sftp_shutdown(LIBSSH2_SFTP *sftp) override;
+    unsigned long sftp_last_error(LIBSSH2_SFTP *sftp) override;
+    LIBSSH2_SFTP_HANDLE *sftp_open_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len, unsigned long flags, long mode, int open_type) override;
+    int sftp_close_handle(LIBSSH2_SFTP_HANDLE *handle) override;
+    ssize_t sftp_read(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen) override;
+    ssize_t sftp_write(LIBSSH2_SFTP_HANDLE *handle, const char *buffer, size_t count) override;
+    void sftp_seek64(LIBSSH2_SFTP_HANDLE *handle, libssh2_uint64_t offset) override;
+    int sftp_readdir_ex(LIBSSH2_SFTP_HANDLE *handle, char *buffer, size_t buffer_maxlen, char *longentry, size_t longentry_maxlen, LIBSSH2_SFTP_ATTRIBUTES *attrs) override;
+    int sftp_stat_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, int stat_type, LIBSSH2_SFTP_ATTRIBUTES *attrs) override;
+    int sftp_mkdir_ex(LIBSSH2_SFTP *sftp, const char *path, unsigned int path_len, long mode) override;
+    int sftp_rename_ex(LIBSSH2_SFTP *sftp, const char *source_filename, unsigned int source_filename_len, const char *dest_filename, unsigned int dest_filename_len, long flags) override;
+    int sftp_unlink_ex(LIBSSH2_SFTP *sftp, const char *filename, unsigned int filename_len) override;
+
+private:
+    friend class SshFakeChannel;
+    struct Sftp;
+    struct SftpHandle;
+    struct Listener;
+
+    Conditions m_conditions;
+    Handler m_execHandler;
+    Handler m_directTcpipHandler;
+    bool m_acceptAuth {true};
+    QList<QByteArray> m_authorizedKeys;
+    QMap<QString, File> m_files;
+    Stats m_stats;
+    qint64 m_callCount {0};
+    int m_stormLeft {0};
+    int m_nextBoundPort {40000};
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    qint64 m_nextEvent {-1};
+    QTcpServer m_server;
+
+    QList<SshFakeSession *> m_sessions;
+    QList<Listener *> m_listeners;
+    QHash<QPair<void *, QByteArray>, qint64> m_requests;
+
+    qint64 _now() const;
+    void _schedule(qint64 at);
+    qint64 _deliveryTime(SshFakeSession *session, bool up, qint64 len);
+    bool _again(SshFakeSession *session);
+    bool _request(SshFakeSession *session, void *handle, const QByteArray &op, int roundTrips = 1);
+    void _setError(SshFakeSession *session, int error, const QByteArray &message = QByteArray());
+    static QByteArray _userauthRequest(SshFakeSession *session, const QByteArray &username, const QByteArray &blob);
+    SshFakeChannel *_newChannel(SshFakeSession *session, SshFakeChannel::Kind kind, unsigned int window = LIBSSH2_CHANNEL_WINDOW_DEFAULT);
+    void _credit(SshFakeChannel *channel, qint64 len, bool toPeer);
+    void _fillAttributes(const File &file, LIBSSH2_SFTP_ATTRIBUTES *attrs) const;
+    QString _cleanPath(const char *path, unsigned int len) const;
+
+private slots:
+    void _advance();
+};
+
+#endif // SSHFAKETRANSPORT_H
@@ -0,0 +1,11 @@
+#include <QCoreApplication>
+#include <QTest>
+
+#include "tester.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    Tester test;
+    return QTest::qExec(&test, argc, argv);
+}
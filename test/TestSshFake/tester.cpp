@@ -0,0 +1,810 @@
+#include "tester.h"
+#include <sshprocess.h>
+#include <sshsftp.h>
+#include <sshscpsend.h>
+#include <sshscpget.h>
+#include <sshagent.h>
+#include <sshtunnelscheduler.h>
+#include <sshtunneldataconnector.h>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QMessageAuthenticationCode>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimer>
+#include <limits>
+
+Q_LOGGING_CATEGORY(testsshfake, "test.ssh.fake", QtInfoMsg)
+
+#define TestTimeOut (30*1000)
+
+Tester::Tester(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void Tester::init()
+{
+    m_fake = new SshFakeTransport();
+    SshTransport::setInstance(m_fake);
+}
+
+void Tester::cleanup()
+{
+    if(m_ssh)
+    {
+        m_ssh->disconnectFromHost();
+        m_ssh->waitForState(SshClient::SshState::Unconnected);
+        delete m_ssh;
+        m_ssh = nullptr;
+    }
+    QTest::qWait(50); // Let the channels deleteLater
+    SshTransport::setInstance(nullptr);
+    delete m_fake;
+    m_fake = nullptr;
+}
+
+bool Tester::connectClient(const SshFakeTransport::Conditions &conditions)
+{
+    m_fake->setConditions(conditions);
+    m_ssh = new SshClient("SshFake");
+    m_ssh->setPassphrase("fake");
+    QEventLoop waitssh;
+    QObject::connect(m_ssh, &SshClient::sshReady, &waitssh, &QEventLoop::quit);
+    QObject::connect(m_ssh, &SshClient::sshError, &waitssh, &QEventLoop::quit);
+    QTimer::singleShot(TestTimeOut, &waitssh, &QEventLoop::quit);
+    m_ssh->connectToHost("fake", "127.0.0.1", m_fake->listen());
+    waitssh.exec();
+    return m_ssh->sshState() == SshClient::SshState::Ready;
+}
+
+/* For tests needing several clients, the transport conditions already set */
+bool Tester::connectWith(SshClient &client)
+{
+    QEventLoop waitssh;
+    QObject::connect(&client, &SshClient::sshReady, &waitssh, &QEventLoop::quit);
+    QObject::connect(&client, &SshClient::sshError, &waitssh, &QEventLoop::quit);
+    QTimer::singleShot(TestTimeOut, &waitssh, &QEventLoop::quit);
+    client.connectToHost("fake", "127.0.0.1", m_fake->listen());
+    waitssh.exec();
+    return client.sshState() == SshClient::SshState::Ready;
+}
+
+SshTunnelOut *Tester::openTunnel(QTcpSocket &sock)
+{
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>("TunnelOut");
+    out->listen(22);
+    sock.connectToHost("127.0.0.1", out->localPort());
+    if(!sock.waitForConnected(TestTimeOut))
+    {
+        return nullptr;
+    }
+    return out;
+}
+
+/*
+ * Echo data through a new connection of out, limited to connectionRate if
+ * not 0: ms until all of it came back, -1 if it did not come back intact.
+ */
+qint64 Tester::timedEcho(SshTunnelOut *out, const QByteArray &data, qint64 connectionRate)
+{
+    QList<SshTunnelOutConnection *> known = m_ssh->findChildren<SshTunnelOutConnection *>();
+    QTcpSocket sock;
+    sock.connectToHost("127.0.0.1", out->localPort());
+    if(!sock.waitForConnected(TestTimeOut))
+    {
+        return -1;
+    }
+    if(connectionRate > 0)
+    {
+        SshTunnelOutConnection *connection = nullptr;
+        QElapsedTimer wait;
+        wait.start();
+        while(connection == nullptr && wait.elapsed() < TestTimeOut)
+        {
+            QTest::qWait(5);
+            for(SshTunnelOutConnection *candidate: m_ssh->findChildren<SshTunnelOutConnection *>())
+            {
+                if(!known.contains(candidate))
+                {
+                    connection = candidate;
+                }
+            }
+        }
+        if(connection == nullptr)
+        {
+            return -1;
+        }
+        connection->setRateLimit(connectionRate);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    sock.write(data);
+    QByteArray received = readAtLeast(sock, data.size());
+    qint64 elapsed = timer.elapsed();
+    sock.disconnectFromHost();
+    return (received == data)?(elapsed):(-1);
+}
+
+QByteArray Tester::readAtLeast(QTcpSocket &sock, int size)
+{
+    QByteArray received = sock.readAll();
+    QEventLoop wait;
+    QTimer::singleShot(TestTimeOut, &wait, &QEventLoop::quit);
+    QObject::connect(&sock, &QTcpSocket::readyRead, &wait, [&]() {
+        received += sock.readAll();
+        if(received.size() >= size)
+            wait.quit();
+    });
+    if(received.size() < size)
+    {
+        wait.exec();
+    }
+    return received;
+}
+
+/* One seeded sequence for the run: reproducible, but no two calls alike */
+QByteArray Tester::randomData(int size)
+{
+    static QRandomGenerator generator(42);
+    QByteArray data(size, '\0');
+    for(int i = 0; i < size; i++)
+    {
+        data[i] = static_cast<char>(generator.bounded(256));
+    }
+    return data;
+}
+
+/* Every request waits a round-trip: the result comes, not before */
+void Tester::test1_processWithLatency()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 20;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QElapsedTimer timer;
+    timer.start();
+    QEventLoop wait;
+    SshProcess *proc = m_ssh->getChannel<SshProcess>("command");
+    QObject::connect(proc, &SshProcess::finished, &wait, &QEventLoop::quit);
+    QObject::connect(proc, &SshProcess::failed, &wait, &QEventLoop::quit);
+    QTimer::singleShot(TestTimeOut, &wait, &QEventLoop::quit);
+    proc->runCommand("echo hello");
+    wait.exec();
+
+    QCOMPARE(proc->result(), QByteArray("hello\n"));
+    /* Channel open and exec round-trips, then the output one way */
+    QVERIFY(timer.elapsed() >= 5 * conditions.latency);
+}
+
+void Tester::test2_tunnelOutIntegrity()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 2;
+    conditions.bandwidth = 8*1024*1024;
+    conditions.window = 64*1024;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QByteArray data = randomData(2*1024*1024);
+    QTcpSocket sock;
+    SshTunnelOut *out = openTunnel(sock);
+    QVERIFY(out != nullptr);
+    sock.write(data);
+    QByteArray received = readAtLeast(sock, data.size());
+    sock.disconnectFromHost();
+    out->close();
+
+    QCOMPARE(received.size(), data.size());
+    QVERIFY(received == data);
+    QCOMPARE(m_fake->stats().bytesUp, static_cast<qint64>(data.size()));
+}
+
+/*
+ * A peer that does not read: the client fills the window, then waits for a
+ * window adjust without polling. Once the peer reads, everything goes through.
+ */
+void Tester::test3_tunnelOutWindowBackpressure()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 1;
+    conditions.window = 64*1024;
+    conditions.packetSize = 16*1024;
+    QPointer<SshFakeChannel> peer;
+    m_fake->setDirectTcpipHandler([&peer](SshFakeChannel *channel) {
+        peer = channel;
+        return true;
+    });
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QByteArray data = randomData(1024*1024);
+    QTcpSocket sock;
+    SshTunnelOut *out = openTunnel(sock);
+    QVERIFY(out != nullptr);
+    sock.write(data);
+
+    QTRY_VERIFY_WITH_TIMEOUT(peer && peer->bytesAvailable() == conditions.window, TestTimeOut);
+    SshFakeTransport::Stats blocked = m_fake->stats();
+    QTest::qWait(200);
+    SshFakeTransport::Stats idle = m_fake->stats();
+    qCInfo(testsshfake) << "Calls while the window is full:" << idle.calls - blocked.calls;
+    QCOMPARE(peer->bytesAvailable(), static_cast<qint64>(conditions.window));
+    QVERIFY2(idle.calls - blocked.calls < 20, "The client polls a full window");
+
+    QObject::connect(peer.data(), &SshFakeChannel::dataReceived, peer.data(), [&peer]() {
+        peer->write(peer->readAll());
+    });
+    peer->write(peer->readAll());
+    QByteArray received = readAtLeast(sock, data.size());
+    sock.disconnectFromHost();
+    out->close();
+
+    QCOMPARE(received.size(), data.size());
+    QVERIFY(received == data);
+}
+
+/* SFTP commands retry on EAGAIN: a storm of them must not lose or reorder data */
+void Tester::test4_sftpRoundTripWithEagainStorm()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 1;
+    conditions.eagainEvery = 3;
+    conditions.eagainStorm = 4;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QByteArray data = randomData(512*1024);
+    SshSFtp *sftp = m_ssh->getChannel<SshSFtp>("sftp");
+    QCOMPARE(sftp->mkdir("/upload"), 0);
+    QVERIFY(sftp->sendData(data, "/upload/data.bin"));
+    QVERIFY(m_fake->files().value("/upload/data.bin").data == data);
+    QVERIFY(sftp->isFile("/upload/data.bin"));
+    QCOMPARE(sftp->filesize("/upload/data.bin"), static_cast<quint64>(data.size()));
+    QVERIFY(sftp->readdir("/upload").contains("data.bin"));
+
+    QByteArray got = sftp->getData("/upload/data.bin");
+    QCOMPARE(got.size(), data.size());
+    QVERIFY(got == data);
+    QVERIFY(m_fake->stats().eagain > 0);
+    sftp->close();
+}
+
+void Tester::test5_scpRoundTrip()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 2;
+    conditions.bandwidth = 16*1024*1024;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QByteArray data = randomData(1024*1024);
+    QEventLoop wait;
+    QTimer::singleShot(TestTimeOut, &wait, &QEventLoop::quit);
+    bool failed = false;
+    SshScpSend *send = m_ssh->getChannel<SshScpSend>("scpsend");
+    QObject::connect(send, &SshScpSend::finished, &wait, &QEventLoop::quit);
+    QObject::connect(send, &SshScpSend::failed, &wait, [&]() { failed = true; wait.quit(); });
+    send->sendData(data, "/data.bin");
+    wait.exec();
+    QVERIFY(!failed);
+    QTRY_VERIFY_WITH_TIMEOUT(m_fake->files().value("/data.bin").data.size() == data.size(), TestTimeOut);
+    QVERIFY(m_fake->files().value("/data.bin").data == data);
+
+    QEventLoop waitGet;
+    QTimer::singleShot(TestTimeOut, &waitGet, &QEventLoop::quit);
+    SshScpGet *get = m_ssh->getChannel<SshScpGet>("scpget");
+    QObject::connect(get, &SshScpGet::finished, &waitGet, &QEventLoop::quit);
+    QObject::connect(get, &SshScpGet::failed, &waitGet, [&]() { failed = true; waitGet.quit(); });
+    get->getData("/data.bin");
+    waitGet.exec();
+    QVERIFY(!failed);
+    QVERIFY(get->data() == data);
+}
+
+/* Plain and hashed hosts, revocation, reload on change and pending additions */
+void Tester::test6_knownHostsIndex()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("known_hosts");
+    QByteArray rsa = QByteArray::fromHex("000000077373682d727361") + randomData(64);
+    QByteArray other = QByteArray::fromHex("000000077373682d727361") + randomData(32);
+    QByteArray salt = randomData(20);
+    QByteArray hash = QMessageAuthenticationCode::hash("hashed.example", salt, QCryptographicHash::Sha1);
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("# comment\n");
+    file.write("plain.example,[plain.example]:2222 ssh-rsa " + rsa.toBase64() + " a comment\n");
+    file.write("|1|" + salt.toBase64() + "|" + hash.toBase64() + " ssh-rsa " + rsa.toBase64() + "\n");
+    file.write("@revoked revoked.example ssh-rsa " + rsa.toBase64() + "\n");
+    file.close();
+
+    QSharedPointer<SshKnownHosts> hosts = SshKnownHosts::shared(path);
+    QVERIFY(SshKnownHosts::shared(path) == hosts);
+    QCOMPARE(hosts->count(), 3);
+    QCOMPARE(hosts->check("plain.example", 22, rsa), SshKnownHosts::Match);
+    QCOMPARE(hosts->check("PLAIN.example", 2222, rsa), SshKnownHosts::Match);
+    QCOMPARE(hosts->check("plain.example", 22, other), SshKnownHosts::Mismatch);
+    QCOMPARE(hosts->check("plain.example", 2200, rsa), SshKnownHosts::NotFound);
+    QCOMPARE(hosts->check("hashed.example", 22, rsa), SshKnownHosts::Match);
+    QCOMPARE(hosts->check("hashed.example", 22, other), SshKnownHosts::Mismatch);
+    QCOMPARE(hosts->check("revoked.example", 22, rsa), SshKnownHosts::Mismatch);
+
+    QVERIFY(hosts->add("new.example", 22, other));
+    QCOMPARE(hosts->check("new.example", 22, other), SshKnownHosts::Match);
+
+    /* Changed behind our back: reloaded, the pending addition survives */
+    QTest::qWait(20);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write("late.example ssh-rsa " + other.toBase64() + "\n");
+    file.close();
+    QCOMPARE(hosts->check("late.example", 22, other), SshKnownHosts::Match);
+    QCOMPARE(hosts->check("new.example", 22, other), SshKnownHosts::Match);
+    QCOMPARE(hosts->count(), 5);
+
+    QVERIFY(hosts->save(path));
+    QCOMPARE(hosts->count(), 5);
+    SshKnownHosts reread(path);
+    QCOMPARE(reread.check("new.example", 22, other), SshKnownHosts::Match);
+    QCOMPARE(reread.check("hashed.example", 22, rsa), SshKnownHosts::Match);
+
+    /* Only keys of the offered type are compared: another type is not a change */
+    QByteArray ed25519 = QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32);
+    QByteArray ed25519Other = QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32);
+    QCOMPARE(reread.check("plain.example", 22, ed25519), SshKnownHosts::NotFound);
+    QCOMPARE(reread.check("hashed.example", 22, ed25519), SshKnownHosts::NotFound);
+    QCOMPARE(reread.check("revoked.example", 22, ed25519), SshKnownHosts::NotFound);
+    QVERIFY(reread.add("plain.example", 22, ed25519));
+    QCOMPARE(reread.check("plain.example", 22, ed25519), SshKnownHosts::Match);
+    QCOMPARE(reread.check("plain.example", 22, ed25519Other), SshKnownHosts::Mismatch);
+    QCOMPARE(reread.check("plain.example", 22, rsa), SshKnownHosts::Match);
+    QCOMPARE(reread.check("plain.example", 22, other), SshKnownHosts::Mismatch);
+}
+
+void Tester::test7_hostKeyPolicy()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("known_hosts");
+    QByteArray host = SshKnownHosts::hostName("127.0.0.1", m_fake->listen());
+
+    /* Unknown host */
+    {
+        SshClient strict("Strict");
+        strict.setKownHostFile(path);
+        strict.setHostKeyPolicy(SshClient::Strict);
+        QVERIFY(!connectWith(strict));
+    }
+
+    /* Learned on first use, appended to the file */
+    {
+        SshClient acceptNew("AcceptNew");
+        acceptNew.setKownHostFile(path);
+        QVERIFY(connectWith(acceptNew));
+        QCOMPARE(acceptNew.hostKey().type, SshKey::Rsa);
+        QVERIFY(acceptNew.hostKey().fingerprint().startsWith("SHA256:"));
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVERIFY(file.readAll().startsWith(host + " ssh-rsa "));
+        acceptNew.disconnectFromHost();
+        acceptNew.waitForState(SshClient::SshState::Unconnected);
+    }
+
+    /* Known now, even for the strict policy */
+    {
+        SshClient strict("Strict");
+        strict.setKownHostFile(path);
+        strict.setHostKeyPolicy(SshClient::Strict);
+        QVERIFY(connectWith(strict));
+        strict.disconnectFromHost();
+        strict.waitForState(SshClient::SshState::Unconnected);
+
+        /* Revoked since: the key accepted last time is checked again */
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+        file.write("@revoked " + host + " ssh-rsa " + strict.hostKey().key.toBase64() + "\n");
+        file.close();
+        QVERIFY(!connectWith(strict));
+    }
+
+    /* Changed key: refused unless the callback accepts it */
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(host + " ssh-rsa " + (QByteArray::fromHex("000000077373682d727361") + randomData(64)).toBase64() + "\n");
+    file.close();
+    {
+        SshKnownHosts::Result seen = SshKnownHosts::Match;
+        SshClient callback("Callback");
+        callback.setKownHostFile(path);
+        callback.setHostKeyPolicy(SshClient::Callback, [&seen](const SshKey &, SshKnownHosts::Result known) {
+            seen = known;
+            return false;
+        });
+        QVERIFY(!connectWith(callback));
+        QCOMPARE(seen, SshKnownHosts::Mismatch);
+    }
+    {
+        SshClient acceptNew("AcceptNew");
+        acceptNew.setKownHostFile(path);
+        QVERIFY(!connectWith(acceptNew));
+    }
+
+    /* Known by another key type only (e.g. after a host key algorithm change): new, not changed */
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(host + " ssh-ed25519 " + (QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32)).toBase64() + "\n");
+    file.close();
+    {
+        SshClient strict("Strict");
+        strict.setKownHostFile(path);
+        strict.setHostKeyPolicy(SshClient::Strict);
+        QVERIFY(!connectWith(strict));
+    }
+    {
+        SshClient acceptNew("AcceptNew");
+        acceptNew.setKownHostFile(path);
+        QVERIFY(connectWith(acceptNew));
+        acceptNew.disconnectFromHost();
+        acceptNew.waitForState(SshClient::SshState::Unconnected);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QList<QByteArray> lines = file.readAll().trimmed().split('\n');
+        file.close();
+        QCOMPARE(lines.size(), 2);
+        QVERIFY(lines.at(0).startsWith(host + " ssh-ed25519 "));
+        QVERIFY(lines.at(1).startsWith(host + " ssh-rsa "));
+    }
+}
+
+void Tester::test8_keyStore()
+{
+    SshKeyStore *store = SshKeyStore::instance();
+
+    /* Same content, same identity */
+    SshKeyStore::IdentityPtr first = store->identity("ssh-rsa AAAA", "private");
+    QCOMPARE(store->identity("ssh-rsa AAAA", "private"), first);
+    QVERIFY(store->identity("ssh-rsa AAAA", "other") != first);
+
+    /* Files are read once while unchanged */
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QFile priv(dir.filePath("id_test"));
+    QVERIFY(priv.open(QIODevice::WriteOnly));
+    priv.write("private");
+    priv.close();
+    SshKeyStore::IdentityPtr fromFile = store->identityFromFile(priv.fileName());
+    QVERIFY(!fromFile.isNull());
+    QCOMPARE(fromFile->privateKey, QByteArray("private"));
+    QCOMPARE(store->identityFromFile(priv.fileName()), fromFile);
+
+    /* Authentication through a signer, no private key */
+    int signatures = 0;
+    QByteArray blob = QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32);
+    SshKeyStore::IdentityPtr signer = store->identityWithSigner("ssh-ed25519 " + blob.toBase64() + " token", [&signatures](const QByteArray &data) {
+        signatures++;
+        return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    });
+    QVERIFY(!signer.isNull());
+    QCOMPARE(signer->publicKeyBlob, blob);
+    {
+        SshClient client("Signer");
+        client.setIdentity(signer);
+        QVERIFY(connectWith(client));
+        QCOMPARE(signatures, 1);
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+
+    /* Refused signature: falls back to password */
+    {
+        SshClient client("Refused");
+        client.setIdentity(store->identityWithSigner("ssh-ed25519 " + blob.toBase64(), [](const QByteArray &) {
+            return QByteArray();
+        }));
+        client.setPassphrase("fake");
+        QVERIFY(connectWith(client));
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+}
+
+void Tester::test9_agentIdentities()
+{
+    QByteArray refused = QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32);
+    QByteArray accepted = QByteArray::fromHex("0000000b7373682d65643235353139") + randomData(32);
+    QVERIFY(refused != accepted);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    SshFakeAgent agent({refused, accepted});
+    QVERIFY(agent.listen(dir.filePath("agent.sock")));
+    SshAgent::instance()->setSocketPath(agent.path());
+    m_fake->setAuthorizedKeys({accepted});
+
+    /* First connection: both identities tried, in the agent order */
+    {
+        SshClient client("Agent");
+        client.setUseAgent(true);
+        QVERIFY(connectWith(client));
+        QCOMPARE(m_fake->stats().publickeyAttempts, 2);
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+
+    /* Next ones: the identity that worked first, same agent connection and list */
+    m_fake->resetStats();
+    for(int i = 0; i < 3; i++)
+    {
+        SshClient client("Agent");
+        client.setUseAgent(true);
+        QVERIFY(connectWith(client));
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+    QCOMPARE(m_fake->stats().publickeyAttempts, 3);
+    QCOMPARE(agent.connections(), 1);
+    QCOMPARE(agent.identityRequests(), 1);
+    QCOMPARE(agent.signRequests(), 5);
+
+    SshAgent::instance()->setSocketPath(QString());
+}
+
+/* RSA signed as the algorithm libssh2 chose; a stalled agent only costs the timeout */
+void Tester::test10_agentSignatures()
+{
+    QByteArray rsa = QByteArray::fromHex("000000077373682d727361") + randomData(64);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    SshFakeAgent agent({rsa});
+    QVERIFY(agent.listen(dir.filePath("agent.sock")));
+    SshAgent::instance()->setSocketPath(agent.path());
+    SshAgent::instance()->setTimeout(200);
+
+    {
+        SshClient client("Agent");
+        client.setUseAgent(true);
+        QVERIFY(connectWith(client));
+        QCOMPARE(agent.lastSignFlags(), 0x04); /* SSH_AGENT_RSA_SHA2_512 */
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+
+    agent.setStalled(true);
+    m_fake->resetStats();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        SshClient client("Stalled");
+        client.setUseAgent(true);
+        client.setPassphrase("fake");
+        QVERIFY(connectWith(client));
+        QCOMPARE(m_fake->stats().publickeyAttempts, 1);
+        client.disconnectFromHost();
+        client.waitForState(SshClient::SshState::Unconnected);
+    }
+    QVERIFY(timer.elapsed() < 5000);
+
+    SshAgent::instance()->setTimeout(0);
+    SshAgent::instance()->setSocketPath(QString());
+}
+
+/* A warm channel the target closed meanwhile is not handed to a client */
+void Tester::test11_staleWarmChannel()
+{
+    QList<QPointer<SshFakeChannel>> opened;
+    m_fake->setDirectTcpipHandler([&opened](SshFakeChannel *channel) {
+        opened.append(channel);
+        QObject::connect(channel, &SshFakeChannel::dataReceived, channel, [channel]() {
+            channel->write(channel->readAll());
+        });
+        return true;
+    });
+    QVERIFY2(connectClient(SshFakeTransport::Conditions()), "Can't connect to the fake transport");
+
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>("TunnelOut");
+    out->setWarmChannels(1, 0);
+    out->listen(22);
+    QTRY_COMPARE_WITH_TIMEOUT(opened.size(), 1, TestTimeOut);
+    QTest::qWait(50);
+    opened.first()->close();
+    QTest::qWait(50);
+
+    QTcpSocket sock;
+    sock.connectToHost("127.0.0.1", out->localPort());
+    QVERIFY(sock.waitForConnected(TestTimeOut));
+    sock.write("ping");
+    QCOMPARE(readAtLeast(sock, 4), QByteArray("ping"));
+    QVERIFY(opened.size() >= 2);
+    sock.disconnectFromHost();
+    out->close();
+}
+
+/*
+ * Deficit round-robin, driven by hand: no SSH involved. A connector asks
+ * for its allowance before each write and waits for sendEvent when it gets 0.
+ */
+void Tester::test12_tunnelScheduler()
+{
+    const qint64 chunk = 4*1024;
+    const qint64 unlimited = std::numeric_limits<qint64>::max();
+    SshTunnelScheduler scheduler;
+    const qint64 quantum = scheduler.quantum();
+    SshTunnelDataConnector bulk("bulk");
+    SshTunnelDataConnector interactive("interactive");
+    scheduler.add(&bulk);
+    scheduler.add(&interactive);
+
+    QHash<SshTunnelDataConnector*, bool> waiting;
+    QHash<SshTunnelDataConnector*, qint64> sent;
+    for(SshTunnelDataConnector *connector: {&bulk, &interactive})
+    {
+        QObject::connect(connector, &SshTunnelDataConnector::sendEvent, [&waiting, connector]() {
+            waiting[connector] = false;
+        });
+    }
+    /* One write attempt of up to len bytes, false when the connector has to wait */
+    auto write = [&](SshTunnelDataConnector *connector, qint64 len) {
+        if(waiting.value(connector))
+        {
+            return false;
+        }
+        qint64 allowed = scheduler.allowance(connector);
+        if(allowed == 0)
+        {
+            waiting[connector] = true;
+            return false;
+        }
+        qint64 n = qMin(allowed, len);
+        scheduler.consumed(connector, n);
+        sent[connector] += n;
+        return true;
+    };
+
+    /* Alone, the bulk transfer is not limited */
+    QCOMPARE(scheduler.allowance(&bulk), unlimited);
+    for(int i = 0; i < 100; i++)
+    {
+        QVERIFY(write(&bulk, chunk));
+    }
+
+    /* An interactive message between bulk writes goes at once, then leaves the round */
+    for(int message = 0; message < 100; message++)
+    {
+        for(int i = 0; i < 10; i++)
+        {
+            write(&bulk, chunk);
+        }
+        QVERIFY(write(&interactive, 1000));
+        scheduler.idle(&interactive);
+    }
+
+    /* Both busy: the bulk one, taking all it is allowed, is at most one quantum ahead */
+    qint64 ahead = 0;
+    int served = 0;
+    for(int message = 0; message < 200; message++)
+    {
+        served += (write(&interactive, 1000))?(1):(0);
+        qint64 before = sent.value(&bulk);
+        write(&bulk, std::numeric_limits<int>::max());
+        ahead = qMax(ahead, sent.value(&bulk) - before);
+    }
+    qCInfo(testsshfake) << "Bulk bytes between two interactive writes:" << ahead;
+    QCOMPARE(served, 200);
+    QVERIFY(ahead > 0 && ahead <= quantum);
+
+    /* Priorities set the share */
+    for(int priority: {1, 3})
+    {
+        scheduler.setPriority(&interactive, priority);
+        sent.clear();
+        for(int i = 0; i < 4000; i++)
+        {
+            write(&bulk, chunk);
+            write(&interactive, chunk);
+        }
+        double share = static_cast<double>(sent.value(&interactive)) / static_cast<double>(sent.value(&bulk));
+        qCInfo(testsshfake) << "Share with priority" << priority << ":" << share;
+        QVERIFY(share > priority * 0.9 && share < priority * 1.1);
+    }
+    scheduler.setPriority(&interactive, 1);
+
+    /* Leaving the round (idle or EAGAIN) wakes the waiting one and lifts the limit */
+    scheduler.idle(&bulk);
+    scheduler.idle(&interactive);
+    waiting.clear();
+    sent.clear();
+    QVERIFY(write(&interactive, 1));
+    while(write(&bulk, chunk))
+    {
+        QVERIFY(sent.value(&bulk) < 100 * quantum);
+    }
+    QVERIFY(waiting.value(&bulk));
+    scheduler.idle(&interactive);
+    QVERIFY(!waiting.value(&bulk));
+    QCOMPARE(scheduler.allowance(&bulk), unlimited);
+
+    /* A removed connector does not hold the round either */
+    QVERIFY(write(&interactive, 1));
+    while(write(&bulk, chunk))
+    {
+        QVERIFY(sent.value(&bulk) < 200 * quantum);
+    }
+    QVERIFY(waiting.value(&bulk));
+    scheduler.remove(&interactive);
+    QVERIFY(!waiting.value(&bulk));
+    QCOMPARE(scheduler.allowance(&bulk), unlimited);
+}
+
+/*
+ * Limits on a connection, a tunnel and the session hold data back: an echo
+ * (counted both ways) takes at least the time the rate allows past the
+ * initial burst, and comes back byte-exact.
+ */
+void Tester::test13_rateLimit()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 1;
+    conditions.bandwidth = 16*1024*1024;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    const qint64 rate = 256*1024;
+    QByteArray data = randomData(256*1024);
+    /* A quarter of a second of burst is allowed before the limit applies */
+    const qint64 minimum = (2 * data.size() - rate / 4) * 1000 / rate;
+
+    SshTunnelOut *out = m_ssh->getChannel<SshTunnelOut>("Limited");
+    out->listen(22);
+    qint64 unlimited = timedEcho(out, data);
+    QVERIFY(unlimited >= 0);
+
+    qint64 connection = timedEcho(out, data, rate);
+    out->setRateLimit(rate);
+    qint64 tunnel = timedEcho(out, data);
+    out->setRateLimit(0);
+    m_ssh->setRateLimit(rate);
+    qint64 session = timedEcho(out, data);
+    m_ssh->setRateLimit(0);
+    qCInfo(testsshfake) << "Echo time (ms) unlimited:" << unlimited << "connection:" << connection
+                        << "tunnel:" << tunnel << "session:" << session << "minimum:" << minimum;
+
+    for(qint64 elapsed: {connection, tunnel, session})
+    {
+        QVERIFY2(elapsed >= 0, "Data lost or corrupted");
+        QVERIFY(elapsed >= minimum * 9 / 10);
+        QVERIFY(elapsed < minimum * 3);
+    }
+    QVERIFY(unlimited < minimum);
+    out->close();
+}
+
+/* A tunnel waiting for its rate leaves the scheduler round: an unlimited one is not slowed */
+void Tester::test14_rateLimitedNeighbour()
+{
+    SshFakeTransport::Conditions conditions;
+    conditions.latency = 1;
+    conditions.bandwidth = 16*1024*1024;
+    QVERIFY2(connectClient(conditions), "Can't connect to the fake transport");
+
+    QByteArray data = randomData(2*1024*1024);
+    SshTunnelOut *fast = m_ssh->getChannel<SshTunnelOut>("Free");
+    fast->listen(22);
+    qint64 alone = timedEcho(fast, data);
+    QVERIFY(alone >= 0);
+
+    SshTunnelOut *limited = m_ssh->getChannel<SshTunnelOut>("Limited");
+    limited->setRateLimit(64*1024);
+    limited->listen(22);
+    QTcpSocket sock;
+    sock.connectToHost("127.0.0.1", limited->localPort());
+    QVERIFY(sock.waitForConnected(TestTimeOut));
+    sock.write(randomData(1024*1024));
+    /* Past its burst: the limited tunnel now waits for its rate */
+    QVERIFY(readAtLeast(sock, 32*1024).size() >= 32*1024);
+
+    qint64 shared = timedEcho(fast, data);
+    qCInfo(testsshfake) << "Unlimited echo (ms) alone:" << alone << "next to a limited tunnel:" << shared;
+    QVERIFY2(shared >= 0, "Data lost or corrupted");
+    QVERIFY(shared < alone * 4 + 1000);
+
+    sock.disconnectFromHost();
+    limited->close();
+    fast->close();
+}
@@ -0,0 +1,55 @@
+#ifndef TESTER_H
+#define TESTER_H
+
+#include <QObject>
+#include <QLoggingCategory>
+#include <QTcpSocket>
+#include <sshclient.h>
+#include <sshtunnelout.h>
+#include <sshfaketransport.h>
+#include <sshfakeagent.h>
+
+Q_DECLARE_LOGGING_CATEGORY(testsshfake)
+
+/*
+ * The library against SshFakeTransport: no sshd, reproducible network
+ * conditions. Each test gets a fresh transport and SshClient.
+ */
+class Tester : public QObject
+{
+    Q_OBJECT
+
+    SshFakeTransport *m_fake {nullptr};
+    SshClient *m_ssh {nullptr};
+
+public:
+    explicit Tester(QObject *parent = nullptr);
+
+private:
+    bool connectClient(const SshFakeTransport::Conditions &conditions);
+    SshTunnelOut *openTunnel(QTcpSocket &sock);
+    QByteArray readAtLeast(QTcpSocket &sock, int size);
+    static QByteArray randomData(int size);
+    bool connectWith(SshClient &client);
+    qint64 timedEcho(SshTunnelOut *out, const QByteArray &data, qint64 connectionRate = 0);
+
+private slots:
+    void init();
+    void cleanup();
+    void test1_processWithLatency();
+    void test2_tunnelOutIntegrity();
+    void test3_tunnelOutWindowBackpressure();
+    void test4_sftpRoundTripWithEagainStorm();
+    void test5_scpRoundTrip();
+    void test6_knownHostsIndex();
+    void test7_hostKeyPolicy();
+    void test8_keyStore();
+    void test9_agentIdentities();
+    void test10_agentSignatures();
+    void test11_staleWarmChannel();
+    void test12_tunnelScheduler();
+    void test13_rateLimit();
+    void test14_rateLimitedNeighbour();
+};
+
+#endif // TESTER_H
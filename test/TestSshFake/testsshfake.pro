@@ -0,0 +1,16 @@
+QT -= gui
+
+QT += testlib
+
+CONFIG += c++1z console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += main.cpp tester.cpp
+HEADERS += tester.h
+
+include(../../QtSsh.pri)
+include(../SshFake/sshfake.pri)
+
+LIBS += -lssh2